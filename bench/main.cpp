@@ -0,0 +1,413 @@
+#include <stdint.h>  // for uint64_t, uint32_t, int64_t, uint8_t
+#include <stdio.h>   // for printf, snprintf
+#include <stdlib.h>  // for atof
+#include <atomic>    // for atomic, memory_order_relaxed
+#include <chrono>    // for steady_clock, duration_cast, nanoseconds
+#include <fstream>   // for ifstream, istreambuf_iterator
+#include <memory>    // for shared_ptr, unique_ptr
+#include <sstream>   // for istringstream
+#include <string>    // for string
+#include <vector>    // for vector
+
+#include "AudioCodecs.h"      // for AudioCodecs
+#include "AudioContainer.h"   // for AudioContainer
+#include "AudioContainers.h"  // for guessAudioContainer
+#include "BaseCodec.h"        // for BaseCodec
+#include "BellLogger.h"       // for AbstractLogger, bellGlobalLogger
+#include "CodecType.h"        // for AudioCodec
+
+#if defined(__SANITIZE_ADDRESS__)
+#define BENCH_SANITIZED 1
+#elif defined(__has_feature)
+#if __has_feature(address_sanitizer)
+#define BENCH_SANITIZED 1
+#endif
+#endif
+
+// sanitizers replace malloc themselves
+#if defined(__GLIBC__) && !defined(BENCH_SANITIZED)
+#define BENCH_HEAP_STATS 1
+#include <malloc.h>  // for malloc_usable_size
+#else
+#define BENCH_HEAP_STATS 0
+#endif
+
+/**
+ * Decoding throughput of every enabled codec, over the fixtures in bench/fixtures (or the
+ * directory given as the first argument). Each fixture is decoded from its demuxed packets
+ * straight through BaseCodec::decode(), which measures the codec alone, and from the file
+ * through its container, as playback does. Elementary streams are also decoded with
+ * random bytes spliced in, which measures resynchronization.
+ *
+ * The fixtures are 5 s of the same synthetic stereo signal, except for he_aac.aac (HE-AAC
+ * v2, 22.05 kHz mono with SBR and parametric stereo): AAC-LC at 128 kbps as ADTS and in an
+ * M4A file, MP3 at a constant 160 kbps and in VBR, Vorbis, Opus at 48 kHz, FLAC, and ALAC in
+ * an M4A file.
+ *
+ * Reported per fixture and path:
+ * - x-realtime: seconds of audio decoded per second
+ * - ns/frame: time per decoded packet
+ * - allocs/frame: heap allocations per decoded packet, setup excluded
+ * - peak heap: largest heap use of a decode with a newly created decoder, above the use
+ *   before it; the decoder instance, container and their buffers included
+ *
+ * Heap use is counted by wrapping malloc, which only works with glibc and without
+ * AddressSanitizer; elsewhere these columns are left empty.
+ */
+
+using namespace bell;
+
+// minimum time spent measuring each fixture and path, unless given as the second argument
+#define BENCH_MIN_SECONDS 1.0
+#define BENCH_MIN_RUNS 3
+// bound on decode calls per run, in case a decoder stops consuming its input
+#define BENCH_MAX_PACKETS 1000000
+// failed decodes tolerated at the end of the input, for the containers' buffered bytes
+#define BENCH_MAX_TRAILING_FAILURES 64
+// random bytes spliced in after every block of the noisy variants
+#define BENCH_NOISE_BLOCK (16 * 1024)
+#define BENCH_NOISE_SIZE (2 * 1024)
+
+namespace {
+std::atomic<uint64_t> allocations{0};
+std::atomic<int64_t> heapUsed{0};
+std::atomic<int64_t> heapPeak{0};
+
+void countAlloc(void* ptr, size_t size) {
+  if (ptr == nullptr)
+    return;
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  int64_t used =
+      heapUsed.fetch_add(size, std::memory_order_relaxed) + (int64_t)size;
+  int64_t peak = heapPeak.load(std::memory_order_relaxed);
+  while (used > peak && !heapPeak.compare_exchange_weak(
+                            peak, used, std::memory_order_relaxed)) {
+  }
+}
+
+void countFree(size_t size) {
+  heapUsed.fetch_sub(size, std::memory_order_relaxed);
+}
+}  // namespace
+
+#if BENCH_HEAP_STATS
+// the codec libraries allocate with malloc rather than new, so glibc's allocator
+// is wrapped as a whole
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void __libc_free(void* ptr);
+
+void* malloc(size_t size) {
+  void* ptr = __libc_malloc(size);
+  countAlloc(ptr, ptr ? malloc_usable_size(ptr) : 0);
+  return ptr;
+}
+
+void* calloc(size_t count, size_t size) {
+  void* ptr = __libc_calloc(count, size);
+  countAlloc(ptr, ptr ? malloc_usable_size(ptr) : 0);
+  return ptr;
+}
+
+void* realloc(void* ptr, size_t size) {
+  size_t oldSize = ptr ? malloc_usable_size(ptr) : 0;
+  void* newPtr = __libc_realloc(ptr, size);
+  // on failure, the old block is kept
+  if (newPtr != nullptr || size == 0) {
+    countFree(oldSize);
+    countAlloc(newPtr, newPtr ? malloc_usable_size(newPtr) : 0);
+  }
+  return newPtr;
+}
+
+void free(void* ptr) {
+  if (ptr != nullptr)
+    countFree(malloc_usable_size(ptr));
+  __libc_free(ptr);
+}
+}
+#endif
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+struct Fixture {
+  const char* name;
+  const char* file;
+  AudioCodec codec;
+  // also decoded with random bytes spliced in
+  bool noisy;
+};
+
+const Fixture fixtures[] = {
+    {"AAC-LC", "aac_lc.aac", AudioCodec::AAC, true},
+    {"AAC M4A", "aac_lc.m4a", AudioCodec::AAC, false},
+    {"HE-AAC", "he_aac.aac", AudioCodec::AAC, true},
+    {"MP3 CBR", "mp3_cbr.mp3", AudioCodec::MP3, true},
+    {"MP3 VBR", "mp3_vbr.mp3", AudioCodec::MP3, false},
+    {"Vorbis", "vorbis.ogg", AudioCodec::VORBIS, false},
+    {"Opus", "opus.opus", AudioCodec::OPUS, false},
+    {"FLAC", "flac.flac", AudioCodec::FLAC, true},
+    {"ALAC", "alac.m4a", AudioCodec::ALAC, false},
+};
+
+struct Result {
+  uint64_t runs = 0;
+  uint64_t frames = 0;
+  // per channel
+  uint64_t samples = 0;
+  uint32_t sampleRate = 0;
+  uint64_t nanoseconds = 0;
+  uint64_t allocations = 0;
+  int64_t peakHeap = 0;
+
+  void add(const Result& run) {
+    runs++;
+    frames += run.frames;
+    samples += run.samples;
+    sampleRate = run.sampleRate;
+    nanoseconds += run.nanoseconds;
+    allocations += run.allocations;
+  }
+};
+
+// a stream demuxed into the packets consumed by each decode() call
+struct Packets {
+  std::unique_ptr<std::istringstream> stream;
+  // kept for setting decoders up
+  std::unique_ptr<AudioContainer> container;
+  std::vector<uint8_t> data;
+  // offset in data, and size
+  std::vector<std::pair<size_t, uint32_t>> packets;
+};
+
+void startHeapStats() {
+  heapPeak.store(heapUsed.load());
+}
+
+// free the idle decoders of a type, for the next one to be created anew
+void flushPool(AudioCodec type) {
+  AudioCodecs::setPoolSize(type, 0);
+  AudioCodecs::setPoolSize(type, BELL_CODEC_POOL_SIZE);
+}
+
+void countOutput(BaseCodec* codec, uint32_t outLen, Result& result) {
+  result.frames++;
+  result.samples += outLen / (codec->channelCount * (codec->bitDepth / 8));
+  result.sampleRate = codec->sampleRate;
+}
+
+bool decodeContainer(const std::string& data, Result& result) {
+  std::istringstream stream(data);
+  int64_t heapStart = heapUsed.load();
+  startHeapStats();
+  auto start = Clock::now();
+
+  auto container = AudioContainers::guessAudioContainer(stream);
+  if (container == nullptr)
+    return false;
+  auto codec = AudioCodecs::getCodec(container.get());
+  if (codec == nullptr)
+    return false;
+
+  uint64_t allocationsStart = allocations.load();
+  int failures = 0;
+  for (int i = 0; i < BENCH_MAX_PACKETS; i++) {
+    uint32_t outLen;
+    uint8_t* pcm = codec->decode(container.get(), outLen);
+    if (pcm == nullptr) {
+      if (stream.eof() && ++failures > BENCH_MAX_TRAILING_FAILURES)
+        break;
+      continue;
+    }
+    failures = 0;
+    countOutput(codec.get(), outLen, result);
+  }
+
+  result.allocations = allocations.load() - allocationsStart;
+  result.nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           Clock::now() - start)
+                           .count();
+  result.peakHeap = heapPeak.load() - heapStart;
+  return true;
+}
+
+bool demux(const std::string& data, Packets& packets) {
+  packets.stream = std::make_unique<std::istringstream>(data);
+  packets.container = AudioContainers::guessAudioContainer(*packets.stream);
+  if (packets.container == nullptr)
+    return false;
+  auto codec = AudioCodecs::getCodec(packets.container.get());
+  if (codec == nullptr)
+    return false;
+
+  // packet boundaries of elementary streams are only known to the decoder
+  int failures = 0;
+  for (int i = 0; i < BENCH_MAX_PACKETS; i++) {
+    uint32_t len;
+    auto* sample = (uint8_t*)packets.container->readSample(len);
+    if (sample == nullptr || len == 0) {
+      if (packets.stream->eof() && ++failures > BENCH_MAX_TRAILING_FAILURES)
+        break;
+      continue;
+    }
+    failures = 0;
+    uint32_t inLen = len, outLen;
+    codec->decode(sample, inLen, outLen);
+    uint32_t consumed = len - inLen;
+    uint32_t size = consumed ? consumed : len;
+    packets.packets.emplace_back(packets.data.size(), size);
+    packets.data.insert(packets.data.end(), sample, sample + size);
+    packets.container->consumeBytes(consumed);
+  }
+  return !packets.packets.empty();
+}
+
+bool decodePackets(Packets& packets, AudioCodec type, Result& result) {
+  int64_t heapStart = heapUsed.load();
+  startHeapStats();
+  auto start = Clock::now();
+
+  auto codec = AudioCodecs::getCodec(type);
+  if (codec == nullptr || !codec->setup(packets.container.get()))
+    return false;
+
+  uint64_t allocationsStart = allocations.load();
+  for (auto& [offset, size] : packets.packets) {
+    uint32_t inLen = size, outLen;
+    if (codec->decode(packets.data.data() + offset, inLen, outLen) != nullptr)
+      countOutput(codec.get(), outLen, result);
+  }
+
+  result.allocations = allocations.load() - allocationsStart;
+  result.nanoseconds = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                           Clock::now() - start)
+                           .count();
+  result.peakHeap = heapPeak.load() - heapStart;
+  return true;
+}
+
+std::string addNoise(const std::string& data) {
+  std::string noisy;
+  noisy.reserve(data.size() +
+                data.size() / BENCH_NOISE_BLOCK * BENCH_NOISE_SIZE);
+  // xorshift, for the same noise on every run
+  uint32_t state = 0x9e3779b9;
+  for (size_t offset = 0; offset < data.size(); offset += BENCH_NOISE_BLOCK) {
+    noisy.append(data, offset, BENCH_NOISE_BLOCK);
+    if (offset + BENCH_NOISE_BLOCK >= data.size())
+      break;
+    for (int i = 0; i < BENCH_NOISE_SIZE; i++) {
+      state ^= state << 13;
+      state ^= state >> 17;
+      state ^= state << 5;
+      noisy.push_back((char)(state >> 24));
+    }
+  }
+  return noisy;
+}
+
+void printResult(const char* name, const char* path, const Result& result) {
+  if (result.runs == 0 || result.frames == 0 || result.sampleRate == 0) {
+    printf("%-10s %-10s %12s\n", name, path, "failed");
+    return;
+  }
+  double seconds = result.nanoseconds / 1e9;
+  double audioSeconds = (double)result.samples / result.sampleRate;
+  char heap[32] = "";
+  char allocs[32] = "";
+  if (BENCH_HEAP_STATS) {
+    snprintf(heap, sizeof(heap), "%.1f KiB", result.peakHeap / 1024.0);
+    snprintf(allocs, sizeof(allocs), "%.2f",
+             (double)result.allocations / result.frames);
+  }
+  printf("%-10s %-10s %11.1fx %10.0f %13s %12s\n", name, path,
+         audioSeconds / seconds, (double)result.nanoseconds / result.frames,
+         allocs, heap);
+}
+
+template <typename Run>
+Result measure(AudioCodec type, double minSeconds, Run run) {
+  Result result, cold;
+  // decoder created in the first run only, which gives the peak heap use
+  flushPool(type);
+  if (!run(cold))
+    return result;
+  result.peakHeap = cold.peakHeap;
+
+  auto start = Clock::now();
+  while (result.runs < BENCH_MIN_RUNS ||
+         std::chrono::duration<double>(Clock::now() - start).count() <
+             minSeconds) {
+    Result warm;
+    if (!run(warm))
+      return Result();
+    result.add(warm);
+  }
+  return result;
+}
+
+// drops the log lines, which would be timed with the decoding
+class SilentLogger : public AbstractLogger {
+ public:
+  void debug(std::string filename, int line, std::string submodule,
+             const char* format, ...) override {}
+  void error(std::string filename, int line, std::string submodule,
+             const char* format, ...) override {}
+  void info(std::string filename, int line, std::string submodule,
+            const char* format, ...) override {}
+};
+
+bool readFile(const std::string& path, std::string& data) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+    return false;
+  data.assign(std::istreambuf_iterator<char>(file),
+              std::istreambuf_iterator<char>());
+  return true;
+}
+}  // namespace
+
+int main(int argc, char** argv) {
+  bell::bellGlobalLogger = new SilentLogger();
+  std::string directory = argc > 1 ? argv[1] : BELL_BENCH_FIXTURES;
+  double minSeconds = argc > 2 ? atof(argv[2]) : BENCH_MIN_SECONDS;
+
+  printf("%-10s %-10s %12s %10s %13s %12s\n", "fixture", "path", "x-realtime",
+         "ns/frame", "allocs/frame", "peak heap");
+  for (const auto& fixture : fixtures) {
+    if (AudioCodecs::getCodec(fixture.codec) == nullptr) {
+      printf("%-10s %-10s %12s\n", fixture.name, "-", "disabled");
+      continue;
+    }
+    std::string data;
+    if (!readFile(directory + "/" + fixture.file, data)) {
+      printf("%-10s %-10s %12s\n", fixture.name, "-", "missing");
+      continue;
+    }
+
+    Packets packets;
+    if (demux(data, packets)) {
+      printResult(fixture.name, "packets",
+                  measure(fixture.codec, minSeconds, [&](Result& result) {
+                    return decodePackets(packets, fixture.codec, result);
+                  }));
+    } else {
+      printf("%-10s %-10s %12s\n", fixture.name, "packets", "failed");
+    }
+    printResult(fixture.name, "container",
+                measure(fixture.codec, minSeconds, [&](Result& result) {
+                  return decodeContainer(data, result);
+                }));
+    if (fixture.noisy) {
+      std::string noisy = addNoise(data);
+      printResult(fixture.name, "noisy",
+                  measure(fixture.codec, minSeconds, [&](Result& result) {
+                    return decodeContainer(noisy, result);
+                  }));
+    }
+  }
+  return 0;
+}
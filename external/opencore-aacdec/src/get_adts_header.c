@@ -487,6 +487,18 @@ Int get_adts_header(
         } /* if (status == SUCCESS) */
 
 
+        /*
+         *  ADTS carries no AudioSpecificConfig, so default to regular AAC
+         *  as get_audio_specific_config does, otherwise the filterbank
+         *  output never reaches pOutputBuffer
+         */
+        if (*(pInvoke) == 0)
+        {
+            pVars->mc_info.upsamplingFactor = 1;
+            pVars->mc_info.ExtendedAudioObjectType =
+                (tMP4AudioObjectType)(pVars->prog_config.profile + 1);
+        }
+
 #ifdef AAC_PLUS
 
         /*
@@ -499,8 +511,18 @@ Int get_adts_header(
             pVars->mc_info.upsamplingFactor = 2;
             pVars->prog_config.sampling_rate_idx -= 3;
             pVars->mc_info.sbrPresentFlag = 1;
-            pVars->sbrDecoderData.SbrChannel[0].syncState = SBR_ACTIVE;
-            pVars->sbrDecoderData.SbrChannel[1].syncState = SBR_ACTIVE;
+
+            /*
+             *  Only upsample until an SBR header has set up the frequency
+             *  tables, as get_audio_specific_config does. Forcing SBR_ACTIVE
+             *  ran the SBR tool on empty tables when the first frames carry
+             *  no header
+             */
+            if (*(pInvoke) == 0)
+            {
+                pVars->sbrDecoderData.SbrChannel[0].syncState = SBR_NOT_INITIALIZED;
+                pVars->sbrDecoderData.SbrChannel[1].syncState = SBR_NOT_INITIALIZED;
+            }
         }
 #endif
 
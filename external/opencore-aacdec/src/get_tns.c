@@ -400,6 +400,12 @@ void get_tns(
                 top -= get9_n_lessbits(num_start_band_bits,
                                        pInputStream);
 
+                /* a corrupt filter length must not start below band 0 */
+                if (top < 0)
+                {
+                    top = 0;
+                }
+
                 tempInt = MINIMUM(top, tns_bands);
 
                 pFilt->start_coef = SCALE_FACTOR_BAND_OFFSET(tempInt);
@@ -137,12 +137,6 @@ Int32 ps_allocate_decoder(SBRDECODER_DATA *self,
     Int32 status;
 
     Int32 *ptr1;
-    Int32 *ptr2;
-    Int32 *ptr3;
-    Int32 *ptr4;
-    Int32 *ptr5;
-    Int32 *ptr6;
-    Int32 *ptr7;
 
     const Int32 pHybridResolution[] = { HYBRID_8_CPLX,
                                         HYBRID_2_REAL,
@@ -158,29 +152,15 @@ Int32 ps_allocate_decoder(SBRDECODER_DATA *self,
 
     /*
      *  Reuse AAC+ HQ right channel, which is not used when PS is enabled
+     *
+     *  The buffers are carved one after the other. Pointer tables take
+     *  sizeof(Int32 *) words each, which fixed offsets did not leave room
+     *  for on 64-bit hosts. The whole allocation needs about 1630 words
+     *  (1830 on 64-bit hosts) and stays clear of V[], which holds the
+     *  right channel qmf filter history.
      */
     ptr1 = (Int32 *)(self->SbrChannel[1].frameData.codecQmfBufferReal[0]);   /*  reuse un-used right channel QMF_FILTER Synthesis buffer */
 
-    ptr2 = (&ptr1[658]);  /*  reuse un-used right channel QMF_FILTER Synthesis buffer */
-    /* 1162 - 658 = 504
-     *            = NO_QMF_ALLPASS_CHANNELS*2 (Re&Im)*( 3 + 4 + 5) + ( 3 + 4 + 5)*2 (Re&Im)
-     */
-
-    ptr3 = (&ptr1[1162]);  /*  reuse un-used right channel QMF_FILTER Synthesis buffer */
-    /* 1426 - 1162 = 264
-     *            = SUBQMF_GROUPS*2 (Re&Im)*( 3 + 4 + 5) + ( 3 + 4 + 5)*2 (Re&Im)
-     */
-
-    ptr4 = (&ptr1[1426]);  /*  high freq generation buffers */
-
-    ptr5 = (&ptr1[1490]);  /*  high freq generation buffers */
-
-    ptr6 = (&ptr1[1618]);  /*  high freq generation buffers */
-
-    ptr7 = (&ptr1[1810]);  /*  high freq generation buffers */
-
-    /*  whole allocation requires 1871 words, sbrQmfBufferImag has 1920 words */
-
 
     h_ps_dec->aPeakDecayFast =  ptr1;
     ptr1 += NO_BINS;
@@ -227,11 +207,11 @@ Int32 ps_allocate_decoder(SBRDECODER_DATA *self,
     }
 
 
-    h_ps_dec->aaRealDelayBufferQmf = (Int32 **)ptr6;
-    ptr6 += NO_QMF_ICC_CHANNELS * sizeof(Int32 *) / sizeof(Int32);
+    h_ps_dec->aaRealDelayBufferQmf = (Int32 **)ptr1;
+    ptr1 += NO_QMF_ICC_CHANNELS * sizeof(Int32 *) / sizeof(Int32);
 
-    h_ps_dec->aaImagDelayBufferQmf = (Int32 **)ptr7;
-    ptr7 += NO_QMF_ICC_CHANNELS * sizeof(Int32 *) / sizeof(Int32);
+    h_ps_dec->aaImagDelayBufferQmf = (Int32 **)ptr1;
+    ptr1 += NO_QMF_ICC_CHANNELS * sizeof(Int32 *) / sizeof(Int32);
 
     h_ps_dec->aaRealDelayBufferSubQmf = (Int32 **)ptr1;
     ptr1 += SUBQMF_GROUPS * sizeof(Int32 *) / sizeof(Int32);
@@ -246,30 +226,21 @@ Int32 ps_allocate_decoder(SBRDECODER_DATA *self,
         if (i < NO_QMF_ALLPASS_CHANNELS)    /* 20 */
         {
             delay = 2;
-            h_ps_dec->aaRealDelayBufferQmf[i] = (Int32 *)ptr4;
-            ptr4 += delay;
-
-            h_ps_dec->aaImagDelayBufferQmf[i] = (Int32 *)ptr5;
-            ptr5 += delay;
+        }
+        else if (i >= (NO_QMF_ALLPASS_CHANNELS + SHORT_DELAY_START))
+        {
+            delay = SHORT_DELAY;
         }
         else
         {
+            delay = LONG_DELAY;
+        }
 
-            if (i >= (NO_QMF_ALLPASS_CHANNELS + SHORT_DELAY_START))
-            {
-                delay = SHORT_DELAY;
-            }
-            else
-            {
-                delay = LONG_DELAY;
-            }
-
-            h_ps_dec->aaRealDelayBufferQmf[i] = (Int32 *)ptr1;
-            ptr1 += delay;
+        h_ps_dec->aaRealDelayBufferQmf[i] = (Int32 *)ptr1;
+        ptr1 += delay;
 
-            h_ps_dec->aaImagDelayBufferQmf[i] = (Int32 *)ptr1;
-            ptr1 += delay;
-        }
+        h_ps_dec->aaImagDelayBufferQmf[i] = (Int32 *)ptr1;
+        ptr1 += delay;
     }
 
     for (i = 0; i < SUBQMF_GROUPS; i++)
@@ -287,31 +258,31 @@ Int32 ps_allocate_decoder(SBRDECODER_DATA *self,
 
         h_ps_dec->aDelayRBufIndexSer[i] = 0;
 
-        h_ps_dec->aaaRealDelayRBufferSerQmf[i] = (Int32 **)ptr2;
-        ptr2 += aRevLinkDelaySer[i];
+        h_ps_dec->aaaRealDelayRBufferSerQmf[i] = (Int32 **)ptr1;
+        ptr1 += aRevLinkDelaySer[i] * sizeof(Int32 *) / sizeof(Int32);
 
-        h_ps_dec->aaaImagDelayRBufferSerQmf[i] = (Int32 **)ptr2;
-        ptr2 += aRevLinkDelaySer[i];
+        h_ps_dec->aaaImagDelayRBufferSerQmf[i] = (Int32 **)ptr1;
+        ptr1 += aRevLinkDelaySer[i] * sizeof(Int32 *) / sizeof(Int32);
 
-        h_ps_dec->aaaRealDelayRBufferSerSubQmf[i] = (Int32 **)ptr3;
-        ptr3 += aRevLinkDelaySer[i];
+        h_ps_dec->aaaRealDelayRBufferSerSubQmf[i] = (Int32 **)ptr1;
+        ptr1 += aRevLinkDelaySer[i] * sizeof(Int32 *) / sizeof(Int32);
 
-        h_ps_dec->aaaImagDelayRBufferSerSubQmf[i] = (Int32 **)ptr3;
-        ptr3 += aRevLinkDelaySer[i];
+        h_ps_dec->aaaImagDelayRBufferSerSubQmf[i] = (Int32 **)ptr1;
+        ptr1 += aRevLinkDelaySer[i] * sizeof(Int32 *) / sizeof(Int32);
 
         for (j = 0; j < aRevLinkDelaySer[i]; j++)
         {
-            h_ps_dec->aaaRealDelayRBufferSerQmf[i][j] = ptr2;
-            ptr2 += NO_QMF_ALLPASS_CHANNELS;    /* NO_QMF_ALLPASS_CHANNELS == 20 */
+            h_ps_dec->aaaRealDelayRBufferSerQmf[i][j] = ptr1;
+            ptr1 += NO_QMF_ALLPASS_CHANNELS;    /* NO_QMF_ALLPASS_CHANNELS == 20 */
 
-            h_ps_dec->aaaImagDelayRBufferSerQmf[i][j] = ptr2;
-            ptr2 += NO_QMF_ALLPASS_CHANNELS;
+            h_ps_dec->aaaImagDelayRBufferSerQmf[i][j] = ptr1;
+            ptr1 += NO_QMF_ALLPASS_CHANNELS;
 
-            h_ps_dec->aaaRealDelayRBufferSerSubQmf[i][j] = ptr3;
-            ptr3 += SUBQMF_GROUPS;
+            h_ps_dec->aaaRealDelayRBufferSerSubQmf[i][j] = ptr1;
+            ptr1 += SUBQMF_GROUPS;
 
-            h_ps_dec->aaaImagDelayRBufferSerSubQmf[i][j] = ptr3;
-            ptr3 += SUBQMF_GROUPS;
+            h_ps_dec->aaaImagDelayRBufferSerSubQmf[i][j] = ptr1;
+            ptr1 += SUBQMF_GROUPS;
 
         }
     }
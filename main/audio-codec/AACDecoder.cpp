@@ -3,13 +3,11 @@
 #include <assert.h>
 #include <stdlib.h>  // for free, malloc
 #include <string.h>
+#include "AudioContainer.h"  // for AudioContainer
+#include "CodecType.h"       // for AudioCodec, AudioCodec::AAC
 #include "e_tmp4audioobjecttype.h"
 #include "pvmp4audiodecoder_api.h"
 
-namespace bell {
-class AudioContainer;
-}  // namespace bell
-
 using namespace bell;
 
 AACDecoder::AACDecoder() {
@@ -40,7 +38,9 @@ AACDecoder::AACDecoder() {
 
   firstFrame = true;
 
-  assert(PVMP4AudioDecoderInitLibrary(aacDecoder, pMem) == MP4AUDEC_SUCCESS);
+  // not inside assert(), which NDEBUG builds compile out
+  lastErrno = PVMP4AudioDecoderInitLibrary(aacDecoder, pMem);
+  assert(lastErrno == MP4AUDEC_SUCCESS);
 }
 
 AACDecoder::~AACDecoder() {
@@ -65,18 +65,45 @@ int AACDecoder::getDecodedStreamType() {
 bool AACDecoder::setup(uint32_t sampleRate, uint8_t channelCount,
                        uint8_t bitDepth) {
   PVMP4AudioDecoderResetBuffer(pMem);
-  assert(PVMP4AudioDecoderInitLibrary(aacDecoder, pMem) == MP4AUDEC_SUCCESS);
+  // the library turns SBR off after a plain AAC-LC track, turn it back on
+  aacDecoder->aacPlusEnabled = TRUE;
+  lastErrno = PVMP4AudioDecoderInitLibrary(aacDecoder, pMem);
   firstFrame = true;
-  return true;
+  return lastErrno == MP4AUDEC_SUCCESS;
 }
 
 bool AACDecoder::setup(AudioContainer* container) {
   PVMP4AudioDecoderResetBuffer(pMem);
-  assert(PVMP4AudioDecoderInitLibrary(aacDecoder, pMem) == MP4AUDEC_SUCCESS);
+  // the library turns SBR off after a plain AAC-LC track, turn it back on
+  aacDecoder->aacPlusEnabled = TRUE;
+  lastErrno = PVMP4AudioDecoderInitLibrary(aacDecoder, pMem);
   firstFrame = true;
+  if (lastErrno != MP4AUDEC_SUCCESS)
+    return false;
+
+  // raw access units (MP4) need the AudioSpecificConfig, ADTS carries its own
+  uint32_t configLen;
+  uint8_t* config = container->getSetupData(configLen, AudioCodec::AAC);
+  if (!config)
+    return true;
+  aacDecoder->pInputBuffer = config;
+  aacDecoder->inputBufferCurrentLength = configLen;
+  aacDecoder->inputBufferMaxLength = configLen;
+  aacDecoder->inputBufferUsedLength = 0;
+  aacDecoder->remainderBits = 0;
+  lastErrno = PVMP4AudioDecoderConfig(aacDecoder, pMem);
+  if (lastErrno != MP4AUDEC_SUCCESS)
+    return false;
+  sampleRate = aacDecoder->samplingRate;
   return true;
 }
 
+void AACDecoder::reset() {
+  BaseCodec::reset();
+  PVMP4AudioDecoderResetBuffer(pMem);
+  firstFrame = true;
+}
+
 uint8_t* AACDecoder::decode(uint8_t* inData, uint32_t& inLen,
                             uint32_t& outLen) {
   if (!inData || inLen == 0)
@@ -100,6 +127,9 @@ uint8_t* AACDecoder::decode(uint8_t* inData, uint32_t& inLen,
     inLen -= aacDecoder->inputBufferUsedLength;
   }
 
+  // known from the first frame, SBR upsampling included
+  if (aacDecoder->samplingRate)
+    sampleRate = aacDecoder->samplingRate;
   outLen = aacDecoder->frameLength * sizeof(int16_t);
 
   // Handle AAC+
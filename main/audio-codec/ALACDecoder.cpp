@@ -0,0 +1,160 @@
+#include "ALACDecoder.h"
+
+#include <string.h>   // for memcpy
+#include <algorithm>  // for max, min
+#include <memory>     // for make_unique, unique_ptr
+#include <utility>    // for move
+
+#include "AudioContainer.h"          // for AudioContainer
+#include "CodecType.h"               // for AudioCodec, AudioCodec::ALAC
+#include "PCMConverter.h"            // for convert
+#include "codec/ALACAudioTypes.h"    // for ALACSpecificConfig, kALACDefaultF...
+#include "codec/ALACBitUtilities.h"  // for BitBuffer, BitBufferInit, ALAC_noErr
+#include "codec/ALACDecoder.h"       // for ALACDecoder
+
+using namespace bell;
+
+#define ALAC_ERR_SETUP -1
+
+// the reference decoder reads whole words, past the end of the packet
+#define ALAC_INPUT_PADDING 16
+
+// limits for values read from the cookie, to keep allocations sane
+#define ALAC_MAX_FRAME_LENGTH 65536
+#define ALAC_MAX_CHANNELS 8
+
+// default encoder parameters, as used by AirPlay
+#define ALAC_DEFAULT_PB 40
+#define ALAC_DEFAULT_MB 10
+#define ALAC_DEFAULT_KB 14
+#define ALAC_DEFAULT_MAX_RUN 255
+
+static void writeBE32(uint8_t* buf, uint32_t value) {
+  buf[0] = value >> 24;
+  buf[1] = value >> 16;
+  buf[2] = value >> 8;
+  buf[3] = value;
+}
+
+bell::ALACDecoder::ALACDecoder() {}
+
+bell::ALACDecoder::~ALACDecoder() {}
+
+bool bell::ALACDecoder::setup(uint32_t sampleRate, uint8_t channelCount,
+                              uint8_t bitDepth) {
+  return setup(sampleRate, channelCount, bitDepth, kALACDefaultFrameSize);
+}
+
+bool bell::ALACDecoder::setup(uint32_t sampleRate, uint8_t channelCount,
+                              uint8_t bitDepth, uint32_t frameLength) {
+  // build the cookie the encoder would have written
+  uint8_t cookie[sizeof(ALACSpecificConfig)] = {};
+  writeBE32(cookie, frameLength);
+  cookie[5] = bitDepth;
+  cookie[6] = ALAC_DEFAULT_PB;
+  cookie[7] = ALAC_DEFAULT_MB;
+  cookie[8] = ALAC_DEFAULT_KB;
+  cookie[9] = channelCount;
+  cookie[11] = ALAC_DEFAULT_MAX_RUN;
+  writeBE32(cookie + 20, sampleRate);
+  return setup(cookie, sizeof(cookie));
+}
+
+bool bell::ALACDecoder::setup(const uint8_t* cookie, uint32_t cookieSize) {
+  lastErrno = ALAC_ERR_SETUP;
+  // Init() looks for atom headers in the first 8 bytes
+  if (!cookie || cookieSize < sizeof(ALACSpecificConfig))
+    return false;
+
+  auto decoder = std::make_unique<::ALACDecoder>();
+  // Init() doesn't modify the cookie, but isn't const-correct
+  if (decoder->Init(const_cast<uint8_t*>(cookie), cookieSize) != ALAC_noErr)
+    return false;
+  auto& config = decoder->mConfig;
+  if (config.frameLength == 0 || config.frameLength > ALAC_MAX_FRAME_LENGTH ||
+      config.numChannels == 0 || config.numChannels > ALAC_MAX_CHANNELS) {
+    return false;
+  }
+  switch (config.bitDepth) {
+    case 16:
+    case 20:
+    case 24:
+    case 32:
+      break;
+    default:
+      return false;
+  }
+
+  alac = std::move(decoder);
+  frameLength = config.frameLength;
+  sourceBitDepth = config.bitDepth;
+  sampleRate = config.sampleRate;
+  channelCount = config.numChannels;
+  bitDepth = outputBitDepth();
+  output.resize(frameLength * channelCount * (nativeBitDepth() / 8));
+  // escaped (uncompressed) packets are the largest
+  input.resize(std::max<size_t>(config.maxFrameBytes, output.size() + 64) +
+               ALAC_INPUT_PADDING);
+  lastErrno = ALAC_noErr;
+  return true;
+}
+
+bool bell::ALACDecoder::setup(AudioContainer* container) {
+  uint32_t cookieSize;
+  uint8_t* cookie = container->getSetupData(cookieSize, AudioCodec::ALAC);
+  return cookie && setup(cookie, cookieSize);
+}
+
+void bell::ALACDecoder::reset() {
+  BaseCodec::reset();
+  narrowBitDepth = 16;
+  setNativeOutput(false);
+}
+
+void bell::ALACDecoder::setNativeOutput(bool native) {
+  nativeOutput = native;
+  bitDepth = outputBitDepth();
+}
+
+uint8_t bell::ALACDecoder::setMaxBitDepth(uint8_t maxBitDepth) {
+  narrowBitDepth = maxBitDepth >= 24 ? 24 : 16;
+  setNativeOutput(nativeBitDepth() <= maxBitDepth);
+  return bitDepth;
+}
+
+uint8_t bell::ALACDecoder::nativeBitDepth() const {
+  // 20-bit samples are returned as 3 bytes
+  return sourceBitDepth == 20 ? 24 : sourceBitDepth;
+}
+
+uint8_t bell::ALACDecoder::outputBitDepth() const {
+  if (!nativeOutput)
+    return std::min(narrowBitDepth, nativeBitDepth());
+  return nativeBitDepth();
+}
+
+uint8_t* bell::ALACDecoder::decode(uint8_t* inData, uint32_t& inLen,
+                                   uint32_t& outLen) {
+  outLen = 0;
+  if (!inData || inLen == 0 || !alac)
+    return nullptr;
+
+  if (inLen + ALAC_INPUT_PADDING > input.size())
+    input.resize(inLen + ALAC_INPUT_PADDING);
+  memcpy(input.data(), inData, inLen);
+  BitBuffer bits;
+  BitBufferInit(&bits, input.data(), inLen);
+  uint32_t samples = 0;
+  lastErrno = alac->Decode(&bits, output.data(), frameLength, channelCount,
+                           &samples);
+  // one packet per sample, consumed whole
+  inLen = 0;
+  if (lastErrno != ALAC_noErr)
+    return nullptr;
+
+  uint32_t count = samples * channelCount;
+  uint8_t* out = output.data();
+  // keep the top bits, in place - the output is never larger than the input
+  outLen = PCMConverter::convert(out, nativeBitDepth(), out, bitDepth, count);
+  return out;
+}
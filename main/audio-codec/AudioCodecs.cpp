@@ -1,7 +1,9 @@
 #include "AudioCodecs.h"
 
-#include <map>          // for map, operator!=, map<>::iterator, map<>:...
-#include <type_traits>  // for remove_extent_t
+#include <map>      // for map, operator!=, map<>::iterator, map<>:...
+#include <mutex>    // for mutex, scoped_lock
+#include <utility>  // for move
+#include <vector>   // for vector
 
 #include "AudioContainer.h"  // for AudioContainer
 
@@ -13,67 +15,135 @@ using namespace bell;
 
 #ifdef BELL_CODEC_AAC
 #include "AACDecoder.h"  // for AACDecoder
-
-static std::shared_ptr<AACDecoder> codecAac;
 #endif
 
 #ifdef BELL_CODEC_MP3
 #include "MP3Decoder.h"  // for MP3Decoder
-
-static std::shared_ptr<MP3Decoder> codecMp3;
 #endif
 
 #ifdef BELL_CODEC_VORBIS
 #include "VorbisDecoder.h"  // for VorbisDecoder
-
-static std::shared_ptr<VorbisDecoder> codecVorbis;
 #endif
 
 #ifdef BELL_CODEC_OPUS
 #include "OPUSDecoder.h"  // for OPUSDecoder
+#endif
 
-static std::shared_ptr<OPUSDecoder> codecOpus;
+#ifdef BELL_CODEC_FLAC
+#include "FLACDecoder.h"  // for FLACDecoder
 #endif
 
-std::map<AudioCodec, std::shared_ptr<BaseCodec>> customCodecs;
+#ifdef BELL_CODEC_ALAC
+#include "ALACDecoder.h"  // for ALACDecoder
+#endif
 
-std::shared_ptr<BaseCodec> AudioCodecs::getCodec(AudioCodec type) {
-  if (customCodecs.find(type) != customCodecs.end())
-    return customCodecs[type];
+#ifdef BELL_CODEC_PCM
+#include "PCMDecoder.h"  // for PCMDecoder
+#endif
+
+namespace {
+struct CodecPool {
+  std::vector<std::unique_ptr<BaseCodec>> idle;
+  size_t instances = 0;  // idle and in use
+  size_t size = BELL_CODEC_POOL_SIZE;
+};
+
+struct CodecPools {
+  std::mutex mutex;
+  std::map<AudioCodec, CodecPool> pools;
+  std::map<AudioCodec, std::shared_ptr<BaseCodec>> customCodecs;
+};
+
+CodecPools& codecPools() {
+  // never destroyed, as decoders may be released during static destruction
+  static auto* pools = new CodecPools();
+  return *pools;
+}
+
+std::unique_ptr<BaseCodec> createCodec(AudioCodec type) {
   switch (type) {
 #ifdef BELL_CODEC_AAC
     case AudioCodec::AAC:
-      if (codecAac)
-        return codecAac;
-      codecAac = std::make_shared<AACDecoder>();
-      return codecAac;
+      return std::make_unique<AACDecoder>();
 #endif
 #ifdef BELL_CODEC_MP3
     case AudioCodec::MP3:
-      if (codecMp3)
-        return codecMp3;
-      codecMp3 = std::make_shared<MP3Decoder>();
-      return codecMp3;
+      return std::make_unique<MP3Decoder>();
 #endif
 #ifdef BELL_CODEC_VORBIS
     case AudioCodec::VORBIS:
-      if (codecVorbis)
-        return codecVorbis;
-      codecVorbis = std::make_shared<VorbisDecoder>();
-      return codecVorbis;
+      return std::make_unique<VorbisDecoder>();
 #endif
 #ifdef BELL_CODEC_OPUS
     case AudioCodec::OPUS:
-      if (codecOpus)
-        return codecOpus;
-      codecOpus = std::make_shared<OPUSDecoder>();
-      return codecOpus;
+      return std::make_unique<OPUSDecoder>();
+#endif
+#ifdef BELL_CODEC_FLAC
+    case AudioCodec::FLAC:
+      return std::make_unique<FLACDecoder>();
+#endif
+#ifdef BELL_CODEC_ALAC
+    case AudioCodec::ALAC:
+      return std::make_unique<bell::ALACDecoder>();
+#endif
+#ifdef BELL_CODEC_PCM
+    case AudioCodec::PCM:
+      return std::make_unique<bell::PCMDecoder>();
 #endif
     default:
       return nullptr;
   }
 }
 
+void releaseCodec(AudioCodec type, BaseCodec* codec) {
+  // reset outside of the lock, it may take a while
+  codec->reset();
+  auto& state = codecPools();
+  std::scoped_lock lock(state.mutex);
+  auto& pool = state.pools[type];
+  if (pool.instances > pool.size) {
+    // pool was shrunk meanwhile
+    pool.instances--;
+    delete codec;
+    return;
+  }
+  pool.idle.emplace_back(codec);
+}
+}  // namespace
+
+std::shared_ptr<BaseCodec> AudioCodecs::getCodec(AudioCodec type) {
+  auto& state = codecPools();
+  std::unique_ptr<BaseCodec> codec;
+  {
+    std::scoped_lock lock(state.mutex);
+    auto custom = state.customCodecs.find(type);
+    if (custom != state.customCodecs.end())
+      return custom->second;
+
+    auto& pool = state.pools[type];
+    if (!pool.idle.empty()) {
+      codec = std::move(pool.idle.back());
+      pool.idle.pop_back();
+    } else if (pool.instances < pool.size) {
+      // reserve the slot, and allocate outside of the lock
+      pool.instances++;
+    } else {
+      return nullptr;
+    }
+  }
+
+  if (!codec) {
+    codec = createCodec(type);
+    if (!codec) {
+      std::scoped_lock lock(state.mutex);
+      state.pools[type].instances--;
+      return nullptr;
+    }
+  }
+  return std::shared_ptr<BaseCodec>(
+      codec.release(), [type](BaseCodec* codec) { releaseCodec(type, codec); });
+}
+
 std::shared_ptr<BaseCodec> AudioCodecs::getCodec(AudioContainer* container) {
   auto codec = getCodec(container->getCodec());
   if (codec != nullptr) {
@@ -81,7 +151,35 @@ std::shared_ptr<BaseCodec> AudioCodecs::getCodec(AudioContainer* container) {
   }
   return codec;
 }
+
 void AudioCodecs::addCodec(AudioCodec type,
                            const std::shared_ptr<BaseCodec>& codec) {
-  customCodecs[type] = codec;
+  auto& state = codecPools();
+  std::scoped_lock lock(state.mutex);
+  state.customCodecs[type] = codec;
+}
+
+bool AudioCodecs::preallocate(AudioCodec type, size_t count) {
+  auto& state = codecPools();
+  std::scoped_lock lock(state.mutex);
+  auto& pool = state.pools[type];
+  while (pool.idle.size() < count && pool.instances < pool.size) {
+    auto codec = createCodec(type);
+    if (!codec)
+      return false;
+    pool.idle.push_back(std::move(codec));
+    pool.instances++;
+  }
+  return true;
+}
+
+void AudioCodecs::setPoolSize(AudioCodec type, size_t size) {
+  auto& state = codecPools();
+  std::scoped_lock lock(state.mutex);
+  auto& pool = state.pools[type];
+  pool.size = size;
+  while (pool.instances > size && !pool.idle.empty()) {
+    pool.idle.pop_back();
+    pool.instances--;
+  }
 }
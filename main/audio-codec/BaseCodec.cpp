@@ -1,6 +1,9 @@
 #include "BaseCodec.h"
 
+#include <algorithm>  // for min
+
 #include "AudioContainer.h"  // for AudioContainer
+#include "PCMConverter.h"    // for toFloat
 
 using namespace bell;
 
@@ -8,6 +11,11 @@ bool BaseCodec::setup(AudioContainer* container) {
   return false;
 }
 
+void BaseCodec::reset() {
+  pendingOffset = 0;
+  pendingSamples = 0;
+}
+
 uint8_t* BaseCodec::decode(AudioContainer* container, uint32_t& outLen) {
   auto* data = container->readSample(lastSampleLen);
   if (data == nullptr) {
@@ -26,3 +34,53 @@ uint8_t* BaseCodec::decode(AudioContainer* container, uint32_t& outLen) {
 
   return result;
 }
+
+size_t BaseCodec::decodeInto(AudioContainer* container, PlanarBuffer& buffer,
+                             size_t maxSamples) {
+  size_t end = std::min(buffer.capacity, buffer.numSamples + maxSamples);
+  size_t written = 0;
+  while (buffer.numSamples < end) {
+    if (pendingSamples == 0) {
+      auto* data = container->readSample(lastSampleLen);
+      if (data == nullptr || lastSampleLen == 0)
+        break;
+
+      availableBytes = lastSampleLen;
+      int32_t decoded = decodeSamples((uint8_t*)data, availableBytes);
+      container->consumeBytes(lastSampleLen - availableBytes);
+      if (decoded < 0)
+        break;
+      pendingOffset = 0;
+      pendingSamples = decoded;
+      continue;
+    }
+
+    uint32_t count =
+        std::min<size_t>(pendingSamples, end - buffer.numSamples);
+    writeFloat(buffer, pendingOffset, count);
+    buffer.numSamples += count;
+    pendingOffset += count;
+    pendingSamples -= count;
+    written += count;
+  }
+  return written;
+}
+
+int32_t BaseCodec::decodeSamples(uint8_t* inData, uint32_t& inLen) {
+  uint32_t outLen;
+  lastOutput = decode(inData, inLen, outLen);
+  if (lastOutput == nullptr)
+    return -1;
+  return outLen / (channelCount * (bitDepth / 8));
+}
+
+void BaseCodec::writeFloat(PlanarBuffer& buffer, uint32_t offset,
+                           uint32_t count) {
+  size_t stride = channelCount * (bitDepth / 8);
+  for (int channel = 0; channel < buffer.numChannels; channel++) {
+    int source = std::min(channel, channelCount - 1);
+    PCMConverter::toFloat(
+        lastOutput + offset * stride + source * (bitDepth / 8), bitDepth,
+        stride, buffer.data[channel] + buffer.numSamples, count);
+  }
+}
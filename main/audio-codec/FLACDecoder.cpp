@@ -0,0 +1,527 @@
+#include "FLACDecoder.h"
+
+#include <algorithm>  // for min
+#include <array>      // for array
+#include <bit>        // for countl_zero
+#include <cmath>      // for ldexp
+
+#include "AudioContainer.h"  // for AudioContainer
+#include "CodecType.h"       // for AudioCodec, AudioCodec::FLAC
+#include "FLACContainer.h"   // for FLACContainer
+#include "FrameHeader.h"     // for FLACInfo, parseFLAC
+
+using namespace bell;
+
+#define FLAC_ERR_HEADER -1
+#define FLAC_ERR_SUBFRAME -2
+#define FLAC_ERR_CRC -3
+
+#define FLAC_MAX_LPC_ORDER 32
+
+namespace {
+/**
+ * MSB-first bit reader over a frame, keeping up to 64 bits in a cache.
+ */
+class BitReader {
+ public:
+  BitReader(const uint8_t* data, size_t size) : data(data), size(size) {
+    refill();
+  }
+
+  bool overflow = false;
+
+  uint32_t read(uint8_t n) {
+    if (n == 0)
+      return 0;
+    if (bits < n) {
+      refill();
+      if (bits < n) {
+        overflow = true;
+        return 0;
+      }
+    }
+    uint32_t value = cache >> (64 - n);
+    drop(n);
+    return value;
+  }
+
+  int32_t readSigned(uint8_t n) {
+    if (n == 0)
+      return 0;
+    uint32_t value = read(n);
+    return (int32_t)(value << (32 - n)) >> (32 - n);
+  }
+
+  uint32_t readUnary() {
+    uint32_t count = 0;
+    while (true) {
+      if (bits == 0) {
+        refill();
+        if (bits == 0) {
+          overflow = true;
+          return 0;
+        }
+      }
+      // bits past the valid ones are always zero
+      if (cache) {
+        uint32_t zeros = std::countl_zero(cache);
+        if (zeros < bits) {
+          drop(zeros + 1);
+          return count + zeros;
+        }
+      }
+      count += bits;
+      cache = 0;
+      bits = 0;
+    }
+  }
+
+  void readRice(int32_t* dst, uint32_t count, uint8_t param) {
+    for (uint32_t i = 0; i < count; i++) {
+      uint32_t value = (readUnary() << param) | read(param);
+      dst[i] = (int32_t)(value >> 1) ^ -(int32_t)(value & 1);
+    }
+  }
+
+  void alignToByte() { drop(bits % 8); }
+
+  // bytes consumed so far, after alignToByte()
+  size_t bytePosition() const { return pos - bits / 8; }
+
+ private:
+  const uint8_t* data;
+  size_t size;
+  size_t pos = 0;
+  uint64_t cache = 0;
+  uint32_t bits = 0;
+
+  void refill() {
+    while (bits <= 56 && pos < size) {
+      cache |= (uint64_t)data[pos++] << (56 - bits);
+      bits += 8;
+    }
+  }
+
+  void drop(uint32_t n) {
+    cache = n < 64 ? cache << n : 0;
+    bits -= n;
+  }
+};
+
+uint16_t crc16(const uint8_t* data, size_t len) {
+  static const auto table = []() {
+    std::array<uint16_t, 256> table;
+    for (uint32_t i = 0; i < 256; i++) {
+      uint16_t crc = i << 8;
+      for (int bit = 0; bit < 8; bit++) {
+        crc = (crc & 0x8000) ? (crc << 1) ^ 0x8005 : crc << 1;
+      }
+      table[i] = crc;
+    }
+    return table;
+  }();
+
+  uint16_t crc = 0;
+  while (len--) {
+    crc = (crc << 8) ^ table[(crc >> 8) ^ *data++];
+  }
+  return crc;
+}
+
+bool readResidual(BitReader& reader, int32_t* out, uint32_t blockSize,
+                  uint8_t order) {
+  uint8_t method = reader.read(2);
+  if (method > 1)
+    return false;
+  uint8_t paramBits = method ? 5 : 4;
+  uint8_t escape = method ? 31 : 15;
+  uint8_t partitionOrder = reader.read(4);
+  uint32_t partitionSize = blockSize >> partitionOrder;
+  if ((partitionSize << partitionOrder) != blockSize || partitionSize < order)
+    return false;
+
+  int32_t* dst = out + order;
+  for (uint32_t partition = 0; partition < (1u << partitionOrder);
+       partition++) {
+    uint32_t count = partition ? partitionSize : partitionSize - order;
+    uint8_t param = reader.read(paramBits);
+    if (param == escape) {
+      // unencoded, with a fixed bit length
+      uint8_t rawBits = reader.read(5);
+      for (uint32_t i = 0; i < count; i++) {
+        dst[i] = reader.readSigned(rawBits);
+      }
+    } else {
+      reader.readRice(dst, count, param);
+    }
+    dst += count;
+  }
+  return !reader.overflow;
+}
+
+template <typename Accumulator>
+void restoreFixed(int32_t* data, uint32_t blockSize, uint8_t order) {
+  switch (order) {
+    case 1:
+      for (uint32_t i = 1; i < blockSize; i++)
+        data[i] += data[i - 1];
+      break;
+    case 2:
+      for (uint32_t i = 2; i < blockSize; i++)
+        data[i] += (Accumulator)2 * data[i - 1] - data[i - 2];
+      break;
+    case 3:
+      for (uint32_t i = 3; i < blockSize; i++)
+        data[i] += (Accumulator)3 * (data[i - 1] - (Accumulator)data[i - 2]) +
+                   data[i - 3];
+      break;
+    case 4:
+      for (uint32_t i = 4; i < blockSize; i++)
+        data[i] += (Accumulator)4 * (data[i - 1] + (Accumulator)data[i - 3]) -
+                   (Accumulator)6 * data[i - 2] - data[i - 4];
+      break;
+  }
+}
+
+// order known at compile time, so that the inner loop is fully unrolled
+template <int ORDER>
+void restoreLPC(int32_t* data, uint32_t blockSize, const int32_t* coefs,
+                int shift) {
+  for (uint32_t i = ORDER; i < blockSize; i++) {
+    int32_t sum = 0;
+    for (int j = 0; j < ORDER; j++) {
+      sum += coefs[j] * data[i - 1 - j];
+    }
+    data[i] += sum >> shift;
+  }
+}
+
+void restoreLPC(int32_t* data, uint32_t blockSize, const int32_t* coefs,
+                uint8_t order, int shift) {
+  switch (order) {
+    case 1:
+      return restoreLPC<1>(data, blockSize, coefs, shift);
+    case 2:
+      return restoreLPC<2>(data, blockSize, coefs, shift);
+    case 4:
+      return restoreLPC<4>(data, blockSize, coefs, shift);
+    case 6:
+      return restoreLPC<6>(data, blockSize, coefs, shift);
+    case 8:
+      return restoreLPC<8>(data, blockSize, coefs, shift);
+    case 10:
+      return restoreLPC<10>(data, blockSize, coefs, shift);
+    case 12:
+      return restoreLPC<12>(data, blockSize, coefs, shift);
+    default:
+      for (uint32_t i = order; i < blockSize; i++) {
+        int32_t sum = 0;
+        for (int j = 0; j < order; j++) {
+          sum += coefs[j] * data[i - 1 - j];
+        }
+        data[i] += sum >> shift;
+      }
+  }
+}
+
+// for predictions that may not fit into 32 bits
+void restoreLPCWide(int32_t* data, uint32_t blockSize, const int32_t* coefs,
+                    uint8_t order, int shift) {
+  for (uint32_t i = order; i < blockSize; i++) {
+    int64_t sum = 0;
+    for (int j = 0; j < order; j++) {
+      sum += (int64_t)coefs[j] * data[i - 1 - j];
+    }
+    data[i] += (int32_t)(sum >> shift);
+  }
+}
+
+bool decodeSubframe(BitReader& reader, int32_t* out, uint32_t blockSize,
+                    uint8_t bps) {
+  if (reader.read(1))
+    return false;
+  uint8_t type = reader.read(6);
+  uint8_t wasted = 0;
+  if (reader.read(1)) {
+    wasted = reader.readUnary() + 1;
+    if (wasted >= bps)
+      return false;
+    bps -= wasted;
+  }
+
+  if (type == 0) {
+    // constant
+    int32_t value = reader.readSigned(bps);
+    std::fill(out, out + blockSize, value);
+  } else if (type == 1) {
+    // verbatim
+    for (uint32_t i = 0; i < blockSize; i++) {
+      out[i] = reader.readSigned(bps);
+    }
+  } else if (type >= 8 && type <= 12) {
+    // fixed predictor
+    uint8_t order = type - 8;
+    if (order > blockSize)
+      return false;
+    for (uint8_t i = 0; i < order; i++) {
+      out[i] = reader.readSigned(bps);
+    }
+    if (!readResidual(reader, out, blockSize, order))
+      return false;
+    if (bps <= 28) {
+      restoreFixed<int32_t>(out, blockSize, order);
+    } else {
+      restoreFixed<int64_t>(out, blockSize, order);
+    }
+  } else if (type >= 32) {
+    // linear predictor
+    uint8_t order = type - 31;
+    if (order > blockSize)
+      return false;
+    for (uint8_t i = 0; i < order; i++) {
+      out[i] = reader.readSigned(bps);
+    }
+    uint8_t precision = reader.read(4) + 1;
+    int shift = reader.readSigned(5);
+    if (precision == 16 || shift < 0)
+      return false;
+    int32_t coefs[FLAC_MAX_LPC_ORDER];
+    for (uint8_t i = 0; i < order; i++) {
+      coefs[i] = reader.readSigned(precision);
+    }
+    if (!readResidual(reader, out, blockSize, order))
+      return false;
+
+    uint8_t orderBits = 0;
+    while ((1u << orderBits) < order)
+      orderBits++;
+    if (bps + precision + orderBits <= 32) {
+      restoreLPC(out, blockSize, coefs, order, shift);
+    } else {
+      restoreLPCWide(out, blockSize, coefs, order, shift);
+    }
+  } else {
+    return false;
+  }
+
+  if (wasted) {
+    for (uint32_t i = 0; i < blockSize; i++) {
+      out[i] = (int32_t)((uint32_t)out[i] << wasted);
+    }
+  }
+  return !reader.overflow;
+}
+}  // namespace
+
+FLACDecoder::FLACDecoder() {}
+
+FLACDecoder::~FLACDecoder() {}
+
+bool FLACDecoder::setup(uint32_t sampleRate, uint8_t channelCount,
+                        uint8_t bitDepth) {
+  this->streamSampleRate = sampleRate;
+  this->streamBitDepth = bitDepth;
+  this->sourceBitDepth = bitDepth;
+  this->sampleRate = sampleRate;
+  this->channelCount = channelCount;
+  return true;
+}
+
+bool FLACDecoder::setup(AudioContainer* container) {
+  if (container->getCodec() != AudioCodec::FLAC)
+    return false;
+  auto* flac = static_cast<FLACContainer*>(container);
+  flac->parseSetupData();
+  auto& info = flac->getStreamInfo();
+  if (!info.sampleRate)
+    return false;
+  setup(info.sampleRate, info.channels, info.bitsPerSample);
+
+  // allocate the largest block up front
+  samples.resize(info.maxBlockSize * info.channels);
+  output.resize(info.maxBlockSize * info.channels * sizeof(int32_t));
+  return true;
+}
+
+void FLACDecoder::reset() {
+  BaseCodec::reset();
+  setOutputFormat(OutputFormat::PCM_16);
+}
+
+void FLACDecoder::setOutputFormat(OutputFormat format) {
+  outputFormat = format;
+  switch (format) {
+    case OutputFormat::PCM_16:
+      bitDepth = 16;
+      break;
+    case OutputFormat::PCM_24:
+      bitDepth = 24;
+      break;
+    case OutputFormat::PCM_32:
+    case OutputFormat::FLOAT_PLANAR:
+      bitDepth = 32;
+      break;
+  }
+}
+
+uint8_t FLACDecoder::setMaxBitDepth(uint8_t maxBitDepth) {
+  if (sourceBitDepth > 24 && maxBitDepth >= 32) {
+    setOutputFormat(OutputFormat::PCM_32);
+  } else if (sourceBitDepth > 16 && maxBitDepth >= 24) {
+    setOutputFormat(OutputFormat::PCM_24);
+  } else {
+    setOutputFormat(OutputFormat::PCM_16);
+  }
+  return bitDepth;
+}
+
+uint8_t* FLACDecoder::decode(uint8_t* inData, uint32_t& inLen,
+                             uint32_t& outLen) {
+  outLen = 0;
+  int32_t blockSize = decodeSamples(inData, inLen);
+  if (blockSize < 0)
+    return nullptr;
+  outLen = convertOutput(blockSize, channelCount, sourceBitDepth);
+  return output.data();
+}
+
+int32_t FLACDecoder::decodeSamples(uint8_t* inData, uint32_t& inLen) {
+  if (!inData || inLen == 0)
+    return -1;
+
+  FrameHeader::FLACInfo header;
+  if (!FrameHeader::parseFLAC(inData, inLen, header)) {
+    lastErrno = FLAC_ERR_HEADER;
+    inLen -= std::min(inLen, 2u);
+    return -1;
+  }
+  uint8_t bps = header.bitsPerSample ? header.bitsPerSample : streamBitDepth;
+  uint32_t blockSize = header.blockSize;
+  if (samples.size() < blockSize * header.channels) {
+    samples.resize(blockSize * header.channels);
+    output.resize(blockSize * header.channels * sizeof(int32_t));
+  }
+
+  BitReader reader(inData + header.headerSize, inLen - header.headerSize);
+  for (uint8_t channel = 0; channel < header.channels; channel++) {
+    // side channels need an extra bit
+    bool side = (header.channelAssignment == 8 && channel == 1) ||
+                (header.channelAssignment == 9 && channel == 0) ||
+                (header.channelAssignment == 10 && channel == 1);
+    uint8_t channelBps = bps + (side ? 1 : 0);
+    if (channelBps > 32 ||
+        !decodeSubframe(reader, samples.data() + channel * blockSize,
+                        blockSize, channelBps)) {
+      lastErrno = FLAC_ERR_SUBFRAME;
+      inLen -= std::min(inLen, 2u);
+      return -1;
+    }
+  }
+
+  reader.alignToByte();
+  uint16_t crc = reader.read(16);
+  size_t frameSize = header.headerSize + reader.bytePosition();
+  if (reader.overflow || crc16(inData, frameSize - 2) != crc) {
+    lastErrno = FLAC_ERR_CRC;
+    inLen -= std::min(inLen, 2u);
+    return -1;
+  }
+
+  decorrelate(header.channelAssignment, blockSize);
+  sampleRate = header.sampleRate ? header.sampleRate : streamSampleRate;
+  channelCount = header.channels;
+  sourceBitDepth = bps;
+  decodedBlockSize = blockSize;
+  inLen -= frameSize;
+  return blockSize;
+}
+
+void FLACDecoder::writeFloat(PlanarBuffer& buffer, uint32_t offset,
+                             uint32_t count) {
+  float scale = std::ldexp(1.0f, 1 - sourceBitDepth);
+  for (int channel = 0; channel < buffer.numChannels; channel++) {
+    int source = std::min(channel, channelCount - 1);
+    const int32_t* in =
+        samples.data() + source * decodedBlockSize + offset;
+    float* out = buffer.data[channel] + buffer.numSamples;
+    for (uint32_t i = 0; i < count; i++)
+      out[i] = in[i] * scale;
+  }
+}
+
+void FLACDecoder::decorrelate(uint8_t channelAssignment, uint32_t blockSize) {
+  int32_t* left = samples.data();
+  int32_t* right = samples.data() + blockSize;
+  switch (channelAssignment) {
+    case 8:  // left/side
+      for (uint32_t i = 0; i < blockSize; i++)
+        right[i] = left[i] - right[i];
+      break;
+    case 9:  // side/right
+      for (uint32_t i = 0; i < blockSize; i++)
+        left[i] += right[i];
+      break;
+    case 10:  // mid/side
+      for (uint32_t i = 0; i < blockSize; i++) {
+        int32_t side = right[i];
+        int32_t mid = (int32_t)((uint32_t)left[i] << 1) | (side & 1);
+        left[i] = (mid + side) >> 1;
+        right[i] = (mid - side) >> 1;
+      }
+      break;
+  }
+}
+
+uint32_t FLACDecoder::convertOutput(uint32_t blockSize, uint8_t channels,
+                                    uint8_t bps) {
+  uint32_t count = blockSize * channels;
+  switch (outputFormat) {
+    case OutputFormat::PCM_16: {
+      auto* out = (int16_t*)output.data();
+      for (uint8_t channel = 0; channel < channels; channel++) {
+        const int32_t* in = samples.data() + channel * blockSize;
+        if (bps >= 16) {
+          for (uint32_t i = 0; i < blockSize; i++)
+            out[i * channels + channel] = in[i] >> (bps - 16);
+        } else {
+          for (uint32_t i = 0; i < blockSize; i++)
+            out[i * channels + channel] = in[i] << (16 - bps);
+        }
+      }
+      return count * sizeof(int16_t);
+    }
+    case OutputFormat::PCM_24: {
+      // packed, little endian
+      uint8_t* out = output.data();
+      for (uint8_t channel = 0; channel < channels; channel++) {
+        const int32_t* in = samples.data() + channel * blockSize;
+        for (uint32_t i = 0; i < blockSize; i++) {
+          int32_t value = bps >= 24 ? in[i] >> (bps - 24) : in[i] << (24 - bps);
+          uint8_t* dst = out + (i * channels + channel) * 3;
+          dst[0] = value;
+          dst[1] = value >> 8;
+          dst[2] = value >> 16;
+        }
+      }
+      return count * 3;
+    }
+    case OutputFormat::PCM_32: {
+      auto* out = (int32_t*)output.data();
+      for (uint8_t channel = 0; channel < channels; channel++) {
+        const int32_t* in = samples.data() + channel * blockSize;
+        for (uint32_t i = 0; i < blockSize; i++)
+          out[i * channels + channel] = (int32_t)((uint32_t)in[i]
+                                                  << (32 - bps));
+      }
+      return count * sizeof(int32_t);
+    }
+    case OutputFormat::FLOAT_PLANAR: {
+      auto* out = (float*)output.data();
+      float scale = std::ldexp(1.0f, 1 - bps);
+      for (uint32_t i = 0; i < count; i++)
+        out[i] = samples[i] * scale;
+      return count * sizeof(float);
+    }
+  }
+  return 0;
+}
@@ -1,11 +1,10 @@
 #include "MP3Decoder.h"
 
-#include <stdlib.h>  // for free, malloc
+#include <stdlib.h>   // for free, malloc
+#include <algorithm>  // for min
 #include <cstdio>
 
-namespace bell {
-class AudioContainer;
-}  // namespace bell
+#include "AudioContainer.h"  // for AudioContainer
 
 using namespace bell;
 
@@ -22,25 +21,61 @@ MP3Decoder::~MP3Decoder() {
 
 bool MP3Decoder::setup(uint32_t sampleRate, uint8_t channelCount,
                        uint8_t bitDepth) {
+  hasGapless = false;
   return true;
 }
 
 bool MP3Decoder::setup(AudioContainer* container) {
+  hasGapless = container->getGaplessInfo(delaySamples, validSamples);
+  seekedTo(0);
   return true;
 }
 
+void MP3Decoder::reset() {
+  BaseCodec::reset();
+  // drop the bit reservoir, which belongs to the previous frames; libhelix
+  // has no other public way to do it
+  MP3FreeDecoder(mp3);
+  mp3 = MP3InitDecoder();
+  skipSamples = 0;
+  trimEnd = false;
+}
+
+void MP3Decoder::seekedTo(uint64_t sample) {
+  if (!hasGapless)
+    return;
+  // the container reports positions past the delay; decoding only restarts
+  // within it from the first frame
+  skipSamples = sample ? 0 : delaySamples;
+  remainingSamples = validSamples - std::min(validSamples, sample);
+  trimEnd = true;
+}
+
 uint8_t* MP3Decoder::decode(uint8_t* inData, uint32_t& inLen,
                             uint32_t& outLen) {
   if (!inData || inLen == 0)
     return nullptr;
+  uint32_t inSize = inLen;
   int status = MP3Decode(mp3, static_cast<unsigned char**>(&inData),
                          reinterpret_cast<int*>(&inLen),
                          static_cast<short*>(this->pcmData),
                          /* useSize */ 0);
   MP3GetLastFrameInfo(mp3, &frame);
+  if (frame.nChans == 0) {
+    // a layer I/II frame (or a false sync), reported as decoded
+    status = ERR_MP3_INVALID_FRAMEHEADER;
+  }
   if (status != ERR_MP3_NONE) {
     lastErrno = status;
-    inLen -= 2;
+    if (inLen == inSize) {
+      // skip the sync word
+      inLen -= std::min(inLen, 2u);
+    } else if (frame.nChans) {
+      // consumed without output, e.g. after seeking, when its bit reservoir
+      // is missing - its samples still count for trimming
+      uint32_t samples = frame.outputSamps / frame.nChans;
+      trim(samples);
+    }
     outLen = 0;
     return nullptr;
   }
@@ -51,6 +86,19 @@ uint8_t* MP3Decoder::decode(uint8_t* inData, uint32_t& inLen,
   if (channelCount != frame.nChans) {
     this->channelCount = frame.nChans;
   }
-  outLen = frame.outputSamps * sizeof(int16_t);
-  return (uint8_t*)pcmData;
+  uint32_t samples = frame.outputSamps / frame.nChans;
+  int16_t* pcm = pcmData + trim(samples) * frame.nChans;
+  outLen = samples * frame.nChans * sizeof(int16_t);
+  return (uint8_t*)pcm;
+}
+
+uint32_t MP3Decoder::trim(uint32_t& samples) {
+  uint32_t skip = std::min(skipSamples, samples);
+  skipSamples -= skip;
+  samples -= skip;
+  if (trimEnd) {
+    samples = std::min<uint64_t>(samples, remainingSamples);
+    remainingSamples -= samples;
+  }
+  return skip;
 }
@@ -1,49 +1,208 @@
 #include "OPUSDecoder.h"
 
-#include <stdlib.h>  // for free, malloc
+#include <stdlib.h>   // for free, malloc
+#include <string.h>   // for memcmp
+#include <algorithm>  // for min
 
-#include "CodecType.h"  // for bell
-#include "opus.h"       // for opus_decoder_destroy, opus_decode, opus_decod...
+#include "AudioContainer.h"  // for AudioContainer
+#include "BellLogger.h"      // for AbstractLogger, BELL_LOG
+#include "CodecType.h"       // for bell, AudioCodec, AudioCodec::OPUS
+#include "opus.h"            // for opus_decoder_init, opus_decode, opus_de...
 
 using namespace bell;
 
 #define MAX_FRAME_SIZE 6 * 960
 #define MAX_CHANNELS 2
-
-// dummy structure, just to get access to channels
-struct OpusDecoder {
-  int dummy1;
-  int dummy2;
-  int channels;
-};
+#define OPUS_SAMPLE_RATE 48000
+#define OPUS_HEAD_SIZE 19
 
 OPUSDecoder::OPUSDecoder() {
-  opus = nullptr;
+  // sized for stereo, enough for any stream it's set up for
+  opus = (OpusDecoder*)malloc(opus_decoder_get_size(MAX_CHANNELS));
   pcmData = (int16_t*)malloc(MAX_FRAME_SIZE * MAX_CHANNELS * sizeof(int16_t));
+  floatData = (float*)malloc(MAX_FRAME_SIZE * MAX_CHANNELS * sizeof(float));
 }
 
 OPUSDecoder::~OPUSDecoder() {
-  if (opus)
-    opus_decoder_destroy(opus);
+  free(opus);
   free(pcmData);
+  free(floatData);
 }
 
 bool OPUSDecoder::setup(uint32_t sampleRate, uint8_t channelCount,
                         uint8_t bitDepth) {
-  if (opus)
-    opus_decoder_destroy(opus);
-  opus = opus_decoder_create((int32_t)sampleRate, channelCount, &lastErrno);
-  return !lastErrno;
+  skipSamples = 0;
+  if (initialized && sampleRate == this->sampleRate &&
+      channelCount == this->channelCount) {
+    lastErrno = opus_decoder_ctl(opus, OPUS_RESET_STATE);
+  } else {
+    initialized = false;
+    if (channelCount == 0 || channelCount > MAX_CHANNELS) {
+      lastErrno = OPUS_BAD_ARG;
+      return false;
+    }
+    lastErrno = opus_decoder_init(opus, (int32_t)sampleRate, channelCount);
+  }
+  initialized = !lastErrno;
+  this->sampleRate = sampleRate;
+  this->channelCount = channelCount;
+  return initialized;
+}
+
+bool OPUSDecoder::setup(AudioContainer* container) {
+  uint32_t headLen;
+  uint8_t* head = container->getSetupData(headLen, AudioCodec::OPUS);
+  return head && setupHead(head, headLen);
+}
+
+bool OPUSDecoder::setupHead(const uint8_t* head, uint32_t len) {
+  if (len < OPUS_HEAD_SIZE || memcmp(head, "OpusHead", 8) != 0)
+    return false;
+  uint8_t channels = head[9];
+  // only the RTP mapping (mono or stereo) is supported by a single decoder
+  if (head[18] != 0 || channels == 0 || channels > MAX_CHANNELS) {
+    BELL_LOG(error, "OPUSDecoder", "Unsupported channel mapping %d, %d ch",
+             head[18], channels);
+    return false;
+  }
+  // always decoded at 48 kHz, which pre-skip and granule positions refer to
+  if (!setup(OPUS_SAMPLE_RATE, channels, 16))
+    return false;
+  skipSamples = head[10] | (head[11] << 8);
+  // kept by resets, so set for every stream
+  int16_t gain = head[16] | (head[17] << 8);
+  opus_decoder_ctl(opus, OPUS_SET_GAIN(gain));
+  return true;
+}
+
+void OPUSDecoder::reset() {
+  BaseCodec::reset();
+  if (initialized)
+    opus_decoder_ctl(opus, OPUS_RESET_STATE);
+}
+
+bool OPUSDecoder::readHeaderPacket(uint8_t* inData, uint32_t& inLen) {
+  if (inLen < 8 || memcmp(inData, "Opus", 4) != 0 ||
+      (memcmp(inData + 4, "Head", 4) != 0 &&
+       memcmp(inData + 4, "Tags", 4) != 0)) {
+    return false;
+  }
+  // headers of a chained stream
+  if (inData[4] == 'H')
+    setupHead(inData, inLen);
+  inLen = 0;
+  return true;
+}
+
+uint32_t OPUSDecoder::skip(uint32_t samples) {
+  uint32_t skipped = std::min(skipSamples, samples);
+  skipSamples -= skipped;
+  return skipped;
+}
+
+int32_t OPUSDecoder::decodePacket(const uint8_t* inData, uint32_t inLen,
+                                  uint32_t frameSize, bool fec, bool toFloat) {
+  if (!initialized)
+    return -1;
+  auto frameSamples = (int32_t)std::min<uint32_t>(frameSize, MAX_FRAME_SIZE);
+  int samples =
+      toFloat ? opus_decode_float(opus, inData, (int32_t)inLen, floatData,
+                                  frameSamples, fec)
+              : opus_decode(opus, inData, (int32_t)inLen, pcmData,
+                            frameSamples, fec);
+  if (samples < 0) {
+    lastErrno = samples;
+    return -1;
+  }
+  uint32_t skipped = skip(samples);
+  (toFloat ? floatStart : pcmStart) = skipped;
+  return samples - skipped;
 }
 
 uint8_t* OPUSDecoder::decode(uint8_t* inData, uint32_t& inLen,
                              uint32_t& outLen) {
   if (!inData)
     return nullptr;
-  outLen =
-      opus_decode(opus, static_cast<unsigned char*>(inData),
-                  static_cast<int32_t>(inLen), pcmData, MAX_FRAME_SIZE, false);
-  outLen *= opus->channels * sizeof(int16_t);
+  if (readHeaderPacket(inData, inLen)) {
+    outLen = 0;
+    return (uint8_t*)pcmData;
+  }
+
+  int32_t samples = decodePacket(inData, inLen, MAX_FRAME_SIZE, false, false);
   inLen = 0;
-  return (uint8_t*)pcmData;
+  if (samples < 0) {
+    outLen = 0;
+    return nullptr;
+  }
+  outLen = samples * channelCount * sizeof(int16_t);
+  return (uint8_t*)(pcmData + pcmStart * channelCount);
+}
+
+int32_t OPUSDecoder::decodeSamples(uint8_t* inData, uint32_t& inLen) {
+  if (!inData)
+    return -1;
+  if (readHeaderPacket(inData, inLen))
+    return 0;
+
+  int32_t samples = decodePacket(inData, inLen, MAX_FRAME_SIZE, false, true);
+  inLen = 0;
+  return samples;
+}
+
+int32_t OPUSDecoder::decodeFloat(const uint8_t* inData, uint32_t inLen,
+                                 PlanarBuffer& buffer) {
+  if (!inData)
+    return -1;
+  return appendFloat(
+      decodePacket(inData, inLen, MAX_FRAME_SIZE, false, true), buffer);
+}
+
+uint8_t* OPUSDecoder::conceal(uint32_t samples, uint32_t& outLen,
+                              const uint8_t* nextPacket, uint32_t nextLen) {
+  // without a next packet, or FEC data in it, opus falls back to PLC
+  int32_t decoded = decodePacket(nextPacket, nextPacket ? nextLen : 0, samples,
+                                 nextPacket != nullptr, false);
+  if (decoded < 0) {
+    outLen = 0;
+    return nullptr;
+  }
+  outLen = decoded * channelCount * sizeof(int16_t);
+  return (uint8_t*)(pcmData + pcmStart * channelCount);
+}
+
+int32_t OPUSDecoder::concealFloat(uint32_t samples, PlanarBuffer& buffer,
+                                  const uint8_t* nextPacket,
+                                  uint32_t nextLen) {
+  return appendFloat(decodePacket(nextPacket, nextPacket ? nextLen : 0,
+                                  samples, nextPacket != nullptr, true),
+                     buffer);
+}
+
+uint32_t OPUSDecoder::lastPacketSamples() {
+  opus_int32 samples = 0;
+  if (initialized)
+    opus_decoder_ctl(opus, OPUS_GET_LAST_PACKET_DURATION(&samples));
+  return samples;
+}
+
+int32_t OPUSDecoder::appendFloat(int32_t samples, PlanarBuffer& buffer) {
+  if (samples < 0)
+    return samples;
+  auto count = (uint32_t)std::min<size_t>(
+      samples, buffer.capacity - std::min(buffer.numSamples, buffer.capacity));
+  writeFloat(buffer, 0, count);
+  buffer.numSamples += count;
+  return count;
+}
+
+void OPUSDecoder::writeFloat(PlanarBuffer& buffer, uint32_t offset,
+                             uint32_t count) {
+  int channels = channelCount;
+  for (int channel = 0; channel < buffer.numChannels; channel++) {
+    const float* in = floatData + (floatStart + offset) * channels +
+                      std::min(channel, channels - 1);
+    float* out = buffer.data[channel] + buffer.numSamples;
+    for (uint32_t i = 0; i < count; i++)
+      out[i] = in[i * channels];
+  }
 }
@@ -0,0 +1,129 @@
+#include "PCMDecoder.h"
+
+#include <stdint.h>  // for uintptr_t, int16_t, int32_t
+#include <string.h>  // for memcpy
+
+#include "AudioContainer.h"  // for AudioContainer
+#include "CodecType.h"       // for AudioCodec, AudioCodec::PCM
+#include "PCMConverter.h"    // for convert, fromFloat, swapBytes
+
+using namespace bell;
+
+PCMDecoder::PCMDecoder() {}
+
+PCMDecoder::~PCMDecoder() {}
+
+bool PCMDecoder::setup(uint32_t sampleRate, uint8_t channelCount,
+                       uint8_t bitDepth) {
+  PCMContainer::Format format;
+  format.sampleRate = sampleRate;
+  format.channels = channelCount;
+  format.bitsPerSample = bitDepth;
+  return setup(format);
+}
+
+bool PCMDecoder::setup(const PCMContainer::Format& format) {
+  // nothing is decoded until set up again
+  this->format = format.isValid() ? format : PCMContainer::Format();
+  if (!format.isValid())
+    return false;
+  sourceBitDepth = format.bitsPerSample == 8 ? 16 : format.bitsPerSample;
+  sampleRate = format.sampleRate;
+  channelCount = format.channels;
+  bitDepth = 16;
+  return true;
+}
+
+bool PCMDecoder::setup(AudioContainer* container) {
+  if (container->getCodec() != AudioCodec::PCM)
+    return false;
+  auto* pcm = static_cast<PCMContainer*>(container);
+  pcm->parseSetupData();
+  return setup(pcm->getFormat());
+}
+
+void PCMDecoder::reset() {
+  BaseCodec::reset();
+  bitDepth = 16;
+}
+
+uint8_t PCMDecoder::setMaxBitDepth(uint8_t maxBitDepth) {
+  if (sourceBitDepth > 24 && maxBitDepth >= 32) {
+    bitDepth = 32;
+  } else if (sourceBitDepth > 16 && maxBitDepth >= 24) {
+    bitDepth = 24;
+  } else {
+    bitDepth = 16;
+  }
+  return bitDepth;
+}
+
+bool PCMDecoder::isPassthrough(const uint8_t* inData) const {
+  if (format.sampleFormat != PCMContainer::SampleFormat::SIGNED ||
+      format.bigEndian || format.bitsPerSample != bitDepth)
+    return false;
+  // samples are read as integers further on, which some targets can't do unaligned
+  uintptr_t alignment = bitDepth == 24 ? 1 : bitDepth / 8;
+  return (uintptr_t)inData % alignment == 0;
+}
+
+uint8_t* PCMDecoder::decode(uint8_t* inData, uint32_t& inLen,
+                            uint32_t& outLen) {
+  size_t frameSize = format.frameSize();
+  outLen = 0;
+  if (inData == nullptr || !frameSize)
+    return nullptr;
+
+  // whole frames only, the rest is left to the container
+  uint32_t frames = inLen / frameSize;
+  uint32_t len = frames * frameSize;
+  inLen -= len;
+  if (isPassthrough(inData)) {
+    outLen = len;
+    return inData;
+  }
+
+  // signed little endian samples at sourceBitDepth, in output
+  size_t count = (size_t)frames * format.channels;
+  if (output.size() < count * (sourceBitDepth / 8))
+    output.resize(count * (sourceBitDepth / 8));
+  const uint8_t* source = output.data();
+  switch (format.sampleFormat) {
+    case PCMContainer::SampleFormat::UNSIGNED: {
+      auto* out16 = (int16_t*)output.data();
+      for (size_t i = 0; i < count; i++)
+        out16[i] = (int16_t)((inData[i] - 128) * 256);
+      break;
+    }
+    case PCMContainer::SampleFormat::FLOAT: {
+      // converted in place, as floats and integers have the same size
+      if (format.bigEndian) {
+        PCMConverter::swapBytes(inData, output.data(), 32, count);
+      } else {
+        memcpy(output.data(), inData, len);
+      }
+      PCMConverter::fromFloat((const float*)output.data(), output.data(), 32,
+                              sizeof(float), count);
+      break;
+    }
+    case PCMContainer::SampleFormat::SIGNED:
+      if (format.bitsPerSample == 8) {
+        auto* out16 = (int16_t*)output.data();
+        for (size_t i = 0; i < count; i++)
+          out16[i] = (int16_t)((int8_t)inData[i] * 256);
+      } else if (format.bigEndian) {
+        PCMConverter::swapBytes(inData, output.data(), sourceBitDepth, count);
+      } else if ((uintptr_t)inData % (sourceBitDepth / 8) == 0 ||
+                 sourceBitDepth == 24) {
+        // narrowed straight from the input
+        source = inData;
+      } else {
+        memcpy(output.data(), inData, len);
+      }
+      break;
+  }
+
+  outLen = PCMConverter::convert(source, sourceBitDepth, output.data(),
+                                 bitDepth, count);
+  return output.data();
+}
@@ -1,13 +1,12 @@
 #include "VorbisDecoder.h"
 
-#include <stdlib.h>  // for free, malloc
+#include <stdlib.h>  // for free, malloc, realloc
+#include <string.h>  // for memcmp
+#include <vector>    // for vector
 
-#include "CodecType.h"     // for bell
-#include "config_types.h"  // for ogg_int16_t
-
-namespace bell {
-class AudioContainer;
-}  // namespace bell
+#include "AudioContainer.h"  // for AudioContainer
+#include "CodecType.h"       // for bell, AudioCodec, AudioCodec::VORBIS
+#include "config_types.h"    // for ogg_int16_t
 
 using namespace bell;
 
@@ -24,7 +23,8 @@ extern int vorbis_dsp_pcmout(vorbis_dsp_state* v, ogg_int16_t* pcm,
 extern int vorbis_dsp_read(vorbis_dsp_state* v, int samples);
 }
 
-#define VORBIS_BUF_SAMPLES 1024
+// a packet decodes to at most half of the largest (8192) block size
+#define VORBIS_BUF_SAMPLES 4096
 #define VORBIS_BUF_CHANNELS 2
 
 VorbisDecoder::VorbisDecoder() {
@@ -48,58 +48,82 @@ VorbisDecoder::VorbisDecoder() {
 }
 
 VorbisDecoder::~VorbisDecoder() {
-  vorbis_info_clear(vi);
-  vorbis_comment_clear(vc);
   if (vd)
     vorbis_dsp_destroy(vd);
   vd = nullptr;
+  vorbis_info_clear(vi);
+  vorbis_comment_clear(vc);
+  delete vi;
+  delete vc;
+  delete op.packet->buffer;
+  delete op.packet;
   free(pcmData);
 }
 
 bool VorbisDecoder::setup(AudioContainer* container) {
-  /*
   uint32_t setupLen;
   uint8_t* setup = container->getSetupData(setupLen, AudioCodec::VORBIS);
-  if (!setup)
+  if (!setup || !setupLen)
     return false;
-  op.b_o_s = true;                    // mark this page as beginning of stream
   uint32_t bytesLeft = setupLen - 1;  // minus header count length (8 bit)
   std::vector<uint32_t> headers(setup[0]);
+  uint8_t* sizeByte = (uint8_t*)setup + 1;
   for (uint8_t i = 0; i < setup[0]; i++) {
-    uint8_t* sizeByte = (uint8_t*)setup + 1 + i;
     headers[i] = 0;
-    while (*sizeByte == 255) {
+    while (*sizeByte == 255 && bytesLeft) {
       headers[i] += *(sizeByte++);
       bytesLeft--;
     }
-    headers[i] += *sizeByte;
+    headers[i] += *(sizeByte++);
     bytesLeft--;
   }
   // parse all headers from the setup data
+  lastErrno = 0;
   for (const auto& headerSize : headers) {
-    setPacket(setup + setupLen - bytesLeft, headerSize);
-    bytesLeft -= headerSize;
-    lastErrno = vorbis_dsp_headerin(vi, vc, &op);
-    if (lastErrno < 0) {
-      bytesLeft = 0;
-      break;
+    if (headerSize > bytesLeft ||
+        !readHeader(setup + setupLen - bytesLeft, headerSize)) {
+      return false;
     }
+    bytesLeft -= headerSize;
   }
   // parse last header, not present in header table (seems to happen for MP4 containers)
-  if (bytesLeft) {
-    setPacket(setup + setupLen - bytesLeft, bytesLeft);
-    lastErrno = vorbis_dsp_headerin(vi, vc, &op);
+  if (bytesLeft && !readHeader(setup + setupLen - bytesLeft, bytesLeft))
+    return false;
+  return vd != nullptr;
+}
+
+bool VorbisDecoder::readHeader(uint8_t* data, uint32_t len) {
+  if (!len)
+    return false;
+  if (data[0] == 0x01) {
+    // identification header, starts a new stream - the DSP state refers to vi
+    if (vd)
+      vorbis_dsp_destroy(vd);
+    vd = nullptr;
+    vorbis_info_clear(vi);
+    vorbis_info_init(vi);
+    vorbis_comment_clear(vc);
+    vorbis_comment_init(vc);
+    op.b_o_s = true;  // mark this page as beginning of stream
   }
+  setPacket(data, len);
+  lastErrno = vorbis_dsp_headerin(vi, vc, &op);
   // disable BOS to allow reading audio data
   op.b_o_s = false;
-  // set up the codec
-  if (vd)
-    vorbis_dsp_restart(vd);
-  else
+  if (lastErrno < 0)
+    return false;
+
+  if (data[0] == 0x05) {
+    // setup header, the last one - set up the codec
     vd = vorbis_dsp_create(vi);
-  return !lastErrno;
-  */
-  return false;
+    if (!vd)
+      return false;
+    sampleRate = vi->rate;
+    channelCount = vi->channels;
+    pcmData = (int16_t*)realloc(
+        pcmData, VORBIS_BUF_SAMPLES * vi->channels * sizeof(int16_t));
+  }
+  return true;
 }
 
 bool VorbisDecoder::setup(uint32_t sampleRate, uint8_t channelCount,
@@ -108,9 +132,25 @@ bool VorbisDecoder::setup(uint32_t sampleRate, uint8_t channelCount,
   return false;
 }
 
+void VorbisDecoder::reset() {
+  BaseCodec::reset();
+  if (vd)
+    vorbis_dsp_restart(vd);
+}
+
 uint8_t* VorbisDecoder::decode(uint8_t* inData, uint32_t& inLen,
                                uint32_t& outLen) {
-  if (!inData || !vi)
+  if (!inData || !inLen || !vi)
+    return nullptr;
+  if ((inData[0] & 0x01) && inLen > 7 &&
+      memcmp(inData + 1, "vorbis", 6) == 0) {
+    // headers of a chained stream
+    readHeader(inData, inLen);
+    inLen = 0;
+    outLen = 0;
+    return (uint8_t*)pcmData;
+  }
+  if (!vd)
     return nullptr;
   setPacket(inData, inLen);
   // sources:
@@ -25,6 +25,7 @@ class AACDecoder : public BaseCodec {
   bool setup(uint32_t sampleRate, uint8_t channelCount,
              uint8_t bitDepth) override;
   bool setup(AudioContainer* container) override;
+  void reset() override;
   uint8_t* decode(uint8_t* inData, uint32_t& inLen, uint32_t& outLen) override;
 };
 }  // namespace bell
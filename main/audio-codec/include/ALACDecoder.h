@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdint.h>  // for uint8_t, uint32_t
+#include <memory>    // for unique_ptr
+#include <vector>    // for vector
+
+#include "BaseCodec.h"  // for BaseCodec
+
+// Apple's reference decoder, from external/alac
+class ALACDecoder;
+
+namespace bell {
+class AudioContainer;
+
+/**
+ * Apple Lossless decoder, wrapping the vendored reference implementation.
+ *
+ * The decoder is configured from the ALAC magic cookie - the 24-byte ALACSpecificConfig,
+ * optionally wrapped in 'frma' and 'alac' atoms - and then decodes one ALAC packet per
+ * call. Setting it up with a sample rate, channel count and bit depth assumes the default
+ * encoder parameters, with frameLength samples per packet (352 for AirPlay streams).
+ *
+ * All buffers are allocated in setup, decoding itself doesn't allocate (packets are
+ * copied to a padded buffer, as the reference decoder reads past their end). Output is
+ * interleaved 16-bit PCM, unless native output is enabled, in which case 20- and 24-bit
+ * sources are returned as packed 24-bit, and 32-bit sources as 32-bit samples.
+ */
+class ALACDecoder : public BaseCodec {
+ public:
+  ALACDecoder();
+  ~ALACDecoder();
+  bool setup(uint32_t sampleRate, uint8_t channelCount,
+             uint8_t bitDepth) override;
+  bool setup(uint32_t sampleRate, uint8_t channelCount, uint8_t bitDepth,
+             uint32_t frameLength);
+  /**
+	 * Setup the codec using the ALAC magic cookie, as found in an MP4 'alac' atom or
+	 * a CAF 'kuki' chunk.
+	 */
+  bool setup(const uint8_t* cookie, uint32_t cookieSize);
+  /**
+	 * Setup the codec using the magic cookie carried by the container.
+	 */
+  bool setup(AudioContainer* container) override;
+  void reset() override;
+  uint8_t* decode(uint8_t* inData, uint32_t& inLen, uint32_t& outLen) override;
+  uint8_t setMaxBitDepth(uint8_t maxBitDepth) override;
+
+  /**
+	 * Return samples at the source's bit depth, instead of truncating them to 16 bits.
+	 * bitDepth is updated accordingly.
+	 */
+  void setNativeOutput(bool native);
+  /**
+	 * Bits per sample of the encoded stream.
+	 */
+  uint8_t getSourceBitDepth() const { return sourceBitDepth; }
+  /**
+	 * Samples per channel in a full packet.
+	 */
+  uint32_t getFrameLength() const { return frameLength; }
+
+ private:
+  std::unique_ptr<::ALACDecoder> alac;
+  bool nativeOutput = false;
+  // bits per sample when not native; 24 for 32-bit sources on 24-bit outputs
+  uint8_t narrowBitDepth = 16;
+  uint8_t sourceBitDepth = 16;
+  uint32_t frameLength = 0;
+  // one full packet, at the largest sample size
+  std::vector<uint8_t> output;
+  // packet being decoded, with room for the decoder's overreads
+  std::vector<uint8_t> input;
+
+  uint8_t nativeBitDepth() const;
+  uint8_t outputBitDepth() const;
+};
+}  // namespace bell
@@ -1,17 +1,56 @@
 #pragma once
 
-#include <memory>  // for shared_ptr
+#include <stddef.h>  // for size_t
+#include <memory>    // for shared_ptr
 
 #include "AudioContainer.h"  // for AudioContainer
 #include "BaseCodec.h"       // for BaseCodec
 #include "CodecType.h"       // for AudioCodec
 
+// decoders kept per codec type, unless set with AudioCodecs::setPoolSize()
+#ifndef BELL_CODEC_POOL_SIZE
+#define BELL_CODEC_POOL_SIZE 2
+#endif
+
 namespace bell {
+/**
+ * Decoder instances are pooled per codec type, so that every stream decodes with its
+ * own instance - concurrent streams (zones, preloading the next track) never share
+ * decoder state. The returned shared_ptr gives the instance back to the pool when
+ * released, after reset(); it's then reused by the next stream of the same type.
+ *
+ * Each pool holds at most poolSize instances, idle or in use. Once all are in use,
+ * getCodec() returns nullptr until one is released. Instances are created on demand,
+ * or up front with preallocate(), to take the allocations out of the playback path.
+ */
 class AudioCodecs {
  public:
+  /**
+	 * Get a decoder for the given codec type. The caller is responsible for setting it up.
+	 * @returns nullptr if the codec is unsupported, or its pool is exhausted
+	 */
   static std::shared_ptr<BaseCodec> getCodec(AudioCodec type);
+  /**
+	 * Get a decoder for the container's codec, set up from the container.
+	 */
   static std::shared_ptr<BaseCodec> getCodec(AudioContainer* container);
+  /**
+	 * Register a custom codec, used instead of the built-in one. The instance is shared
+	 * by all streams of this type, and not pooled.
+	 */
   static void addCodec(AudioCodec type,
                        const std::shared_ptr<BaseCodec>& codec);
+
+  /**
+	 * Create idle decoders of the given type, so that up to count streams can be started
+	 * without allocating. Limited by the pool size.
+	 * @returns false if the codec is unsupported
+	 */
+  static bool preallocate(AudioCodec type, size_t count);
+  /**
+	 * Set the maximum number of decoders of the given type. Idle decoders above the
+	 * limit are freed; ones in use are freed as they are released.
+	 */
+  static void setPoolSize(AudioCodec type, size_t size);
 };
 }  // namespace bell
@@ -1,6 +1,9 @@
 #pragma once
 
-#include <stdint.h>  // for uint32_t, uint8_t
+#include <stddef.h>  // for size_t
+#include <stdint.h>  // for uint32_t, uint8_t, int32_t
+
+#include "StreamInfo.h"  // for PlanarBuffer
 
 namespace bell {
 class AudioContainer;
@@ -8,12 +11,18 @@ class AudioContainer;
 class BaseCodec {
  private:
   uint32_t lastSampleLen, availableBytes;
+  // decode() output of the last decodeSamples(), for the default writeFloat()
+  uint8_t* lastOutput = nullptr;
+  // decoded samples per channel not yet written by decodeInto()
+  uint32_t pendingOffset = 0, pendingSamples = 0;
 
  public:
   uint32_t sampleRate = 44100;
   uint8_t channelCount = 2;
   uint8_t bitDepth = 16;
 
+  virtual ~BaseCodec() = default;
+
   /**
 	 * Setup the codec (sample rate, channel count, etc) using the specified container.
 	 */
@@ -23,6 +32,25 @@ class BaseCodec {
 	 */
   virtual bool setup(uint32_t sampleRate, uint8_t channelCount,
                      uint8_t bitDepth) = 0;
+  /**
+	 * Drop any decoding state kept from the previous stream. Called when a pooled
+	 * instance is returned, before it's handed to another stream and set up again, and
+	 * after seeking. Overrides must call BaseCodec::reset().
+	 */
+  virtual void reset();
+  /**
+	 * Tell the codec where decoding restarts after a seek and reset(), as returned by
+	 * AudioContainer::currentSample(). The default implementation ignores it.
+	 */
+  virtual void seekedTo(uint64_t sample) {}
+  /**
+	 * Let the codec output up to maxBitDepth bits per sample for high-resolution sources,
+	 * instead of 16. Call after setup(); reset() goes back to 16 bits. bitDepth is updated
+	 * accordingly, the default implementation keeps it.
+	 *
+	 * @return the resulting bitDepth
+	 */
+  virtual uint8_t setMaxBitDepth(uint8_t maxBitDepth) { return bitDepth; }
   /**
 	 * Decode the given sample.
 	 *
@@ -41,10 +69,39 @@ class BaseCodec {
 	 * @return pointer to decoded raw PCM audio data, allocated inside the codec object; nullptr on failure
 	 */
   uint8_t* decode(AudioContainer* container, uint32_t& outLen);
+  /**
+	 * Decode samples from the container straight into the caller's planar float buffer,
+	 * appending to it until maxSamples more samples per channel are written or it's full.
+	 * Decoded audio that doesn't fit is kept, and written first by the next call. Output
+	 * channels the source lacks repeat its last channel; extra source channels are dropped.
+	 *
+	 * @param [in] container media container to read samples from (the container's codec must match this instance)
+	 * @param [in,out] buffer caller-owned buffers, written from buffer.numSamples on
+	 * @param [in] maxSamples maximum number of samples per channel to write
+	 * @return samples per channel written; 0 at the end of the stream, or if a sample failed to decode
+	 */
+  size_t decodeInto(AudioContainer* container, PlanarBuffer& buffer,
+                    size_t maxSamples);
   /**
 	 * Last error that occurred, this is a codec-specific value.
 	 * This may be set by a codec upon decoding failure.
 	 */
   int lastErrno = -1;
+
+ protected:
+  /**
+	 * Decode the given sample for decodeInto(), keeping the result inside the codec object
+	 * until it's written by writeFloat(). The default implementation uses decode().
+	 *
+	 * @return samples per channel decoded; negative on failure
+	 */
+  virtual int32_t decodeSamples(uint8_t* inData, uint32_t& inLen);
+  /**
+	 * Convert count samples per channel of the last decodeSamples() result, starting at
+	 * offset, into buffer at buffer.numSamples. The default implementation reads the
+	 * interleaved integer PCM returned by decode(), at bitDepth.
+	 */
+  virtual void writeFloat(PlanarBuffer& buffer, uint32_t offset,
+                          uint32_t count);
 };
 }  // namespace bell
@@ -8,6 +8,9 @@ enum class AudioCodec {
   VORBIS = 3,
   OPUS = 4,
   FLAC = 5,
+  ALAC = 6,
+  // uncompressed, from WAV, AIFF or raw streams
+  PCM = 7,
 };
 
 }
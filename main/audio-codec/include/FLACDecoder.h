@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>  // for uint8_t, uint32_t, int32_t
+#include <vector>    // for vector
+
+#include "BaseCodec.h"  // for BaseCodec
+
+namespace bell {
+class AudioContainer;
+
+/**
+ * Native FLAC decoder, for frames returned by FLACContainer.
+ *
+ * Supports 8 to 32 bits per sample (16 and 24 being the common ones) and up to
+ * 8 channels. Decoded audio is interleaved, and converted to the configured output
+ * format - bitDepth is updated accordingly. FLOAT_PLANAR returns one block of floats
+ * in [-1, 1) per channel, for DSP code working on planar data.
+ */
+class FLACDecoder : public BaseCodec {
+ public:
+  enum class OutputFormat { PCM_16, PCM_24, PCM_32, FLOAT_PLANAR };
+
+  FLACDecoder();
+  ~FLACDecoder();
+  bool setup(uint32_t sampleRate, uint8_t channelCount,
+             uint8_t bitDepth) override;
+  bool setup(AudioContainer* container) override;
+  void reset() override;
+  uint8_t* decode(uint8_t* inData, uint32_t& inLen, uint32_t& outLen) override;
+  uint8_t setMaxBitDepth(uint8_t maxBitDepth) override;
+
+  /**
+	 * Set the format of the decoded audio. Defaults to PCM_16, higher resolution sources
+	 * being truncated; setMaxBitDepth() picks the format from the source's bit depth.
+	 */
+  void setOutputFormat(OutputFormat format);
+  /**
+	 * Bits per sample of the encoded stream.
+	 */
+  uint8_t getSourceBitDepth() const { return sourceBitDepth; }
+
+ protected:
+  // planar blocks are written as they are, at any output format
+  int32_t decodeSamples(uint8_t* inData, uint32_t& inLen) override;
+  void writeFloat(PlanarBuffer& buffer, uint32_t offset,
+                  uint32_t count) override;
+
+ private:
+  OutputFormat outputFormat = OutputFormat::PCM_16;
+  // from STREAMINFO, used when a frame header doesn't specify them
+  uint32_t streamSampleRate = 44100;
+  uint8_t streamBitDepth = 16;
+  uint8_t sourceBitDepth = 16;
+
+  // decoded samples, one block per channel
+  std::vector<int32_t> samples;
+  uint32_t decodedBlockSize = 0;
+  std::vector<uint8_t> output;
+
+  void decorrelate(uint8_t channelAssignment, uint32_t blockSize);
+  uint32_t convertOutput(uint32_t blockSize, uint8_t channels, uint8_t bps);
+};
+}  // namespace bell
@@ -1,6 +1,6 @@
 #pragma once
 
-#include <stdint.h>  // for uint8_t, uint32_t, int16_t
+#include <stdint.h>  // for uint8_t, uint32_t, int16_t, uint64_t
 
 #include "BaseCodec.h"  // for BaseCodec
 #include "mp3dec.h"     // for HMP3Decoder, MP3FrameInfo
@@ -13,6 +13,17 @@ class MP3Decoder : public BaseCodec {
   HMP3Decoder mp3;
   int16_t* pcmData;
   MP3FrameInfo frame = {};
+  // gapless trimming, from the container: delay and samples between it and the
+  // padding, then the delay still to drop and samples left to output
+  uint32_t delaySamples = 0;
+  uint64_t validSamples = 0;
+  uint32_t skipSamples = 0;
+  uint64_t remainingSamples = 0;
+  bool trimEnd = false;
+  bool hasGapless = false;
+
+  // applies the trimming to a frame of samples, returns how many to skip
+  uint32_t trim(uint32_t& samples);
 
  public:
   MP3Decoder();
@@ -20,7 +31,14 @@ class MP3Decoder : public BaseCodec {
   bool setup(uint32_t sampleRate, uint8_t channelCount,
              uint8_t bitDepth) override;
 
+  /**
+	 * Also sets up gapless trimming, if the container knows the encoder delay and padding.
+	 * reset() suspends it, as the position is unknown after seeking, until seekedTo()
+	 * tells it.
+	 */
   bool setup(AudioContainer* container) override;
+  void reset() override;
+  void seekedTo(uint64_t sample) override;
   uint8_t* decode(uint8_t* inData, uint32_t& inLen, uint32_t& outLen) override;
 };
 }  // namespace bell
@@ -7,16 +7,88 @@
 struct OpusDecoder;
 
 namespace bell {
+class AudioContainer;
+
+/**
+ * Opus decoder, for Ogg Opus streams and for packets handed over without a container,
+ * e.g. from RTP.
+ *
+ * The decoder state is allocated once, for stereo; setting it up again for another
+ * stream initializes it in place, or only resets it when the format is the same.
+ *
+ * Network sources that lose a packet can call conceal() (or concealFloat()) in its
+ * place, instead of waiting for it. When the packet after the lost one already arrived,
+ * its in-band FEC data, if any, rebuilds the lost one; otherwise the decoder extrapolates
+ * from the previous audio (PLC).
+ */
 class OPUSDecoder : public BaseCodec {
  private:
   OpusDecoder* opus;
+  // whether opus was initialized, at sampleRate and channelCount
+  bool initialized = false;
   int16_t* pcmData;
+  uint32_t pcmStart = 0;
+  // interleaved, for decodeInto()
+  float* floatData;
+  uint32_t floatStart = 0;
+  // decoded samples still to be dropped, from the stream's pre-skip
+  uint32_t skipSamples = 0;
+
+  bool setupHead(const uint8_t* head, uint32_t len);
+  bool readHeaderPacket(uint8_t* inData, uint32_t& inLen);
+  uint32_t skip(uint32_t samples);
+  /**
+	 * Decode into pcmData from pcmStart, or floatData from floatStart, see opus_decode().
+	 * @return samples per channel decoded, pre-skip excluded; negative on failure
+	 */
+  int32_t decodePacket(const uint8_t* inData, uint32_t inLen,
+                       uint32_t frameSize, bool fec, bool toFloat);
+  int32_t appendFloat(int32_t samples, PlanarBuffer& buffer);
 
  public:
   OPUSDecoder();
   ~OPUSDecoder();
   bool setup(uint32_t sampleRate, uint8_t channelCount,
              uint8_t bitDepth) override;
+  bool setup(AudioContainer* container) override;
+  void reset() override;
   uint8_t* decode(uint8_t* inData, uint32_t& inLen, uint32_t& outLen) override;
+
+  /**
+	 * Decode a packet into the caller's planar float buffer, appending at buffer.numSamples.
+	 * The buffer should have room for the longest packet, 120 ms; samples that don't fit
+	 * are dropped.
+	 *
+	 * @return samples per channel written; negative on failure
+	 */
+  int32_t decodeFloat(const uint8_t* inData, uint32_t inLen,
+                      PlanarBuffer& buffer);
+  /**
+	 * Conceal a lost packet, in place of decoding it.
+	 *
+	 * @param [in] samples duration of the lost packet, per channel, a multiple of 2.5 ms; lastPacketSamples() if unknown
+	 * @param [out] outLen size of output PCM data, in bytes
+	 * @param [in] nextPacket the packet following the lost one, if it already arrived; it must still be decoded afterwards
+	 * @return pointer to decoded raw PCM audio data, as decode(); nullptr on failure
+	 */
+  uint8_t* conceal(uint32_t samples, uint32_t& outLen,
+                   const uint8_t* nextPacket = nullptr, uint32_t nextLen = 0);
+  /**
+	 * Conceal a lost packet into the caller's planar float buffer, see conceal() and
+	 * decodeFloat().
+	 */
+  int32_t concealFloat(uint32_t samples, PlanarBuffer& buffer,
+                       const uint8_t* nextPacket = nullptr,
+                       uint32_t nextLen = 0);
+  /**
+	 * Duration of the last decoded (or concealed) packet, per channel.
+	 */
+  uint32_t lastPacketSamples();
+
+ protected:
+  // decoded as float, without going through 16-bit samples
+  int32_t decodeSamples(uint8_t* inData, uint32_t& inLen) override;
+  void writeFloat(PlanarBuffer& buffer, uint32_t offset,
+                  uint32_t count) override;
 };
 }  // namespace bell
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>  // for uint8_t, uint32_t
+#include <vector>    // for vector
+
+#include "BaseCodec.h"     // for BaseCodec
+#include "PCMContainer.h"  // for PCMContainer
+
+namespace bell {
+class AudioContainer;
+
+/**
+ * "Decoder" for the uncompressed PCM of PCMContainer, WAVContainer and AIFFContainer.
+ *
+ * Blocks of signed little endian samples at the output bit depth are returned as they
+ * are, pointing into the container's window: there's no copy from the input to the DSP.
+ * Anything else is converted into a buffer of the decoder - big endian samples are
+ * byte-swapped, 8-bit ones widened to 16 bits, floats converted to 32-bit integers - and
+ * then narrowed to the output bit depth, 16 unless setMaxBitDepth() allows more.
+ */
+class PCMDecoder : public BaseCodec {
+ public:
+  PCMDecoder();
+  ~PCMDecoder();
+  /**
+	 * Setup the codec for signed little endian samples of bitDepth bits.
+	 */
+  bool setup(uint32_t sampleRate, uint8_t channelCount,
+             uint8_t bitDepth) override;
+  bool setup(const PCMContainer::Format& format);
+  bool setup(AudioContainer* container) override;
+  void reset() override;
+  uint8_t* decode(uint8_t* inData, uint32_t& inLen, uint32_t& outLen) override;
+  uint8_t setMaxBitDepth(uint8_t maxBitDepth) override;
+
+ private:
+  PCMContainer::Format format;
+  // signed integer samples the input is converted to, before narrowing
+  uint8_t sourceBitDepth = 16;
+  std::vector<uint8_t> output;
+
+  bool isPassthrough(const uint8_t* inData) const;
+};
+}  // namespace bell
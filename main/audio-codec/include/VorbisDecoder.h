@@ -24,8 +24,10 @@ class VorbisDecoder : public BaseCodec {
              uint8_t bitDepth) override;
   uint8_t* decode(uint8_t* inData, uint32_t& inLen, uint32_t& outLen) override;
   bool setup(AudioContainer* container) override;
+  void reset() override;
 
  private:
   void setPacket(uint8_t* inData, uint32_t inLen) const;
+  bool readHeader(uint8_t* data, uint32_t len);
 };
 }  // namespace bell
@@ -1,8 +1,9 @@
 #include "ADTSContainer.h"
 
-#include <cstring>  // for memmove
+#include <algorithm>  // for max, min
 #include <iostream>
 
+#include "BellLogger.h"  // for AbstractLogger, BELL_LOG
 #include "StreamInfo.h"  // for BitWidth, BitWidth::BW_16, SampleRate, Sampl...
 // #include "aacdec.h"      // for AACFindSyncWord
 
@@ -23,107 +24,243 @@ using namespace bell;
 #define AAC_ADTS_FRAME_GETSIZE(buf) \
   ((buf[3] & 0x03) << 11 | buf[4] << 3 | buf[5] >> 5)
 
+// frames decoded before a seek target, for the transform overlap
+#define AAC_SEEK_PREROLL 1
+// frame headers walked past the indexed range, before estimating instead
+#define AAC_MAX_SCAN_FRAMES 256
+
 ADTSContainer::ADTSContainer(std::istream& istr, const std::byte* headingBytes)
-    : bell::AudioContainer(istr) {
-  if (headingBytes != nullptr) {
-    memcpy(buffer.data(), headingBytes, 7);
-    bytesInBuffer = 7;
-  }
-}
+    : bell::AudioContainer(istr),
+      window(istr, BUFFER_SIZE, headingBytes, headingBytes ? 14 : 0) {}
 
 bool ADTSContainer::fillBuffer() {
-  if (this->bytesInBuffer < AAC_MAX_FRAME_SIZE * 2) {
-    this->istr.read((char*)buffer.data() + bytesInBuffer,
-                    buffer.size() - bytesInBuffer);
-    this->bytesInBuffer += istr.gcount();
-  }
-  return this->bytesInBuffer >= AAC_MAX_FRAME_SIZE;
+  window.ensure(AAC_MAX_FRAME_SIZE * 2);
+  // the last frames are shorter than that
+  return window.available() >= AAC_MAX_FRAME_SIZE ||
+         (window.eof() && window.available() > 0);
 }
 
 bool ADTSContainer::resyncADTS() {
-  int resyncOffset = 0;
+  const uint8_t* data = window.data();
+  size_t validBytes = window.available();
+  size_t resyncOffset = 0;
   bool resyncValid = false;
 
-  size_t validBytes = bytesInBuffer - dataOffset;
-
-  while (!resyncValid && resyncOffset < validBytes) {
-    uint8_t* buf = (uint8_t*)this->buffer.data() + dataOffset + resyncOffset;
-    if (AAC_ADTS_SYNC_VERIFY(buf)) {
-      // Read frame size, and check if a consecutive frame is available
-      uint32_t frameSize = AAC_ADTS_FRAME_GETSIZE(buf);
-
-      if (frameSize + resyncOffset > validBytes) {
-        // Not enough data, discard this frame
-        resyncOffset++;
-        continue;
-      }
-
-      buf =
-          (uint8_t*)this->buffer.data() + dataOffset + resyncOffset + frameSize;
-
-      if (AAC_ADTS_SYNC_VERIFY(buf)) {
-        buf += AAC_ADTS_FRAME_GETSIZE(buf);
-        if (AAC_ADTS_SYNC_VERIFY(buf)) {
-          protectionAbsent = (buf[1] & 1);
-
-          // Found 3 consecutive frames, resynced
-          resyncValid = true;
-        }
-      }
-    } else {
-      resyncOffset++;
+  for (; resyncOffset < validBytes; resyncOffset++) {
+    resyncOffset += FrameHeader::findSync(data + resyncOffset,
+                                          validBytes - resyncOffset,
+                                          FrameHeader::ADTS_SYNC);
+    FrameHeader::Info info;
+    if (resyncOffset + FrameHeader::ADTS_HEADER_SIZE > validBytes ||
+        !FrameHeader::parseADTS(data + resyncOffset, info)) {
+      continue;
+    }
+
+    // Check if two consecutive frames follow, discard this one if they don't,
+    // or if there's not enough data
+    size_t next = resyncOffset + info.frameSize;
+    FrameHeader::Info nextInfo;
+    if (next + FrameHeader::ADTS_HEADER_SIZE > validBytes ||
+        !FrameHeader::parseADTS(data + next, nextInfo)) {
+      continue;
+    }
+    next += nextInfo.frameSize;
+    if (next + 2 <= validBytes && AAC_ADTS_SYNC_VERIFY((data + next))) {
+      protectionAbsent = (data[resyncOffset + 1] & 1);
+
+      // Found 3 consecutive frames, resynced
+      resyncValid = true;
+      break;
     }
   }
 
-  dataOffset += resyncOffset;
+  window.consume(resyncOffset);
   return resyncValid;
 }
 
 void ADTSContainer::consumeBytes(uint32_t len) {
-  dataOffset += len;
+  window.consume(len);
 }
 
 std::byte* ADTSContainer::readSample(uint32_t& len) {
-  // Align data if previous read was offseted
-  if (dataOffset > 0 && bytesInBuffer > 0) {
-    size_t toConsume = std::min(dataOffset, bytesInBuffer);
-    memmove(buffer.data(), buffer.data() + toConsume,
-            buffer.size() - toConsume);
-
-    dataOffset -= toConsume;
-    bytesInBuffer -= toConsume;
-  }
+  if (!setupParsed)
+    parseSetupData();
 
   if (!this->fillBuffer()) {
+    if (indexing && window.eof())
+      frameIndex.setComplete();
     len = 0;
     return nullptr;
   }
 
-  uint8_t* buf = (uint8_t*)buffer.data() + dataOffset;
+  uint8_t* buf = window.data();
 
   if (!AAC_ADTS_SYNC_VERIFY(buf)) {
     if (!resyncADTS()) {
       len = 0;
       return nullptr;
     }
+    // the frame may extend past the bytes that were scanned
+    fillBuffer();
+    buf = window.data();
   } else {
     protectionAbsent = (buf[1] & 1);
   }
 
   len = AAC_ADTS_FRAME_GETSIZE(buf);
 
-  if (len > bytesInBuffer - dataOffset) {
+  if (len > window.available()) {
     if (!resyncADTS()) {
       len = 0;
       return nullptr;
     }
   }
 
-  return buffer.data() + dataOffset;
+  FrameHeader::Info info;
+  if (window.available() >= FrameHeader::ADTS_HEADER_SIZE &&
+      FrameHeader::parseADTS(window.data(), info)) {
+    len = info.frameSize;
+    trackFrame(info);
+  }
+
+  return (std::byte*)window.data();
+}
+
+void ADTSContainer::trackFrame(const FrameHeader::Info& info) {
+  uint64_t offset = window.offset();
+  // same frame, or a false sync inside of it
+  if (frameKnown && offset < frameEnd)
+    return;
+  if (frameKnown)
+    frameSample += frameSamples;
+  frameKnown = true;
+  frameSamples = info.samples;
+  frameEnd = offset + info.frameSize;
+  if (indexing)
+    frameIndex.addFrame(offset, info.frameSize, info.samples);
 }
 
 void ADTSContainer::parseSetupData() {
+  if (setupParsed)
+    return;
+  setupParsed = true;
   channels = 2;
   sampleRate = bell::SampleRate::SR_44100;
   bitWidth = bell::BitWidth::BW_16;
+
+  fillBuffer();
+  FrameHeader::Info info;
+  if (window.available() < FrameHeader::ADTS_HEADER_SIZE ||
+      !FrameHeader::parseADTS(window.data(), info)) {
+    if (!resyncADTS() || !FrameHeader::parseADTS(window.data(), info)) {
+      BELL_LOG(error, "ADTSContainer", "No ADTS frame found");
+      return;
+    }
+  }
+  // 0 when given by a program config element
+  if (info.channels)
+    channels = info.channels;
+  streamSampleRate = info.sampleRate;
+  sampleRate = static_cast<bell::SampleRate>(info.sampleRate);
+  samplesPerFrame = info.samples;
+  firstFrameSize = info.frameSize;
+
+  if (window.isSeekable()) {
+    dataStart = window.offset();
+    frameIndex.begin(dataStart);
+    indexing = true;
+  }
+}
+
+uint64_t ADTSContainer::bytesPerBlock() {
+  FrameIndex::Entry end = frameIndex.end();
+  if (end.sample >= samplesPerFrame * FrameIndex::INTERVAL)
+    return (end.offset - dataStart) * 1024 / end.sample;
+  return (uint64_t)firstFrameSize * 1024 / samplesPerFrame;
+}
+
+uint64_t ADTSContainer::duration() {
+  if (!setupParsed)
+    parseSetupData();
+  if (frameIndex.isComplete())
+    return frameIndex.end().sample;
+  if (dataStart < 0 || !samplesPerFrame)
+    return 0;
+
+  // estimated from the stream size, once
+  if (dataEnd < 0)
+    dataEnd = window.streamSize();
+  uint64_t bytes = bytesPerBlock();
+  if (dataEnd <= dataStart || !bytes)
+    return 0;
+  return std::max<uint64_t>((dataEnd - dataStart) * 1024 / bytes,
+                            frameIndex.end().sample);
+}
+
+bool ADTSContainer::seekTo(uint64_t offset, uint64_t sample) {
+  if (!window.seek(offset))
+    return false;
+  frameKnown = false;
+  frameSample = sample;
+  return true;
+}
+
+void ADTSContainer::scanTo(uint64_t sample) {
+  // walk the frame headers, without decoding
+  FrameHeader::Info info;
+  while (fillBuffer()) {
+    const uint8_t* data = window.data();
+    if (window.available() < FrameHeader::ADTS_HEADER_SIZE ||
+        !FrameHeader::parseADTS(data, info)) {
+      // lost sync, e.g. on junk between frames
+      if (!resyncADTS())
+        break;
+      continue;
+    }
+    if (frameSample + info.samples > sample)
+      return;
+    if (indexing)
+      frameIndex.addFrame(window.offset(), info.frameSize, info.samples);
+    frameSample += info.samples;
+    window.consume(info.frameSize);
+  }
+  if (indexing && window.eof())
+    frameIndex.setComplete();
+  BELL_LOG(debug, "ADTSContainer", "Seeked past the last frame");
+}
+
+bool ADTSContainer::seekToSample(uint64_t sample) {
+  if (!setupParsed)
+    parseSetupData();
+  if (dataStart < 0 || !samplesPerFrame)
+    return false;
+
+  uint64_t target =
+      sample - std::min<uint64_t>(sample, AAC_SEEK_PREROLL * samplesPerFrame);
+
+  FrameIndex::Entry entry;
+  if (!frameIndex.find(target, entry)) {
+    entry = frameIndex.end();
+    if (!frameIndex.isComplete() &&
+        target - entry.sample >= AAC_MAX_SCAN_FRAMES * samplesPerFrame) {
+      // too far past the indexed range, estimated from the average bitrate
+      uint64_t frameStart = target / samplesPerFrame * samplesPerFrame;
+      uint64_t offset = dataStart + frameStart * bytesPerBlock() / 1024;
+      if (!seekTo(offset, frameStart))
+        return false;
+      // the index can't be extended from an estimated position
+      indexing = false;
+      fillBuffer();
+      if (!resyncADTS())
+        BELL_LOG(debug, "ADTSContainer", "Seeked past the last frame");
+      return true;
+    }
+  }
+
+  // from the closest indexed frame, or the end of the indexed range
+  if (!seekTo(entry.offset, entry.sample))
+    return false;
+  indexing = true;
+  scanTo(target);
+  return true;
 }
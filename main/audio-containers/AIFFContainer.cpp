@@ -0,0 +1,138 @@
+#include "AIFFContainer.h"
+
+#include <string.h>   // for memcmp
+#include <algorithm>  // for min
+
+#include "BellLogger.h"  // for AbstractLogger, BELL_LOG
+
+using namespace bell;
+
+#define AIFF_FORM_HEADER_SIZE 12
+#define AIFF_CHUNK_HEADER_SIZE 8
+#define AIFF_COMM_SIZE 18
+// with the compression type, its name isn't needed
+#define AIFC_COMM_SIZE 22
+#define AIFF_SSND_HEADER_SIZE 8
+#define AIFF_EXTENDED_BIAS 16383
+
+static uint64_t readBE(const uint8_t* buf, uint8_t size) {
+  uint64_t value = 0;
+  for (uint8_t i = 0; i < size; i++) {
+    value = (value << 8) | buf[i];
+  }
+  return value;
+}
+
+// 80-bit IEEE 754 extended precision, as used for the sample rate
+static uint32_t readExtended(const uint8_t* buf) {
+  int exponent = (int)(readBE(buf, 2) & 0x7fff) - AIFF_EXTENDED_BIAS;
+  uint64_t mantissa = readBE(buf + 2, 8);
+  if ((buf[0] & 0x80) || exponent < 0 || exponent > 31)
+    return 0;
+  return mantissa >> (63 - exponent);
+}
+
+AIFFContainer::AIFFContainer(std::istream& istr, const std::byte* headingBytes)
+    : PCMContainer(istr, headingBytes) {}
+
+bool AIFFContainer::parseHeader() {
+  uint8_t form[AIFF_FORM_HEADER_SIZE];
+  if (!readHeader(form, sizeof(form)) || memcmp(form, "FORM", 4) != 0 ||
+      (memcmp(form + 8, "AIFF", 4) != 0 && memcmp(form + 8, "AIFC", 4) != 0)) {
+    BELL_LOG(error, "AIFFContainer", "Missing FORM AIFF header");
+    return false;
+  }
+  bool aifc = memcmp(form + 8, "AIFC", 4) == 0;
+
+  bool commonParsed = false;
+  bool soundFound = false;
+  // of the samples in SSND, which may come first
+  uint64_t soundOffset = 0, soundSize = 0;
+  uint8_t chunk[AIFF_CHUNK_HEADER_SIZE];
+  while (readHeader(chunk, sizeof(chunk))) {
+    uint32_t size = readBE(chunk + 4, 4);
+    // chunks are padded to an even size
+    uint64_t padded = (uint64_t)size + (size & 1);
+
+    if (memcmp(chunk, "COMM", 4) == 0) {
+      uint8_t comm[AIFC_COMM_SIZE];
+      size_t len = std::min<size_t>(size, sizeof(comm));
+      if (size < AIFF_COMM_SIZE || !readHeader(comm, len) ||
+          !parseCommon(comm, len, aifc))
+        return false;
+      window.skip(padded - len);
+      commonParsed = true;
+      if (soundFound) {
+        dataOffset = soundOffset;
+        dataSize = soundSize;
+        break;
+      }
+    } else if (memcmp(chunk, "SSND", 4) == 0 &&
+               size >= AIFF_SSND_HEADER_SIZE) {
+      uint8_t ssnd[AIFF_SSND_HEADER_SIZE];
+      if (!readHeader(ssnd, sizeof(ssnd)))
+        return false;
+      // samples start after offset bytes, usually 0
+      uint32_t body = size - sizeof(ssnd);
+      uint32_t offset = std::min<uint32_t>(readBE(ssnd, 4), body);
+      soundFound = true;
+      soundOffset = window.offset() + offset;
+      soundSize = body - offset;
+      if (commonParsed) {
+        window.skip(offset);
+        dataOffset = window.offset();
+        dataSize = soundSize;
+        break;
+      }
+      if (!window.isSeekable()) {
+        BELL_LOG(error, "AIFFContainer",
+                 "Sound data before the COMM chunk, on an unseekable input");
+        return false;
+      }
+      window.skip(padded - sizeof(ssnd));
+    } else {
+      window.skip(padded);
+    }
+  }
+
+  if (!commonParsed || !soundFound || !window.seek(dataOffset)) {
+    BELL_LOG(error, "AIFFContainer", "Missing COMM or SSND chunk");
+    return false;
+  }
+  // SSND may be padded beyond the frames
+  if (commFrames)
+    dataSize = std::min(dataSize, commFrames * format.frameSize());
+  return true;
+}
+
+bool AIFFContainer::parseCommon(const uint8_t* comm, size_t len, bool aifc) {
+  format.channels = readBE(comm, 2);
+  commFrames = readBE(comm + 2, 4);
+  format.validBits = readBE(comm + 6, 2);
+  format.bitsPerSample = (format.validBits + 7) / 8 * 8;
+  format.sampleRate = readExtended(comm + 8);
+  format.sampleFormat = SampleFormat::SIGNED;
+  format.bigEndian = true;
+  if (!aifc || len < AIFC_COMM_SIZE)
+    return true;
+
+  const uint8_t* type = comm + AIFF_COMM_SIZE;
+  if (memcmp(type, "NONE", 4) == 0 || memcmp(type, "twos", 4) == 0) {
+    return true;
+  } else if (memcmp(type, "sowt", 4) == 0) {
+    format.bigEndian = false;
+  } else if (memcmp(type, "in24", 4) == 0 || memcmp(type, "in32", 4) == 0) {
+    format.bitsPerSample = format.validBits = type[3] == '4' ? 24 : 32;
+  } else if (memcmp(type, "fl32", 4) == 0 || memcmp(type, "FL32", 4) == 0) {
+    format.sampleFormat = SampleFormat::FLOAT;
+    format.bitsPerSample = format.validBits = 32;
+  } else if (memcmp(type, "raw ", 4) == 0) {
+    format.sampleFormat = SampleFormat::UNSIGNED;
+    format.bitsPerSample = format.validBits = 8;
+  } else {
+    BELL_LOG(error, "AIFFContainer", "Unsupported compression type %.4s",
+             (const char*)type);
+    return false;
+  }
+  return true;
+}
@@ -1,12 +1,19 @@
 #include "AudioContainers.h"
 
-#include <string.h>      // for memcmp
+#include <string.h>      // for memcmp, memmove
 #include <cstddef>       // for byte
 #include "BellLogger.h"  // for BellLogger
 
 #include "ADTSContainer.h"  // for AACContainer
+#include "AIFFContainer.h"  // for AIFFContainer
 #include "CodecType.h"      // for bell
+#include "FLACContainer.h"  // for FLACContainer
+#include "FrameHeader.h"    // for Info, parseMP3
+#include "ID3Tag.h"         // for ID3Tag
 #include "MP3Container.h"   // for MP3Container
+#include "MP4Container.h"   // for MP4Container
+#include "OggContainer.h"   // for OggContainer
+#include "WAVContainer.h"   // for WAVContainer
 
 namespace bell {
 class AudioContainer;
@@ -14,26 +21,105 @@ class AudioContainer;
 
 using namespace bell;
 
+// move past a tag, with a seek if the stream allows, so that embedded pictures aren't
+// downloaded before the first frame
+static void skipTag(std::istream& istr, uint64_t len) {
+  std::streamoff position = istr.tellg();
+  if (position >= 0 && istr.seekg(position + (std::streamoff)len))
+    return;
+  istr.clear();
+  istr.ignore(len);
+}
+
 std::unique_ptr<bell::AudioContainer> AudioContainers::guessAudioContainer(
     std::istream& istr) {
   std::byte tmp[14];
+  std::streamoff tagOffset = istr.tellg();
   istr.read((char*)tmp, sizeof(tmp));
+  bool complete = istr.gcount() == sizeof(tmp);
+  FrameHeader::Info mp3Info;
+
+  // ID3v2 tags precede AAC and FLAC streams too, guess from what follows
+  ID3Tag id3Tag;
+  uint32_t tagSize;
+  while (complete && (tagSize = ID3Tag::tagSize((const uint8_t*)tmp))) {
+    BELL_LOG(info, "AudioContainers", "Skipping %u bytes of ID3v2 tag",
+             tagSize);
+    if (!id3Tag.exists() && tagOffset >= 0)
+      id3Tag = ID3Tag(tagOffset, tagSize);
+    if (tagOffset >= 0)
+      tagOffset += tagSize;
+
+    size_t kept = 0;
+    if (tagSize < sizeof(tmp)) {
+      // empty tag, the stream starts within the bytes read
+      kept = sizeof(tmp) - tagSize;
+      memmove(tmp, tmp + tagSize, kept);
+    } else {
+      skipTag(istr, tagSize - sizeof(tmp));
+    }
+    istr.read((char*)tmp + kept, sizeof(tmp) - kept);
+    complete = (size_t)istr.gcount() == sizeof(tmp) - kept;
+    if (!complete) {
+      // what's left of the header read would pass for an MP3 stream
+      BELL_LOG(error, "AudioContainers", "Stream ends within its ID3v2 tag");
+      return nullptr;
+    }
+  }
 
+  std::unique_ptr<bell::AudioContainer> container;
   if (memcmp(tmp, "\xFF\xF1", 2) == 0 || memcmp(tmp, "\xFF\xF9", 2) == 0) {
     // AAC found
     BELL_LOG(info, "AudioContainers",
              "Mime guesser found AAC in ADTS format, creating ADTSContainer");
-    return std::make_unique<bell::ADTSContainer>(istr, tmp);
-  } else if (memcmp(tmp, "\xFF\xFB", 2) == 0 ||
+    container = std::make_unique<bell::ADTSContainer>(istr, tmp);
+  } else if (FrameHeader::parseMP3((const uint8_t*)tmp, mp3Info) ||
              memcmp(tmp, "\x49\x44\x33", 3) == 0) {
     // MP3 Found
     BELL_LOG(info, "AudioContainers",
              "Mime guesser found MP3 format, creating MP3Container");
 
-    return std::make_unique<bell::MP3Container>(istr, tmp);
+    container = std::make_unique<bell::MP3Container>(istr, tmp);
+  } else if (memcmp(tmp, "fLaC", 4) == 0) {
+    // FLAC found
+    BELL_LOG(info, "AudioContainers",
+             "Mime guesser found FLAC format, creating FLACContainer");
+
+    container = std::make_unique<bell::FLACContainer>(istr, tmp);
+  } else if (memcmp(tmp, "OggS", 4) == 0) {
+    // Ogg found, Vorbis or Opus
+    BELL_LOG(info, "AudioContainers",
+             "Mime guesser found Ogg format, creating OggContainer");
+
+    container = std::make_unique<bell::OggContainer>(istr, tmp);
+  } else if ((memcmp(tmp, "RIFF", 4) == 0 || memcmp(tmp, "RF64", 4) == 0) &&
+             memcmp(tmp + 8, "WAVE", 4) == 0) {
+    // WAV found
+    BELL_LOG(info, "AudioContainers",
+             "Mime guesser found WAV format, creating WAVContainer");
+
+    container = std::make_unique<bell::WAVContainer>(istr, tmp);
+  } else if (memcmp(tmp, "FORM", 4) == 0 &&
+             (memcmp(tmp + 8, "AIFF", 4) == 0 ||
+              memcmp(tmp + 8, "AIFC", 4) == 0)) {
+    // AIFF found
+    BELL_LOG(info, "AudioContainers",
+             "Mime guesser found AIFF format, creating AIFFContainer");
+
+    container = std::make_unique<bell::AIFFContainer>(istr, tmp);
+  } else if (memcmp(tmp + 4, "ftyp", 4) == 0) {
+    // MP4 found, AAC or ALAC
+    BELL_LOG(info, "AudioContainers",
+             "Mime guesser found MP4 format, creating MP4Container");
+
+    container = std::make_unique<bell::MP4Container>(istr, tmp);
+  } else {
+    BELL_LOG(error, "AudioContainers",
+             "Mime guesser found no supported format [%X, %X]", tmp[0], tmp[1]);
+    return nullptr;
   }
 
-  BELL_LOG(error, "AudioContainers",
-           "Mime guesser found no supported format [%X, %X]", tmp[0], tmp[1]);
-  return nullptr;
+  // read on demand, see AudioContainer::getTags()
+  container->setID3Tag(id3Tag);
+  return container;
 }
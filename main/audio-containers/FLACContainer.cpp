@@ -0,0 +1,134 @@
+#include "FLACContainer.h"
+
+#include <string.h>   // for memcpy, memcmp
+#include <algorithm>  // for min, max
+
+#include "BellLogger.h"   // for AbstractLogger, BELL_LOG
+#include "FrameHeader.h"  // for FLACInfo, parseFLAC
+#include "StreamInfo.h"   // for BitWidth, SampleRate
+
+using namespace bell;
+
+#define FLAC_BLOCK_STREAMINFO 0
+#define FLAC_BLOCK_HEADER_LEN 4
+#define FLAC_STREAMINFO_LEN 34
+
+FLACContainer::FLACContainer(std::istream& istr, const std::byte* headingBytes)
+    : bell::AudioContainer(istr),
+      window(istr, MIN_BUFFER_SIZE, headingBytes, headingBytes ? 14 : 0) {}
+
+size_t FLACContainer::readBytes(uint8_t* dst, size_t len) {
+  // skip if dst is nullptr, e.g. over pictures larger than the buffer
+  if (!dst)
+    return window.skip(len) ? len : 0;
+
+  size_t read = 0;
+  while (read < len) {
+    window.ensure(std::min(len - read, window.capacity()));
+    size_t fromBuffer = std::min(len - read, window.available());
+    if (fromBuffer == 0)
+      break;
+    memcpy(dst + read, window.data(), fromBuffer);
+    window.consume(fromBuffer);
+    read += fromBuffer;
+  }
+  return read;
+}
+
+void FLACContainer::parseSetupData() {
+  if (setupParsed)
+    return;
+  setupParsed = true;
+
+  uint8_t marker[4];
+  if (readBytes(marker, sizeof(marker)) != sizeof(marker) ||
+      memcmp(marker, "fLaC", 4) != 0) {
+    BELL_LOG(error, "FLACContainer", "Missing fLaC stream marker");
+    return;
+  }
+
+  bool lastBlock = false;
+  while (!lastBlock) {
+    uint8_t header[FLAC_BLOCK_HEADER_LEN];
+    if (readBytes(header, sizeof(header)) != sizeof(header))
+      return;
+    lastBlock = header[0] & 0x80;
+    uint8_t type = header[0] & 0x7f;
+    uint32_t length = (header[1] << 16) | (header[2] << 8) | header[3];
+
+    if (type != FLAC_BLOCK_STREAMINFO || length < FLAC_STREAMINFO_LEN) {
+      readBytes(nullptr, length);
+      continue;
+    }
+
+    uint8_t info[FLAC_STREAMINFO_LEN];
+    readBytes(info, sizeof(info));
+    readBytes(nullptr, length - sizeof(info));
+    streamInfo.minBlockSize = (info[0] << 8) | info[1];
+    streamInfo.maxBlockSize = (info[2] << 8) | info[3];
+    streamInfo.minFrameSize = (info[4] << 16) | (info[5] << 8) | info[6];
+    streamInfo.maxFrameSize = (info[7] << 16) | (info[8] << 8) | info[9];
+    streamInfo.sampleRate =
+        (info[10] << 12) | (info[11] << 4) | (info[12] >> 4);
+    streamInfo.channels = ((info[12] >> 1) & 0x07) + 1;
+    streamInfo.bitsPerSample = (((info[12] & 0x01) << 4) | (info[13] >> 4)) + 1;
+    streamInfo.totalSamples = ((uint64_t)(info[13] & 0x0f) << 32) |
+                              (info[14] << 24) | (info[15] << 16) |
+                              (info[16] << 8) | info[17];
+  }
+
+  sampleRate = static_cast<bell::SampleRate>(streamInfo.sampleRate);
+  channels = streamInfo.channels;
+  bitWidth = static_cast<bell::BitWidth>(streamInfo.bitsPerSample);
+
+  // the buffer must always hold a whole frame
+  size_t bufferSize = streamInfo.maxFrameSize ? streamInfo.maxFrameSize * 2
+                                              : DEFAULT_BUFFER_SIZE;
+  bufferSize = std::max(bufferSize, (size_t)MIN_BUFFER_SIZE);
+  window.reserve(bufferSize);
+}
+
+bool FLACContainer::fillBuffer() {
+  // half of the buffer holds the largest frame
+  window.ensure(window.capacity() / 2);
+  return window.available() > 0;
+}
+
+void FLACContainer::consumeBytes(uint32_t len) {
+  window.consume(len);
+}
+
+std::byte* FLACContainer::readSample(uint32_t& len) {
+  if (!setupParsed)
+    parseSetupData();
+
+  if (!this->fillBuffer()) {
+    len = 0;
+    return nullptr;
+  }
+
+  const uint8_t* data = window.data();
+  size_t available = window.available();
+  FrameHeader::FLACInfo info;
+  size_t offset =
+      FrameHeader::findSync(data, available, FrameHeader::FLAC_SYNC);
+  while (offset + 1 < available &&
+         !FrameHeader::parseFLAC(data + offset, available - offset, info)) {
+    offset++;
+    offset += FrameHeader::findSync(data + offset, available - offset,
+                                    FrameHeader::FLAC_SYNC);
+  }
+
+  if (offset + 1 >= available) {
+    // no sync found, keep the last byte, which might start one
+    window.consume(available - 1);
+    len = 0;
+    return nullptr;
+  }
+
+  window.consume(offset);
+  // the frame may extend past the bytes that were scanned
+  fillBuffer();
+  len = window.available();
+  return (std::byte*)window.data();
+}
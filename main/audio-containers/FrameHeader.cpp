@@ -0,0 +1,211 @@
+#include "FrameHeader.h"
+
+#include <string.h>  // for memchr
+
+using namespace bell;
+
+static bool isSync(const uint8_t* buf, FrameHeader::Sync sync) {
+  return buf[0] == 0xff && (buf[1] & sync.mask) == sync.value;
+}
+
+size_t FrameHeader::findSync(const uint8_t* buf, size_t len, Sync sync) {
+  if (len < 2)
+    return len;
+  // the second byte must be in range too
+  const uint8_t* last = buf + len - 1;
+  const uint8_t* pos = buf;
+  while (pos < last) {
+    pos = (const uint8_t*)memchr(pos, 0xff, last - pos);
+    if (pos == nullptr)
+      break;
+    if ((pos[1] & sync.mask) == sync.value)
+      return pos - buf;
+    pos++;
+  }
+  return len;
+}
+
+static const uint32_t adtsSampleRates[] = {96000, 88200, 64000, 48000, 44100,
+                                           32000, 24000, 22050, 16000, 12000,
+                                           11025, 8000,  7350};
+
+// kbps, indexed by [MPEG-1 ? 0 : 1][layer - 1][bitrate index]
+static const uint16_t mp3Bitrates[2][3][15] = {
+    {
+        {0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448},
+        {0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384},
+        {0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320},
+    },
+    {
+        {0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256},
+        {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160},
+        {0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160},
+    },
+};
+
+static const uint32_t mp3SampleRates[] = {44100, 48000, 32000};
+
+bool FrameHeader::parseADTS(const uint8_t* buf, Info& info) {
+  if (!isSync(buf, ADTS_SYNC))
+    return false;
+  uint8_t sampleRateIndex = (buf[2] >> 2) & 0x0f;
+  if (sampleRateIndex >= sizeof(adtsSampleRates) / sizeof(uint32_t))
+    return false;
+  info.frameSize = (buf[3] & 0x03) << 11 | buf[4] << 3 | buf[5] >> 5;
+  if (info.frameSize < ADTS_HEADER_SIZE)
+    return false;
+  info.sampleRate = adtsSampleRates[sampleRateIndex];
+  info.channels = ((buf[2] & 0x01) << 2) | (buf[3] >> 6);
+  // number of raw data blocks, 1024 samples each
+  info.samples = ((buf[6] & 0x03) + 1) * 1024;
+  return true;
+}
+
+bool FrameHeader::parseMP3(const uint8_t* buf, Info& info) {
+  if (!isSync(buf, MP3_SYNC))
+    return false;
+  uint8_t version = (buf[1] >> 3) & 0x03;  // 0: MPEG-2.5, 2: MPEG-2, 3: MPEG-1
+  uint8_t layer = 4 - ((buf[1] >> 1) & 0x03);
+  uint8_t bitrateIndex = buf[2] >> 4;
+  uint8_t sampleRateIndex = (buf[2] >> 2) & 0x03;
+  // reject reserved values, and free-format streams
+  if (version == 1 || layer == 4 || bitrateIndex == 0 || bitrateIndex == 15 ||
+      sampleRateIndex == 3) {
+    return false;
+  }
+
+  bool mpeg1 = version == 3;
+  uint32_t bitrate = mp3Bitrates[mpeg1 ? 0 : 1][layer - 1][bitrateIndex] * 1000;
+  // MPEG-2 halves the sample rates, MPEG-2.5 quarters them
+  info.sampleRate =
+      mp3SampleRates[sampleRateIndex] / (mpeg1 ? 1 : (version == 2 ? 2 : 4));
+  uint8_t padding = (buf[2] >> 1) & 0x01;
+  info.channels = (buf[3] >> 6) == 3 ? 1 : 2;
+
+  if (layer == 1) {
+    info.samples = 384;
+    info.frameSize = (12 * bitrate / info.sampleRate + padding) * 4;
+  } else if (layer == 2 || mpeg1) {
+    info.samples = 1152;
+    info.frameSize = 144 * bitrate / info.sampleRate + padding;
+  } else {
+    info.samples = 576;
+    info.frameSize = 72 * bitrate / info.sampleRate + padding;
+  }
+  return true;
+}
+
+static const uint32_t flacSampleRates[] = {0,     88200, 176400, 192000,
+                                           8000,  16000, 22050,  24000,
+                                           32000, 44100, 48000,  96000};
+
+static const uint8_t flacBitsPerSample[] = {0, 8, 12, 0, 16, 20, 24, 32};
+
+static uint8_t crc8(const uint8_t* buf, size_t len) {
+  uint8_t crc = 0;
+  while (len--) {
+    crc ^= *buf++;
+    for (int i = 0; i < 8; i++) {
+      crc = (crc & 0x80) ? (crc << 1) ^ 0x07 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+bool FrameHeader::parseFLAC(const uint8_t* buf, size_t len, FLACInfo& info) {
+  if (len < 6 || !isSync(buf, FLAC_SYNC))
+    return false;
+  info.variableBlockSize = buf[1] & 0x01;
+
+  uint8_t blockSizeCode = buf[2] >> 4;
+  uint8_t sampleRateCode = buf[2] & 0x0f;
+  info.channelAssignment = buf[3] >> 4;
+  uint8_t sampleSizeCode = (buf[3] >> 1) & 0x07;
+  if (blockSizeCode == 0 || sampleRateCode == 15 ||
+      info.channelAssignment > 10 || sampleSizeCode == 3 || (buf[3] & 0x01)) {
+    return false;
+  }
+  info.channels = info.channelAssignment < 8 ? info.channelAssignment + 1 : 2;
+  info.bitsPerSample = flacBitsPerSample[sampleSizeCode];
+
+  // UTF-8 coded frame or sample number
+  size_t pos = 4;
+  uint8_t first = buf[pos++];
+  int extraBytes = 0;
+  if (first < 0x80) {
+    info.number = first;
+  } else {
+    while (extraBytes < 7 && (first & (0x40 >> extraBytes))) {
+      extraBytes++;
+    }
+    if (extraBytes == 0 || extraBytes > 6)
+      return false;
+    info.number = first & (0x3f >> extraBytes);
+    if (pos + extraBytes > len)
+      return false;
+    for (int i = 0; i < extraBytes; i++) {
+      if ((buf[pos] & 0xc0) != 0x80)
+        return false;
+      info.number = (info.number << 6) | (buf[pos++] & 0x3f);
+    }
+  }
+
+  size_t extraSize = (blockSizeCode == 6 ? 1 : blockSizeCode == 7 ? 2 : 0) +
+                     (sampleRateCode == 12   ? 1
+                      : sampleRateCode >= 13 ? 2
+                                             : 0);
+  if (pos + extraSize + 1 > len)
+    return false;
+
+  if (blockSizeCode == 1) {
+    info.blockSize = 192;
+  } else if (blockSizeCode <= 5) {
+    info.blockSize = 576 << (blockSizeCode - 2);
+  } else if (blockSizeCode == 6) {
+    info.blockSize = buf[pos++] + 1;
+  } else if (blockSizeCode == 7) {
+    info.blockSize = ((buf[pos] << 8) | buf[pos + 1]) + 1;
+    pos += 2;
+  } else {
+    info.blockSize = 256 << (blockSizeCode - 8);
+  }
+
+  if (sampleRateCode < 12) {
+    info.sampleRate = flacSampleRates[sampleRateCode];
+  } else if (sampleRateCode == 12) {
+    info.sampleRate = buf[pos++] * 1000;
+  } else {
+    info.sampleRate = (buf[pos] << 8) | buf[pos + 1];
+    if (sampleRateCode == 14)
+      info.sampleRate *= 10;
+    pos += 2;
+  }
+
+  if (crc8(buf, pos) != buf[pos])
+    return false;
+  info.headerSize = pos + 1;
+  return true;
+}
+
+bool FrameHeader::parse(bell::AudioCodec codec, const uint8_t* buf,
+                        Info& info) {
+  switch (codec) {
+    case AudioCodec::AAC:
+      return parseADTS(buf, info);
+    case AudioCodec::MP3:
+      return parseMP3(buf, info);
+    default:
+      return false;
+  }
+}
+
+size_t FrameHeader::headerSize(bell::AudioCodec codec) {
+  switch (codec) {
+    case AudioCodec::AAC:
+      return ADTS_HEADER_SIZE;
+    case AudioCodec::MP3:
+      return MP3_HEADER_SIZE;
+    default:
+      return 0;
+  }
+}
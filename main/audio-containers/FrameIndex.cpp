@@ -0,0 +1,131 @@
+#include "FrameIndex.h"
+
+#include <algorithm>  // for upper_bound
+#include <cstring>    // for memcmp
+#include <fstream>    // for ifstream, ofstream
+
+using namespace bell;
+
+static const char INDEX_MAGIC[4] = {'B', 'I', 'D', 'X'};
+
+static void writeVarint(std::ostream& out, uint64_t value) {
+  while (value >= 0x80) {
+    out.put((char)((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  out.put((char)value);
+}
+
+static bool readVarint(std::istream& in, uint64_t& value) {
+  value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int byte = in.get();
+    if (byte == std::char_traits<char>::eof())
+      return false;
+    value |= (uint64_t)(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      return true;
+  }
+  return false;
+}
+
+void FrameIndex::begin(uint64_t offset) {
+  if (!entries.empty() && entries[0].offset == offset)
+    return;
+  entries.clear();
+  nextSample = 0;
+  nextOffset = offset;
+  frames = 0;
+  complete = false;
+}
+
+void FrameIndex::addFrame(uint64_t offset, uint32_t size, uint32_t samples) {
+  // already indexed, or a frame found before begin()
+  if (complete || offset < nextOffset)
+    return;
+  if (frames % INTERVAL == 0)
+    entries.push_back({nextSample, offset});
+  nextSample += samples;
+  nextOffset = offset + size;
+  frames++;
+}
+
+bool FrameIndex::find(uint64_t sample, Entry& entry) const {
+  if (entries.empty() || sample >= nextSample)
+    return false;
+  auto next = std::upper_bound(entries.begin(), entries.end(), sample,
+                               [](uint64_t sample, const Entry& entry) {
+                                 return sample < entry.sample;
+                               });
+  entry = *(next - 1);
+  return true;
+}
+
+void FrameIndex::save(std::ostream& out, uint64_t streamSize) const {
+  out.write(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+  out.put((char)VERSION);
+  writeVarint(out, streamSize);
+  writeVarint(out, frames);
+  writeVarint(out, nextSample);
+  writeVarint(out, nextOffset);
+  out.put(complete ? 1 : 0);
+  writeVarint(out, entries.size());
+  // entries are increasing, store the differences
+  Entry previous = {0, 0};
+  for (auto& entry : entries) {
+    writeVarint(out, entry.sample - previous.sample);
+    writeVarint(out, entry.offset - previous.offset);
+    previous = entry;
+  }
+}
+
+bool FrameIndex::load(std::istream& in, uint64_t streamSize) {
+  char magic[sizeof(INDEX_MAGIC)];
+  if (!in.read(magic, sizeof(magic)) ||
+      memcmp(magic, INDEX_MAGIC, sizeof(magic)) != 0 || in.get() != VERSION) {
+    return false;
+  }
+
+  uint64_t savedSize, savedFrames, savedSample, savedOffset, count;
+  if (!readVarint(in, savedSize) || savedSize != streamSize ||
+      !readVarint(in, savedFrames) || !readVarint(in, savedSample) ||
+      !readVarint(in, savedOffset)) {
+    return false;
+  }
+  int savedComplete = in.get();
+  if (savedComplete == std::char_traits<char>::eof() ||
+      !readVarint(in, count) ||
+      count != (savedFrames + INTERVAL - 1) / INTERVAL) {
+    return false;
+  }
+
+  std::vector<Entry> savedEntries(count);
+  Entry previous = {0, 0};
+  for (auto& entry : savedEntries) {
+    uint64_t sample, offset;
+    if (!readVarint(in, sample) || !readVarint(in, offset))
+      return false;
+    entry = {previous.sample + sample, previous.offset + offset};
+    previous = entry;
+  }
+  if (count && (previous.sample > savedSample || previous.offset > savedOffset))
+    return false;
+
+  entries = std::move(savedEntries);
+  frames = savedFrames;
+  nextSample = savedSample;
+  nextOffset = savedOffset;
+  complete = savedComplete != 0;
+  return true;
+}
+
+bool FrameIndex::saveFile(const std::string& path, uint64_t streamSize) const {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  save(out, streamSize);
+  return out.good();
+}
+
+bool FrameIndex::loadFile(const std::string& path, uint64_t streamSize) {
+  std::ifstream in(path, std::ios::binary);
+  return in && load(in, streamSize);
+}
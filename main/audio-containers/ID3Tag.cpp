@@ -0,0 +1,297 @@
+#include "ID3Tag.h"
+
+#include <string.h>   // for memcmp
+#include <algorithm>  // for min
+#include <cctype>     // for toupper
+#include <cstdlib>    // for strtof
+
+#include "BellLogger.h"  // for AbstractLogger, BELL_LOG
+
+using namespace bell;
+
+// larger text frames are skipped, they're not titles or ReplayGain values
+#define ID3_MAX_TEXT_FRAME 4096
+// read from picture frames, for the MIME type and description before the image
+#define ID3_PICTURE_HEADER_SIZE 256
+#define ID3_PICTURE_FRONT_COVER 3
+
+#define ID3_ENCODING_LATIN1 0
+#define ID3_ENCODING_UTF16 1
+#define ID3_ENCODING_UTF8 3
+
+static uint32_t readBE(const uint8_t* buf, uint8_t size) {
+  uint32_t value = 0;
+  for (uint8_t i = 0; i < size; i++) {
+    value = (value << 8) | buf[i];
+  }
+  return value;
+}
+
+static uint32_t readSyncsafe(const uint8_t* buf) {
+  return ((buf[0] & 0x7f) << 21) | ((buf[1] & 0x7f) << 14) |
+         ((buf[2] & 0x7f) << 7) | (buf[3] & 0x7f);
+}
+
+static void appendUTF8(std::string& out, uint32_t c) {
+  if (c < 0x80) {
+    out += (char)c;
+  } else if (c < 0x800) {
+    out += (char)(0xc0 | (c >> 6));
+    out += (char)(0x80 | (c & 0x3f));
+  } else if (c < 0x10000) {
+    out += (char)(0xe0 | (c >> 12));
+    out += (char)(0x80 | ((c >> 6) & 0x3f));
+    out += (char)(0x80 | (c & 0x3f));
+  } else {
+    out += (char)(0xf0 | (c >> 18));
+    out += (char)(0x80 | ((c >> 12) & 0x3f));
+    out += (char)(0x80 | ((c >> 6) & 0x3f));
+    out += (char)(0x80 | (c & 0x3f));
+  }
+}
+
+/**
+ * Decode a string up to its terminator, or the end of data, to UTF-8.
+ * @returns bytes consumed, terminator included
+ */
+static size_t decodeText(const uint8_t* data, size_t len, uint8_t encoding,
+                         std::string& out) {
+  out.clear();
+  if (encoding == ID3_ENCODING_LATIN1 || encoding == ID3_ENCODING_UTF8) {
+    size_t i = 0;
+    for (; i < len && data[i]; i++) {
+      if (encoding == ID3_ENCODING_UTF8)
+        out += (char)data[i];
+      else
+        appendUTF8(out, data[i]);
+    }
+    return std::min(i + 1, len);
+  }
+
+  // UTF-16, big endian unless a byte order mark says otherwise
+  bool littleEndian = false;
+  size_t i = 0;
+  if (encoding == ID3_ENCODING_UTF16 && len >= 2 &&
+      ((data[0] == 0xff && data[1] == 0xfe) ||
+       (data[0] == 0xfe && data[1] == 0xff))) {
+    littleEndian = data[0] == 0xff;
+    i = 2;
+  }
+  for (; i + 1 < len; i += 2) {
+    uint32_t c = littleEndian ? data[i] | (data[i + 1] << 8)
+                              : (data[i] << 8) | data[i + 1];
+    if (c == 0)
+      return i + 2;
+    if (c >= 0xd800 && c < 0xdc00 && i + 3 < len) {
+      // surrogate pair
+      uint32_t low = littleEndian ? data[i + 2] | (data[i + 3] << 8)
+                                  : (data[i + 2] << 8) | data[i + 3];
+      c = 0x10000 + ((c - 0xd800) << 10) + (low - 0xdc00);
+      i += 2;
+    }
+    appendUTF8(out, c);
+  }
+  return len;
+}
+
+// undo the unsynchronisation scheme, which inserts a zero after every 0xff
+static void removeUnsync(std::vector<uint8_t>& data) {
+  size_t out = 0;
+  for (size_t i = 0; i < data.size(); i++) {
+    data[out++] = data[i];
+    if (data[i] == 0xff && i + 1 < data.size() && data[i + 1] == 0)
+      i++;
+  }
+  data.resize(out);
+}
+
+static bool isTextFrame(const std::string& id) {
+  return id == "TIT2" || id == "TPE1" || id == "TALB" || id == "TXXX" ||
+         id == "TT2" || id == "TP1" || id == "TAL" || id == "TXX";
+}
+
+uint32_t ID3Tag::tagSize(const uint8_t* header) {
+  if (memcmp(header, "ID3", 3) != 0 || header[3] == 0xff || header[4] == 0xff)
+    return 0;
+  // syncsafe, the high bit of every byte is cleared
+  if ((header[6] | header[7] | header[8] | header[9]) & 0x80)
+    return 0;
+  // the size excludes the header and footer
+  return readSyncsafe(header + 6) +
+         HEADER_SIZE * ((header[5] & 0x10) ? 2 : 1);
+}
+
+const ID3Tag::Fields* ID3Tag::read(std::istream& istr) {
+  if (!size)
+    return nullptr;
+  if (!parsed) {
+    parsed = true;
+    // the stream may have ended, its state is restored afterwards
+    std::ios::iostate state = istr.rdstate();
+    istr.clear();
+    std::streamoff position = istr.tellg();
+    if (position >= 0 && istr.seekg(offset)) {
+      valid = parse(istr);
+      if (!valid)
+        BELL_LOG(error, "ID3Tag", "Invalid ID3v2 tag at %llu",
+                 (unsigned long long)offset);
+      istr.clear();
+      istr.seekg(position);
+    }
+    istr.clear(state);
+  }
+  return valid ? &fields : nullptr;
+}
+
+bool ID3Tag::parse(std::istream& istr) {
+  uint8_t header[HEADER_SIZE];
+  if (!istr.read((char*)header, sizeof(header)) || tagSize(header) != size)
+    return false;
+  uint8_t version = header[3];
+  if (version < 2 || version > 4)
+    return false;
+  bool unsynchronised = header[5] & 0x80;
+  uint64_t position = offset + HEADER_SIZE;
+  // frames are followed by padding, or the footer
+  uint64_t end = position + readSyncsafe(header + 6);
+
+  if (version >= 3 && (header[5] & 0x40)) {
+    uint8_t extended[4];
+    if (!istr.read((char*)extended, sizeof(extended)))
+      return true;
+    // excluding its size field in 2.3
+    position += version == 4 ? readSyncsafe(extended)
+                             : readBE(extended, 4) + sizeof(extended);
+    if (!istr.seekg(position))
+      return true;
+  }
+
+  size_t idSize = version == 2 ? 3 : 4;
+  size_t headerSize = version == 2 ? 6 : 10;
+  std::vector<uint8_t> frame;
+  while (position + headerSize <= end) {
+    uint8_t frameHeader[10];
+    if (!istr.read((char*)frameHeader, headerSize) || frameHeader[0] == 0)
+      break;
+    std::string id((const char*)frameHeader, idSize);
+    uint32_t frameSize;
+    // compressed, encrypted or grouped frames are skipped
+    bool plain = true;
+    bool frameUnsync = unsynchronised;
+    if (version == 2) {
+      frameSize = readBE(frameHeader + 3, 3);
+    } else if (version == 3) {
+      frameSize = readBE(frameHeader + 4, 4);
+      plain = !(frameHeader[9] & 0xe0);
+    } else {
+      frameSize = readSyncsafe(frameHeader + 4);
+      plain = !(frameHeader[9] & 0x4d);
+      frameUnsync = frameUnsync || (frameHeader[9] & 0x02);
+    }
+    position += headerSize;
+    if (frameSize > end - position)
+      break;
+
+    if (plain && frameSize && isTextFrame(id) &&
+        frameSize <= ID3_MAX_TEXT_FRAME) {
+      frame.resize(frameSize);
+      if (!istr.read((char*)frame.data(), frameSize))
+        break;
+      if (frameUnsync)
+        removeUnsync(frame);
+      if (id == "TXXX" || id == "TXX") {
+        parseUserText(frame);
+      } else {
+        parseText(id, frame);
+      }
+    } else if (plain && !frameUnsync && (id == "APIC" || id == "PIC")) {
+      // the image's offset would be off with unsynchronisation
+      parsePicture(istr, id, position, frameSize);
+    }
+
+    position += frameSize;
+    if (!istr.seekg(position))
+      break;
+  }
+  return true;
+}
+
+void ID3Tag::parseText(const std::string& id, std::vector<uint8_t>& frame) {
+  std::string* field = nullptr;
+  if (id == "TIT2" || id == "TT2") {
+    field = &fields.title;
+  } else if (id == "TPE1" || id == "TP1") {
+    field = &fields.artist;
+  } else if (id == "TALB" || id == "TAL") {
+    field = &fields.album;
+  }
+  // multiple values (2.4) are separated by terminators, the first one is kept
+  if (field && !frame.empty())
+    decodeText(frame.data() + 1, frame.size() - 1, frame[0], *field);
+}
+
+void ID3Tag::parseUserText(std::vector<uint8_t>& frame) {
+  if (frame.empty())
+    return;
+  std::string description, value;
+  size_t used =
+      1 + decodeText(frame.data() + 1, frame.size() - 1, frame[0], description);
+  decodeText(frame.data() + used, frame.size() - used, frame[0], value);
+  for (auto& c : description)
+    c = std::toupper((unsigned char)c);
+
+  // e.g. "-6.52 dB", as written by most taggers
+  float number = std::strtof(value.c_str(), nullptr);
+  if (description == "REPLAYGAIN_TRACK_GAIN") {
+    fields.hasTrackGain = true;
+    fields.trackGain = number;
+  } else if (description == "REPLAYGAIN_TRACK_PEAK") {
+    fields.trackPeak = number;
+  } else if (description == "REPLAYGAIN_ALBUM_GAIN") {
+    fields.hasAlbumGain = true;
+    fields.albumGain = number;
+  } else if (description == "REPLAYGAIN_ALBUM_PEAK") {
+    fields.albumPeak = number;
+  }
+}
+
+bool ID3Tag::parsePicture(std::istream& istr, const std::string& id,
+                          uint64_t frameOffset, uint32_t frameSize) {
+  // a front cover was found already
+  if (fields.artSize && frontCover)
+    return false;
+
+  uint8_t header[ID3_PICTURE_HEADER_SIZE];
+  size_t len = std::min<size_t>(frameSize, sizeof(header));
+  if (len < 2 || !istr.read((char*)header, len))
+    return false;
+  uint8_t encoding = header[0];
+  std::string mime;
+  size_t used = 1;
+  if (id == "PIC") {
+    // three letter image format in 2.2
+    if (len < 5)
+      return false;
+    mime = memcmp(header + 1, "PNG", 3) == 0 ? "image/png" : "image/jpeg";
+    used += 3;
+  } else {
+    used += decodeText(header + used, len - used, ID3_ENCODING_LATIN1, mime);
+  }
+  if (used >= len)
+    return false;
+  uint8_t type = header[used++];
+
+  // the description ends within the bytes read, or it's too long to bother
+  std::string description;
+  size_t descriptionSize =
+      decodeText(header + used, len - used, encoding, description);
+  if (used + descriptionSize >= len)
+    return false;
+  used += descriptionSize;
+
+  fields.artMime = mime;
+  fields.artOffset = frameOffset + used;
+  fields.artSize = frameSize - used;
+  frontCover = type == ID3_PICTURE_FRONT_COVER;
+  return true;
+}
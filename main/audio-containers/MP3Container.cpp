@@ -1,67 +1,443 @@
 #include "MP3Container.h"
 
-#include <cstring>  // for memmove
+#include <algorithm>  // for min, upper_bound
+#include <cstring>    // for memcmp
 
+#include "BellLogger.h"  // for AbstractLogger, BELL_LOG
 #include "StreamInfo.h"  // for BitWidth, BitWidth::BW_16, SampleRate, Sampl...
-#include "mp3dec.h"      // for MP3FindSyncWord
 
 using namespace bell;
 
-MP3Container::MP3Container(std::istream& istr, const std::byte* headingBytes)
-    : bell::AudioContainer(istr) {
-  if (headingBytes != nullptr) {
-    memcpy(buffer.data(), headingBytes, 7);
-    bytesInBuffer = 7;
+// delay of the synthesis filterbank, on top of the encoder's
+#define MP3_DECODER_DELAY 529
+// frames decoded before a seek target, to refill the bit reservoir and overlap
+#define MP3_SEEK_PREROLL 2
+// frame headers walked past the indexed range, before estimating instead
+#define MP3_MAX_SCAN_FRAMES 256
+
+#define XING_FLAG_FRAMES 0x01
+#define XING_FLAG_BYTES 0x02
+#define XING_FLAG_TOC 0x04
+#define XING_FLAG_QUALITY 0x08
+#define XING_TOC_SIZE 100
+#define LAME_TAG_SIZE 24
+// VBRI header, at a fixed offset after the frame header
+#define VBRI_OFFSET 36
+#define VBRI_HEADER_SIZE 26
+
+static uint32_t readBE(const uint8_t* buf, uint8_t size) {
+  uint32_t value = 0;
+  for (uint8_t i = 0; i < size; i++) {
+    value = (value << 8) | buf[i];
   }
+  return value;
 }
 
+MP3Container::MP3Container(std::istream& istr, const std::byte* headingBytes)
+    : bell::AudioContainer(istr),
+      window(istr, BUFFER_SIZE, headingBytes, headingBytes ? 14 : 0) {}
+
 bool MP3Container::fillBuffer() {
-  if (this->bytesInBuffer < MP3_MAX_FRAME_SIZE * 2) {
-    this->istr.read((char*)buffer.data() + bytesInBuffer,
-                    buffer.size() - bytesInBuffer);
-    this->bytesInBuffer += istr.gcount();
-  }
-  return this->bytesInBuffer >= MP3_MAX_FRAME_SIZE * 2;
+  // the last frames are shorter than that
+  return window.ensure(MP3_MAX_FRAME_SIZE * 2) ||
+         (window.eof() && window.available() > 0);
 }
 
 void MP3Container::consumeBytes(uint32_t len) {
-  dataOffset += len;
+  window.consume(len);
 }
 
 std::byte* MP3Container::readSample(uint32_t& len) {
-  // Align data if previous read was offseted
-  if (dataOffset > 0 && bytesInBuffer > 0) {
-    size_t toConsume = std::min(dataOffset, bytesInBuffer);
-    memmove(buffer.data(), buffer.data() + toConsume,
-            buffer.size() - toConsume);
-
-    dataOffset -= toConsume;
-    bytesInBuffer -= toConsume;
-  }
+  if (!setupParsed)
+    parseSetupData();
 
   if (!this->fillBuffer()) {
+    if (indexing && window.eof())
+      frameIndex.setComplete();
     len = 0;
     return nullptr;
   }
 
-  int startOffset =
-      MP3FindSyncWord((uint8_t*)this->buffer.data(), bytesInBuffer);
+  size_t startOffset = FrameHeader::findSync(
+      window.data(), window.available(), FrameHeader::MP3_SYNC);
 
-  if (startOffset < 0) {
+  if (startOffset == window.available()) {
     // Discard word
-    dataOffset = MP3_MAX_FRAME_SIZE;
+    window.consume(MP3_MAX_FRAME_SIZE);
+    len = 0;
     return nullptr;
   }
 
-  dataOffset += startOffset;
+  window.consume(startOffset);
+  // the frame may extend past the bytes that were scanned
+  fillBuffer();
+
+  len = window.available();
+
+  FrameHeader::Info info;
+  if (len >= FrameHeader::MP3_HEADER_SIZE &&
+      FrameHeader::parseMP3(window.data(), info) &&
+      info.sampleRate == streamSampleRate) {
+    trackFrame(info);
+  }
+
+  return (std::byte*)window.data();
+}
+
+void MP3Container::trackFrame(const FrameHeader::Info& info) {
+  uint64_t offset = window.offset();
+  // same frame, or a false sync inside of it
+  if (frameKnown && offset < frameEnd)
+    return;
+  if (frameKnown)
+    frameSample += frameSamples;
+  frameKnown = true;
+  frameSamples = info.samples;
+  frameEnd = offset + info.frameSize;
+  if (indexing)
+    frameIndex.addFrame(offset, info.frameSize, info.samples);
+}
+
+void MP3Container::skipID3v2() {
+  fillBuffer();
+  while (window.available() >= ID3Tag::HEADER_SIZE) {
+    uint32_t size = ID3Tag::tagSize(window.data());
+    if (!size)
+      break;
+    BELL_LOG(debug, "MP3Container", "Skipping %u bytes of ID3v2 tag", size);
+    // unless the container guesser skipped it already; read on demand by getTags()
+    if (!id3Tag.exists() && window.isSeekable())
+      id3Tag = ID3Tag(window.offset(), size);
+
+    window.skip(size);
+    fillBuffer();
+  }
+}
+
+bool MP3Container::findFrame(FrameHeader::Info& info) {
+  while (true) {
+    fillBuffer();
+    const uint8_t* data = window.data();
+    size_t available = window.available();
+    for (size_t offset = 0;
+         offset + FrameHeader::MP3_HEADER_SIZE <= available; offset++) {
+      offset += FrameHeader::findSync(data + offset, available - offset,
+                                      FrameHeader::MP3_SYNC);
+      if (offset + FrameHeader::MP3_HEADER_SIZE > available ||
+          !FrameHeader::parseMP3(data + offset, info)) {
+        continue;
+      }
+      // confirmed by the next frame's header, unless it's not buffered
+      size_t next = offset + info.frameSize;
+      FrameHeader::Info nextInfo;
+      if (next + FrameHeader::MP3_HEADER_SIZE <= available &&
+          (!FrameHeader::parseMP3(data + next, nextInfo) ||
+           nextInfo.sampleRate != info.sampleRate)) {
+        continue;
+      }
+      window.consume(offset);
+      return true;
+    }
+
+    if (window.eof())
+      return false;
+    // keep the last bytes, which might start a header
+    window.consume(available - std::min<size_t>(
+                                   available,
+                                   FrameHeader::MP3_HEADER_SIZE - 1));
+  }
+}
+
+bool MP3Container::parseXing(const uint8_t* frame,
+                             const FrameHeader::Info& info) {
+  // placed after the side information, whose size depends on version and mode
+  bool mpeg1 = ((frame[1] >> 3) & 0x03) == 3;
+  size_t offset = FrameHeader::MP3_HEADER_SIZE;
+  if (mpeg1) {
+    offset += info.channels == 1 ? 17 : 32;
+  } else {
+    offset += info.channels == 1 ? 9 : 17;
+  }
+  if (offset + 8 > info.frameSize)
+    return false;
+  const uint8_t* xing = frame + offset;
+  if (memcmp(xing, "Xing", 4) != 0 && memcmp(xing, "Info", 4) != 0)
+    return false;
+
+  uint32_t flags = readBE(xing + 4, 4);
+  size_t size = 8 + ((flags & XING_FLAG_FRAMES) ? 4 : 0) +
+                ((flags & XING_FLAG_BYTES) ? 4 : 0) +
+                ((flags & XING_FLAG_TOC) ? XING_TOC_SIZE : 0) +
+                ((flags & XING_FLAG_QUALITY) ? 4 : 0);
+  if (offset + size > info.frameSize)
+    return false;
 
-  len = bytesInBuffer - dataOffset;
+  const uint8_t* field = xing + 8;
+  if (flags & XING_FLAG_FRAMES) {
+    totalFrames = readBE(field, 4);
+    field += 4;
+  }
+  if (flags & XING_FLAG_BYTES) {
+    totalBytes = readBE(field, 4);
+    field += 4;
+  }
+  // only used for VBR streams, CBR positions are exact from the bitrate
+  if ((flags & XING_FLAG_TOC) && xing[0] == 'X' && totalFrames && totalBytes &&
+      dataStart >= 0) {
+    // byte position, in 1/256 of the stream, at every percent of its duration
+    uint64_t samples = (uint64_t)totalFrames * samplesPerFrame;
+    for (int i = 0; i < XING_TOC_SIZE; i++) {
+      seekPoints.push_back({samples * i / XING_TOC_SIZE,
+                            dataStart + (uint64_t)field[i] * totalBytes / 256});
+    }
+  }
+
+  // LAME extension, also written by FFmpeg
+  const uint8_t* lame = xing + size;
+  if (offset + size + LAME_TAG_SIZE <= info.frameSize &&
+      (memcmp(lame, "LAME", 4) == 0 || memcmp(lame, "Lavc", 4) == 0 ||
+       memcmp(lame, "Lavf", 4) == 0)) {
+    hasGapless = true;
+    encoderDelay = (lame[21] << 4) | (lame[22] >> 4);
+    encoderPadding = ((lame[22] & 0x0f) << 8) | lame[23];
+  }
+  return true;
+}
+
+bool MP3Container::parseVBRI(const uint8_t* frame,
+                             const FrameHeader::Info& info) {
+  if (VBRI_OFFSET + VBRI_HEADER_SIZE > info.frameSize ||
+      memcmp(frame + VBRI_OFFSET, "VBRI", 4) != 0) {
+    return false;
+  }
+  const uint8_t* vbri = frame + VBRI_OFFSET;
+  totalBytes = readBE(vbri + 10, 4);
+  totalFrames = readBE(vbri + 14, 4);
+  uint16_t entries = readBE(vbri + 18, 2);
+  uint16_t scale = readBE(vbri + 20, 2);
+  uint8_t entrySize = readBE(vbri + 22, 2);
+  uint16_t framesPerEntry = readBE(vbri + 24, 2);
+  if (entrySize < 1 || entrySize > 4 ||
+      (size_t)(VBRI_OFFSET + VBRI_HEADER_SIZE + entries * entrySize) >
+          info.frameSize ||
+      dataStart < 0) {
+    return true;
+  }
 
-  return this->buffer.data() + dataOffset;
+  // bytes taken by every framesPerEntry frames
+  const uint8_t* entry = vbri + VBRI_HEADER_SIZE;
+  uint64_t offset = dataStart;
+  for (uint16_t i = 0; i < entries; i++, entry += entrySize) {
+    seekPoints.push_back(
+        {(uint64_t)i * framesPerEntry * samplesPerFrame, offset});
+    offset += readBE(entry, entrySize) * scale;
+  }
+  return true;
 }
 
 void MP3Container::parseSetupData() {
+  if (setupParsed)
+    return;
+  setupParsed = true;
   channels = 2;
   sampleRate = bell::SampleRate::SR_44100;
   bitWidth = bell::BitWidth::BW_16;
+
+  skipID3v2();
+  FrameHeader::Info info;
+  if (!findFrame(info)) {
+    BELL_LOG(error, "MP3Container", "No MPEG audio frame found");
+    return;
+  }
+  channels = info.channels;
+  streamSampleRate = info.sampleRate;
+  sampleRate = static_cast<bell::SampleRate>(info.sampleRate);
+  samplesPerFrame = info.samples;
+  bitrate = info.frameSize * 8 * info.sampleRate / info.samples;
+
+  if (window.isSeekable())
+    dataStart = window.offset();
+
+  const uint8_t* frame = window.data();
+  if (info.frameSize <= window.available() &&
+      (parseXing(frame, info) || parseVBRI(frame, info))) {
+    BELL_LOG(info, "MP3Container", "%u frames, encoder delay %u, padding %u",
+             totalFrames, encoderDelay, encoderPadding);
+    // the header frame holds no audio
+    window.consume(info.frameSize);
+    if (dataStart >= 0)
+      dataStart += info.frameSize;
+    if (totalFrames && totalBytes > info.frameSize) {
+      // the byte count includes the header frame
+      uint64_t bytes = totalBytes - info.frameSize;
+      bitrate = bytes * 8 * info.sampleRate /
+                ((uint64_t)totalFrames * info.samples);
+    }
+  }
+
+  if (dataStart >= 0) {
+    frameIndex.begin(dataStart);
+    indexing = true;
+  }
+}
+
+bool MP3Container::getGaplessInfo(uint32_t& skipSamples,
+                                  uint64_t& validSamples) {
+  if (!setupParsed)
+    parseSetupData();
+  if (!hasGapless || !totalFrames)
+    return false;
+  uint64_t samples = (uint64_t)totalFrames * samplesPerFrame;
+  skipSamples = encoderDelay + MP3_DECODER_DELAY;
+  validSamples = samples - std::min<uint64_t>(samples, encoderDelay +
+                                                           encoderPadding);
+  return true;
+}
+
+uint32_t MP3Container::delaySamples() const {
+  return hasGapless ? encoderDelay + MP3_DECODER_DELAY : 0;
+}
+
+uint64_t MP3Container::currentSample() {
+  return frameSample - std::min<uint64_t>(frameSample, delaySamples());
+}
+
+uint64_t MP3Container::duration() {
+  if (!setupParsed)
+    parseSetupData();
+  if (!streamSampleRate)
+    return 0;
+
+  uint64_t samples;
+  if (frameIndex.isComplete()) {
+    samples = frameIndex.end().sample;
+  } else if (totalFrames) {
+    samples = (uint64_t)totalFrames * samplesPerFrame;
+  } else {
+    // estimated from the stream size, once
+    if (dataEnd < 0 && dataStart >= 0)
+      dataEnd = window.streamSize();
+    if (dataEnd <= dataStart || !bitrate)
+      return 0;
+    samples = (uint64_t)(dataEnd - dataStart) * 8 * streamSampleRate / bitrate;
+    samples = std::max(samples, frameIndex.end().sample);
+  }
+  if (hasGapless)
+    samples -= std::min<uint64_t>(samples, encoderDelay + encoderPadding);
+  return samples;
+}
+
+uint32_t MP3Container::getDurationMs() {
+  uint64_t samples = duration();
+  return samples ? samples * 1000 / streamSampleRate : 0;
+}
+
+bool MP3Container::seekMs(uint32_t ms) {
+  if (!setupParsed)
+    parseSetupData();
+  return seekToSample((uint64_t)ms * streamSampleRate / 1000);
+}
+
+bool MP3Container::seekTo(uint64_t offset, uint64_t sample) {
+  if (!window.seek(offset))
+    return false;
+  frameKnown = false;
+  frameSample = sample;
+  return true;
+}
+
+void MP3Container::scanTo(uint64_t sample) {
+  // walk the frame headers, without decoding
+  FrameHeader::Info info;
+  while (fillBuffer()) {
+    const uint8_t* data = window.data();
+    if (window.available() < FrameHeader::MP3_HEADER_SIZE ||
+        !FrameHeader::parseMP3(data, info) ||
+        info.sampleRate != streamSampleRate) {
+      // lost sync, e.g. on junk between frames
+      if (!findFrame(info))
+        break;
+      continue;
+    }
+    if (frameSample + info.samples > sample)
+      return;
+    if (indexing)
+      frameIndex.addFrame(window.offset(), info.frameSize, info.samples);
+    frameSample += info.samples;
+    window.consume(info.frameSize);
+  }
+  if (indexing && window.eof())
+    frameIndex.setComplete();
+  BELL_LOG(debug, "MP3Container", "Seeked past the last frame");
+}
+
+bool MP3Container::seekToSample(uint64_t sample) {
+  if (!setupParsed)
+    parseSetupData();
+  if (dataStart < 0 || !streamSampleRate || !samplesPerFrame)
+    return false;
+
+  // decoded sample to start from, delay included
+  uint64_t target = sample + delaySamples();
+  target -= std::min<uint64_t>(target, MP3_SEEK_PREROLL * samplesPerFrame);
+
+  FrameIndex::Entry entry;
+  if (frameIndex.find(target, entry)) {
+    // exact, from the closest indexed frame
+    if (!seekTo(entry.offset, entry.sample))
+      return false;
+    indexing = true;
+    scanTo(target);
+    return true;
+  }
+  entry = frameIndex.end();
+  if (frameIndex.isComplete() ||
+      target - entry.sample < MP3_MAX_SCAN_FRAMES * samplesPerFrame) {
+    // just past the indexed range, which keeps growing
+    if (!seekTo(entry.offset, entry.sample))
+      return false;
+    indexing = true;
+    scanTo(target);
+    return true;
+  }
+
+  std::streamoff offset;
+  if (!seekPoints.empty()) {
+    // interpolate between the surrounding table entries
+    auto next = std::upper_bound(
+        seekPoints.begin(), seekPoints.end(), target,
+        [](uint64_t sample, const SeekPoint& point) {
+          return sample < point.sample;
+        });
+    const SeekPoint& point = *(next - 1);
+    uint64_t endSample = (uint64_t)totalFrames * samplesPerFrame;
+    uint64_t endOffset = seekPoints[0].offset + totalBytes;
+    if (next != seekPoints.end()) {
+      endSample = next->sample;
+      endOffset = next->offset;
+    }
+    target = std::min(target, endSample);
+    offset = point.offset;
+    if (endSample > point.sample && endOffset > point.offset) {
+      offset += (target - point.sample) * (endOffset - point.offset) /
+                (endSample - point.sample);
+    }
+  } else if (bitrate) {
+    // constant bitrate, from the start of the target's frame
+    uint64_t frameStart = target / samplesPerFrame * samplesPerFrame;
+    offset = dataStart + frameStart * bitrate / 8 / streamSampleRate;
+  } else {
+    return false;
+  }
+
+  // the Xing/VBRI frame is where the table starts, but isn't audio
+  offset = std::max(offset, dataStart);
+  if (!seekTo(offset, target / samplesPerFrame * samplesPerFrame))
+    return false;
+  // the index can't be extended from an estimated position
+  indexing = false;
+  FrameHeader::Info info;
+  if (!findFrame(info))
+    BELL_LOG(debug, "MP3Container", "Seeked past the last frame");
+  return true;
 }
@@ -0,0 +1,848 @@
+#include "MP4Container.h"
+
+#include <string.h>   // for memcpy
+#include <algorithm>  // for min, max, upper_bound
+#include <limits>     // for numeric_limits
+
+#include "BellLogger.h"  // for AbstractLogger, BELL_LOG
+#include "StreamInfo.h"  // for BitWidth, SampleRate
+
+using namespace bell;
+
+// box size meaning "up to the end of the file"
+#define BOX_SIZE_TO_END std::numeric_limits<uint64_t>::max()
+// gaps between samples below this are read through, rather than seeked over
+#define MP4_MAX_SKIP 64 * 1024
+
+// AudioSampleEntry fields, after the box header
+#define SAMPLE_ENTRY_SIZE 28
+#define SAMPLE_ENTRY_V1_EXTRA 16
+#define SAMPLE_ENTRY_V2_EXTRA 36
+
+// MPEG-4 descriptor tags, in 'esds'
+#define ES_DESCRIPTOR_TAG 0x03
+#define DECODER_CONFIG_TAG 0x04
+#define DECODER_SPECIFIC_INFO_TAG 0x05
+#define DECODER_CONFIG_SIZE 13
+// objectTypeIndication of MPEG-4 audio, and of MPEG-2 AAC profiles
+#define OBJECT_TYPE_MPEG4_AUDIO 0x40
+#define OBJECT_TYPE_MPEG2_AAC_MIN 0x66
+#define OBJECT_TYPE_MPEG2_AAC_MAX 0x68
+
+// 'tfhd' and 'trun' flags
+#define TFHD_BASE_DATA_OFFSET 0x000001
+#define TFHD_SAMPLE_DESCRIPTION_INDEX 0x000002
+#define TFHD_DEFAULT_DURATION 0x000008
+#define TFHD_DEFAULT_SIZE 0x000010
+#define TRUN_DATA_OFFSET 0x000001
+#define TRUN_FIRST_SAMPLE_FLAGS 0x000004
+#define TRUN_SAMPLE_DURATION 0x000100
+#define TRUN_SAMPLE_SIZE 0x000200
+#define TRUN_SAMPLE_FLAGS 0x000400
+#define TRUN_SAMPLE_CTS_OFFSET 0x000800
+
+static constexpr uint32_t fourcc(const char* type) {
+  return (uint32_t)type[0] << 24 | (uint32_t)type[1] << 16 |
+         (uint32_t)type[2] << 8 | (uint32_t)type[3];
+}
+
+static uint16_t readBE16(const uint8_t* buf) {
+  return (buf[0] << 8) | buf[1];
+}
+
+static uint32_t readBE32(const uint8_t* buf) {
+  return ((uint32_t)buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3];
+}
+
+static uint64_t readBE64(const uint8_t* buf) {
+  return ((uint64_t)readBE32(buf) << 32) | readBE32(buf + 4);
+}
+
+/**
+ * Call fn(type, payload, payloadSize) for each box of a buffer, until it returns false.
+ */
+template <typename F>
+static void forEachBox(const uint8_t* data, size_t size, F&& fn) {
+  size_t offset = 0;
+  while (size - offset >= 8) {
+    uint64_t boxSize = readBE32(data + offset);
+    uint32_t type = readBE32(data + offset + 4);
+    size_t header = 8;
+    if (boxSize == 1) {
+      if (size - offset < 16)
+        return;
+      boxSize = readBE64(data + offset + 8);
+      header = 16;
+    } else if (boxSize == 0) {
+      boxSize = size - offset;
+    }
+    if (boxSize < header || boxSize > size - offset)
+      return;
+    if (!fn(type, data + offset + header, (size_t)(boxSize - header)))
+      return;
+    offset += boxSize;
+  }
+}
+
+/**
+ * Read an MPEG-4 descriptor header, leaving p at its payload.
+ */
+static bool readDescriptor(const uint8_t*& p, const uint8_t* end, uint8_t& tag,
+                           uint32_t& len) {
+  if (p >= end)
+    return false;
+  tag = *p++;
+  len = 0;
+  for (int i = 0; i < 4; i++) {
+    if (p >= end)
+      return false;
+    uint8_t byte = *p++;
+    len = (len << 7) | (byte & 0x7f);
+    if (!(byte & 0x80))
+      return len <= (size_t)(end - p);
+  }
+  return false;
+}
+
+MP4Container::MP4Container(std::istream& istr, const std::byte* headingBytes)
+    : bell::AudioContainer(istr) {
+  if (headingBytes != nullptr) {
+    const uint8_t* bytes = (const uint8_t*)headingBytes;
+    this->headingBytes.assign(bytes, bytes + 14);
+  }
+  std::streamoff position = istr.tellg();
+  seekable = position >= 0;
+  if (seekable)
+    streamOffset = position - this->headingBytes.size();
+}
+
+size_t MP4Container::readBytes(uint8_t* dst, size_t len) {
+  size_t fromHeading = std::min(len, headingBytes.size() - headingOffset);
+  memcpy(dst, headingBytes.data() + headingOffset, fromHeading);
+  headingOffset += fromHeading;
+  size_t read = fromHeading;
+  if (fromHeading < len) {
+    istr.read((char*)dst + fromHeading, len - fromHeading);
+    read += istr.gcount();
+  }
+  streamOffset += read;
+  return read;
+}
+
+bool MP4Container::skipTo(uint64_t offset) {
+  if (offset == streamOffset)
+    return true;
+  if (offset > streamOffset &&
+      (!seekable || offset - streamOffset <= MP4_MAX_SKIP)) {
+    // read through
+    uint64_t toSkip = offset - streamOffset;
+    size_t fromHeading =
+        std::min<uint64_t>(toSkip, headingBytes.size() - headingOffset);
+    headingOffset += fromHeading;
+    streamOffset += fromHeading;
+    toSkip -= fromHeading;
+    while (toSkip > 0) {
+      size_t chunkSize =
+          std::min<uint64_t>(toSkip, std::numeric_limits<int32_t>::max());
+      istr.ignore(chunkSize);
+      streamOffset += istr.gcount();
+      if ((size_t)istr.gcount() != chunkSize)
+        return false;
+      toSkip -= chunkSize;
+    }
+    return true;
+  }
+  if (!seekable)
+    return false;
+
+  istr.clear();
+  if (!istr.seekg(offset))
+    return false;
+  headingOffset = headingBytes.size();
+  streamOffset = offset;
+  return true;
+}
+
+bool MP4Container::readBoxHeader(uint32_t& type, uint64_t& size,
+                                 uint64_t& offset) {
+  offset = streamOffset;
+  uint8_t header[16];
+  if (readBytes(header, BOX_HEADER_SIZE) != BOX_HEADER_SIZE)
+    return false;
+  size = readBE32(header);
+  type = readBE32(header + 4);
+  if (size == 1) {
+    if (readBytes(header + 8, 8) != 8)
+      return false;
+    size = readBE64(header + 8);
+  } else if (size == 0) {
+    size = BOX_SIZE_TO_END;
+  }
+  return size == BOX_SIZE_TO_END || size >= streamOffset - offset;
+}
+
+bool MP4Container::readBox(uint64_t size) {
+  if (size > MAX_BOX_SIZE) {
+    BELL_LOG(error, "MP4Container", "Box too large (%llu bytes)",
+             (unsigned long long)size);
+    return false;
+  }
+  box.resize(size);
+  return readBytes(box.data(), size) == size;
+}
+
+void MP4Container::parseSetupData() {
+  if (setupParsed)
+    return;
+  setupParsed = true;
+  channels = 2;
+  sampleRate = bell::SampleRate::SR_44100;
+  bitWidth = bell::BitWidth::BW_16;
+
+  uint32_t type;
+  uint64_t size, offset;
+  bool hasMoov = false;
+  while (readBoxHeader(type, size, offset)) {
+    uint64_t header = streamOffset - offset;
+    if (type == fourcc("moov")) {
+      hasMoov = size != BOX_SIZE_TO_END && readBox(size - header) &&
+                parseMoov(box.data(), box.size());
+      break;
+    }
+    if (size == BOX_SIZE_TO_END)
+      break;
+    if (type == fourcc("mdat") && !seekable) {
+      BELL_LOG(error, "MP4Container",
+               "'moov' follows the media data, the input must be seekable");
+      return;
+    }
+    if (!skipTo(offset + size))
+      break;
+  }
+  box.clear();
+  box.shrink_to_fit();
+  if (!hasMoov) {
+    BELL_LOG(error, "MP4Container", "No supported audio track found");
+    codec = AudioCodec::UNKNOWN;
+    return;
+  }
+
+  if (sampleRateHz)
+    sampleRate = static_cast<bell::SampleRate>(sampleRateHz);
+  BELL_LOG(info, "MP4Container", "Track %u: %s, %u Hz, %d channels%s",
+           trackId, codec == AudioCodec::AAC ? "AAC" : "ALAC", sampleRateHz,
+           channels, fragmented ? ", fragmented" : "");
+  firstFragment = nextBox = streamOffset;
+  rewindTable();
+}
+
+bool MP4Container::parseMoov(const uint8_t* data, size_t size) {
+  forEachBox(data, size, [&](uint32_t type, const uint8_t* p, size_t n) {
+    // the first supported audio track
+    if (type == fourcc("trak"))
+      return !parseTrack(p, n);
+    return true;
+  });
+  if (codec == AudioCodec::UNKNOWN)
+    return false;
+
+  uint32_t movieTimescale = 0;
+  uint64_t fragmentDuration = 0;
+  forEachBox(data, size, [&](uint32_t type, const uint8_t* p, size_t n) {
+    if (type == fourcc("mvhd") && n >= 24) {
+      movieTimescale = readBE32(p + (p[0] == 1 ? 20 : 12));
+      return true;
+    }
+    if (type != fourcc("mvex"))
+      return true;
+    fragmented = true;
+    forEachBox(p, n, [&](uint32_t type, const uint8_t* q, size_t m) {
+      if (type == fourcc("trex") && m >= 24 && readBE32(q + 4) == trackId) {
+        defaultDuration = readBE32(q + 12);
+        defaultSize = readBE32(q + 16);
+      } else if (type == fourcc("mehd") && m >= 8) {
+        fragmentDuration =
+            q[0] == 1 && m >= 12 ? readBE64(q + 4) : readBE32(q + 4);
+      }
+      return true;
+    });
+    return true;
+  });
+  // 'mdhd' of fragmented files usually only covers the samples in 'moov'
+  if (fragmented && fragmentDuration && movieTimescale) {
+    mediaDuration = fragmentDuration * timescale / movieTimescale;
+  }
+  return true;
+}
+
+bool MP4Container::parseTrack(const uint8_t* data, size_t size) {
+  uint32_t id = 0;
+  const uint8_t* mdia = nullptr;
+  size_t mdiaSize = 0;
+  forEachBox(data, size, [&](uint32_t type, const uint8_t* p, size_t n) {
+    if (type == fourcc("tkhd") && n >= 24) {
+      id = readBE32(p + (p[0] == 1 ? 20 : 12));
+    } else if (type == fourcc("mdia")) {
+      mdia = p;
+      mdiaSize = n;
+    }
+    return true;
+  });
+  if (!mdia)
+    return false;
+
+  bool audio = false;
+  uint32_t scale = 0;
+  uint64_t length = 0;
+  const uint8_t* stbl = nullptr;
+  size_t stblSize = 0;
+  forEachBox(mdia, mdiaSize, [&](uint32_t type, const uint8_t* p, size_t n) {
+    if (type == fourcc("hdlr") && n >= 12) {
+      audio = readBE32(p + 8) == fourcc("soun");
+    } else if (type == fourcc("mdhd")) {
+      if (p[0] == 1 && n >= 32) {
+        scale = readBE32(p + 20);
+        length = readBE64(p + 24);
+      } else if (n >= 20) {
+        scale = readBE32(p + 12);
+        length = readBE32(p + 16);
+      }
+    } else if (type == fourcc("minf")) {
+      forEachBox(p, n, [&](uint32_t type, const uint8_t* q, size_t m) {
+        if (type == fourcc("stbl")) {
+          stbl = q;
+          stblSize = m;
+        }
+        return true;
+      });
+    }
+    return true;
+  });
+  if (!audio || !scale || !stbl)
+    return false;
+
+  trackId = id;
+  timescale = scale;
+  mediaDuration = length;
+  return parseSampleTable(stbl, stblSize);
+}
+
+bool MP4Container::parseESDescriptor(const uint8_t* data, size_t size) {
+  // after the version and flags
+  if (size < 4)
+    return false;
+  const uint8_t* p = data + 4;
+  const uint8_t* end = data + size;
+  uint8_t tag;
+  uint32_t len;
+  if (!readDescriptor(p, end, tag, len) || tag != ES_DESCRIPTOR_TAG ||
+      len < 3) {
+    return false;
+  }
+  uint8_t flags = p[2];
+  p += 3;
+  // stream dependence, URL and OCR stream fields
+  if (flags & 0x80)
+    p += 2;
+  if ((flags & 0x40) && p < end)
+    p += 1 + *p;
+  if (flags & 0x20)
+    p += 2;
+  if (p >= end || !readDescriptor(p, end, tag, len) ||
+      tag != DECODER_CONFIG_TAG || len < DECODER_CONFIG_SIZE) {
+    return false;
+  }
+  uint8_t objectType = p[0];
+  if (objectType != OBJECT_TYPE_MPEG4_AUDIO &&
+      (objectType < OBJECT_TYPE_MPEG2_AAC_MIN ||
+       objectType > OBJECT_TYPE_MPEG2_AAC_MAX)) {
+    BELL_LOG(error, "MP4Container", "Unsupported object type 0x%02x",
+             objectType);
+    return false;
+  }
+  p += DECODER_CONFIG_SIZE;
+  if (!readDescriptor(p, end, tag, len) || tag != DECODER_SPECIFIC_INFO_TAG ||
+      len < 2) {
+    return false;
+  }
+  setupData.assign(p, p + len);
+  return true;
+}
+
+bool MP4Container::parseSampleEntry(uint32_t type, const uint8_t* data,
+                                    size_t size) {
+  if (size < SAMPLE_ENTRY_SIZE)
+    return false;
+  uint16_t version = readBE16(data + 8);
+  uint16_t channelCount = readBE16(data + 16);
+  // 16.16 fixed point, the media timescale holds rates above 65535 Hz
+  uint32_t rate = readBE32(data + 24) >> 16;
+  size_t childOffset = SAMPLE_ENTRY_SIZE;
+  if (version == 1) {
+    childOffset += SAMPLE_ENTRY_V1_EXTRA;
+  } else if (version == 2) {
+    childOffset += SAMPLE_ENTRY_V2_EXTRA;
+  }
+  if (childOffset > size)
+    return false;
+  const uint8_t* children = data + childOffset;
+  size_t childrenSize = size - childOffset;
+
+  bool found = false;
+  if (type == fourcc("mp4a")) {
+    auto findEsds = [&](uint32_t type, const uint8_t* p, size_t n) {
+      if (type == fourcc("esds"))
+        found = parseESDescriptor(p, n);
+      return !found;
+    };
+    forEachBox(children, childrenSize,
+               [&](uint32_t type, const uint8_t* p, size_t n) {
+                 // QuickTime files wrap it in 'wave'
+                 if (type == fourcc("wave")) {
+                   forEachBox(p, n, findEsds);
+                 } else {
+                   findEsds(type, p, n);
+                 }
+                 return !found;
+               });
+    if (found)
+      codec = AudioCodec::AAC;
+  } else if (type == fourcc("alac")) {
+    forEachBox(children, childrenSize,
+               [&](uint32_t type, const uint8_t* p, size_t n) {
+                 if (type != fourcc("alac") || n < 4 + 24)
+                   return true;
+                 // the decoder takes the whole atom, header included
+                 setupData.assign(p - BOX_HEADER_SIZE, p + n);
+                 // ALACSpecificConfig, after the version and flags
+                 channelCount = p[4 + 9];
+                 rate = readBE32(p + 4 + 20);
+                 found = true;
+                 return false;
+               });
+    if (found)
+      codec = AudioCodec::ALAC;
+  }
+  if (!found)
+    return false;
+
+  channels = channelCount ? channelCount : 2;
+  sampleRateHz = rate ? rate : timescale;
+  return true;
+}
+
+bool MP4Container::parseSampleTable(const uint8_t* data, size_t size) {
+  const uint8_t* stsc = nullptr;
+  size_t stscSize = 0;
+  const uint8_t* stco = nullptr;
+  size_t stcoSize = 0;
+  bool largeOffsets = false;
+  bool valid = true;
+  codec = AudioCodec::UNKNOWN;
+  chunks.clear();
+  sampleSizes.clear();
+  timeRuns.clear();
+  constantSize = 0;
+  sampleCount = 0;
+
+  forEachBox(data, size, [&](uint32_t type, const uint8_t* p, size_t n) {
+    if (type == fourcc("stsd")) {
+      // the first entry only
+      if (n >= 16 && readBE32(p + 4) >= 1) {
+        uint32_t entrySize = readBE32(p + 8);
+        if (entrySize >= 16 && entrySize <= n - 8)
+          parseSampleEntry(readBE32(p + 12), p + 16, entrySize - 8);
+      }
+    } else if (type == fourcc("stts") && n >= 8) {
+      uint32_t count = readBE32(p + 4);
+      if (count > (n - 8) / 8)
+        return valid = false;
+      for (uint32_t i = 0; i < count; i++) {
+        addTimeRun(readBE32(p + 8 + i * 8), readBE32(p + 12 + i * 8));
+      }
+    } else if (type == fourcc("stsz") && n >= 12) {
+      constantSize = readBE32(p + 4);
+      sampleCount = readBE32(p + 8);
+      if (!constantSize) {
+        if (sampleCount > (n - 12) / 4)
+          return valid = false;
+        sampleSizes.resize(sampleCount);
+        for (uint32_t i = 0; i < sampleCount; i++) {
+          sampleSizes[i] = readBE32(p + 12 + i * 4);
+        }
+      }
+    } else if (type == fourcc("stz2") && n >= 12) {
+      uint8_t fieldSize = p[7];
+      sampleCount = readBE32(p + 8);
+      if ((fieldSize != 4 && fieldSize != 8 && fieldSize != 16) ||
+          sampleCount > (uint64_t)(n - 12) * 8 / fieldSize) {
+        return valid = false;
+      }
+      sampleSizes.resize(sampleCount);
+      const uint8_t* field = p + 12;
+      for (uint32_t i = 0; i < sampleCount; i++) {
+        if (fieldSize == 16) {
+          sampleSizes[i] = readBE16(field + i * 2);
+        } else if (fieldSize == 8) {
+          sampleSizes[i] = field[i];
+        } else {
+          sampleSizes[i] = (field[i / 2] >> ((i % 2) ? 0 : 4)) & 0x0f;
+        }
+      }
+    } else if (type == fourcc("stsc")) {
+      stsc = p;
+      stscSize = n;
+    } else if (type == fourcc("stco") || type == fourcc("co64")) {
+      stco = p;
+      stcoSize = n;
+      largeOffsets = type == fourcc("co64");
+    }
+    return true;
+  });
+  if (!valid || codec == AudioCodec::UNKNOWN || !stsc || !stco ||
+      stscSize < 8 || stcoSize < 8) {
+    codec = AudioCodec::UNKNOWN;
+    return false;
+  }
+
+  // chunk offsets, with the first sample of each from the sample-to-chunk runs
+  uint32_t chunkCount = readBE32(stco + 4);
+  uint32_t entrySize = largeOffsets ? 8 : 4;
+  uint32_t runs = readBE32(stsc + 4);
+  if (chunkCount > (stcoSize - 8) / entrySize || runs > (stscSize - 8) / 12) {
+    codec = AudioCodec::UNKNOWN;
+    return false;
+  }
+  chunks.reserve(chunkCount);
+  uint32_t firstSample = 0;
+  for (uint32_t run = 0; run < runs && firstSample < sampleCount; run++) {
+    const uint8_t* entry = stsc + 8 + run * 12;
+    // 1-based chunk numbers
+    uint32_t first = readBE32(entry) - 1;
+    uint32_t last =
+        run + 1 < runs ? readBE32(entry + 12) - 1 : chunkCount;
+    uint32_t samplesPerChunk = readBE32(entry + 4);
+    for (uint32_t i = first; i < std::min(last, chunkCount); i++) {
+      const uint8_t* offset = stco + 8 + i * entrySize;
+      chunks.push_back({largeOffsets ? readBE64(offset) : readBE32(offset),
+                        firstSample});
+      firstSample += samplesPerChunk;
+      if (firstSample >= sampleCount)
+        break;
+    }
+  }
+  sampleCount = std::min(sampleCount, firstSample);
+
+  uint32_t maxSize = constantSize;
+  for (auto size : sampleSizes) {
+    maxSize = std::max(maxSize, size);
+  }
+  if (maxSize > MAX_SAMPLE_SIZE) {
+    BELL_LOG(error, "MP4Container", "Sample too large (%u bytes)", maxSize);
+    codec = AudioCodec::UNKNOWN;
+    return false;
+  }
+  sampleData.resize(maxSize);
+  tableTime = 0;
+  tableEnd = 0;
+  for (auto& run : timeRuns) {
+    tableEnd += (uint64_t)run.count * run.delta;
+  }
+  return true;
+}
+
+bool MP4Container::parseFragment(const uint8_t* data, size_t size,
+                                 uint64_t moofOffset) {
+  chunks.clear();
+  sampleSizes.clear();
+  timeRuns.clear();
+  constantSize = 0;
+  sampleCount = 0;
+  // unless given by 'tfdt', fragments follow each other
+  tableTime = tableEnd;
+
+  forEachBox(data, size, [&](uint32_t type, const uint8_t* p, size_t n) {
+    if (type != fourcc("traf"))
+      return true;
+    bool ours = false;
+    uint64_t base = moofOffset;
+    uint64_t dataOffset = base;
+    uint32_t duration = defaultDuration;
+    uint32_t sampleSize = defaultSize;
+    forEachBox(p, n, [&](uint32_t type, const uint8_t* q, size_t m) {
+      if (type == fourcc("tfhd") && m >= 8) {
+        uint32_t flags = readBE32(q) & 0xffffff;
+        ours = readBE32(q + 4) == trackId;
+        size_t field = 8;
+        size_t needed = field + ((flags & TFHD_BASE_DATA_OFFSET) ? 8 : 0) +
+                        ((flags & TFHD_SAMPLE_DESCRIPTION_INDEX) ? 4 : 0) +
+                        ((flags & TFHD_DEFAULT_DURATION) ? 4 : 0) +
+                        ((flags & TFHD_DEFAULT_SIZE) ? 4 : 0);
+        if (!ours || needed > m)
+          return ours = false;
+        if (flags & TFHD_BASE_DATA_OFFSET) {
+          base = readBE64(q + field);
+          field += 8;
+        }
+        if (flags & TFHD_SAMPLE_DESCRIPTION_INDEX)
+          field += 4;
+        if (flags & TFHD_DEFAULT_DURATION) {
+          duration = readBE32(q + field);
+          field += 4;
+        }
+        if (flags & TFHD_DEFAULT_SIZE)
+          sampleSize = readBE32(q + field);
+        dataOffset = base;
+      } else if (type == fourcc("tfdt") && ours && m >= 8) {
+        tableTime = q[0] == 1 && m >= 12 ? readBE64(q + 4) : readBE32(q + 4);
+      } else if (type == fourcc("trun") && ours && m >= 8) {
+        uint32_t flags = readBE32(q) & 0xffffff;
+        uint32_t count = readBE32(q + 4);
+        size_t field = 8;
+        if (flags & TRUN_DATA_OFFSET) {
+          if (m < field + 4)
+            return false;
+          dataOffset = base + (int32_t)readBE32(q + field);
+          field += 4;
+        }
+        if (flags & TRUN_FIRST_SAMPLE_FLAGS)
+          field += 4;
+        uint32_t perSample = 4 * (!!(flags & TRUN_SAMPLE_DURATION) +
+                                  !!(flags & TRUN_SAMPLE_SIZE) +
+                                  !!(flags & TRUN_SAMPLE_FLAGS) +
+                                  !!(flags & TRUN_SAMPLE_CTS_OFFSET));
+        if (field > m || (perSample && count > (m - field) / perSample))
+          return false;
+
+        chunks.push_back({dataOffset, sampleCount});
+        for (uint32_t i = 0; i < count; i++) {
+          uint32_t sampleDuration = duration;
+          uint32_t size = sampleSize;
+          if (flags & TRUN_SAMPLE_DURATION) {
+            sampleDuration = readBE32(q + field);
+            field += 4;
+          }
+          if (flags & TRUN_SAMPLE_SIZE) {
+            size = readBE32(q + field);
+            field += 4;
+          }
+          field += 4 * (!!(flags & TRUN_SAMPLE_FLAGS) +
+                        !!(flags & TRUN_SAMPLE_CTS_OFFSET));
+          addTimeRun(1, sampleDuration);
+          sampleSizes.push_back(size);
+          dataOffset += size;
+        }
+        sampleCount += count;
+      }
+      return true;
+    });
+    return true;
+  });
+
+  tableEnd = tableTime;
+  uint32_t maxSize = 0;
+  for (auto size : sampleSizes) {
+    maxSize = std::max(maxSize, size);
+  }
+  for (auto& run : timeRuns) {
+    tableEnd += (uint64_t)run.count * run.delta;
+  }
+  if (maxSize > MAX_SAMPLE_SIZE) {
+    BELL_LOG(error, "MP4Container", "Sample too large (%u bytes)", maxSize);
+    sampleCount = 0;
+  } else if (maxSize > sampleData.size()) {
+    sampleData.resize(maxSize);
+  }
+  rewindTable();
+  return sampleCount > 0;
+}
+
+bool MP4Container::nextFragment() {
+  if (nextBox == BOX_SIZE_TO_END || !skipTo(nextBox))
+    return false;
+  uint32_t type;
+  uint64_t size, offset;
+  bool hasSamples = false;
+  while (readBoxHeader(type, size, offset)) {
+    uint64_t header = streamOffset - offset;
+    if (type == fourcc("moof") && size != BOX_SIZE_TO_END) {
+      if (!readBox(size - header))
+        return false;
+      // fragments of other tracks are skipped
+      hasSamples = parseFragment(box.data(), box.size(), offset);
+      continue;
+    }
+    if (type == fourcc("mdat") && hasSamples) {
+      // samples are read from here on
+      nextBox = size == BOX_SIZE_TO_END ? size : offset + size;
+      return true;
+    }
+    if (size == BOX_SIZE_TO_END || !skipTo(offset + size))
+      return false;
+  }
+  return false;
+}
+
+void MP4Container::addTimeRun(uint32_t count, uint32_t delta) {
+  if (!timeRuns.empty() && timeRuns.back().delta == delta) {
+    timeRuns.back().count += count;
+  } else {
+    timeRuns.push_back({count, delta});
+  }
+}
+
+void MP4Container::rewindTable() {
+  sample = 0;
+  chunk = 0;
+  sampleOffset = chunks.empty() ? 0 : chunks[0].offset;
+  sampleTime = tableTime;
+  lastTime = tableTime;
+  timeRun = 0;
+  timeRunSample = 0;
+}
+
+uint32_t MP4Container::sampleSize(uint32_t index) const {
+  return constantSize ? constantSize : sampleSizes[index];
+}
+
+void MP4Container::advanceTime() {
+  if (timeRun >= timeRuns.size())
+    return;
+  sampleTime += timeRuns[timeRun].delta;
+  if (++timeRunSample >= timeRuns[timeRun].count) {
+    timeRun++;
+    timeRunSample = 0;
+  }
+}
+
+std::byte* MP4Container::readSample(uint32_t& len) {
+  if (!setupParsed)
+    parseSetupData();
+  len = 0;
+  if (codec == AudioCodec::UNKNOWN)
+    return nullptr;
+  while (sample >= sampleCount) {
+    if (!fragmented || !nextFragment())
+      return nullptr;
+  }
+
+  while (chunk + 1 < chunks.size() && sample >= chunks[chunk + 1].firstSample) {
+    chunk++;
+    sampleOffset = chunks[chunk].offset;
+  }
+  uint32_t size = sampleSize(sample);
+  if (!skipTo(sampleOffset) || readBytes(sampleData.data(), size) != size)
+    return nullptr;
+
+  lastTime = sampleTime;
+  sample++;
+  sampleOffset += size;
+  advanceTime();
+  len = size;
+  return (std::byte*)sampleData.data();
+}
+
+void MP4Container::consumeBytes(uint32_t len) {
+  // samples are always consumed whole
+}
+
+bool MP4Container::isEnd() {
+  // the stream usually goes on past the media data, e.g. with 'moov' at its end
+  if (istr.eof())
+    return true;
+  return setupParsed && (codec == AudioCodec::UNKNOWN ||
+                         (!fragmented && sample >= sampleCount));
+}
+
+uint8_t* MP4Container::getSetupData(uint32_t& len,
+                                    bell::AudioCodec matchCodec) {
+  if (!setupParsed)
+    parseSetupData();
+  if (matchCodec != codec || setupData.empty()) {
+    len = 0;
+    return nullptr;
+  }
+  len = setupData.size();
+  return setupData.data();
+}
+
+bell::AudioCodec MP4Container::getCodec() {
+  // only known once 'moov' is read
+  if (!setupParsed)
+    parseSetupData();
+  return codec;
+}
+
+uint64_t MP4Container::currentSample() {
+  if (!timescale)
+    return 0;
+  return lastTime * sampleRateHz / timescale;
+}
+
+uint64_t MP4Container::duration() {
+  if (!setupParsed)
+    parseSetupData();
+  if (!timescale)
+    return 0;
+  // the sum of the sample durations, unless only known per fragment
+  uint64_t time = fragmented || !tableEnd ? mediaDuration : tableEnd;
+  return time * sampleRateHz / timescale;
+}
+
+bool MP4Container::seekToSample(uint64_t target) {
+  if (!setupParsed)
+    parseSetupData();
+  if (!seekable || codec == AudioCodec::UNKNOWN || !sampleRateHz)
+    return false;
+  uint64_t time = target * timescale / sampleRateHz;
+
+  if (fragmented) {
+    if (time < tableTime) {
+      // fragments are only linked forward, walk them from the first one
+      nextBox = firstFragment;
+      tableEnd = 0;
+      chunks.clear();
+      sampleCount = 0;
+    }
+    while (time >= tableEnd || !sampleCount) {
+      if (!nextFragment()) {
+        // past the end
+        sample = sampleCount;
+        lastTime = tableEnd;
+        return true;
+      }
+    }
+  }
+
+  // sample holding the target
+  rewindTable();
+  for (auto& run : timeRuns) {
+    uint64_t runDuration = (uint64_t)run.count * run.delta;
+    if (sampleTime + runDuration > time && run.delta) {
+      uint32_t count = (time - sampleTime) / run.delta;
+      sample += count;
+      sampleTime += (uint64_t)count * run.delta;
+      timeRunSample = count;
+      break;
+    }
+    sample += run.count;
+    sampleTime += runDuration;
+    timeRun++;
+  }
+  lastTime = sampleTime;
+  if (sample >= sampleCount) {
+    sample = sampleCount;
+    return true;
+  }
+
+  auto next = std::upper_bound(chunks.begin(), chunks.end(), sample,
+                               [](uint32_t sample, const Chunk& chunk) {
+                                 return sample < chunk.firstSample;
+                               });
+  chunk = next - chunks.begin() - 1;
+  sampleOffset = chunks[chunk].offset;
+  for (uint32_t i = chunks[chunk].firstSample; i < sample; i++) {
+    sampleOffset += sampleSize(i);
+  }
+  return true;
+}
@@ -0,0 +1,424 @@
+#include "OggContainer.h"
+
+#include <string.h>   // for memcmp, memcpy, memmove, memset
+#include <algorithm>  // for min, max
+#include <array>      // for array
+
+#include "BellLogger.h"  // for AbstractLogger, BELL_LOG
+#include "StreamInfo.h"  // for BitWidth, SampleRate
+
+using namespace bell;
+
+#define OGG_FLAG_CONTINUED 0x01
+#define OGG_FLAG_BOS 0x02
+
+#define VORBIS_HEADER_COUNT 3
+#define OPUS_HEADER_COUNT 2
+#define VORBIS_ID_HEADER_SIZE 30
+#define OPUS_HEAD_SIZE 19
+
+static uint32_t readLE32(const uint8_t* buf) {
+  return buf[0] | (buf[1] << 8) | (buf[2] << 16) | ((uint32_t)buf[3] << 24);
+}
+
+static uint32_t oggCrc(const uint8_t* data, size_t len) {
+  // CRC-32 with polynomial 0x04c11db7, unreflected, zero initial value
+  static const auto table = []() {
+    std::array<uint32_t, 256> table = {};
+    for (uint32_t i = 0; i < 256; i++) {
+      uint32_t crc = i << 24;
+      for (int bit = 0; bit < 8; bit++) {
+        crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04c11db7 : crc << 1;
+      }
+      table[i] = crc;
+    }
+    return table;
+  }();
+
+  uint32_t crc = 0;
+  while (len--) {
+    crc = (crc << 8) ^ table[((crc >> 24) ^ *data++) & 0xff];
+  }
+  return crc;
+}
+
+OggContainer::OggContainer(std::istream& istr, const std::byte* headingBytes)
+    : bell::AudioContainer(istr) {
+  if (headingBytes != nullptr) {
+    const uint8_t* bytes = (const uint8_t*)headingBytes;
+    this->headingBytes.assign(bytes, bytes + 14);
+  }
+}
+
+size_t OggContainer::readBytes(uint8_t* dst, size_t len) {
+  size_t fromHeading = std::min(len, headingBytes.size() - headingOffset);
+  memcpy(dst, headingBytes.data() + headingOffset, fromHeading);
+  headingOffset += fromHeading;
+  if (fromHeading == len)
+    return len;
+  istr.read((char*)dst + fromHeading, len - fromHeading);
+  return fromHeading + istr.gcount();
+}
+
+void OggContainer::unreadBytes(const uint8_t* src, size_t len) {
+  std::vector<uint8_t> pending(src, src + len);
+  pending.insert(pending.end(), headingBytes.begin() + headingOffset,
+                 headingBytes.end());
+  headingBytes = std::move(pending);
+  headingOffset = 0;
+}
+
+void OggContainer::dropUnread() {
+  headingBytes.clear();
+  headingOffset = 0;
+}
+
+bool OggContainer::readPage() {
+  uint8_t* header = page.data();
+  if (readBytes(header, 4) != 4)
+    return false;
+
+  while (true) {
+    // look for the capture pattern
+    while (memcmp(header, "OggS", 4) != 0) {
+      memmove(header, header + 1, 3);
+      if (readBytes(header + 3, 1) != 1)
+        return false;
+    }
+
+    size_t size = PAGE_HEADER_SIZE;
+    if (readBytes(header + 4, size - 4) != size - 4)
+      return false;
+    uint8_t segments = header[26];
+    if (readBytes(header + size, segments) != segments)
+      return false;
+    size_t bodySize = 0;
+    for (int i = 0; i < segments; i++) {
+      bodySize += header[size + i];
+    }
+    size += segments;
+    if (readBytes(header + size, bodySize) != bodySize)
+      return false;
+    size += bodySize;
+
+    uint8_t crcBytes[4];
+    memcpy(crcBytes, header + 22, 4);
+    memset(header + 22, 0, 4);
+    if (header[4] == 0 && oggCrc(header, size) == readLE32(crcBytes)) {
+      pageSize = size;
+      pageFlags = header[5];
+      pageGranule = 0;
+      for (int i = 13; i >= 6; i--) {
+        pageGranule = (pageGranule << 8) | header[i];
+      }
+      pageSerial = readLE32(header + 14);
+      pageSegments = segments;
+      segment = 0;
+      bodyOffset = PAGE_HEADER_SIZE + segments;
+      return true;
+    }
+
+    // not a valid page - the capture pattern may be a false match, hiding
+    // valid pages in what it claims as its body, so scan again from the byte
+    // after it
+    BELL_LOG(debug, "OggContainer", "Invalid page, resyncing");
+    memcpy(header + 22, crcBytes, 4);
+    unreadBytes(header + 1, size - 1);
+    if (readBytes(header, 4) != 4)
+      return false;
+  }
+}
+
+bell::AudioCodec OggContainer::identifyPage(const uint8_t*& data,
+                                            uint32_t& len) {
+  // a BOS page holds only the identification header
+  const uint8_t* lacing = page.data() + PAGE_HEADER_SIZE;
+  len = 0;
+  for (int i = 0; i < pageSegments; i++) {
+    len += lacing[i];
+    if (lacing[i] < 255)
+      break;
+  }
+  data = page.data() + bodyOffset;
+
+  if (len >= VORBIS_ID_HEADER_SIZE && data[0] == 0x01 &&
+      memcmp(data + 1, "vorbis", 6) == 0) {
+    return AudioCodec::VORBIS;
+  }
+  if (len >= OPUS_HEAD_SIZE && memcmp(data, "OpusHead", 8) == 0)
+    return AudioCodec::OPUS;
+  return AudioCodec::UNKNOWN;
+}
+
+void OggContainer::parseIdentification(const uint8_t* data) {
+  if (codec == AudioCodec::VORBIS) {
+    channels = data[11];
+    streamSampleRate = readLE32(data + 12);
+  } else {
+    channels = data[9];
+    preSkip = data[10] | (data[11] << 8);
+    // decoded at 48 kHz, whatever the input rate was
+    streamSampleRate = OPUS_SAMPLE_RATE;
+  }
+  sampleRate = static_cast<bell::SampleRate>(streamSampleRate);
+  bitWidth = bell::BitWidth::BW_16;
+}
+
+bool OggContainer::nextPage() {
+  while (readPage()) {
+    if (pageSerial == serial) {
+      granule = pageGranule;
+      return true;
+    }
+    if (!(pageFlags & OGG_FLAG_BOS))
+      continue;
+
+    // a chained stream, followed if it's of the same codec
+    const uint8_t* data;
+    uint32_t len;
+    if (identifyPage(data, len) != codec)
+      continue;
+    BELL_LOG(info, "OggContainer", "New chained stream %08x", pageSerial);
+    serial = pageSerial;
+    granule = pageGranule;
+    packetContinues = false;
+    parseIdentification(data);
+    return true;
+  }
+  return false;
+}
+
+uint8_t* OggContainer::nextPacket(uint32_t& len) {
+  const uint8_t* lacing = page.data() + PAGE_HEADER_SIZE;
+  while (true) {
+    if (segment >= pageSegments) {
+      if (!nextPage()) {
+        len = 0;
+        return nullptr;
+      }
+      bool continued = pageFlags & OGG_FLAG_CONTINUED;
+      if (packetContinues && !continued) {
+        // the rest of the packet was lost
+        packetContinues = false;
+      }
+      dropPacket = continued && !packetContinues;
+      continue;
+    }
+
+    uint8_t* start = page.data() + bodyOffset;
+    size_t size = 0;
+    bool complete = false;
+    while (segment < pageSegments) {
+      uint8_t lace = lacing[segment++];
+      size += lace;
+      if (lace < 255) {
+        complete = true;
+        break;
+      }
+    }
+    bodyOffset += size;
+
+    if (dropPacket) {
+      dropPacket = !complete;
+      continue;
+    }
+    if (!complete || packetContinues) {
+      // join the parts in the packet buffer
+      if (!packetContinues)
+        packet.clear();
+      packet.insert(packet.end(), start, start + size);
+      packetContinues = !complete;
+      if (!complete)
+        continue;
+      len = packet.size();
+      return packet.data();
+    }
+    if (size == 0)
+      continue;
+
+    len = size;
+    return start;
+  }
+}
+
+void OggContainer::parseSetupData() {
+  if (setupParsed)
+    return;
+  setupParsed = true;
+
+  // use the first Vorbis or Opus logical stream
+  while (!hasSerial) {
+    if (!readPage()) {
+      BELL_LOG(error, "OggContainer", "No Vorbis or Opus stream found");
+      return;
+    }
+    const uint8_t* data;
+    uint32_t len;
+    if (!(pageFlags & OGG_FLAG_BOS) ||
+        (codec = identifyPage(data, len)) == AudioCodec::UNKNOWN) {
+      continue;
+    }
+    serial = pageSerial;
+    hasSerial = true;
+  }
+
+  size_t count =
+      codec == AudioCodec::VORBIS ? VORBIS_HEADER_COUNT : OPUS_HEADER_COUNT;
+  while (headers.size() < count) {
+    uint32_t len;
+    uint8_t* data = nextPacket(len);
+    if (!data) {
+      BELL_LOG(error, "OggContainer", "Missing codec headers");
+      return;
+    }
+    headers.emplace_back(data, data + len);
+  }
+  parseIdentification(headers[0].data());
+
+  // audio always starts on a new page
+  if (segment >= pageSegments && headingOffset == headingBytes.size())
+    dataStart = istr.tellg();
+}
+
+uint8_t* OggContainer::getSetupData(uint32_t& len,
+                                    bell::AudioCodec matchCodec) {
+  if (!setupParsed)
+    parseSetupData();
+  len = 0;
+  if (matchCodec != codec || headers.empty())
+    return nullptr;
+
+  if (codec == AudioCodec::OPUS) {
+    len = headers[0].size();
+    return headers[0].data();
+  }
+
+  if (setupData.empty()) {
+    // Xiph lacing: packet count - 1, sizes of all packets but the last, packets
+    setupData.push_back(headers.size() - 1);
+    for (size_t i = 0; i + 1 < headers.size(); i++) {
+      size_t size = headers[i].size();
+      for (; size >= 255; size -= 255) {
+        setupData.push_back(255);
+      }
+      setupData.push_back(size);
+    }
+    for (auto& header : headers) {
+      setupData.insert(setupData.end(), header.begin(), header.end());
+    }
+  }
+  len = setupData.size();
+  return setupData.data();
+}
+
+bell::AudioCodec OggContainer::getCodec() {
+  // only known once the first pages are read
+  if (!setupParsed)
+    parseSetupData();
+  return codec;
+}
+
+std::byte* OggContainer::readSample(uint32_t& len) {
+  if (!setupParsed)
+    parseSetupData();
+  if (!hasSerial) {
+    len = 0;
+    return nullptr;
+  }
+  return (std::byte*)nextPacket(len);
+}
+
+void OggContainer::consumeBytes(uint32_t len) {
+  // packets are always consumed whole
+}
+
+uint64_t OggContainer::currentSample() {
+  if (granule < 0)
+    return 0;
+  int64_t samples = granule;
+  if (codec == AudioCodec::OPUS)
+    samples = std::max<int64_t>(samples - preSkip, 0);
+  return samples;
+}
+
+uint32_t OggContainer::getPositionMs() {
+  if (!streamSampleRate)
+    return 0;
+  return currentSample() * 1000 / streamSampleRate;
+}
+
+void OggContainer::resetPageState() {
+  pageSegments = 0;
+  segment = 0;
+  packetContinues = false;
+  dropPacket = false;
+  granule = -1;
+}
+
+bool OggContainer::findPage(std::streamoff offset,
+                            std::streamoff& pageOffset) {
+  istr.clear();
+  if (!istr.seekg(offset))
+    return false;
+  dropUnread();
+  // first page of our stream that ends a packet
+  while (readPage()) {
+    if (pageSerial == serial && pageGranule >= 0) {
+      size_t unread = headingBytes.size() - headingOffset;
+      pageOffset = (std::streamoff)istr.tellg() - unread - pageSize;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool OggContainer::seekMs(uint32_t ms) {
+  if (!setupParsed)
+    parseSetupData();
+  return seekToSample((uint64_t)ms * streamSampleRate / 1000);
+}
+
+bool OggContainer::seekToSample(uint64_t sample) {
+  if (!setupParsed)
+    parseSetupData();
+  if (dataStart < 0 || !streamSampleRate)
+    return false;
+  istr.clear();
+  if (!istr.seekg(0, std::ios::end))
+    return false;
+  std::streamoff end = istr.tellg();
+
+  int64_t target = sample;
+  if (codec == AudioCodec::OPUS)
+    target = std::max<int64_t>(target + preSkip - OPUS_PREROLL, 0);
+
+  // bisect for a page starting at lo, ending before the target
+  std::streamoff lo = dataStart, hi = end;
+  while (hi - lo > MAX_PAGE_SIZE) {
+    std::streamoff mid = lo + (hi - lo) / 2;
+    std::streamoff pageOffset;
+    if (findPage(mid, pageOffset) && pageOffset < hi && pageGranule < target) {
+      lo = pageOffset;
+    } else {
+      hi = mid;
+    }
+  }
+
+  // then walk to the first page ending at or after it
+  std::streamoff position = end;
+  std::streamoff pageOffset;
+  std::streamoff offset = lo;
+  while (findPage(offset, pageOffset)) {
+    if (pageGranule >= target) {
+      position = pageOffset;
+      break;
+    }
+    offset = pageOffset + pageSize;
+  }
+
+  istr.clear();
+  istr.seekg(position);
+  dropUnread();
+  resetPageState();
+  return true;
+}
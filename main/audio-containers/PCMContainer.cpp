@@ -0,0 +1,133 @@
+#include "PCMContainer.h"
+
+#include <string.h>   // for memcpy
+#include <algorithm>  // for min
+
+#include "BellLogger.h"  // for AbstractLogger, BELL_LOG
+
+using namespace bell;
+
+bool PCMContainer::Format::isValid() const {
+  if (!sampleRate || !channels || validBits > bitsPerSample)
+    return false;
+  switch (sampleFormat) {
+    case SampleFormat::SIGNED:
+      return bitsPerSample == 8 || bitsPerSample == 16 ||
+             bitsPerSample == 24 || bitsPerSample == 32;
+    case SampleFormat::UNSIGNED:
+      return bitsPerSample == 8;
+    case SampleFormat::FLOAT:
+      return bitsPerSample == 32;
+  }
+  return false;
+}
+
+PCMContainer::PCMContainer(std::istream& istr, const Format& format)
+    : bell::AudioContainer(istr),
+      window(istr, BLOCK_SIZE * 2),
+      format(format) {
+  dataOffset = window.offset();
+}
+
+PCMContainer::PCMContainer(std::istream& istr, const std::byte* headingBytes)
+    : bell::AudioContainer(istr),
+      window(istr, BLOCK_SIZE * 2, headingBytes, headingBytes ? 14 : 0) {}
+
+bool PCMContainer::readHeader(uint8_t* dst, size_t len) {
+  if (!window.ensure(len))
+    return false;
+  memcpy(dst, window.data(), len);
+  window.consume(len);
+  return true;
+}
+
+void PCMContainer::parseSetupData() {
+  if (setupParsed)
+    return;
+  setupParsed = true;
+
+  if (!parseHeader() || !format.isValid()) {
+    BELL_LOG(error, "PCMContainer", "Unsupported PCM format");
+    format.channels = 0;
+    return;
+  }
+  if (!format.validBits)
+    format.validBits = format.bitsPerSample;
+  // a partial frame at the end is never returned
+  dataSize -= dataSize % format.frameSize();
+
+  sampleRate = static_cast<bell::SampleRate>(format.sampleRate);
+  channels = format.channels;
+  bitWidth = static_cast<bell::BitWidth>(format.bitsPerSample);
+}
+
+void PCMContainer::consumeBytes(uint32_t len) {
+  window.consume(len);
+}
+
+std::byte* PCMContainer::readSample(uint32_t& len) {
+  if (!setupParsed)
+    parseSetupData();
+
+  len = 0;
+  size_t frameSize = format.frameSize();
+  if (!frameSize)
+    return nullptr;
+  uint64_t left = BLOCK_SIZE;
+  if (dataSize)
+    left = std::min(left, dataOffset + dataSize - window.offset());
+
+  // the whole block if the stream has it
+  window.ensure(left);
+  size_t available = std::min<uint64_t>(window.available(), left);
+  len = available - available % frameSize;
+  if (!len)
+    return nullptr;
+  position = window.offset() - dataOffset;
+  return (std::byte*)window.data();
+}
+
+bool PCMContainer::isEnd() {
+  if (!format.frameSize())
+    return true;
+  if (dataSize && window.offset() >= dataOffset + dataSize)
+    return true;
+  return window.eof() && window.available() < format.frameSize();
+}
+
+bool PCMContainer::seekToSample(uint64_t sample) {
+  if (!setupParsed)
+    parseSetupData();
+  size_t frameSize = format.frameSize();
+  if (!frameSize || !window.isSeekable())
+    return false;
+
+  uint64_t offset = sample * frameSize;
+  if (dataSize)
+    offset = std::min(offset, dataSize);
+  if (!window.seek(dataOffset + offset))
+    return false;
+  position = offset;
+  return true;
+}
+
+uint64_t PCMContainer::currentSample() {
+  size_t frameSize = format.frameSize();
+  return frameSize ? position / frameSize : 0;
+}
+
+uint64_t PCMContainer::duration() {
+  if (!setupParsed)
+    parseSetupData();
+  size_t frameSize = format.frameSize();
+  if (!frameSize)
+    return 0;
+  if (dataSize)
+    return dataSize / frameSize;
+
+  // until the end of the stream
+  uint64_t streamSize = window.streamSize();
+  if (streamSize <= dataOffset)
+    return 0;
+  return (streamSize - dataOffset) / frameSize;
+}
@@ -0,0 +1,109 @@
+#include "StreamWindow.h"
+
+#include <string.h>   // for memcpy, memmove
+#include <algorithm>  // for min, max
+#include <limits>     // for numeric_limits
+
+using namespace bell;
+
+StreamWindow::StreamWindow(std::istream& istr, size_t capacity,
+                           const std::byte* headingBytes, size_t headingSize)
+    : istr(istr), buffer(std::max(capacity, headingSize)) {
+  if (headingBytes != nullptr) {
+    memcpy(buffer.data(), headingBytes, headingSize);
+    end = headingSize;
+  }
+  std::streamoff position = istr.tellg();
+  seekable = position >= 0;
+  if (seekable)
+    bufferOffset = position - end;
+}
+
+void StreamWindow::compact() {
+  // only the unconsumed bytes are moved
+  memmove(buffer.data(), buffer.data() + start, end - start);
+  bufferOffset += start;
+  end -= start;
+  start = 0;
+}
+
+bool StreamWindow::ensure(size_t len) {
+  if (available() >= len)
+    return true;
+  if (buffer.size() - start < len)
+    compact();
+  if (!istr.eof() && end < buffer.size()) {
+    // whatever the stream has at hand, then only the missing bytes: waiting for a
+    // live source to fill the whole window would delay every frame
+    end += istr.readsome((char*)buffer.data() + end, buffer.size() - end);
+    if (available() < len) {
+      istr.read((char*)buffer.data() + end,
+                std::min(len - available(), buffer.size() - end));
+      end += istr.gcount();
+    }
+  }
+  return available() >= len;
+}
+
+bool StreamWindow::skip(uint64_t len) {
+  size_t fromBuffer = std::min<uint64_t>(len, available());
+  start += fromBuffer;
+  len -= fromBuffer;
+  if (len == 0)
+    return true;
+
+  // the buffer is empty, seek over the rest, e.g. cover art, instead of downloading it
+  bufferOffset += end;
+  start = end = 0;
+  if (seekable && len > buffer.size()) {
+    istr.clear();
+    if (istr.seekg(bufferOffset + len)) {
+      bufferOffset += len;
+      return true;
+    }
+    istr.clear();
+  }
+  while (len > 0) {
+    size_t chunkSize =
+        std::min<uint64_t>(len, std::numeric_limits<int32_t>::max());
+    istr.ignore(chunkSize);
+    bufferOffset += istr.gcount();
+    if ((size_t)istr.gcount() != chunkSize)
+      return false;
+    len -= chunkSize;
+  }
+  return true;
+}
+
+bool StreamWindow::seek(uint64_t offset) {
+  if (offset >= bufferOffset && offset <= bufferOffset + end) {
+    start = offset - bufferOffset;
+    return true;
+  }
+  if (!seekable)
+    return false;
+
+  istr.clear();
+  if (!istr.seekg(offset))
+    return false;
+  bufferOffset = offset;
+  start = end = 0;
+  return true;
+}
+
+uint64_t StreamWindow::streamSize() {
+  if (!seekable)
+    return 0;
+  istr.clear();
+  std::streamoff size = -1;
+  if (istr.seekg(0, std::ios::end))
+    size = istr.tellg();
+  istr.clear();
+  istr.seekg(bufferOffset + end);
+  return size > 0 ? size : 0;
+}
+
+void StreamWindow::reserve(size_t capacity) {
+  if (capacity > buffer.size())
+    buffer.resize(capacity);
+}
@@ -0,0 +1,117 @@
+#include "WAVContainer.h"
+
+#include <stdint.h>   // for uint8_t, uint32_t, uint64_t
+#include <string.h>   // for memcmp
+#include <algorithm>  // for min
+
+#include "BellLogger.h"  // for AbstractLogger, BELL_LOG
+
+using namespace bell;
+
+#define WAV_RIFF_HEADER_SIZE 12
+#define WAV_CHUNK_HEADER_SIZE 8
+#define WAV_FMT_SIZE 16
+#define WAV_FMT_EXTENSIBLE_SIZE 40
+#define WAV_DS64_SIZE 24
+// chunk size of "data" when it's given by "ds64", or unknown
+#define WAV_SIZE_UNSET 0xFFFFFFFF
+
+#define WAVE_FORMAT_PCM 0x0001
+#define WAVE_FORMAT_IEEE_FLOAT 0x0003
+#define WAVE_FORMAT_EXTENSIBLE 0xFFFE
+
+static uint64_t readLE(const uint8_t* buf, uint8_t size) {
+  uint64_t value = 0;
+  for (uint8_t i = size; i > 0; i--) {
+    value = (value << 8) | buf[i - 1];
+  }
+  return value;
+}
+
+WAVContainer::WAVContainer(std::istream& istr, const std::byte* headingBytes)
+    : PCMContainer(istr, headingBytes) {}
+
+bool WAVContainer::parseHeader() {
+  uint8_t riff[WAV_RIFF_HEADER_SIZE];
+  if (!readHeader(riff, sizeof(riff)) ||
+      (memcmp(riff, "RIFF", 4) != 0 && memcmp(riff, "RF64", 4) != 0) ||
+      memcmp(riff + 8, "WAVE", 4) != 0) {
+    BELL_LOG(error, "WAVContainer", "Missing RIFF WAVE header");
+    return false;
+  }
+  bool rf64 = memcmp(riff, "RF64", 4) == 0;
+
+  bool formatParsed = false;
+  uint64_t ds64DataSize = 0;
+  uint8_t chunk[WAV_CHUNK_HEADER_SIZE];
+  while (readHeader(chunk, sizeof(chunk))) {
+    uint32_t size = readLE(chunk + 4, 4);
+    // chunks are padded to an even size
+    uint64_t padded = (uint64_t)size + (size & 1);
+
+    if (memcmp(chunk, "fmt ", 4) == 0) {
+      uint8_t fmt[WAV_FMT_EXTENSIBLE_SIZE];
+      size_t len = std::min<size_t>(size, sizeof(fmt));
+      if (size < WAV_FMT_SIZE || !readHeader(fmt, len) ||
+          !parseFormat(fmt, len))
+        return false;
+      window.skip(padded - len);
+      formatParsed = true;
+    } else if (memcmp(chunk, "ds64", 4) == 0 && size >= WAV_DS64_SIZE) {
+      uint8_t ds64[WAV_DS64_SIZE];
+      if (!readHeader(ds64, sizeof(ds64)))
+        return false;
+      ds64DataSize = readLE(ds64 + 8, 8);
+      window.skip(padded - sizeof(ds64));
+    } else if (memcmp(chunk, "data", 4) == 0) {
+      if (!formatParsed) {
+        BELL_LOG(error, "WAVContainer", "Data chunk before the format chunk");
+        return false;
+      }
+      dataOffset = window.offset();
+      if (size != WAV_SIZE_UNSET)
+        dataSize = size;
+      else if (rf64)
+        dataSize = ds64DataSize;
+      return true;
+    } else {
+      window.skip(padded);
+    }
+  }
+
+  BELL_LOG(error, "WAVContainer", "Missing data chunk");
+  return false;
+}
+
+bool WAVContainer::parseFormat(const uint8_t* fmt, size_t len) {
+  uint16_t formatTag = readLE(fmt, 2);
+  format.channels = readLE(fmt + 2, 2);
+  format.sampleRate = readLE(fmt + 4, 4);
+  uint16_t blockAlign = readLE(fmt + 12, 2);
+  format.validBits = readLE(fmt + 14, 2);
+  if (formatTag == WAVE_FORMAT_EXTENSIBLE && len >= WAV_FMT_EXTENSIBLE_SIZE) {
+    if (readLE(fmt + 18, 2))
+      format.validBits = readLE(fmt + 18, 2);
+    format.channelMask = readLE(fmt + 20, 4);
+    // first two bytes of the subformat GUID
+    formatTag = readLE(fmt + 24, 2);
+  }
+  // the samples' size, as stored, which validBits may not fill
+  format.bitsPerSample =
+      format.channels ? blockAlign / format.channels * 8 : 0;
+
+  switch (formatTag) {
+    case WAVE_FORMAT_PCM:
+      format.sampleFormat = format.bitsPerSample == 8
+                                ? SampleFormat::UNSIGNED
+                                : SampleFormat::SIGNED;
+      return true;
+    case WAVE_FORMAT_IEEE_FLOAT:
+      format.sampleFormat = SampleFormat::FLOAT;
+      return true;
+    default:
+      BELL_LOG(error, "WAVContainer", "Unsupported format tag 0x%04x",
+               formatTag);
+      return false;
+  }
+}
@@ -1,14 +1,23 @@
 #pragma once
 
-#include <stdint.h>  // for uint32_t
+#include <stdint.h>  // for uint32_t, uint64_t
 #include <cstddef>   // for byte, size_t
-#include <istream>   // for istream
-#include <vector>    // for vector
+#include <istream>   // for istream, streamoff
 
 #include "AudioContainer.h"  // for AudioContainer
 #include "CodecType.h"       // for AudioCodec, AudioCodec::AAC
+#include "FrameHeader.h"     // for Info
+#include "FrameIndex.h"      // for FrameIndex
+#include "StreamWindow.h"    // for StreamWindow
 
 namespace bell {
+/**
+ * AAC stream in ADTS framing.
+ *
+ * On seekable inputs, the position of every frame read is recorded in a FrameIndex, and
+ * seekToSample() walks the frame headers from the closest indexed frame. Positions past
+ * the indexed range are estimated from the average bitrate.
+ */
 class ADTSContainer : public AudioContainer {
  public:
   ~ADTSContainer(){};
@@ -18,6 +27,13 @@ class ADTSContainer : public AudioContainer {
   bool resyncADTS();
   void parseSetupData() override;
   void consumeBytes(uint32_t len) override;
+  /**
+	 * Decoding restarts one frame before the target, for the overlap.
+	 */
+  bool seekToSample(uint64_t sample) override;
+  uint64_t currentSample() override { return frameSample; }
+  uint64_t duration() override;
+  FrameIndex* getFrameIndex() override { return &frameIndex; }
 
   bell::AudioCodec getCodec() override { return bell::AudioCodec::AAC; }
 
@@ -25,12 +41,32 @@ class ADTSContainer : public AudioContainer {
   static constexpr auto AAC_MAX_FRAME_SIZE = 2100;
   static constexpr auto BUFFER_SIZE = 1024 * 10;
 
-  std::vector<std::byte> buffer = std::vector<std::byte>(BUFFER_SIZE);
-
-  size_t bytesInBuffer = 0;
-  size_t dataOffset = 0;
+  StreamWindow window;
   bool protectionAbsent = false;
 
+  bool setupParsed = false;
+  uint32_t streamSampleRate = 0;
+  uint32_t samplesPerFrame = 0;
+  // of the first frame, used until the index gives an average
+  uint32_t firstFrameSize = 0;
+  // stream offsets of the first frame and of the end, if the input is seekable
+  std::streamoff dataStart = -1;
+  std::streamoff dataEnd = -1;
+
+  FrameIndex frameIndex;
+  // false after seeking past the indexed range
+  bool indexing = false;
+  // frame returned by the last readSample()
+  bool frameKnown = false;
+  uint64_t frameSample = 0;
+  uint32_t frameSamples = 0;
+  uint64_t frameEnd = 0;
+
   bool fillBuffer();
+  void trackFrame(const FrameHeader::Info& info);
+  bool seekTo(uint64_t offset, uint64_t sample);
+  void scanTo(uint64_t sample);
+  // average stream bytes per 1024 samples
+  uint64_t bytesPerBlock();
 };
 }  // namespace bell
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stdint.h>  // for uint8_t, uint64_t
+#include <cstddef>   // for byte, size_t
+#include <istream>   // for istream
+
+#include "PCMContainer.h"  // for PCMContainer
+
+namespace bell {
+/**
+ * AIFF and AIFF-C file. Samples are big endian signed integers of 8 to 32 bits, or, in
+ * AIFF-C, one of the uncompressed types: "NONE" and "twos" (the same), "sowt" (little
+ * endian), "in24", "in32", "fl32" and "raw " (8-bit unsigned). Compressed types are
+ * refused.
+ *
+ * The COMM chunk may follow SSND, in which case the input must be seekable, for the
+ * samples to be read once the format is known.
+ */
+class AIFFContainer : public PCMContainer {
+ public:
+  ~AIFFContainer(){};
+  AIFFContainer(std::istream& istr, const std::byte* headingBytes = nullptr);
+
+ protected:
+  bool parseHeader() override;
+
+ private:
+  // frames given by COMM
+  uint64_t commFrames = 0;
+
+  bool parseCommon(const uint8_t* comm, size_t len, bool aifc);
+};
+}  // namespace bell
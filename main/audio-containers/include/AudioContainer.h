@@ -4,12 +4,17 @@
 #include <cstring>
 #include <istream>
 #include "CodecType.h"
+#include "ID3Tag.h"
 #include "StreamInfo.h"
 
 namespace bell {
+class FrameIndex;
+
 class AudioContainer {
  protected:
   std::istream& istr;
+  // found before the stream, by the container guesser or the container itself
+  ID3Tag id3Tag;
 
  public:
   bell::SampleRate sampleRate;
@@ -17,10 +22,72 @@ class AudioContainer {
   int channels;
 
   AudioContainer(std::istream& istr) : istr(istr) {}
+  virtual ~AudioContainer() = default;
 
   virtual std::byte* readSample(uint32_t& len) = 0;
   virtual void consumeBytes(uint32_t len) = 0;
   virtual void parseSetupData() = 0;
   virtual bell::AudioCodec getCodec() = 0;
+  /**
+	 * Codec setup data carried by the container, e.g. Vorbis headers.
+	 *
+	 * @param [out] len size of the returned data
+	 * @param [in] matchCodec codec the data is needed for
+	 * @return pointer to the data, owned by the container; nullptr if there's none
+	 */
+  virtual uint8_t* getSetupData(uint32_t& len, bell::AudioCodec matchCodec) {
+    len = 0;
+    return nullptr;
+  }
+  /**
+	 * Trimming needed for gapless playback, as recorded by the encoder.
+	 *
+	 * @param [out] skipSamples decoded samples (per channel) to drop at the start, encoder and decoder delay included
+	 * @param [out] validSamples samples (per channel) to keep after them, the rest is padding
+	 * @return false if the container doesn't know
+	 */
+  virtual bool getGaplessInfo(uint32_t& skipSamples, uint64_t& validSamples) {
+    return false;
+  }
+
+  /**
+	 * Whether the input ended: the stream was read to its end, or the container knows that
+	 * no more samples follow. readSample() may still return frames buffered before that.
+	 */
+  virtual bool isEnd() { return istr.eof(); }
+
+  /**
+	 * Move to the frame holding the given sample (per channel, gapless delay excluded), or
+	 * slightly before it, for the decoder to converge. currentSample() then tells where
+	 * decoding restarts. The codec should be reset afterwards.
+	 *
+	 * @returns false if the container or the input is not seekable
+	 */
+  virtual bool seekToSample(uint64_t sample) { return false; }
+  /**
+	 * Position of the data returned by the last readSample(), or of the next one after a
+	 * seek, in samples per channel. Frame-accurate for elementary streams (approximate
+	 * after seeking outside of their frame index), page-accurate for Ogg.
+	 */
+  virtual uint64_t currentSample() { return 0; }
+  /**
+	 * Duration of the stream, in samples per channel; 0 if unknown. May be an estimate
+	 * until the stream was read (or indexed) to its end.
+	 */
+  virtual uint64_t duration() { return 0; }
+  /**
+	 * Index of the frame positions seen so far, for containers building one; it can be
+	 * saved along the media file and loaded back before parseSetupData().
+	 */
+  virtual FrameIndex* getFrameIndex() { return nullptr; }
+
+  /**
+	 * Fields of the ID3v2 tag found before the stream, parsed on the first call (see
+	 * ID3Tag::read()). As it seeks the input, call it from the thread reading samples.
+	 *
+	 * @returns nullptr if there's no tag, or the input can't seek back to it
+	 */
+  const ID3Tag::Fields* getTags() { return id3Tag.read(istr); }
+  void setID3Tag(const ID3Tag& tag) { id3Tag = tag; }
 };
 }  // namespace bell
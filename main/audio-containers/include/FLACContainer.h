@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>  // for uint32_t, uint8_t, uint16_t, uint64_t
+#include <cstddef>   // for byte, size_t
+#include <istream>   // for istream
+
+#include "AudioContainer.h"  // for AudioContainer
+#include "CodecType.h"       // for AudioCodec, AudioCodec::FLAC
+#include "StreamWindow.h"    // for StreamWindow
+
+namespace bell {
+/**
+ * Native FLAC stream container. Parses the metadata blocks (keeping STREAMINFO, skipping
+ * the rest), and then returns frames, located by their sync code and header CRC.
+ *
+ * readSample() only guarantees that a whole frame is buffered - the codec reports how
+ * many bytes the frame actually took.
+ */
+class FLACContainer : public AudioContainer {
+ public:
+  struct StreamInfo {
+    uint16_t minBlockSize = 0;
+    uint16_t maxBlockSize = 0;
+    uint32_t minFrameSize = 0;
+    uint32_t maxFrameSize = 0;
+    uint32_t sampleRate = 0;
+    uint8_t channels = 0;
+    uint8_t bitsPerSample = 0;
+    uint64_t totalSamples = 0;
+  };
+
+  ~FLACContainer(){};
+  FLACContainer(std::istream& istr, const std::byte* headingBytes = nullptr);
+
+  std::byte* readSample(uint32_t& len) override;
+  void parseSetupData() override;
+  void consumeBytes(uint32_t len) override;
+
+  bell::AudioCodec getCodec() override { return bell::AudioCodec::FLAC; }
+
+  /**
+	 * Contents of the STREAMINFO block. Valid after parseSetupData().
+	 */
+  const StreamInfo& getStreamInfo() const { return streamInfo; }
+
+ private:
+  // used when STREAMINFO doesn't specify the largest frame
+  static constexpr auto DEFAULT_BUFFER_SIZE = 64 * 1024;
+  static constexpr auto MIN_BUFFER_SIZE = 16 * 1024;
+
+  StreamWindow window;
+  bool setupParsed = false;
+  StreamInfo streamInfo;
+
+  bool fillBuffer();
+  size_t readBytes(uint8_t* dst, size_t len);
+};
+}  // namespace bell
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stddef.h>  // for size_t
+#include <stdint.h>  // for uint32_t, uint8_t
+
+#include "CodecType.h"  // for AudioCodec
+
+/**
+ * Parsers for the frame headers of elementary audio streams (MP3, ADTS AAC, FLAC).
+ * They only look at a single header, so a sync point should be confirmed by checking
+ * that the next frame follows where the previous one ends (FLAC headers are also
+ * protected by a CRC-8).
+ */
+namespace bell::FrameHeader {
+struct Info {
+  // whole frame length, including the header
+  uint32_t frameSize;
+  // decoded samples (per channel) in the frame
+  uint32_t samples;
+  uint32_t sampleRate;
+  uint8_t channels;
+};
+
+struct FLACInfo {
+  uint32_t blockSize;
+  // 0 if it should be taken from STREAMINFO
+  uint32_t sampleRate;
+  uint8_t bitsPerSample;
+  uint8_t channels;
+  // 0-7: independent channels, 8: left/side, 9: side/right, 10: mid/side
+  uint8_t channelAssignment;
+  bool variableBlockSize;
+  // frame number, or sample number for variable block size streams
+  uint64_t number;
+  uint8_t headerSize;
+};
+
+// bytes needed by the parsers
+static constexpr size_t ADTS_HEADER_SIZE = 7;
+static constexpr size_t MP3_HEADER_SIZE = 4;
+static constexpr size_t FLAC_MAX_HEADER_SIZE = 16;
+
+// sync word: 0xff, then a byte matching (byte & mask) == value
+struct Sync {
+  uint8_t mask;
+  uint8_t value;
+};
+
+// 11 bits, also matching MPEG-2.5
+static constexpr Sync MP3_SYNC = {0xe0, 0xe0};
+// 12 bits, and layer 0
+static constexpr Sync ADTS_SYNC = {0xf6, 0xf0};
+// 14 bits, and the reserved bit
+static constexpr Sync FLAC_SYNC = {0xfe, 0xf8};
+
+/**
+ * Offset of the first sync word in buf, or len if there's none. Candidates are located
+ * with memchr, which libc implements with SIMD on hosts and a word at a time on the
+ * ESP32, so skipping over corrupted data costs little more than a memory scan.
+ */
+size_t findSync(const uint8_t* buf, size_t len, Sync sync);
+
+bool parseADTS(const uint8_t* buf, Info& info);
+bool parseMP3(const uint8_t* buf, Info& info);
+/**
+ * Parse a FLAC frame header, of at most len bytes, and verify its CRC-8.
+ */
+bool parseFLAC(const uint8_t* buf, size_t len, FLACInfo& info);
+/**
+ * Parse a header of the given codec (AAC or MP3), headerSize() bytes long.
+ */
+bool parse(bell::AudioCodec codec, const uint8_t* buf, Info& info);
+size_t headerSize(bell::AudioCodec codec);
+}  // namespace bell::FrameHeader
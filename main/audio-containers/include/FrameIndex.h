@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdint.h>  // for uint64_t, uint32_t
+#include <istream>   // for istream, ostream
+#include <string>    // for string
+#include <vector>    // for vector
+
+namespace bell {
+/**
+ * Compact index of frame positions in an elementary audio stream (MP3, ADTS), built
+ * lazily while the stream is read. Every INTERVAL-th frame is recorded with its first
+ * sample and stream offset; seeking then walks at most INTERVAL frame headers from the
+ * closest entry, without decoding them.
+ *
+ * Frames are only recorded contiguously from the first one, so the index always covers
+ * the stream up to end(). Once the stream was read to its end, the index is complete,
+ * and also gives the exact duration.
+ *
+ * The index can be saved to a small sidecar file (a few bytes per entry), and loaded
+ * when the same stream is opened again, so that seeking is instant on revisits.
+ */
+class FrameIndex {
+ public:
+  struct Entry {
+    // first sample (per channel) of the frame
+    uint64_t sample;
+    // absolute stream offset of the frame
+    uint64_t offset;
+  };
+
+  // frames per entry
+  static constexpr uint32_t INTERVAL = 32;
+
+  /**
+	 * Start indexing at the first frame, found at the given stream offset. A loaded index
+	 * is kept if it starts there, and dropped otherwise.
+	 */
+  void begin(uint64_t offset);
+  /**
+	 * Record a frame. Frames must be added in stream order, without skipping any (junk
+	 * between them is fine); the container stops adding them after seeking past end().
+	 * Frames that are already indexed are ignored.
+	 */
+  void addFrame(uint64_t offset, uint32_t size, uint32_t samples);
+  /**
+	 * Mark the index complete, once the last frame was added.
+	 */
+  void setComplete() { complete = true; }
+
+  /**
+	 * Find the last entry at or before the given sample.
+	 * @returns false if the sample is not covered by the index
+	 */
+  bool find(uint64_t sample, Entry& entry) const;
+  /**
+	 * Sample and offset of the frame following the indexed range.
+	 */
+  Entry end() const { return {nextSample, nextOffset}; }
+  bool isComplete() const { return complete; }
+  bool isEmpty() const { return entries.empty(); }
+
+  /**
+	 * Serialize the index. streamSize is stored along, and checked by load(), so that an
+	 * index saved for another version of the file is not used.
+	 */
+  void save(std::ostream& out, uint64_t streamSize) const;
+  bool load(std::istream& in, uint64_t streamSize);
+  /**
+	 * Save to, or load from a sidecar file, e.g. the media file's path with ".bidx" added.
+	 */
+  bool saveFile(const std::string& path, uint64_t streamSize) const;
+  bool loadFile(const std::string& path, uint64_t streamSize);
+
+ private:
+  static constexpr uint8_t VERSION = 1;
+
+  std::vector<Entry> entries;
+  uint64_t nextSample = 0;
+  uint64_t nextOffset = 0;
+  uint64_t frames = 0;
+  bool complete = false;
+};
+}  // namespace bell
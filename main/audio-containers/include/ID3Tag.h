@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdint.h>  // for uint32_t, uint64_t, uint8_t
+#include <istream>   // for istream
+#include <string>    // for string
+#include <vector>    // for vector
+
+namespace bell {
+/**
+ * ID3v2 tag (versions 2.2 to 2.4), as found before MP3 streams, and sometimes AAC or
+ * FLAC ones.
+ *
+ * Only the tag header is read when the stream is opened, so that the tag can be skipped
+ * (with a seek, on seekable streams) without reading through embedded pictures. Frames
+ * are parsed on the first call to read(), which seeks back to the tag; pictures aren't
+ * read even then, only their position in the stream is kept.
+ */
+class ID3Tag {
+ public:
+  static constexpr uint32_t HEADER_SIZE = 10;
+
+  struct Fields {
+    std::string title;
+    std::string artist;
+    std::string album;
+    // ReplayGain, in dB, and peak amplitude; 0 if not tagged
+    bool hasTrackGain = false;
+    float trackGain = 0;
+    float trackPeak = 0;
+    bool hasAlbumGain = false;
+    float albumGain = 0;
+    float albumPeak = 0;
+    // embedded picture, the front cover if there are several; artSize is 0 if none
+    std::string artMime;
+    uint64_t artOffset = 0;
+    uint32_t artSize = 0;
+  };
+
+  /**
+	 * Size of the tag starting with the given header, footer included.
+	 *
+	 * @param header at least HEADER_SIZE bytes
+	 * @returns 0 if it's not an ID3v2 tag header
+	 */
+  static uint32_t tagSize(const uint8_t* header);
+
+  ID3Tag() = default;
+  /**
+	 * @param offset stream offset of the tag header
+	 * @param size of the whole tag, see tagSize()
+	 */
+  ID3Tag(uint64_t offset, uint32_t size) : offset(offset), size(size) {}
+
+  bool exists() const { return size != 0; }
+
+  /**
+	 * Parse the tag's frames, on the first call. The stream is moved back to the tag, and
+	 * then to where it was, state included.
+	 *
+	 * @returns nullptr if there's no tag, or the stream can't seek back to it
+	 */
+  const Fields* read(std::istream& istr);
+
+ private:
+  uint64_t offset = 0;
+  uint32_t size = 0;
+  bool parsed = false;
+  bool valid = false;
+  Fields fields;
+  // whether the picture found is the front cover
+  bool frontCover = false;
+
+  bool parse(std::istream& istr);
+  void parseText(const std::string& id, std::vector<uint8_t>& frame);
+  void parseUserText(std::vector<uint8_t>& frame);
+  bool parsePicture(std::istream& istr, const std::string& id,
+                    uint64_t frameOffset, uint32_t frameSize);
+};
+}  // namespace bell
@@ -1,14 +1,31 @@
 #pragma once
 
-#include <stdint.h>  // for uint32_t
+#include <stdint.h>  // for uint32_t, uint64_t, uint8_t
 #include <cstddef>   // for byte, size_t
-#include <istream>   // for istream
+#include <istream>   // for istream, streamoff
 #include <vector>    // for vector
 
 #include "AudioContainer.h"  // for AudioContainer
 #include "CodecType.h"       // for AudioCodec, AudioCodec::MP3
+#include "FrameHeader.h"     // for Info
+#include "FrameIndex.h"      // for FrameIndex
+#include "StreamWindow.h"    // for StreamWindow
 
 namespace bell {
+/**
+ * MPEG audio elementary stream container.
+ *
+ * parseSetupData() skips a leading ID3v2 tag (see getTags()), and reads the stream
+ * parameters from the first frame. If that frame is a Xing/Info or VBRI header, it's not
+ * returned as audio; its frame count gives the exact duration, and its table of contents
+ * is used to seek.
+ * A LAME extension also gives the encoder delay and padding, for gapless playback.
+ *
+ * On seekable inputs, the position of every frame read is recorded in a FrameIndex, and
+ * seekToSample() walks the frame headers from the closest indexed frame. Positions past
+ * the indexed range are estimated from the table of contents (or from the bitrate, for
+ * CBR streams without one), so that seeking never scans the stream from the start.
+ */
 class MP3Container : public AudioContainer {
  public:
   ~MP3Container(){};
@@ -17,19 +34,75 @@ class MP3Container : public AudioContainer {
   std::byte* readSample(uint32_t& len) override;
   void parseSetupData() override;
   void consumeBytes(uint32_t len) override;
+  bool getGaplessInfo(uint32_t& skipSamples, uint64_t& validSamples) override;
+  /**
+	 * Decoding restarts two frames before the target, to refill the bit reservoir; the
+	 * first one may not decode.
+	 */
+  bool seekToSample(uint64_t sample) override;
+  uint64_t currentSample() override;
+  /**
+	 * Exact once the stream was indexed to its end, or when it has a Xing/Info or VBRI
+	 * header; estimated from the bitrate and size otherwise.
+	 */
+  uint64_t duration() override;
+  FrameIndex* getFrameIndex() override { return &frameIndex; }
 
   bell::AudioCodec getCodec() override { return bell::AudioCodec::MP3; }
 
+  /**
+	 * duration() and seekToSample(), in milliseconds.
+	 */
+  uint32_t getDurationMs();
+  bool seekMs(uint32_t ms);
+
  private:
   static constexpr auto MP3_MAX_FRAME_SIZE = 2100;
   static constexpr auto BUFFER_SIZE = 1024 * 10;
 
-  std::vector<std::byte> buffer = std::vector<std::byte>(BUFFER_SIZE);
+  // position in the stream, in samples, and offset from the first audio frame
+  struct SeekPoint {
+    uint64_t sample;
+    uint64_t offset;
+  };
+
+  StreamWindow window;
+
+  bool setupParsed = false;
+  uint32_t streamSampleRate = 0;
+  uint32_t samplesPerFrame = 0;
+  // of the first audio frame, used to estimate CBR positions
+  uint32_t bitrate = 0;
+  // stream offsets of the first audio frame and of the end, if the input is seekable
+  std::streamoff dataStart = -1;
+  std::streamoff dataEnd = -1;
+
+  FrameIndex frameIndex;
+  // false after seeking past the indexed range
+  bool indexing = false;
+  // frame returned by the last readSample()
+  bool frameKnown = false;
+  uint64_t frameSample = 0;
+  uint32_t frameSamples = 0;
+  uint64_t frameEnd = 0;
 
-  size_t bytesInBuffer = 0;
-  size_t dataOffset = 0;
-  size_t toConsume = 0;
+  // from the Xing/Info or VBRI header
+  uint32_t totalFrames = 0;
+  uint32_t totalBytes = 0;
+  std::vector<SeekPoint> seekPoints;
+  // from the LAME extension
+  bool hasGapless = false;
+  uint16_t encoderDelay = 0;
+  uint16_t encoderPadding = 0;
 
   bool fillBuffer();
+  void skipID3v2();
+  bool findFrame(FrameHeader::Info& info);
+  bool parseXing(const uint8_t* frame, const FrameHeader::Info& info);
+  bool parseVBRI(const uint8_t* frame, const FrameHeader::Info& info);
+  uint32_t delaySamples() const;
+  void trackFrame(const FrameHeader::Info& info);
+  bool seekTo(uint64_t offset, uint64_t sample);
+  void scanTo(uint64_t sample);
 };
 }  // namespace bell
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <stdint.h>  // for uint32_t, uint64_t, uint8_t
+#include <cstddef>   // for byte, size_t
+#include <istream>   // for istream
+#include <vector>    // for vector
+
+#include "AudioContainer.h"  // for AudioContainer
+#include "CodecType.h"       // for AudioCodec
+
+namespace bell {
+/**
+ * ISO base media file (MP4, M4A) demuxer, for AAC and ALAC audio tracks.
+ *
+ * parseSetupData() reads the top-level boxes up to 'moov', and keeps the sample table of
+ * the first audio track in a compact form: chunk offsets with their first sample, plus
+ * the sample sizes (none, when they're constant). Reading is sequential, and locating a
+ * sample for a seek is a binary search over the chunks. When 'moov' follows the media
+ * data, as written by many encoders, the input must be seekable; 'mdat' is then skipped,
+ * which for HTTP sources (through BufferedStream) means a range request.
+ *
+ * Fragmented files are supported too: once the samples from 'moov' (often none) are
+ * read, each 'moof' box replaces the table with its fragment's samples.
+ *
+ * readSample() returns one whole sample (an AAC access unit or ALAC packet), read directly
+ * into the buffer handed to the codec. getSetupData() returns the AudioSpecificConfig
+ * for AAC, and the 'alac' atom (the magic cookie) for ALAC.
+ */
+class MP4Container : public AudioContainer {
+ public:
+  ~MP4Container(){};
+  MP4Container(std::istream& istr, const std::byte* headingBytes = nullptr);
+
+  std::byte* readSample(uint32_t& len) override;
+  void parseSetupData() override;
+  void consumeBytes(uint32_t len) override;
+  uint8_t* getSetupData(uint32_t& len, bell::AudioCodec matchCodec) override;
+  bool isEnd() override;
+  bool seekToSample(uint64_t sample) override;
+  uint64_t currentSample() override;
+  uint64_t duration() override;
+
+  bell::AudioCodec getCodec() override;
+
+ private:
+  static constexpr auto BOX_HEADER_SIZE = 8;
+  // larger boxes to be parsed (moov, moof) are refused
+  static constexpr auto MAX_BOX_SIZE = 16 * 1024 * 1024;
+  // well above the largest ALAC packet (8 channels of 4096 32-bit samples)
+  static constexpr auto MAX_SAMPLE_SIZE = 256 * 1024;
+
+  struct Chunk {
+    uint64_t offset;
+    uint32_t firstSample;
+  };
+  // run of samples sharing a duration, from 'stts' or 'trun'
+  struct TimeRun {
+    uint32_t count;
+    uint32_t delta;
+  };
+
+  // bytes read by the container guesser, served before the stream
+  std::vector<uint8_t> headingBytes;
+  size_t headingOffset = 0;
+  // of the next byte read
+  uint64_t streamOffset = 0;
+  bool seekable = false;
+
+  bool setupParsed = false;
+  bell::AudioCodec codec = bell::AudioCodec::UNKNOWN;
+  uint32_t trackId = 0;
+  // media time units per second, from 'mdhd'
+  uint32_t timescale = 0;
+  uint64_t mediaDuration = 0;
+  // AudioSpecificConfig or ALAC magic cookie
+  std::vector<uint8_t> setupData;
+  // defaults for fragments, from 'trex'
+  uint32_t defaultDuration = 0;
+  uint32_t defaultSize = 0;
+  bool fragmented = false;
+  // stream offsets of the first fragment, and of the box after the current one
+  uint64_t firstFragment = 0;
+  uint64_t nextBox = 0;
+
+  // sample table, of 'moov' or of the current fragment
+  std::vector<Chunk> chunks;
+  std::vector<uint32_t> sampleSizes;
+  uint32_t constantSize = 0;
+  uint32_t sampleCount = 0;
+  std::vector<TimeRun> timeRuns;
+  // media time of the table's first sample, and after its last one
+  uint64_t tableTime = 0;
+  uint64_t tableEnd = 0;
+  uint32_t sampleRateHz = 0;
+
+  // next sample to read, its chunk, offset and media time
+  uint32_t sample = 0;
+  size_t chunk = 0;
+  uint64_t sampleOffset = 0;
+  uint64_t sampleTime = 0;
+  size_t timeRun = 0;
+  uint32_t timeRunSample = 0;
+  // media time of the sample returned by the last readSample()
+  uint64_t lastTime = 0;
+
+  std::vector<uint8_t> box;
+  std::vector<uint8_t> sampleData;
+
+  size_t readBytes(uint8_t* dst, size_t len);
+  bool skipTo(uint64_t offset);
+  bool readBoxHeader(uint32_t& type, uint64_t& size, uint64_t& offset);
+  bool readBox(uint64_t size);
+  bool parseMoov(const uint8_t* data, size_t size);
+  bool parseTrack(const uint8_t* data, size_t size);
+  bool parseSampleEntry(uint32_t type, const uint8_t* data, size_t size);
+  bool parseESDescriptor(const uint8_t* data, size_t size);
+  bool parseSampleTable(const uint8_t* data, size_t size);
+  bool parseFragment(const uint8_t* data, size_t size, uint64_t moofOffset);
+  bool nextFragment();
+  void rewindTable();
+  void addTimeRun(uint32_t count, uint32_t delta);
+  uint32_t sampleSize(uint32_t index) const;
+  void advanceTime();
+};
+}  // namespace bell
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <stdint.h>  // for uint32_t, uint8_t, int64_t, uint16_t
+#include <cstddef>   // for byte, size_t
+#include <istream>   // for istream
+#include <vector>    // for vector
+
+#include "AudioContainer.h"  // for AudioContainer
+#include "CodecType.h"       // for AudioCodec
+
+namespace bell {
+/**
+ * Ogg demuxer, for Vorbis and Opus streams.
+ *
+ * Pages are read one at a time, and checked against their CRC - on a mismatch, the next
+ * page is searched for from the byte after the rejected capture pattern, as libogg does. Packets that fit within a page are returned
+ * straight from the page buffer; only packets continued across pages are copied, to be
+ * joined together.
+ *
+ * parseSetupData() reads the codec headers of the first Vorbis or Opus logical stream,
+ * and getSetupData() returns them to the codec (Xiph-laced for Vorbis, the OpusHead
+ * packet for Opus). Other multiplexed streams are skipped. When a new stream is chained
+ * after the current one (as internet radio does on every track change), its header
+ * packets are returned by readSample() like audio packets, for the codec to set itself up
+ * again.
+ *
+ * On seekable inputs, seekToSample() bisects the file using the page granule positions.
+ */
+class OggContainer : public AudioContainer {
+ public:
+  ~OggContainer(){};
+  OggContainer(std::istream& istr, const std::byte* headingBytes = nullptr);
+
+  std::byte* readSample(uint32_t& len) override;
+  void parseSetupData() override;
+  void consumeBytes(uint32_t len) override;
+  uint8_t* getSetupData(uint32_t& len, bell::AudioCodec matchCodec) override;
+
+  bell::AudioCodec getCodec() override;
+
+  /**
+	 * Number of samples to drop at the start of an Opus stream, at 48 kHz.
+	 */
+  uint16_t getPreSkip() const { return preSkip; }
+  /**
+	 * Move to the first page ending at or after the given sample, so that decoding
+	 * starts on a page boundary before it. Opus streams are placed 80 ms earlier, for
+	 * the decoder to converge. The codec should be reset afterwards.
+	 */
+  bool seekToSample(uint64_t sample) override;
+  /**
+	 * Position of the end of the last page read.
+	 */
+  uint64_t currentSample() override;
+
+  /**
+	 * currentSample() and seekToSample(), in milliseconds.
+	 */
+  uint32_t getPositionMs();
+  bool seekMs(uint32_t ms);
+
+ private:
+  static constexpr auto PAGE_HEADER_SIZE = 27;
+  static constexpr auto MAX_PAGE_SIZE = PAGE_HEADER_SIZE + 255 + 255 * 255;
+  static constexpr auto OPUS_SAMPLE_RATE = 48000;
+  static constexpr auto OPUS_PREROLL = 3840;
+
+  // bytes read by the container guesser, or of a rejected page, served
+  // before the stream
+  std::vector<uint8_t> headingBytes;
+  size_t headingOffset = 0;
+
+  // current page, header and lacing table included
+  std::vector<uint8_t> page = std::vector<uint8_t>(MAX_PAGE_SIZE);
+  size_t pageSize = 0;
+  uint8_t pageFlags = 0;
+  uint32_t pageSerial = 0;
+  int64_t pageGranule = -1;
+  uint8_t pageSegments = 0;
+  uint8_t segment = 0;
+  size_t bodyOffset = 0;
+  // of the last page read from our stream
+  int64_t granule = -1;
+
+  // packet continued across pages
+  std::vector<uint8_t> packet;
+  bool packetContinues = false;
+  // rest of a packet whose start was lost, after a resync or seek
+  bool dropPacket = false;
+
+  bell::AudioCodec codec = bell::AudioCodec::UNKNOWN;
+  uint32_t serial = 0;
+  bool hasSerial = false;
+  bool setupParsed = false;
+  uint32_t streamSampleRate = 0;
+  uint16_t preSkip = 0;
+  // Vorbis identification, comment and setup headers, or OpusHead and OpusTags
+  std::vector<std::vector<uint8_t>> headers;
+  std::vector<uint8_t> setupData;
+  // stream offset of the first audio page, if the input is seekable
+  std::streamoff dataStart = -1;
+
+  size_t readBytes(uint8_t* dst, size_t len);
+  // serve len bytes again, before any still unread
+  void unreadBytes(const uint8_t* src, size_t len);
+  void dropUnread();
+  bool readPage();
+  bool nextPage();
+  uint8_t* nextPacket(uint32_t& len);
+  bell::AudioCodec identifyPage(const uint8_t*& data, uint32_t& len);
+  void parseIdentification(const uint8_t* data);
+  bool findPage(std::streamoff offset, std::streamoff& pageOffset);
+  void resetPageState();
+};
+}  // namespace bell
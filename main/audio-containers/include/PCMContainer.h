@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdint.h>  // for uint32_t, uint8_t, uint64_t
+#include <cstddef>   // for byte, size_t
+#include <istream>   // for istream
+
+#include "AudioContainer.h"  // for AudioContainer
+#include "CodecType.h"       // for AudioCodec, AudioCodec::PCM
+#include "StreamWindow.h"    // for StreamWindow
+
+namespace bell {
+/**
+ * Container for uncompressed PCM, passed to PCMDecoder as it is. Used directly for raw
+ * streams of a known format, and as the base of WAVContainer and AIFFContainer, which
+ * parse it from their headers.
+ *
+ * readSample() returns blocks of whole frames, in place in the stream window - for
+ * little endian integer samples, PCMDecoder hands them on without a copy. Frames have a
+ * fixed size, so that seeking is a single seek of the input, and the duration is known
+ * from the size of the data.
+ */
+class PCMContainer : public AudioContainer {
+ public:
+  enum class SampleFormat { SIGNED, UNSIGNED, FLOAT };
+
+  struct Format {
+    uint32_t sampleRate = 0;
+    uint8_t channels = 0;
+    // size of a sample in the stream: 8, 16, 24 or 32 (32 only for FLOAT)
+    uint8_t bitsPerSample = 0;
+    // significant (most significant) bits of a sample, e.g. 20 of 24
+    uint8_t validBits = 0;
+    SampleFormat sampleFormat = SampleFormat::SIGNED;
+    bool bigEndian = false;
+    // WAVE_FORMAT_EXTENSIBLE speaker positions, SPEAKER_FRONT_LEFT being bit 0; 0 if
+    // unknown, channels then follow the usual order for their count
+    uint32_t channelMask = 0;
+
+    size_t frameSize() const { return channels * (bitsPerSample / 8); }
+    // whether PCMDecoder can decode it
+    bool isValid() const;
+  };
+
+  ~PCMContainer(){};
+  /**
+	 * Raw PCM, starting at the stream's current position and lasting until its end.
+	 */
+  PCMContainer(std::istream& istr, const Format& format);
+
+  std::byte* readSample(uint32_t& len) override;
+  void parseSetupData() override;
+  void consumeBytes(uint32_t len) override;
+  bool isEnd() override;
+  bool seekToSample(uint64_t sample) override;
+  uint64_t currentSample() override;
+  uint64_t duration() override;
+
+  bell::AudioCodec getCodec() override { return bell::AudioCodec::PCM; }
+
+  /**
+	 * Format of the samples. Valid after parseSetupData(); channels is 0 if the header
+	 * can't be parsed, or describes samples that aren't supported.
+	 */
+  const Format& getFormat() const { return format; }
+
+ protected:
+  // returned by readSample(), at most
+  static constexpr auto BLOCK_SIZE = 8 * 1024;
+
+  StreamWindow window;
+  Format format;
+  // stream offset of the first frame, and size of the frames; 0 if they last until the
+  // end of the stream
+  uint64_t dataOffset = 0;
+  uint64_t dataSize = 0;
+
+  PCMContainer(std::istream& istr, const std::byte* headingBytes);
+  /**
+	 * Parse the header, leaving the window at the first frame. Sets format, and dataSize
+	 * when known.
+	 */
+  virtual bool parseHeader() { return true; }
+  // reads len header bytes, which must fit in the window
+  bool readHeader(uint8_t* dst, size_t len);
+
+ private:
+  bool setupParsed = false;
+  // offset, from dataOffset, of the block returned by the last readSample()
+  uint64_t position = 0;
+};
+}  // namespace bell
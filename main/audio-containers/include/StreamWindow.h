@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stdint.h>  // for uint8_t, uint64_t
+#include <cstddef>   // for byte, size_t
+#include <istream>   // for istream
+#include <vector>    // for vector
+
+namespace bell {
+/**
+ * Window over a container's input stream, for parsing frames in place.
+ *
+ * data() points at the first unconsumed byte, and stays valid until the next call to
+ * ensure(), skip() or seek(). Each read takes all the stream has buffered, so that the
+ * per-frame path mostly only compares sizes, but waits for no more than the requested
+ * bytes, not to hold up live sources; the unconsumed bytes are moved to the front of the
+ * buffer only when a request doesn't fit behind them.
+ */
+class StreamWindow {
+ public:
+  /**
+	 * @param headingBytes bytes already read from the stream, e.g. by the container guesser
+	 */
+  StreamWindow(std::istream& istr, size_t capacity,
+               const std::byte* headingBytes = nullptr, size_t headingSize = 0);
+
+  uint8_t* data() { return buffer.data() + start; }
+  size_t available() const { return end - start; }
+  size_t capacity() const { return buffer.size(); }
+  /**
+	 * Stream offset of data(); counted from the construction point if the stream can't
+	 * tell its position.
+	 */
+  uint64_t offset() const { return bufferOffset + start; }
+  bool isSeekable() const { return seekable; }
+  // the stream was read to its end, only buffered bytes are left
+  bool eof() const { return istr.eof(); }
+
+  /**
+	 * Make at least len bytes available, reading from the stream if needed.
+	 * @returns false if the stream ends before, or len exceeds the capacity
+	 */
+  bool ensure(size_t len);
+  void consume(size_t len) { start += len < available() ? len : available(); }
+  /**
+	 * Consume len bytes. Past the buffered ones, the stream is read through, or, for
+	 * skips larger than the buffer on seekable streams, seeked over.
+	 * @returns false if the stream ends before; after a seek, that's only known once read
+	 */
+  bool skip(uint64_t len);
+  /**
+	 * Move to an absolute stream offset. Offsets inside the buffer don't touch the stream.
+	 */
+  bool seek(uint64_t offset);
+  /**
+	 * Size of the stream, 0 if it can't tell; the read position is kept.
+	 */
+  uint64_t streamSize();
+  /**
+	 * Grow the buffer to at least the given capacity.
+	 */
+  void reserve(size_t capacity);
+
+ private:
+  std::istream& istr;
+  std::vector<uint8_t> buffer;
+  // unconsumed bytes of the buffer
+  size_t start = 0;
+  size_t end = 0;
+  // stream offset of the buffer's first byte
+  uint64_t bufferOffset = 0;
+  bool seekable = false;
+
+  void compact();
+};
+}  // namespace bell
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>  // for byte, size_t
+#include <istream>  // for istream
+
+#include "PCMContainer.h"  // for PCMContainer
+
+namespace bell {
+/**
+ * WAV (RIFF WAVE) file, and its RF64 variant for data over 4 GB. Integer PCM (8-bit
+ * unsigned, 16, 24 or 32-bit signed) and 32-bit float samples are supported, in plain
+ * or WAVE_FORMAT_EXTENSIBLE format chunks; the latter give the valid bits per sample
+ * and the channel mask.
+ *
+ * Chunks other than "fmt " and "data" (e.g. LIST, "id3 ") are skipped, with a seek if
+ * they are large. A data chunk of unknown size, as written by streaming encoders, lasts
+ * until the end of the stream.
+ */
+class WAVContainer : public PCMContainer {
+ public:
+  ~WAVContainer(){};
+  WAVContainer(std::istream& istr, const std::byte* headingBytes = nullptr);
+
+ protected:
+  bool parseHeader() override;
+
+ private:
+  bool parseFormat(const uint8_t* fmt, size_t len);
+};
+}  // namespace bell
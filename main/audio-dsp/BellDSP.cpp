@@ -1,10 +1,12 @@
 #include "BellDSP.h"
 
+#include <algorithm>    // for min
 #include <type_traits>  // for remove_extent_t
 #include <utility>      // for move
 
 #include "AudioPipeline.h"       // for CentralAudioBuffer
 #include "CentralAudioBuffer.h"  // for CentralAudioBuffer
+#include "PCMConverter.h"        // for fromFloat, toFloat
 
 using namespace bell;
 
@@ -48,70 +50,91 @@ void BellDSP::queryInstantEffect(std::unique_ptr<AudioEffect> instantEffect) {
 
 size_t BellDSP::process(uint8_t* data, size_t bytes, int channels,
                         uint32_t sampleRate, BitWidth bitWidth) {
-  if (bytes > 1024 * 2 * channels) {
-    return 0;
+  auto bits = static_cast<uint8_t>(bitWidth);
+  size_t sampleSize = bits / 8;
+  // the pipeline works on left and right channels, other layouts are left as they are
+  if (channels < 1 || channels > 2 ||
+      (bits != 16 && bits != 24 && bits != 32)) {
+    return bytes;
   }
+  size_t frameSize = channels * sampleSize;
+  size_t frames = bytes / frameSize;
 
   // Create a StreamInfo object to pass to the pipeline
   auto streamInfo = std::make_unique<StreamInfo>();
-  streamInfo->numChannels = channels;
-  streamInfo->sampleRate = static_cast<bell::SampleRate>(sampleRate);
-  streamInfo->bitwidth = bitWidth;
-  streamInfo->numSamples = bytes / channels / 2;
+  float* sampleData[] = {&dataLeft[0], &dataRight[0]};
+  int outChannels = channels;
 
   std::scoped_lock lock(accessMutex);
 
-  int16_t* data16Bit = (int16_t*)data;
-
-  int length16 = bytes / 4;
-
-  for (size_t i = 0; i < length16; i++) {
-    dataLeft[i] = (data16Bit[i * 2] / (float)MAX_INT16);  // Normalize left
-    dataRight[i] =
-        (data16Bit[i * 2 + 1] / (float)MAX_INT16);  // Normalize right
-  }
-  float* sampleData[] = {&dataLeft[0], &dataRight[0]};
-  streamInfo->data = sampleData;
+  // in blocks of the float buffers' size, written back in place
+  for (size_t done = 0; done < frames;) {
+    size_t count = std::min(frames - done, dataLeft.size());
+    uint8_t* in = data + done * frameSize;
+    for (int channel = 0; channel < channels; channel++) {
+      PCMConverter::toFloat(in + channel * sampleSize, bits, frameSize,
+                            sampleData[channel], count);
+    }
 
-  if (activePipeline) {
-    streamInfo = activePipeline->process(std::move(streamInfo));
+    streamInfo->data = sampleData;
+    streamInfo->numChannels = channels;
+    streamInfo->sampleRate = static_cast<bell::SampleRate>(sampleRate);
+    streamInfo->bitwidth = bitWidth;
+    streamInfo->numSamples = count;
+    if (activePipeline) {
+      streamInfo = activePipeline->process(std::move(streamInfo));
+    }
+    // Data may have been downmixed to mono, packed behind the previous blocks.
+    // Written in place, so a pipeline adding channels only keeps the first ones
+    outChannels = std::min(streamInfo->numChannels, channels);
+    applyInstantEffect(sampleData, outChannels, count);
+
+    uint8_t* out = data + done * outChannels * sampleSize;
+    for (int channel = 0; channel < outChannels; channel++) {
+      PCMConverter::fromFloat(sampleData[channel], out + channel * sampleSize,
+                              bits, outChannels * sampleSize, count);
+    }
+    done += count;
   }
 
-  if (this->instantEffect != nullptr) {
-    this->instantEffect->apply(dataLeft.data(), length16,
-                               samplesSinceInstantQueued);
+  return frames * outChannels * sampleSize;
+}
 
-    if (streamInfo->numSamples > 1) {
-      this->instantEffect->apply(dataRight.data(), length16,
-                                 samplesSinceInstantQueued);
-    }
+int BellDSP::process(PlanarBuffer& buffer, uint32_t sampleRate) {
+  auto streamInfo = std::make_unique<StreamInfo>();
+  streamInfo->data = buffer.data;
+  streamInfo->numChannels = buffer.numChannels;
+  streamInfo->sampleRate = static_cast<bell::SampleRate>(sampleRate);
+  streamInfo->bitwidth = BitWidth::BW_32;
+  streamInfo->numSamples = buffer.numSamples;
 
-    samplesSinceInstantQueued += length16;
+  std::scoped_lock lock(accessMutex);
 
-    if (this->instantEffect->duration <= samplesSinceInstantQueued) {
-      this->instantEffect = nullptr;
-    }
+  if (activePipeline) {
+    streamInfo = activePipeline->process(std::move(streamInfo));
   }
+  // the buffer holds no more channels than it came with
+  int outChannels = std::min(streamInfo->numChannels, buffer.numChannels);
+  applyInstantEffect(buffer.data, outChannels, buffer.numSamples);
 
-  for (size_t i = 0; i < length16; i++) {
-    if (dataLeft[i] > 1.0f) {
-      dataLeft[i] = 1.0f;
-    }
+  return outChannels;
+}
 
-    // Data has been downmixed to mono
-    if (streamInfo->numChannels == 1) {
-      data16Bit[i] = dataLeft[i] * MAX_INT16;  // Denormalize left
-    } else {
-      data16Bit[i * 2] = dataLeft[i] * MAX_INT16;       // Denormalize left
-      data16Bit[i * 2 + 1] = dataRight[i] * MAX_INT16;  // Denormalize right
-    }
+void BellDSP::applyInstantEffect(float** data, int channels, size_t samples) {
+  if (this->instantEffect == nullptr) {
+    return;
   }
 
-  if (streamInfo->numChannels == 1) {
-    return bytes / 2;
+  for (int channel = 0; channel < channels; channel++) {
+    this->instantEffect->apply(data[channel], samples,
+                               samplesSinceInstantQueued);
   }
 
-  return bytes;
+  samplesSinceInstantQueued += samples;
+
+  if (this->instantEffect->duration <= samplesSinceInstantQueued) {
+    this->instantEffect = nullptr;
+  }
 }
 
 std::shared_ptr<AudioPipeline> BellDSP::getActivePipeline() {
@@ -0,0 +1,416 @@
+#include "PCMCache.h"
+
+#include <stdio.h>    // for fclose, fopen, fread, fwrite, remove
+#include <string.h>   // for memcpy, memset
+#include <algorithm>  // for min
+#include <utility>    // for move
+
+#include "BellLogger.h"  // for AbstractLogger, BELL_LOG
+
+#ifdef BELL_CODEC_OPUS
+#include "opus.h"  // for opus_encode, opus_decode, opus_encoder_create
+#endif
+
+using namespace bell;
+
+// largest block returned by Reader::read() for raw PCM
+#define PCM_CACHE_READ_SIZE 4096
+
+// spilled track file header, followed by the track data
+#define PCM_CACHE_MAGIC 0x43435042  // "BPCC"
+namespace {
+struct SpillHeader {
+  uint32_t magic;
+  uint32_t sampleRate;
+  uint8_t channels;
+  uint8_t bitDepth;
+  uint8_t isOpus;
+  uint8_t reserved;
+  uint32_t lookahead;
+  uint64_t frames;
+  uint64_t size;
+};
+}  // namespace
+
+PCMCache::Reader::Reader(std::shared_ptr<const Track> track)
+    : track(std::move(track)) {
+  skip = this->track->lookahead;
+  remaining = this->track->frames;
+}
+
+PCMCache::Reader::~Reader() {
+#ifdef BELL_CODEC_OPUS
+  if (decoder)
+    opus_decoder_destroy(decoder);
+#endif
+}
+
+const uint8_t* PCMCache::Reader::read(uint32_t& len) {
+  len = 0;
+  const auto& data = track->data;
+  size_t frameSize = track->format.frameSize();
+  if (!remaining || offset >= data.size())
+    return nullptr;
+
+  if (!track->isOpus) {
+    size_t bytes = std::min(data.size() - offset,
+                            PCM_CACHE_READ_SIZE / frameSize * frameSize);
+    const uint8_t* block = data.data() + offset;
+    offset += bytes;
+    remaining -= bytes / frameSize;
+    len = bytes;
+    return block;
+  }
+
+#ifdef BELL_CODEC_OPUS
+  uint8_t channels = track->format.channels;
+  if (!decoder) {
+    int error;
+    decoder = opus_decoder_create(48000, channels, &error);
+    if (!decoder)
+      return nullptr;
+    pcm.resize(OPUS_FRAME_SAMPLES * channels);
+  }
+  while (remaining && offset + 2 <= data.size()) {
+    size_t size = data[offset] | (data[offset + 1] << 8);
+    offset += 2;
+    if (offset + size > data.size())
+      break;
+    int samples = opus_decode(decoder, data.data() + offset, size, pcm.data(),
+                              OPUS_FRAME_SAMPLES, 0);
+    offset += size;
+    if (samples <= 0)
+      continue;
+
+    // drop the encoder delay, and the padding of the last frame
+    size_t start = std::min<uint64_t>(skip, samples);
+    skip -= start;
+    size_t count = std::min<uint64_t>(samples - start, remaining);
+    remaining -= count;
+    if (count) {
+      len = count * frameSize;
+      return (const uint8_t*)(pcm.data() + start * channels);
+    }
+  }
+#endif
+  return nullptr;
+}
+
+PCMCache::PCMCache() : PCMCache(Config()) {}
+
+PCMCache::PCMCache(const Config& config) : config(config) {
+  if (config.compression == Compression::OPUS) {
+    stagedPCM.resize(OPUS_FRAME_SAMPLES * 2);
+    packet.resize(1500);
+  }
+}
+
+PCMCache::~PCMCache() {
+#ifdef BELL_CODEC_OPUS
+  if (encoder)
+    opus_encoder_destroy(encoder);
+#endif
+}
+
+bool PCMCache::contains(size_t trackHash) {
+  std::scoped_lock lock(accessMutex);
+  return index.count(trackHash) != 0;
+}
+
+std::unique_ptr<PCMCache::Reader> PCMCache::open(size_t trackHash) {
+  std::scoped_lock lock(accessMutex);
+  auto it = index.find(trackHash);
+  if (it == index.end())
+    return nullptr;
+
+  auto slot = it->second;
+  slots.splice(slots.begin(), slots, slot);
+  // held here, as evict() may drop the slot's one again
+  auto track = slot->track;
+  if (!track) {
+    track = load(trackHash);
+    if (!track) {
+      erase(slot);
+      return nullptr;
+    }
+    slot->track = track;
+    memoryBytes += slot->bytes;
+    evict();
+  }
+  return std::unique_ptr<Reader>(new Reader(track));
+}
+
+void PCMCache::beginRecording(size_t trackHash) {
+  std::scoped_lock lock(accessMutex);
+  pending = std::make_unique<Track>();
+  pendingHash = trackHash;
+  stagedSamples = 0;
+  encodedSamples = 0;
+}
+
+bool PCMCache::canCompress(const PCMFormat& format) {
+#ifdef BELL_CODEC_OPUS
+  return config.compression == Compression::OPUS &&
+         format.sampleRate == 48000 && format.bitDepth == 16 &&
+         (format.channels == 1 || format.channels == 2);
+#else
+  return false;
+#endif
+}
+
+bool PCMCache::setupEncoder(uint8_t channels) {
+#ifdef BELL_CODEC_OPUS
+  if (encoderChannels != channels) {
+    if (encoder)
+      opus_encoder_destroy(encoder);
+    int error;
+    encoder =
+        opus_encoder_create(48000, channels, OPUS_APPLICATION_AUDIO, &error);
+    encoderChannels = encoder ? channels : 0;
+    if (!encoder)
+      return false;
+    opus_encoder_ctl(encoder, OPUS_SET_BITRATE(config.opusBitrate));
+  }
+  // a new stream, so that the delay is the same for every track
+  opus_encoder_ctl(encoder, OPUS_RESET_STATE);
+  int32_t lookahead = 0;
+  opus_encoder_ctl(encoder, OPUS_GET_LOOKAHEAD(&lookahead));
+  pending->lookahead = lookahead;
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool PCMCache::encodeStaged(Track& track) {
+#ifdef BELL_CODEC_OPUS
+  int32_t len = opus_encode(encoder, stagedPCM.data(), OPUS_FRAME_SAMPLES,
+                            packet.data(), packet.size());
+  if (len <= 0)
+    return false;
+  auto& data = track.data;
+  data.push_back(len & 0xFF);
+  data.push_back(len >> 8);
+  data.insert(data.end(), packet.data(), packet.data() + len);
+  stagedSamples = 0;
+  encodedSamples += OPUS_FRAME_SAMPLES;
+  return true;
+#else
+  return false;
+#endif
+}
+
+void PCMCache::record(const uint8_t* data, size_t len,
+                      const PCMFormat& format) {
+  std::scoped_lock lock(accessMutex);
+  if (!pending || !len)
+    return;
+
+  if (!pending->format.frameSize()) {
+    pending->format = format;
+    pending->isOpus = canCompress(format) && setupEncoder(format.channels);
+  } else if (format != pending->format) {
+    BELL_LOG(debug, "PCMCache", "Format changed, not caching track %zu",
+             pendingHash);
+    pending.reset();
+    return;
+  }
+
+  size_t frames = len / format.frameSize();
+  pending->frames += frames;
+  if (!pending->isOpus) {
+    pending->data.insert(pending->data.end(), data,
+                         data + frames * format.frameSize());
+  } else {
+    const int16_t* samples = (const int16_t*)data;
+    while (frames) {
+      size_t count =
+          std::min(frames, (size_t)OPUS_FRAME_SAMPLES - stagedSamples);
+      memcpy(stagedPCM.data() + stagedSamples * format.channels, samples,
+             count * format.frameSize());
+      stagedSamples += count;
+      samples += count * format.channels;
+      frames -= count;
+      if (stagedSamples == OPUS_FRAME_SAMPLES && !encodeStaged(*pending)) {
+        pending.reset();
+        return;
+      }
+    }
+  }
+
+  if (pending->data.size() > config.maxTrackBytes) {
+    BELL_LOG(debug, "PCMCache", "Track %zu too large to cache", pendingHash);
+    pending.reset();
+  }
+}
+
+void PCMCache::endRecording(bool complete) {
+  std::scoped_lock lock(accessMutex);
+  if (!pending)
+    return;
+  auto track = std::move(pending);
+  if (!complete || !track->frames)
+    return;
+
+  if (track->isOpus) {
+    // pad with silence, until the delayed last samples are encoded
+    size_t channels = track->format.channels;
+    while (encodedSamples < track->frames + track->lookahead) {
+      memset(stagedPCM.data() + stagedSamples * channels, 0,
+             (OPUS_FRAME_SAMPLES - stagedSamples) * channels * sizeof(int16_t));
+      stagedSamples = OPUS_FRAME_SAMPLES;
+      if (!encodeStaged(*track))
+        return;
+    }
+  }
+  if (track->data.size() > config.maxTrackBytes)
+    return;
+
+  track->data.shrink_to_fit();
+  insert(pendingHash, std::move(track));
+}
+
+void PCMCache::insert(size_t trackHash, std::unique_ptr<Track> track) {
+  auto it = index.find(trackHash);
+  if (it != index.end())
+    erase(it->second);
+
+  Slot slot;
+  slot.trackHash = trackHash;
+  slot.bytes = track->data.size();
+  slot.track = std::move(track);
+  slots.push_front(std::move(slot));
+  index[trackHash] = slots.begin();
+  memoryBytes += slots.front().bytes;
+  evict();
+}
+
+void PCMCache::erase(std::list<Slot>::iterator slot) {
+  if (slot->track)
+    memoryBytes -= slot->bytes;
+  if (slot->spilled) {
+    ::remove(spillPath(slot->trackHash).c_str());
+    spillBytes -= slot->bytes;
+  }
+  index.erase(slot->trackHash);
+  slots.erase(slot);
+}
+
+void PCMCache::evict() {
+  // least recently used tracks leave memory first, spilled to disk if possible
+  for (auto slot = slots.end();
+       memoryBytes > config.maxBytes && slot != slots.begin();) {
+    --slot;
+    if (!slot->track)
+      continue;
+    if (!slot->spilled && !spill(*slot)) {
+      erase(slot++);
+      continue;
+    }
+    memoryBytes -= slot->bytes;
+    slot->track.reset();
+  }
+
+  for (auto slot = slots.end();
+       spillBytes > config.maxSpillBytes && slot != slots.begin();) {
+    --slot;
+    if (!slot->spilled)
+      continue;
+    if (!slot->track) {
+      erase(slot++);
+      continue;
+    }
+    ::remove(spillPath(slot->trackHash).c_str());
+    spillBytes -= slot->bytes;
+    slot->spilled = false;
+  }
+}
+
+bool PCMCache::spill(Slot& slot) {
+  if (config.spillDirectory.empty() || slot.bytes > config.maxSpillBytes)
+    return false;
+
+  FILE* file = fopen(spillPath(slot.trackHash).c_str(), "wb");
+  if (!file) {
+    BELL_LOG(error, "PCMCache", "Cannot create %s",
+             spillPath(slot.trackHash).c_str());
+    return false;
+  }
+  const Track& track = *slot.track;
+  SpillHeader header = {};
+  header.magic = PCM_CACHE_MAGIC;
+  header.sampleRate = track.format.sampleRate;
+  header.channels = track.format.channels;
+  header.bitDepth = track.format.bitDepth;
+  header.isOpus = track.isOpus;
+  header.lookahead = track.lookahead;
+  header.frames = track.frames;
+  header.size = track.data.size();
+  bool written =
+      fwrite(&header, sizeof(header), 1, file) == 1 &&
+      fwrite(track.data.data(), 1, track.data.size(), file) == header.size;
+  written = fclose(file) == 0 && written;
+  if (!written) {
+    ::remove(spillPath(slot.trackHash).c_str());
+    return false;
+  }
+  slot.spilled = true;
+  spillBytes += slot.bytes;
+  return true;
+}
+
+std::shared_ptr<const PCMCache::Track> PCMCache::load(size_t trackHash) {
+  FILE* file = fopen(spillPath(trackHash).c_str(), "rb");
+  if (!file)
+    return nullptr;
+
+  auto track = std::make_shared<Track>();
+  SpillHeader header;
+  bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+               header.magic == PCM_CACHE_MAGIC &&
+               header.size <= config.maxTrackBytes;
+  if (valid) {
+    track->format = {header.sampleRate, header.channels, header.bitDepth};
+    track->isOpus = header.isOpus;
+    track->lookahead = header.lookahead;
+    track->frames = header.frames;
+    track->data.resize(header.size);
+    valid = fread(track->data.data(), 1, header.size, file) == header.size;
+  }
+  fclose(file);
+  if (!valid) {
+    BELL_LOG(error, "PCMCache", "Cannot read %s",
+             spillPath(trackHash).c_str());
+    return nullptr;
+  }
+  return track;
+}
+
+std::string PCMCache::spillPath(size_t trackHash) const {
+  return config.spillDirectory + "/" + config.prefix + "_" +
+         std::to_string(trackHash) + ".pcm";
+}
+
+void PCMCache::remove(size_t trackHash) {
+  std::scoped_lock lock(accessMutex);
+  auto it = index.find(trackHash);
+  if (it != index.end())
+    erase(it->second);
+}
+
+void PCMCache::clear() {
+  std::scoped_lock lock(accessMutex);
+  while (!slots.empty()) {
+    erase(slots.begin());
+  }
+}
+
+size_t PCMCache::memoryUsed() {
+  std::scoped_lock lock(accessMutex);
+  return memoryBytes;
+}
+
+size_t PCMCache::trackCount() {
+  std::scoped_lock lock(accessMutex);
+  return slots.size();
+}
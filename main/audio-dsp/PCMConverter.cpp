@@ -0,0 +1,143 @@
+#include "PCMConverter.h"
+
+#include <string.h>   // for memcpy, memmove
+#include <algorithm>  // for min, max
+#include <cmath>      // for ldexp
+
+using namespace bell;
+
+namespace {
+// largest float below 1, so that scaling it never overflows the integer type
+constexpr float MAX_SAMPLE = 0.99999994f;
+
+int32_t read24(const uint8_t* in) {
+  return in[0] | (in[1] << 8) | ((int8_t)in[2] << 16);
+}
+
+void write24(uint8_t* out, int32_t value) {
+  out[0] = value;
+  out[1] = value >> 8;
+  out[2] = value >> 16;
+}
+
+float clip(float sample) {
+  return std::min(std::max(sample, -1.0f), MAX_SAMPLE);
+}
+}  // namespace
+
+void PCMConverter::toFloat(const uint8_t* in, uint8_t bitDepth, size_t stride,
+                           float* out, size_t count) {
+  float scale = std::ldexp(1.0f, 1 - bitDepth);
+  switch (bitDepth) {
+    case 16:
+      for (size_t i = 0; i < count; i++, in += stride)
+        out[i] = *(const int16_t*)in * scale;
+      break;
+    case 24:
+      for (size_t i = 0; i < count; i++, in += stride)
+        out[i] = read24(in) * scale;
+      break;
+    case 32:
+      for (size_t i = 0; i < count; i++, in += stride)
+        out[i] = *(const int32_t*)in * scale;
+      break;
+  }
+}
+
+void PCMConverter::fromFloat(const float* in, uint8_t* out, uint8_t bitDepth,
+                             size_t stride, size_t count) {
+  float scale = std::ldexp(1.0f, bitDepth - 1);
+  switch (bitDepth) {
+    case 16:
+      for (size_t i = 0; i < count; i++, out += stride)
+        *(int16_t*)out = (int16_t)(clip(in[i]) * scale);
+      break;
+    case 24:
+      for (size_t i = 0; i < count; i++, out += stride)
+        write24(out, (int32_t)(clip(in[i]) * scale));
+      break;
+    case 32:
+      for (size_t i = 0; i < count; i++, out += stride)
+        *(int32_t*)out = (int32_t)(clip(in[i]) * scale);
+      break;
+  }
+}
+
+size_t PCMConverter::convert(const uint8_t* in, uint8_t inDepth, uint8_t* out,
+                             uint8_t outDepth, size_t count) {
+  size_t outSize = count * (outDepth / 8);
+  if (inDepth == outDepth) {
+    if (in != out)
+      memmove(out, in, outSize);
+    return outSize;
+  }
+
+  // forward, so that narrowing in place never overwrites unread samples
+  auto* out16 = (int16_t*)out;
+  auto* out32 = (int32_t*)out;
+  auto* in16 = (const int16_t*)in;
+  auto* in32 = (const int32_t*)in;
+  switch (inDepth * 100 + outDepth) {
+    case 2416:
+      for (size_t i = 0; i < count; i++)
+        out16[i] = (int16_t)(in[i * 3 + 1] | (in[i * 3 + 2] << 8));
+      break;
+    case 3216:
+      for (size_t i = 0; i < count; i++)
+        out16[i] = in32[i] >> 16;
+      break;
+    case 3224:
+      for (size_t i = 0; i < count; i++)
+        write24(out + i * 3, in32[i] >> 8);
+      break;
+    case 1624:
+      for (size_t i = 0; i < count; i++)
+        write24(out + i * 3, in16[i] * 256);
+      break;
+    case 1632:
+      for (size_t i = 0; i < count; i++)
+        out32[i] = in16[i] * 65536;
+      break;
+    case 2432:
+      for (size_t i = 0; i < count; i++)
+        out32[i] = read24(in + i * 3) * 256;
+      break;
+    default:
+      return 0;
+  }
+  return outSize;
+}
+
+void PCMConverter::swapBytes(const uint8_t* in, uint8_t* out, uint8_t bitDepth,
+                             size_t count) {
+  // memcpy through a register for unaligned data. Plain shifts rather than
+  // compiler builtins, which MSVC lacks; they're still recognized as byte swaps,
+  // and the loops vectorize on targets with byte shuffles (SSSE3, NEON)
+  switch (bitDepth) {
+    case 16:
+      for (size_t i = 0; i < count; i++) {
+        uint16_t value;
+        memcpy(&value, in + i * 2, 2);
+        value = (uint16_t)((value >> 8) | (value << 8));
+        memcpy(out + i * 2, &value, 2);
+      }
+      break;
+    case 24:
+      for (size_t i = 0; i < count; i++) {
+        uint8_t first = in[i * 3];
+        out[i * 3] = in[i * 3 + 2];
+        out[i * 3 + 1] = in[i * 3 + 1];
+        out[i * 3 + 2] = first;
+      }
+      break;
+    case 32:
+      for (size_t i = 0; i < count; i++) {
+        uint32_t value;
+        memcpy(&value, in + i * 4, 4);
+        value = (value >> 24) | ((value >> 8) & 0xFF00) |
+                ((value << 8) & 0xFF0000) | (value << 24);
+        memcpy(out + i * 4, &value, 4);
+      }
+      break;
+  }
+}
@@ -0,0 +1,330 @@
+#include "PCMHistoryBuffer.h"
+
+#include <stdlib.h>   // for free, malloc
+#include <string.h>   // for memcpy
+#include <algorithm>  // for min, max
+
+#ifdef ESP_PLATFORM
+#include "esp_heap_caps.h"  // for heap_caps_malloc, MALLOC_CAP_SPIRAM
+#endif
+
+#ifdef BELL_CODEC_OPUS
+#include "opus.h"  // for opus_encode, opus_decode, opus_encoder_create
+#endif
+
+using namespace bell;
+
+PCMHistoryBuffer::PCMHistoryBuffer() : PCMHistoryBuffer(Config()) {}
+
+PCMHistoryBuffer::PCMHistoryBuffer(const Config& config) : config(config) {
+  dataSize = config.maxBytes;
+#ifdef ESP_PLATFORM
+  data = (uint8_t*)heap_caps_malloc(dataSize,
+                                    MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (!data)
+    data = (uint8_t*)malloc(dataSize);
+#else
+  data = (uint8_t*)malloc(dataSize);
+#endif
+
+  // Opus frames last 20 ms; raw chunks as little as ~2.7 ms (192 kHz, 32-bit
+  // stereo), but then take a whole chunk of maxBytes each
+  uint64_t rawChunkUs = CentralAudioBuffer::PCM_CHUNK_SIZE * 1000000ULL /
+                        (192000 * 2 * sizeof(int32_t));
+  uint64_t rawEntries =
+      std::min<uint64_t>(config.maxSeconds * 1000000ULL / rawChunkUs,
+                         dataSize / CentralAudioBuffer::PCM_CHUNK_SIZE);
+  uint64_t opusEntries = config.maxSeconds * 1000000ULL /
+                         (OPUS_FRAME_SAMPLES * 1000000ULL / 48000);
+  entries.resize(std::max(rawEntries, opusEntries) + 1);
+
+  if (config.compression == Compression::OPUS) {
+    stagedPCM.resize(OPUS_FRAME_SAMPLES * 2);
+    packet.resize(1500);
+  }
+}
+
+PCMHistoryBuffer::~PCMHistoryBuffer() {
+#ifdef BELL_CODEC_OPUS
+  if (encoder)
+    opus_encoder_destroy(encoder);
+  if (decoder)
+    opus_decoder_destroy(decoder);
+#endif
+  free(data);
+}
+
+PCMHistoryBuffer::Entry& PCMHistoryBuffer::entryAt(uint64_t seq) {
+  return entries[(firstEntry + (seq - firstSeq)) % entries.size()];
+}
+
+void PCMHistoryBuffer::evictOldest() {
+  if (!entryCount)
+    return;
+  firstEntry = (firstEntry + 1) % entries.size();
+  firstSeq++;
+  entryCount--;
+  if (replaySeq < firstSeq)
+    replaySeq = firstSeq;
+}
+
+bool PCMHistoryBuffer::allocate(size_t size, size_t& offset) {
+  if (size > dataSize || !data)
+    return false;
+
+  while (true) {
+    if (!entryCount) {
+      writeOffset = 0;
+      break;
+    }
+    size_t head = entries[firstEntry].offset;
+    if (writeOffset > head) {
+      // free space at the end, and before the oldest entry
+      if (dataSize - writeOffset >= size)
+        break;
+      if (head >= size) {
+        writeOffset = 0;
+        break;
+      }
+    } else if (writeOffset < head && head - writeOffset >= size) {
+      break;
+    }
+    // writeOffset == head means the data buffer is full
+    evictOldest();
+  }
+
+  offset = writeOffset;
+  writeOffset += size;
+  return true;
+}
+
+void PCMHistoryBuffer::append(const Entry& entry, const uint8_t* payload) {
+  if (entryCount == entries.size())
+    evictOldest();
+
+  size_t offset;
+  if (!allocate(entry.size, offset))
+    return;
+  memcpy(data + offset, payload, entry.size);
+
+  Entry& stored = entries[(firstEntry + entryCount) % entries.size()];
+  stored = entry;
+  stored.offset = offset;
+  stored.timeMs = streamTimeUs / 1000;
+  streamTimeUs += entry.durationUs;
+  entryCount++;
+
+  // drop anything older than the configured duration
+  while (entryCount > 1 &&
+         stored.timeMs - entries[firstEntry].timeMs >
+             config.maxSeconds * 1000ULL) {
+    evictOldest();
+  }
+}
+
+bool PCMHistoryBuffer::canCompress(
+    const CentralAudioBuffer::AudioChunk& chunk) {
+#ifdef BELL_CODEC_OPUS
+  return config.compression == Compression::OPUS &&
+         chunk.sampleRate == 48000 && chunk.bitWidth == 16 &&
+         (chunk.channels == 1 || chunk.channels == 2);
+#else
+  return false;
+#endif
+}
+
+void PCMHistoryBuffer::flushStaged() {
+  if (!stagedSamples)
+    return;
+  // leftover, shorter than an Opus frame - keep it as raw PCM
+  staged.isOpus = false;
+  staged.size = stagedSamples * staged.channels * sizeof(int16_t);
+  staged.durationUs = stagedSamples * 1000000ULL / staged.sampleRate;
+  append(staged, (uint8_t*)stagedPCM.data());
+  stagedSamples = 0;
+}
+
+void PCMHistoryBuffer::stage(const CentralAudioBuffer::AudioChunk& chunk) {
+#ifdef BELL_CODEC_OPUS
+  if (stagedSamples && (staged.trackHash != chunk.trackHash ||
+                        staged.channels != chunk.channels)) {
+    flushStaged();
+  }
+
+  if (encoderChannels != chunk.channels) {
+    if (encoder)
+      opus_encoder_destroy(encoder);
+    int error;
+    encoder = opus_encoder_create(48000, chunk.channels,
+                                  OPUS_APPLICATION_AUDIO, &error);
+    encoderChannels = encoder ? chunk.channels : 0;
+    if (!encoder)
+      return;
+    opus_encoder_ctl(encoder, OPUS_SET_BITRATE(config.opusBitrate));
+  }
+
+  const int16_t* samples = (const int16_t*)chunk.pcmData;
+  size_t chunkSamples = chunk.pcmSize / (chunk.channels * sizeof(int16_t));
+  while (chunkSamples) {
+    if (!stagedSamples) {
+      staged.trackHash = chunk.trackHash;
+      staged.sec = chunk.sec;
+      staged.usec = chunk.usec;
+      staged.sampleRate = chunk.sampleRate;
+      staged.channels = chunk.channels;
+      staged.bitWidth = chunk.bitWidth;
+    }
+    size_t toCopy =
+        std::min(chunkSamples, (size_t)OPUS_FRAME_SAMPLES - stagedSamples);
+    memcpy(stagedPCM.data() + stagedSamples * chunk.channels, samples,
+           toCopy * chunk.channels * sizeof(int16_t));
+    stagedSamples += toCopy;
+    samples += toCopy * chunk.channels;
+    chunkSamples -= toCopy;
+
+    if (stagedSamples == OPUS_FRAME_SAMPLES) {
+      int32_t len = opus_encode(encoder, stagedPCM.data(), OPUS_FRAME_SAMPLES,
+                                packet.data(), packet.size());
+      if (len > 0) {
+        staged.isOpus = true;
+        staged.size = len;
+        staged.durationUs = OPUS_FRAME_SAMPLES * 1000000ULL / 48000;
+        append(staged, packet.data());
+        stagedSamples = 0;
+      } else {
+        flushStaged();
+      }
+    }
+  }
+#endif
+}
+
+void PCMHistoryBuffer::record(const CentralAudioBuffer::AudioChunk& chunk) {
+  std::scoped_lock lock(accessMutex);
+  if (chunk.pcmSize == 0 || chunk.channels == 0 || chunk.sampleRate == 0)
+    return;
+
+  if (canCompress(chunk)) {
+    stage(chunk);
+    return;
+  }
+
+  flushStaged();
+  Entry entry = {};
+  entry.trackHash = chunk.trackHash;
+  entry.sec = chunk.sec;
+  entry.usec = chunk.usec;
+  entry.sampleRate = chunk.sampleRate;
+  entry.channels = chunk.channels;
+  entry.bitWidth = chunk.bitWidth;
+  entry.isOpus = false;
+  entry.size = chunk.pcmSize;
+  size_t frameSize = chunk.channels * (chunk.bitWidth / 8);
+  entry.durationUs =
+      (chunk.pcmSize / frameSize) * 1000000ULL / chunk.sampleRate;
+  append(entry, chunk.pcmData);
+}
+
+uint32_t PCMHistoryBuffer::rewind(uint32_t ms) {
+  std::scoped_lock lock(accessMutex);
+  if (!entryCount)
+    return 0;
+
+  uint64_t liveMs = streamTimeUs / 1000;
+  uint64_t fromMs = liveMs;
+  if (replaying && replaySeq < firstSeq + entryCount)
+    fromMs = entryAt(replaySeq).timeMs;
+  uint64_t targetMs = fromMs > ms ? fromMs - ms : 0;
+
+  // last entry starting at, or before the target
+  uint64_t low = firstSeq, high = firstSeq + entryCount - 1;
+  while (low < high) {
+    uint64_t mid = (low + high + 1) / 2;
+    if (entryAt(mid).timeMs <= targetMs) {
+      low = mid;
+    } else {
+      high = mid - 1;
+    }
+  }
+
+  replaySeq = low;
+  replaying = true;
+  return liveMs - entryAt(replaySeq).timeMs;
+}
+
+void PCMHistoryBuffer::goLive() {
+  std::scoped_lock lock(accessMutex);
+  replaying = false;
+}
+
+bool PCMHistoryBuffer::isReplaying() {
+  std::scoped_lock lock(accessMutex);
+  return replaying;
+}
+
+bool PCMHistoryBuffer::next(CentralAudioBuffer::AudioChunk& chunk) {
+  std::scoped_lock lock(accessMutex);
+  if (!replaying)
+    return false;
+  if (replaySeq >= firstSeq + entryCount) {
+    // caught up with the live stream
+    replaying = false;
+    return false;
+  }
+
+  Entry& entry = entryAt(replaySeq++);
+  chunk.trackHash = entry.trackHash;
+  chunk.sec = entry.sec;
+  chunk.usec = entry.usec;
+  chunk.sampleRate = entry.sampleRate;
+  chunk.channels = entry.channels;
+  chunk.bitWidth = entry.bitWidth;
+  chunk.pcmSize = 0;
+
+  if (!entry.isOpus) {
+    memcpy(chunk.pcmData, data + entry.offset, entry.size);
+    chunk.pcmSize = entry.size;
+    return true;
+  }
+
+#ifdef BELL_CODEC_OPUS
+  if (decoderChannels != entry.channels) {
+    if (decoder)
+      opus_decoder_destroy(decoder);
+    int error;
+    decoder = opus_decoder_create(48000, entry.channels, &error);
+    decoderChannels = decoder ? entry.channels : 0;
+  }
+  if (decoder) {
+    // the decoder state only carries over to the packet that follows
+    if (replaySeq - 1 != nextDecodeSeq)
+      opus_decoder_ctl(decoder, OPUS_RESET_STATE);
+    nextDecodeSeq = replaySeq;
+    int samples = opus_decode(
+        decoder, data + entry.offset, entry.size, (int16_t*)chunk.pcmData,
+        CentralAudioBuffer::PCM_CHUNK_SIZE / (entry.channels * sizeof(int16_t)),
+        0);
+    if (samples > 0)
+      chunk.pcmSize = samples * entry.channels * sizeof(int16_t);
+  }
+#endif
+  return true;
+}
+
+uint32_t PCMHistoryBuffer::availableMs() {
+  std::scoped_lock lock(accessMutex);
+  if (!entryCount)
+    return 0;
+  return streamTimeUs / 1000 - entries[firstEntry].timeMs;
+}
+
+void PCMHistoryBuffer::clear() {
+  std::scoped_lock lock(accessMutex);
+  firstSeq += entryCount;
+  replaySeq = firstSeq;
+  firstEntry = 0;
+  entryCount = 0;
+  writeOffset = 0;
+  stagedSamples = 0;
+  replaying = false;
+}
@@ -0,0 +1,531 @@
+#include "PlaybackEngine.h"
+
+#include <memory>   // for make_unique
+#include <utility>  // for move
+
+#include "AudioSink.h"     // for AudioSink
+#include "BellDSP.h"       // for BellDSP
+#include "BellLogger.h"    // for AbstractLogger, BELL_LOG
+#include "PCMConverter.h"  // for convert
+#include "StreamInfo.h"    // for BitWidth, PCMFormat
+
+using namespace bell;
+
+PlaybackEngine::StageTask::StageTask(const TaskConfig& config,
+                                     std::function<void()> body)
+    : bell::Task(config.name, config.stackSize, config.priority, config.core),
+      body(std::move(body)) {}
+
+void PlaybackEngine::StageTask::start() {
+  started = true;
+  startTask();
+}
+
+void PlaybackEngine::StageTask::join() {
+  if (started) {
+    finished.wait();
+    started = false;
+  }
+}
+
+void PlaybackEngine::StageTask::runTask() {
+  body();
+  finished.give();
+}
+
+PlaybackEngine::PlaybackEngine(std::shared_ptr<AudioSink> sink)
+    : PlaybackEngine(std::move(sink), Config()) {}
+
+PlaybackEngine::PlaybackEngine(std::shared_ptr<AudioSink> sink,
+                               const Config& config)
+    : config(config),
+      sink(std::move(sink)),
+      decodeTask(config.decodeTask, [this]() { decodeTrack(); }),
+      playerTask(config.playerTask, [this]() { playerLoop(); }) {
+  if (this->config.playbackStartChunks > config.audioBufferChunks)
+    this->config.playbackStartChunks = config.audioBufferChunks;
+  audioBuffer = std::make_shared<CentralAudioBuffer>(config.audioBufferChunks);
+  // 24-bit samples widened to 32 bits
+  sinkBuffer.resize(CentralAudioBuffer::PCM_CHUNK_SIZE / 3 * 4);
+  stream = makeStream();
+  playerTask.start();
+}
+
+PlaybackEngine::~PlaybackEngine() {
+  stopTrack();
+  stopPlayer = true;
+  audioBuffer->chunkReady->give();
+  playerTask.join();
+}
+
+void PlaybackEngine::play(const BufferedStream::StreamReader& reader,
+                          size_t trackHash, uint32_t offset) {
+  std::scoped_lock lock(controlMutex);
+  stopTrack();
+  startTrack(trackHash, offset == 0,
+             [&](BufferedStream& stream) { stream.open(reader, offset); });
+}
+
+void PlaybackEngine::play(const BufferedStream::StreamPtr& source,
+                          size_t trackHash) {
+  std::scoped_lock lock(controlMutex);
+  stopTrack();
+  startTrack(trackHash, true,
+             [&](BufferedStream& stream) { stream.open(source); });
+}
+
+void PlaybackEngine::queue(const BufferedStream::StreamReader& reader,
+                           size_t trackHash) {
+  std::scoped_lock lock(controlMutex);
+  queueTrack(trackHash, [&](BufferedStream& stream) { stream.open(reader); });
+}
+
+void PlaybackEngine::queue(const BufferedStream::StreamPtr& source,
+                           size_t trackHash) {
+  std::scoped_lock lock(controlMutex);
+  queueTrack(trackHash, [&](BufferedStream& stream) { stream.open(source); });
+}
+
+void PlaybackEngine::startTrack(size_t trackHash, bool fromStart,
+                                const StreamOpener& open) {
+  // the decode task was stopped, or is done with its last track
+  decodeTask.join();
+  current = Track();
+  current.hash = trackHash;
+  if (!openCached(current, fromStart)) {
+    current.stream = stream;
+    open(*stream);
+  }
+  {
+    std::scoped_lock lock(queueMutex);
+    queueClosed = false;
+  }
+  stopDecoding = false;
+  decoding = true;
+  decodeTask.start();
+}
+
+void PlaybackEngine::queueTrack(size_t trackHash, const StreamOpener& open) {
+  {
+    std::scoped_lock lock(queueMutex);
+    if (!queueClosed) {
+      if (!nextStream) {
+        nextStream = makeStream();
+        if (config.prefetchChunks) {
+          stagedBuffer =
+              std::make_shared<CentralAudioBuffer>(config.prefetchChunks);
+        }
+      }
+      next = Track();
+      next.hash = trackHash;
+      if (!openCached(next, true)) {
+        next.stream = nextStream;
+        open(*nextStream);
+      }
+      hasNext = true;
+      queueGeneration++;
+      return;
+    }
+  }
+  // nothing left to decode, start right after the buffered audio
+  startTrack(trackHash, true, open);
+}
+
+bool PlaybackEngine::openCached(Track& track, bool fromStart) {
+  std::scoped_lock lock(cacheMutex);
+  if (!cache || !fromStart)
+    return false;
+  track.cached = cache->open(track.hash);
+  if (track.cached)
+    return true;
+  // decoded from its start, so cached once complete
+  track.recordingCache = cache;
+  return false;
+}
+
+void PlaybackEngine::stop() {
+  std::scoped_lock lock(controlMutex);
+  stopTrack();
+}
+
+void PlaybackEngine::stopTrack() {
+  stopDecoding = true;
+  {
+    std::scoped_lock lock(queueMutex);
+    stream->close();
+    stream->readySem.give();
+    if (nextStream) {
+      nextStream->close();
+      nextStream->readySem.give();
+    }
+  }
+  audioBuffer->chunkRead->give();
+  decodeTask.join();
+  audioBuffer->clearBuffer();
+
+  std::scoped_lock lock(queueMutex);
+  next = Track();
+  hasNext = false;
+  queueClosed = true;
+  if (stagedBuffer)
+    stagedBuffer->clearBuffer();
+}
+
+std::shared_ptr<BufferedStream> PlaybackEngine::getStream() {
+  std::scoped_lock lock(queueMutex);
+  return stream;
+}
+
+std::shared_ptr<BufferedStream> PlaybackEngine::makeStream() {
+  return std::make_shared<BufferedStream>(
+      config.networkTask.name, config.streamBufferSize,
+      config.streamBufferSize / 2, config.streamReadSize,
+      config.streamReadyThreshold, config.streamNotReadyThreshold, false,
+      config.networkTask.priority, config.networkTask.core);
+}
+
+void PlaybackEngine::setDSP(std::shared_ptr<BellDSP> dsp) {
+  std::scoped_lock lock(dspMutex);
+  this->dsp = std::move(dsp);
+}
+
+void PlaybackEngine::setHistory(std::shared_ptr<PCMHistoryBuffer> history) {
+  std::scoped_lock lock(historyMutex);
+  this->history = std::move(history);
+}
+
+void PlaybackEngine::setCache(std::shared_ptr<PCMCache> cache) {
+  std::scoped_lock lock(cacheMutex);
+  this->cache = std::move(cache);
+}
+
+void PlaybackEngine::recordStage(StageStats& stats, Clock::time_point start) {
+  auto tookUs = static_cast<uint32_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() -
+                                                            start)
+          .count());
+  stats.lastUs = tookUs;
+  if (tookUs > stats.maxUs)
+    stats.maxUs = tookUs;
+}
+
+bool PlaybackEngine::writePCM(const uint8_t* data, size_t len,
+                              const PCMFormat& format) {
+  // the audio buffer takes whole frames only, a partial one would never fit
+  size_t frameSize = format.frameSize();
+  if (!frameSize || len % frameSize) {
+    BELL_LOG(error, "PlaybackEngine", "Dropping %zu bytes of a partial frame",
+             frameSize ? len % frameSize : len);
+    len -= frameSize ? len % frameSize : len;
+  }
+  size_t written = 0;
+  while (written < len) {
+    size_t chunkWritten = audioBuffer->writePCM(
+        data + written, len - written, current.hash, format.sampleRate,
+        format.channels, static_cast<BitWidth>(format.bitDepth));
+    if (chunkWritten) {
+      written += chunkWritten;
+      continue;
+    }
+    if (stopDecoding)
+      return false;
+    // whole frames are only refused by a full audio buffer: decode the queued
+    // track ahead meanwhile, or wait for the player to consume a chunk
+    if (prefetch())
+      continue;
+    decodeStats.stalls++;
+    audioBuffer->chunkRead->twait(config.stageWaitMs);
+  }
+  return true;
+}
+
+bool PlaybackEngine::openDecoder(Track& track) {
+  if (track.cached)
+    return true;
+  if (track.decoder)
+    return track.decoder->isOpen();
+
+  track.decoder = std::make_unique<AudioDecoderStream>(config.streamReadSize);
+  track.decoder->setMaxBitDepth(config.maxBitDepth);
+  auto source = track.stream;
+  bool opened = track.decoder->open(source, [this, source]() {
+    if (stopDecoding || !source->isStreaming())
+      return false;
+    if (prefetching && source->seek(0)) {
+      // prefetch() must not hold up the current track, it starts over later
+      // from the rewound stream. A source whose start left the buffer can't be
+      // read again, and is waited for like the current one
+      prefetchStalled = true;
+      return false;
+    }
+    // source stalled, wait for the network stage
+    decodeStats.stalls++;
+    source->readySem.twait(config.stageWaitMs);
+    return !stopDecoding.load();
+  });
+  if (!opened)
+    BELL_LOG(error, "PlaybackEngine", "Cannot decode track %zu", track.hash);
+  return opened;
+}
+
+const uint8_t* PlaybackEngine::readTrack(Track& track, uint32_t& len,
+                                         PCMFormat& format) {
+  if (track.cached) {
+    // served from the cache, the stream was never opened
+    format = track.cached->format();
+    return track.cached->read(len);
+  }
+  uint8_t* data = track.decoder->decode(len);
+  format = track.decoder->format();
+  return data;
+}
+
+void PlaybackEngine::decodeTrack() {
+  bool opened = openDecoder(current);
+  if (opened && current.recordingCache)
+    current.recordingCache->beginRecording(current.hash);
+  while (true) {
+    if (opened) {
+      bool complete = decodeCurrent();
+      if (current.recordingCache)
+        current.recordingCache->endRecording(complete);
+    }
+    // the queued track follows without a gap, through the same audio buffer
+    if (stopDecoding || !startNext())
+      break;
+    opened = openDecoder(current);
+  }
+
+  // commit the last, partially filled chunk
+  while (!stopDecoding && !audioBuffer->flush()) {
+    audioBuffer->chunkRead->twait(config.stageWaitMs);
+  }
+  // back to the codec pool
+  current = Track();
+  decoding = false;
+  audioBuffer->chunkReady->give();
+}
+
+bool PlaybackEngine::decodeCurrent() {
+  uint32_t len;
+  PCMFormat format;
+  while (!stopDecoding) {
+    auto start = Clock::now();
+    const uint8_t* data = readTrack(current, len, format);
+    recordStage(decodeStats, start);
+    if (!data) {
+      // served from the cache
+      if (!current.decoder)
+        return !stopDecoding;
+      // neither stopped nor cut short by a dropped connection, when the size is known
+      return !stopDecoding && current.decoder->eof() &&
+             (!current.stream->size() || current.stream->reachedEnd());
+    }
+    if (current.recordingCache)
+      current.recordingCache->record(data, len, format);
+    if (!writePCM(data, len, format))
+      return false;
+  }
+  return false;
+}
+
+bool PlaybackEngine::startNext() {
+  bool useStaged;
+  {
+    std::scoped_lock lock(queueMutex);
+    if (!hasNext) {
+      queueClosed = true;
+      return false;
+    }
+    hasNext = false;
+    current = std::move(next);
+    next = Track();
+    if (current.stream) {
+      // the queued track's stream becomes the current one
+      std::swap(stream, nextStream);
+      nextStream->close();
+    }
+    useStaged = stagedBuffer && stagedGeneration == queueGeneration;
+    drainingStaged = true;
+  }
+
+  if (current.recordingCache)
+    current.recordingCache->beginRecording(current.hash);
+  if (useStaged) {
+    drainStaged();
+  } else if (stagedBuffer) {
+    stagedBuffer->clearBuffer();
+  }
+  // the rest of the block staging stopped at
+  if (current.pendingLen) {
+    if (current.recordingCache) {
+      current.recordingCache->record(current.pending, current.pendingLen,
+                                     current.pendingFormat);
+    }
+    writePCM(current.pending, current.pendingLen, current.pendingFormat);
+    current.pendingLen = 0;
+  }
+  drainingStaged = false;
+  return true;
+}
+
+void PlaybackEngine::drainStaged() {
+  // committed chunks first, then the partially filled one
+  for (int pass = 0; pass < 2; pass++) {
+    while (auto* chunk = stagedBuffer->readChunk()) {
+      PCMFormat format = {chunk->sampleRate, chunk->channels, chunk->bitWidth};
+      if (current.recordingCache)
+        current.recordingCache->record(chunk->pcmData, chunk->pcmSize, format);
+      if (!writePCM(chunk->pcmData, chunk->pcmSize, format)) {
+        stagedBuffer->clearBuffer();
+        return;
+      }
+    }
+    stagedBuffer->flush();
+  }
+}
+
+bool PlaybackEngine::prefetch() {
+  if (drainingStaged)
+    return false;
+  std::unique_lock lock(queueMutex, std::try_to_lock);
+  if (!lock.owns_lock() || !hasNext || !stagedBuffer)
+    return false;
+  if (stagedGeneration != queueGeneration) {
+    // staged chunks of the track queued before
+    stagedBuffer->clearBuffer();
+    stagedGeneration = queueGeneration;
+  }
+  // never wait for the network here, the current track's audio is running out
+  if (next.stream && !next.stream->isReady())
+    return false;
+  prefetching = true;
+  prefetchStalled = false;
+  bool opened = openDecoder(next);
+  if (opened && !next.pendingLen) {
+    next.pending = readTrack(next, next.pendingLen, next.pendingFormat);
+    if (!next.pending)
+      next.pendingLen = 0;
+  }
+  prefetching = false;
+  // the source ran dry while the decoder was reading from it, which leaves the
+  // decoder failed or mid-frame
+  if (prefetchStalled) {
+    restartPrefetch();
+    return false;
+  }
+  if (!opened || !next.pendingLen)
+    return false;
+  const PCMFormat& format = next.pendingFormat;
+  size_t written = stagedBuffer->writePCM(
+      next.pending, next.pendingLen, next.hash, format.sampleRate,
+      format.channels, static_cast<BitWidth>(format.bitDepth));
+  next.pending += written;
+  next.pendingLen -= written;
+  return written != 0;
+}
+
+void PlaybackEngine::restartPrefetch() {
+  next.decoder.reset();
+  next.pendingLen = 0;
+  stagedBuffer->clearBuffer();
+  // opened again from the start by the next prefetch(), or by startNext()
+  if (!next.stream->seek(0)) {
+    BELL_LOG(error, "PlaybackEngine", "Cannot rewind queued track %zu",
+             next.hash);
+  }
+}
+
+void PlaybackEngine::playerLoop() {
+  bool buffering = true;
+  // history audio is played from here, while live chunks keep being recorded
+  auto replayChunk = std::make_unique<CentralAudioBuffer::AudioChunk>();
+
+  while (!stopPlayer) {
+    std::shared_ptr<PCMHistoryBuffer> history;
+    {
+      std::scoped_lock lock(historyMutex);
+      history = this->history;
+    }
+
+    // pre-roll, unless the decoder is done and won't provide more
+    if (buffering && decoding &&
+        !audioBuffer->hasAtLeast(config.playbackStartChunks)) {
+      audioBuffer->chunkReady->twait(config.stageWaitMs);
+      continue;
+    }
+
+    auto chunk = audioBuffer->readChunk();
+    if (!chunk || chunk->pcmSize == 0) {
+      // nothing new decoded, a replay can still be served from history
+      if (history && history->next(*replayChunk)) {
+        playChunk(*replayChunk);
+        continue;
+      }
+      if (!buffering && decoding)
+        playerStats.stalls++;  // underrun
+      buffering = true;
+      audioBuffer->chunkReady->twait(config.stageWaitMs);
+      continue;
+    }
+    buffering = false;
+
+    if (history) {
+      history->record(*chunk);
+      if (history->next(*replayChunk)) {
+        playChunk(*replayChunk);
+        continue;
+      }
+    }
+    playChunk(*chunk);
+  }
+}
+
+void PlaybackEngine::configureSink() {
+  // the decoded bit depth first, then the closest ones; 16-bit is never widened
+  uint8_t bitDepth = chunkFormat.bitDepth;
+  uint8_t candidates[] = {bitDepth, uint8_t(bitDepth == 32 ? 24 : 32), 16};
+  size_t count = bitDepth == 16 ? 1 : 3;
+  for (size_t i = 0; i < count; i++) {
+    if (sink->setParams(chunkFormat.sampleRate, chunkFormat.channels,
+                        candidates[i])) {
+      sinkBitDepth = candidates[i];
+      return;
+    }
+  }
+  // sinks that can't be reconfigured take 16 bits
+  sinkBitDepth = 16;
+  BELL_LOG(debug, "PlaybackEngine", "Sink refused %u Hz, %u ch, %u bits",
+           chunkFormat.sampleRate, chunkFormat.channels, bitDepth);
+}
+
+void PlaybackEngine::playChunk(CentralAudioBuffer::AudioChunk& chunk) {
+  auto start = Clock::now();
+  PCMFormat format = {chunk.sampleRate, chunk.channels, chunk.bitWidth};
+  if (format != chunkFormat) {
+    chunkFormat = format;
+    configureSink();
+  }
+
+  size_t pcmSize = chunk.pcmSize;
+  {
+    std::scoped_lock lock(dspMutex);
+    if (dsp) {
+      pcmSize = dsp->process(chunk.pcmData, pcmSize, chunk.channels,
+                             chunk.sampleRate,
+                             static_cast<BitWidth>(chunk.bitWidth));
+    }
+  }
+
+  uint8_t* pcm = chunk.pcmData;
+  if (sinkBitDepth != chunk.bitWidth) {
+    // narrowed in place, widened into sinkBuffer
+    if (sinkBitDepth > chunk.bitWidth)
+      pcm = sinkBuffer.data();
+    size_t samples = pcmSize / (chunk.bitWidth / 8);
+    pcmSize = PCMConverter::convert(chunk.pcmData, chunk.bitWidth, pcm,
+                                    sinkBitDepth, samples);
+  }
+  sink->feedPCMFrames(pcm, pcmSize);
+  recordStage(playerStats, start);
+}
@@ -7,7 +7,7 @@
 #include <mutex>       // for mutex
 #include <vector>      // for vector
 
-#include "StreamInfo.h"  // for BitWidth
+#include "StreamInfo.h"  // for BitWidth, PlanarBuffer
 
 namespace bell {
 class AudioPipeline;
@@ -47,8 +47,18 @@ class BellDSP {
 
   std::shared_ptr<AudioPipeline> getActivePipeline();
 
+  /**
+	 * Process interleaved 16, 24 (packed) or 32-bit PCM in place, at its own resolution.
+	 * @returns number of bytes after processing, as the pipeline may downmix to mono
+	 */
   size_t process(uint8_t* data, size_t bytes, int channels, uint32_t sampleRate,
                  BitWidth bitWidth);
+  /**
+	 * Process planar float audio in place, as written by BaseCodec::decodeInto(), without
+	 * converting it to 16-bit samples and back.
+	 * @returns number of channels after processing, as the pipeline may downmix to mono
+	 */
+  int process(PlanarBuffer& buffer, uint32_t sampleRate);
 
  private:
   std::shared_ptr<AudioPipeline> activePipeline;
@@ -62,5 +72,7 @@ class BellDSP {
   std::unique_ptr<AudioEffect> instantEffect = nullptr;
 
   size_t samplesSinceInstantQueued;
+
+  void applyInstantEffect(float** data, int channels, size_t samples);
 };
 };  // namespace bell
@@ -28,7 +28,9 @@ class CentralAudioBuffer {
 
  public:
   static const size_t PCM_CHUNK_SIZE = 4096;
+  // Given when a chunk is committed to the buffer, and when one is read from it
   std::unique_ptr<bell::WrappedSemaphore> chunkReady;
+  std::unique_ptr<bell::WrappedSemaphore> chunkRead;
 
   // Audio marker for track change detection, and DSP autoconfig
   struct AudioChunk {
@@ -54,6 +56,7 @@ class CentralAudioBuffer {
   CentralAudioBuffer(size_t chunks) {
     audioBuffer = std::make_shared<CircularBuffer>(chunks * sizeof(AudioChunk));
     chunkReady = std::make_unique<bell::WrappedSemaphore>(50);
+    chunkRead = std::make_unique<bell::WrappedSemaphore>(50);
   }
 
   std::shared_ptr<bell::CircularBuffer> audioBuffer;
@@ -120,26 +123,59 @@ class CentralAudioBuffer {
 
     audioBuffer->read((uint8_t*)&lastReadChunk, sizeof(AudioChunk));
     currentSampleRate = static_cast<uint32_t>(lastReadChunk.sampleRate);
+    this->chunkRead->give();
     return &lastReadChunk;
   }
 
+  /**
+	 * Commits the partially filled current chunk, e.g. at the end of a track
+	 * @return false if there's no space left in the buffer
+	 */
+  bool flush() {
+    std::scoped_lock lock(this->dataAccessMutex);
+    if (!hasChunk || currentChunk.pcmSize == 0) {
+      return true;
+    }
+    if ((audioBuffer->capacity() - audioBuffer->size()) < sizeof(AudioChunk)) {
+      return false;
+    }
+    hasChunk = false;
+    this->audioBuffer->write((uint8_t*)&currentChunk, sizeof(AudioChunk));
+    this->chunkReady->give();
+    return true;
+  }
+
+  /**
+	 * Copy PCM to the current chunk, committing it when full. Chunks hold whole frames of
+	 * a single format, a new one is started when the format changes.
+	 * @return bytes written, whole frames; 0 if there's no space left in the buffer
+	 */
   size_t writePCM(const uint8_t* data, size_t dataSize, size_t hash,
                   uint32_t sampleRate = 44100, uint8_t channels = 2,
                   BitWidth bitWidth = BitWidth::BW_16, int32_t sec = 0,
                   int32_t usec = 0) {
     std::scoped_lock lock(this->dataAccessMutex);
+    auto bits = static_cast<uint8_t>(bitWidth);
+    size_t frameSize = channels * (bits / 8);
+    if (frameSize == 0) {
+      return 0;
+    }
+
     if (hasChunk && (currentChunk.trackHash != hash ||
-                     currentChunk.pcmSize >= PCM_CHUNK_SIZE)) {
+                     currentChunk.sampleRate != sampleRate ||
+                     currentChunk.channels != channels ||
+                     currentChunk.bitWidth != bits ||
+                     currentChunk.pcmSize + frameSize > PCM_CHUNK_SIZE)) {
 
-      if ((audioBuffer->size() - audioBuffer->capacity()) <
+      if ((audioBuffer->capacity() - audioBuffer->size()) <
           sizeof(AudioChunk)) {
         return 0;
       }
 
-      // Track changed or buf full, return current chunk
+      // Track or format changed, or buf full, return current chunk
       hasChunk = false;
       this->audioBuffer->write((uint8_t*)&currentChunk, sizeof(AudioChunk));
-      // this->chunkReady->give();
+      this->chunkReady->give();
     }
 
     // New chunk requested, initialize
@@ -147,7 +183,7 @@ class CentralAudioBuffer {
       currentChunk.trackHash = hash;
       currentChunk.sampleRate = sampleRate;
       currentChunk.channels = channels;
-      currentChunk.bitWidth = 16;
+      currentChunk.bitWidth = bits;
       currentChunk.sec = sec;
       currentChunk.usec = usec;
       currentChunk.pcmSize = 0;
@@ -160,6 +196,7 @@ class CentralAudioBuffer {
     if (currentChunk.pcmSize + toWriteSize > PCM_CHUNK_SIZE) {
       toWriteSize = PCM_CHUNK_SIZE - currentChunk.pcmSize;
     }
+    toWriteSize -= toWriteSize % frameSize;
 
     // Copy it over :)
     memcpy(currentChunk.pcmData + currentChunk.pcmSize, data, toWriteSize);
@@ -0,0 +1,168 @@
+#pragma once
+
+#include <stddef.h>       // for size_t
+#include <stdint.h>       // for uint32_t, uint8_t, uint64_t
+#include <list>           // for list
+#include <memory>         // for shared_ptr, unique_ptr
+#include <mutex>          // for mutex
+#include <string>         // for string
+#include <unordered_map>  // for unordered_map
+#include <vector>         // for vector
+
+#include "StreamInfo.h"  // for PCMFormat
+
+struct OpusEncoder;
+struct OpusDecoder;
+
+namespace bell {
+/**
+ * Cache of fully decoded tracks, for sources played over and over (jingles,
+ * announcements). Tracks are keyed by the same hash passed to CentralAudioBuffer, e.g.
+ * std::hash of the URL.
+ *
+ * A track is recorded while it's decoded (see beginRecording()), and only kept if it was
+ * decoded to the end, in a single format, and within maxTrackBytes. Its PCM is stored as
+ * decoded, or re-encoded to Opus for 48 kHz, 16-bit audio, with the encoder's delay and
+ * padding trimmed on read, so that replays start and end on the same sample.
+ *
+ * Tracks are evicted least recently used first, once maxBytes of memory is exceeded.
+ * With a spill directory configured, evicted tracks are written there instead, and read
+ * back on the next hit; the oldest spilled files are deleted past maxSpillBytes. Files
+ * spilled by a previous instance aren't reused.
+ */
+class PCMCache {
+ public:
+  enum class Compression { NONE, OPUS };
+
+  struct Config {
+    // memory for cached tracks
+    size_t maxBytes = 8 * 1024 * 1024;
+    // larger tracks, after compression, aren't cached
+    size_t maxTrackBytes = 2 * 1024 * 1024;
+    Compression compression = Compression::NONE;
+    int32_t opusBitrate = 128000;
+    // directory evicted tracks are written to, which must exist; empty to drop them
+    std::string spillDirectory;
+    std::string prefix = "pcmcache";
+    size_t maxSpillBytes = 64 * 1024 * 1024;
+  };
+
+ private:
+  struct Track {
+    PCMFormat format;
+    bool isOpus = false;
+    // Opus: samples of encoder delay at the start
+    uint32_t lookahead = 0;
+    // samples per channel
+    uint64_t frames = 0;
+    // raw PCM, or Opus packets each preceded by their 16-bit little endian length
+    std::vector<uint8_t> data;
+  };
+
+ public:
+  /**
+	 * Reads a cached track. It stays readable after being evicted from the cache.
+	 */
+  class Reader {
+   public:
+    ~Reader();
+
+    /**
+		 * Read the next block of PCM, see AudioDecoderStream::decode().
+		 *
+		 * @param [out] len size of the returned PCM, in bytes
+		 * @returns interleaved PCM at format(), valid until the next call; nullptr at the end of the track
+		 */
+    const uint8_t* read(uint32_t& len);
+    const PCMFormat& format() const { return track->format; }
+
+   private:
+    friend class PCMCache;
+    Reader(std::shared_ptr<const Track> track);
+
+    std::shared_ptr<const Track> track;
+    size_t offset = 0;
+    // Opus delay samples left to drop, and samples left to return
+    uint64_t skip = 0;
+    uint64_t remaining = 0;
+    OpusDecoder* decoder = nullptr;
+    std::vector<int16_t> pcm;
+  };
+
+  PCMCache();
+  PCMCache(const Config& config);
+  ~PCMCache();
+
+  bool contains(size_t trackHash);
+  /**
+	 * Start reading a cached track, making it the most recently used one.
+	 * @returns nullptr if the track isn't cached
+	 */
+  std::unique_ptr<Reader> open(size_t trackHash);
+
+  /**
+	 * Start recording a track decoded from its beginning, dropping any unfinished one.
+	 */
+  void beginRecording(size_t trackHash);
+  /**
+	 * Append decoded PCM to the track being recorded.
+	 */
+  void record(const uint8_t* data, size_t len, const PCMFormat& format);
+  /**
+	 * Stop recording, caching the track if it was decoded to its end.
+	 */
+  void endRecording(bool complete);
+
+  void remove(size_t trackHash);
+  /**
+	 * Drop all cached tracks, including spilled ones.
+	 */
+  void clear();
+
+  // memory used by cached tracks, in bytes
+  size_t memoryUsed();
+  size_t trackCount();
+
+ private:
+  struct Slot {
+    size_t trackHash;
+    // nullptr once evicted from memory
+    std::shared_ptr<const Track> track;
+    size_t bytes;
+    bool spilled = false;
+  };
+
+  static constexpr uint32_t OPUS_FRAME_SAMPLES = 960;  // 20 ms at 48 kHz
+
+  Config config;
+  std::mutex accessMutex;
+
+  // most recently used first
+  std::list<Slot> slots;
+  std::unordered_map<size_t, std::list<Slot>::iterator> index;
+  size_t memoryBytes = 0;
+  size_t spillBytes = 0;
+
+  // track being recorded, and its hash
+  std::unique_ptr<Track> pending;
+  size_t pendingHash = 0;
+
+  // Opus staging, accumulating 20 ms frames of the recorded track
+  OpusEncoder* encoder = nullptr;
+  uint8_t encoderChannels = 0;
+  std::vector<int16_t> stagedPCM;
+  size_t stagedSamples = 0;
+  uint64_t encodedSamples = 0;
+  std::vector<uint8_t> packet;
+
+  bool canCompress(const PCMFormat& format);
+  bool setupEncoder(uint8_t channels);
+  bool encodeStaged(Track& track);
+  void insert(size_t trackHash, std::unique_ptr<Track> track);
+  void erase(std::list<Slot>::iterator slot);
+  void evict();
+  bool spill(Slot& slot);
+  std::shared_ptr<const Track> load(size_t trackHash);
+  std::string spillPath(size_t trackHash) const;
+};
+}  // namespace bell
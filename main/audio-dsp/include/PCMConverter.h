@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stddef.h>  // for size_t
+#include <stdint.h>  // for uint8_t
+
+namespace bell::PCMConverter {
+/**
+ * Conversions between the integer PCM of PCMFormat (16, 24 packed or 32 bits) and
+ * floats in [-1, 1). Each bit depth has its own loop without branches, which compilers
+ * vectorize for interleaved data too.
+ */
+
+/**
+ * Convert count samples of one channel to float.
+ *
+ * @param stride bytes from one sample to the next, e.g. the frame size of interleaved PCM
+ */
+void toFloat(const uint8_t* in, uint8_t bitDepth, size_t stride, float* out,
+             size_t count);
+/**
+ * Convert count float samples of one channel to integer PCM, clipping them.
+ *
+ * @param stride bytes from one sample to the next, e.g. the frame size of interleaved PCM
+ */
+void fromFloat(const float* in, uint8_t* out, uint8_t bitDepth, size_t stride,
+               size_t count);
+/**
+ * Convert count samples between bit depths; in and out may be the same buffer when
+ * narrowing. Narrowing keeps the top bits.
+ *
+ * @return bytes written to out
+ */
+size_t convert(const uint8_t* in, uint8_t inDepth, uint8_t* out,
+               uint8_t outDepth, size_t count);
+/**
+ * Reverse the byte order of count samples, e.g. big endian AIFF to the little endian
+ * PCM used everywhere else; in and out may be the same buffer. Neither needs to be
+ * aligned.
+ */
+void swapBytes(const uint8_t* in, uint8_t* out, uint8_t bitDepth,
+               size_t count);
+}  // namespace bell::PCMConverter
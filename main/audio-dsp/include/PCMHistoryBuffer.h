@@ -0,0 +1,129 @@
+#pragma once
+
+#include <stddef.h>  // for size_t
+#include <stdint.h>  // for uint32_t, uint8_t, uint64_t
+#include <mutex>     // for mutex
+#include <vector>    // for vector
+
+#include "CentralAudioBuffer.h"  // for CentralAudioBuffer
+
+struct OpusEncoder;
+struct OpusDecoder;
+
+namespace bell {
+/**
+ * Retains the last few seconds of played PCM audio, for instant rewind and replay.
+ *
+ * Chunks are recorded as they're played (see record()), and stored either as they are,
+ * or re-encoded to Opus to save memory. Opus is only used for 48 kHz, 16-bit audio;
+ * anything else is always stored as raw PCM. All memory is allocated up front (in PSRAM
+ * on ESP32), and the oldest entries are evicted when the byte budget, the entry index or
+ * the configured duration is exhausted.
+ *
+ * Entries are indexed by stream time, i.e. the amount of audio recorded so far. After
+ * rewind(), next() returns the recorded audio starting that far back, while recording
+ * continues - calling next() once per recorded chunk keeps a constant delay behind
+ * the live stream, until goLive() is called.
+ */
+class PCMHistoryBuffer {
+ public:
+  enum class Compression { NONE, OPUS };
+
+  struct Config {
+    // memory for the recorded audio
+    size_t maxBytes = 2 * 1024 * 1024;
+    // longest duration to keep, regardless of available memory
+    uint32_t maxSeconds = 30;
+    Compression compression = Compression::NONE;
+    int32_t opusBitrate = 96000;
+  };
+
+  PCMHistoryBuffer();
+  PCMHistoryBuffer(const Config& config);
+  ~PCMHistoryBuffer();
+
+  /**
+	 * Append a played chunk to the history.
+	 */
+  void record(const CentralAudioBuffer::AudioChunk& chunk);
+
+  /**
+	 * Move the replay position ms milliseconds back from the newest recorded audio.
+	 * @return how far back the replay position actually is, limited by retained audio
+	 */
+  uint32_t rewind(uint32_t ms);
+  /**
+	 * Stop replaying, returning to the live stream.
+	 */
+  void goLive();
+  bool isReplaying();
+
+  /**
+	 * Read the audio at the replay position, and advance it.
+	 * @return false if not replaying, or the replay position has caught up with live
+	 */
+  bool next(CentralAudioBuffer::AudioChunk& chunk);
+
+  /**
+	 * Amount of retained audio, in milliseconds.
+	 */
+  uint32_t availableMs();
+  /**
+	 * Drop all of the recorded audio.
+	 */
+  void clear();
+
+ private:
+  struct Entry {
+    uint64_t timeMs;  // stream time at the start of the entry
+    uint32_t durationUs;
+    size_t trackHash;
+    int32_t sec;
+    int32_t usec;
+    uint32_t sampleRate;
+    uint8_t channels;
+    uint8_t bitWidth;
+    bool isOpus;
+    size_t offset;  // in data
+    size_t size;
+  };
+
+  static constexpr uint32_t OPUS_FRAME_SAMPLES = 960;  // 20 ms at 48 kHz
+
+  Config config;
+  std::mutex accessMutex;
+
+  uint8_t* data;
+  size_t dataSize;
+  size_t writeOffset = 0;
+
+  // ring of entries; sequence numbers stay valid across evictions
+  std::vector<Entry> entries;
+  size_t firstEntry = 0;
+  size_t entryCount = 0;
+  uint64_t firstSeq = 0;
+  uint64_t replaySeq = 0;
+  bool replaying = false;
+  uint64_t streamTimeUs = 0;
+
+  // Opus staging, accumulating 20 ms frames out of chunks
+  OpusEncoder* encoder = nullptr;
+  OpusDecoder* decoder = nullptr;
+  uint8_t encoderChannels = 0;
+  uint8_t decoderChannels = 0;
+  // entry following the last packet decoded
+  uint64_t nextDecodeSeq = 0;
+  Entry staged = {};
+  std::vector<int16_t> stagedPCM;
+  size_t stagedSamples = 0;
+  std::vector<uint8_t> packet;
+
+  Entry& entryAt(uint64_t seq);
+  bool allocate(size_t size, size_t& offset);
+  void evictOldest();
+  void append(const Entry& entry, const uint8_t* payload);
+  void stage(const CentralAudioBuffer::AudioChunk& chunk);
+  void flushStaged();
+  bool canCompress(const CentralAudioBuffer::AudioChunk& chunk);
+};
+}  // namespace bell
@@ -0,0 +1,248 @@
+#pragma once
+
+#include <stddef.h>    // for size_t
+#include <stdint.h>    // for uint32_t, uint8_t
+#include <atomic>      // for atomic
+#include <chrono>      // for steady_clock
+#include <functional>  // for function
+#include <memory>      // for shared_ptr, unique_ptr
+#include <mutex>       // for mutex
+#include <string>      // for string
+#include <vector>      // for vector
+
+#include "AudioDecoderStream.h"  // for AudioDecoderStream
+#include "BellTask.h"            // for Task
+#include "BufferedStream.h"      // for BufferedStream
+#include "CentralAudioBuffer.h"  // for CentralAudioBuffer
+#include "PCMCache.h"            // for PCMCache
+#include "PCMHistoryBuffer.h"    // for PCMHistoryBuffer
+#include "StreamInfo.h"          // for PCMFormat
+#include "WrappedSemaphore.h"    // for WrappedSemaphore
+
+class AudioSink;
+
+namespace bell {
+class BellDSP;
+
+/**
+ * Three-stage playback engine, with each stage running on its own task:
+ *  - network: a BufferedStream, reading the source ahead of the decoder,
+ *  - decode: decodes the stream with an AudioDecoderStream, filling a CentralAudioBuffer,
+ *  - player: feeds decoded chunks to an AudioSink, optionally through a BellDSP.
+ *
+ * Tracks queued with queue() play gaplessly after the current one. The next track's
+ * source is buffered by a second BufferedStream while the current one plays, and its
+ * start is decoded into a staging CentralAudioBuffer whenever the decoder would
+ * otherwise wait for the player; at the track change, the staged chunks are moved to
+ * the audio buffer, and decoding carries on with the already set up codec.
+ *
+ * With a PCMCache set, tracks played from their start are cached once fully decoded,
+ * and later plays of the same track hash are served from it, without touching the
+ * network, container or codec.
+ *
+ * Audio keeps the resolution it's decoded at (see Config::maxBitDepth) through the DSP,
+ * and is only converted when the sink doesn't accept it.
+ *
+ * Stages block on semaphores instead of polling. The decoder waits for buffered source
+ * data, and for free space in the audio buffer (backpressure), while the player waits
+ * for decoded chunks. Network stalls are absorbed by the two buffers in between.
+ */
+class PlaybackEngine {
+ public:
+  struct TaskConfig {
+    std::string name;
+    int stackSize;
+    int priority;
+    int core;
+  };
+
+  struct Config {
+    TaskConfig networkTask = {"bell_network", 4096, 5, 0};
+    TaskConfig decodeTask = {"bell_decode", 16 * 1024, 6, 1};
+    TaskConfig playerTask = {"bell_player", 4096, 8, 1};
+
+    // network stage, see BufferedStream
+    uint32_t streamBufferSize = 32 * 1024;
+    uint32_t streamReadSize = 4096;
+    uint32_t streamReadyThreshold = 8 * 1024;
+    uint32_t streamNotReadyThreshold = 4 * 1024;
+
+    // highest bit depth decoded from high-resolution sources (FLAC, ALAC); the sink is
+    // asked for the decoded one, and samples are converted if it refuses
+    uint8_t maxBitDepth = 32;
+
+    // decoded audio queue depth, in CentralAudioBuffer chunks
+    size_t audioBufferChunks = 32;
+    // chunks to buffer before starting playback, or resuming after an underrun
+    size_t playbackStartChunks = 8;
+    // chunks of the queued track decoded ahead of the track change. Along with them,
+    // queueing allocates a second stream buffer of streamBufferSize on first use.
+    size_t prefetchChunks = 8;
+    // longest time a stage blocks waiting, before re-checking its state
+    uint32_t stageWaitMs = 50;
+  };
+
+  struct StageStats {
+    // duration of the last, and longest unit of work (decoded frame, played chunk)
+    std::atomic<uint32_t> lastUs = 0;
+    std::atomic<uint32_t> maxUs = 0;
+    // number of times the stage had to wait for its input or output
+    std::atomic<uint32_t> stalls = 0;
+  };
+
+  PlaybackEngine(std::shared_ptr<AudioSink> sink);
+  PlaybackEngine(std::shared_ptr<AudioSink> sink, const Config& config);
+  ~PlaybackEngine();
+
+  /**
+	 * Stop the current track, and start playing one from the given source.
+	 *
+	 * @param reader source factory, allowing range requests (and seeking)
+	 * @param trackHash unique track identifier, passed to CentralAudioBuffer
+	 * @param offset where to start reading the source, e.g. a frame-aligned offset
+	 * from TimeShiftBuffer::offsetBehindLive(); the cache is only used from offset 0
+	 */
+  void play(const BufferedStream::StreamReader& reader, size_t trackHash,
+            uint32_t offset = 0);
+  void play(const BufferedStream::StreamPtr& stream, size_t trackHash);
+  /**
+	 * Play the given track after the current one, without a gap, replacing the one
+	 * queued before. If nothing is being decoded, it's played after the buffered audio.
+	 */
+  void queue(const BufferedStream::StreamReader& reader, size_t trackHash);
+  void queue(const BufferedStream::StreamPtr& stream, size_t trackHash);
+  /**
+	 * Stop decoding, and drop any buffered audio and queued track.
+	 */
+  void stop();
+
+  void setDSP(std::shared_ptr<BellDSP> dsp);
+  /**
+	 * Record played audio into the given history buffer, and play from it while it's
+	 * replaying. The decoder keeps running meanwhile, so a live stream stays connected,
+	 * and PCMHistoryBuffer::goLive() skips back to it instantly.
+	 *
+	 * The history isn't cleared when changing tracks.
+	 */
+  void setHistory(std::shared_ptr<PCMHistoryBuffer> history);
+  /**
+	 * Cache decoded tracks, and play cached ones from memory (or the cache's spill
+	 * directory). The reader passed to play() isn't called on a hit.
+	 */
+  void setCache(std::shared_ptr<PCMCache> cache);
+
+  std::shared_ptr<CentralAudioBuffer> getAudioBuffer() { return audioBuffer; }
+  /**
+	 * Stream of the track being decoded.
+	 */
+  std::shared_ptr<BufferedStream> getStream();
+  /**
+	 * Whether the decode stage is running.
+	 */
+  bool isDecoding() const { return decoding; }
+
+  StageStats decodeStats;
+  StageStats playerStats;
+
+ private:
+  typedef std::chrono::steady_clock Clock;
+
+  typedef std::function<void(BufferedStream& stream)> StreamOpener;
+
+  // a track to decode, from the cache or from a stream
+  struct Track {
+    size_t hash = 0;
+    // nullptr for cached tracks
+    std::shared_ptr<BufferedStream> stream;
+    std::unique_ptr<AudioDecoderStream> decoder;
+    std::unique_ptr<PCMCache::Reader> cached;
+    // cache to record the track into, when decoded from its start
+    std::shared_ptr<PCMCache> recordingCache;
+    // decoded block not written to a buffer yet
+    const uint8_t* pending = nullptr;
+    uint32_t pendingLen = 0;
+    PCMFormat pendingFormat;
+  };
+
+  class StageTask : public bell::Task {
+   public:
+    StageTask(const TaskConfig& config, std::function<void()> body);
+    void start();
+    // wait for the task started by the last start() to finish
+    void join();
+
+   protected:
+    void runTask() override;
+
+   private:
+    std::function<void()> body;
+    bell::WrappedSemaphore finished;
+    bool started = false;
+  };
+
+  Config config;
+  std::shared_ptr<AudioSink> sink;
+  std::shared_ptr<CentralAudioBuffer> audioBuffer;
+  std::shared_ptr<BufferedStream> stream;
+  // stream and staged start of the queued track, created by the first queue()
+  std::shared_ptr<BufferedStream> nextStream;
+  std::shared_ptr<CentralAudioBuffer> stagedBuffer;
+  std::shared_ptr<BellDSP> dsp;
+  std::mutex dspMutex;
+  std::shared_ptr<PCMHistoryBuffer> history;
+  std::mutex historyMutex;
+  std::shared_ptr<PCMCache> cache;
+  std::mutex cacheMutex;
+  std::mutex controlMutex;
+  StageTask decodeTask;
+  StageTask playerTask;
+
+  // owned by the decode task while it runs
+  Track current;
+  std::atomic<bool> decoding = false;
+  std::atomic<bool> stopDecoding = false;
+  std::atomic<bool> stopPlayer = false;
+  // the decode task is decoding the queued track ahead, and mustn't wait for data
+  bool prefetching = false;
+  // the queued track's source ran dry during the last prefetch
+  bool prefetchStalled = false;
+
+  // guards the queued track, and the stream pointers swapped at track changes
+  std::mutex queueMutex;
+  Track next;
+  bool hasNext = false;
+  // set once the decode task took its last track, and won't pick a queued one
+  bool queueClosed = true;
+  // incremented by queue(), to tell stale staged chunks apart
+  uint32_t queueGeneration = 0;
+  uint32_t stagedGeneration = 0;
+  // the decode task is moving staged chunks to the audio buffer
+  bool drainingStaged = false;
+
+  // format of the chunks the sink is currently configured for
+  PCMFormat chunkFormat;
+  // bit depth the sink accepted for them
+  uint8_t sinkBitDepth = 16;
+  // chunks converted to a larger bit depth for the sink
+  std::vector<uint8_t> sinkBuffer;
+
+  void startTrack(size_t trackHash, bool fromStart, const StreamOpener& open);
+  void queueTrack(size_t trackHash, const StreamOpener& open);
+  bool openCached(Track& track, bool fromStart);
+  bool openDecoder(Track& track);
+  const uint8_t* readTrack(Track& track, uint32_t& len, PCMFormat& format);
+  void stopTrack();
+  std::shared_ptr<BufferedStream> makeStream();
+  void decodeTrack();
+  bool decodeCurrent();
+  bool startNext();
+  void drainStaged();
+  bool prefetch();
+  void restartPrefetch();
+  void playerLoop();
+  void playChunk(CentralAudioBuffer::AudioChunk& chunk);
+  void configureSink();
+  bool writePCM(const uint8_t* data, size_t len, const PCMFormat& format);
+  void recordStage(StageStats& stats, Clock::time_point start);
+};
+}  // namespace bell
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
 #include <string>
 #include <vector>
@@ -10,6 +11,10 @@ enum class Channels { LEFT, RIGHT, LEFT_RIGHT };
 enum class SampleRate : uint32_t {
   SR_44100 = 44100,
   SR_48000 = 48000,
+  SR_88200 = 88200,
+  SR_96000 = 96000,
+  SR_176400 = 176400,
+  SR_192000 = 192000,
 };
 
 enum class BitWidth : uint32_t {
@@ -25,4 +30,32 @@ typedef struct {
   SampleRate sampleRate;
   size_t numSamples;
 } StreamInfo;
+
+/**
+ * Format of interleaved integer PCM, carried along the decoded audio from the codec to
+ * the AudioSink. Samples are signed and little endian; 24-bit ones are packed in 3 bytes.
+ */
+struct PCMFormat {
+  uint32_t sampleRate = 0;
+  uint8_t channels = 0;
+  uint8_t bitDepth = 0;
+
+  size_t frameSize() const { return channels * (bitDepth / 8); }
+  bool operator==(const PCMFormat& other) const {
+    return sampleRate == other.sampleRate && channels == other.channels &&
+           bitDepth == other.bitDepth;
+  }
+  bool operator!=(const PCMFormat& other) const { return !(*this == other); }
+};
+
+/**
+ * Planar float audio in caller-owned memory, filled by BaseCodec::decodeInto().
+ * Samples are nominally in [-1, 1), Opus may slightly exceed it.
+ */
+struct PlanarBuffer {
+  float** data = nullptr;  // numChannels buffers of capacity samples
+  int numChannels = 0;
+  size_t capacity = 0;
+  size_t numSamples = 0;  // per channel, written so far
+};
 };  // namespace bell
\ No newline at end of file
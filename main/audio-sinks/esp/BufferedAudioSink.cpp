@@ -39,7 +39,10 @@ void BufferedAudioSink::feedPCMFramesInternal(const void* pvItem,
 bool BufferedAudioSink::setParams(uint32_t sampleRate, uint8_t channelCount,
                                   uint8_t bitDepth) {
   // TODO override this for sinks with custom mclk
-  i2s_set_clk((i2s_port_t)0, sampleRate, (i2s_bits_per_sample_t)bitDepth,
-              (i2s_channel_t)channelCount);
-  return true;
+  // I2S samples take 16 or 32 bit slots, packed 24-bit PCM would need unpacking
+  if (bitDepth != 16 && bitDepth != 32)
+    return false;
+  return i2s_set_clk((i2s_port_t)0, sampleRate,
+                     (i2s_bits_per_sample_t)bitDepth,
+                     (i2s_channel_t)channelCount) == ESP_OK;
 }
\ No newline at end of file
@@ -16,4 +16,6 @@ class PortAudioSink : public AudioSink {
 
  private:
   PaStream* stream = nullptr;
+  // bytes per frame of the configured format
+  size_t frameSize = 4;
 };
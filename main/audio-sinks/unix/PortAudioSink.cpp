@@ -33,8 +33,7 @@ bool PortAudioSink::setParams(uint32_t sampleRate, uint8_t channelCount,
       outputParameters.sampleFormat = paInt8;
       break;
     default:
-      outputParameters.sampleFormat = paInt16;
-      break;
+      return false;
   }
   outputParameters.suggestedLatency = 0.050;
   outputParameters.hostApiSpecificStreamInfo = NULL;
@@ -44,6 +43,7 @@ bool PortAudioSink::setParams(uint32_t sampleRate, uint8_t channelCount,
                               NULL,  // blocking api
                               NULL);
   Pa_StartStream(stream);
+  frameSize = channelCount * bitDepth / 8;
   return !err;
 }
 
@@ -53,5 +53,5 @@ PortAudioSink::~PortAudioSink() {
 }
 
 void PortAudioSink::feedPCMFrames(const uint8_t* buffer, size_t bytes) {
-  Pa_WriteStream(stream, buffer, bytes / 4);
+  Pa_WriteStream(stream, buffer, bytes / frameSize);
 }
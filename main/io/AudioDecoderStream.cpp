@@ -0,0 +1,130 @@
+#include "AudioDecoderStream.h"
+
+#include <utility>  // for move
+
+#include "AudioCodecs.h"      // for AudioCodecs
+#include "AudioContainer.h"   // for AudioContainer
+#include "AudioContainers.h"  // for guessAudioContainer
+#include "BaseCodec.h"        // for BaseCodec
+#include "BellLogger.h"       // for AbstractLogger, BELL_LOG
+#include "ByteStream.h"       // for ByteStream
+#include "StreamUtils.h"      // for IByteStream
+
+using namespace bell;
+
+// failed decodes tolerated once the input ended, while the container may still hold
+// buffered frames
+#define DECODER_MAX_TRAILING_FAILURES 64
+
+AudioDecoderStream::AudioDecoderStream(size_t inputBufferSize)
+    : inputBufferSize(inputBufferSize) {}
+
+AudioDecoderStream::~AudioDecoderStream() {
+  close();
+}
+
+bool AudioDecoderStream::open(std::shared_ptr<ByteStream> stream,
+                              std::function<bool()> waitForData) {
+  close();
+  istr = std::make_unique<IByteStream>(std::move(stream),
+                                       std::move(waitForData), inputBufferSize);
+  container = AudioContainers::guessAudioContainer(*istr);
+  return openCodec();
+}
+
+bool AudioDecoderStream::open(std::shared_ptr<ByteStream> stream,
+                              const PCMContainer::Format& format,
+                              std::function<bool()> waitForData) {
+  close();
+  istr = std::make_unique<IByteStream>(std::move(stream),
+                                       std::move(waitForData), inputBufferSize);
+  container = std::make_unique<PCMContainer>(*istr, format);
+  return openCodec();
+}
+
+bool AudioDecoderStream::openCodec() {
+  if (container)
+    codec = AudioCodecs::getCodec(container.get());
+  if (!codec) {
+    BELL_LOG(error, "AudioDecoderStream", "No decoder for the stream");
+    close();
+    return false;
+  }
+
+  codec->setMaxBitDepth(maxBitDepth);
+  ended = false;
+  formatKnown = false;
+  currentFormat = {codec->sampleRate, codec->channelCount, codec->bitDepth};
+  return true;
+}
+
+void AudioDecoderStream::close() {
+  // back to the pool, before the container it was reading from goes away
+  codec.reset();
+  container.reset();
+  istr.reset();
+  ended = true;
+}
+
+uint8_t* AudioDecoderStream::decode(uint32_t& len) {
+  len = 0;
+  if (ended)
+    return nullptr;
+
+  int failures = 0;
+  do {
+    uint8_t* data = codec->decode(container.get(), len);
+    if (data && len) {
+      updateFormat();
+      return data;
+    }
+  } while (retry(failures));
+
+  len = 0;
+  return nullptr;
+}
+
+size_t AudioDecoderStream::decodeInto(PlanarBuffer& buffer,
+                                      size_t maxSamples) {
+  if (ended)
+    return 0;
+
+  int failures = 0;
+  do {
+    size_t written = codec->decodeInto(container.get(), buffer, maxSamples);
+    if (written) {
+      updateFormat();
+      return written;
+    }
+  } while (buffer.numSamples < buffer.capacity && retry(failures));
+  return 0;
+}
+
+bool AudioDecoderStream::seekToSample(uint64_t sample) {
+  if (!container || !container->seekToSample(sample))
+    return false;
+  codec->reset();
+  codec->seekedTo(container->currentSample());
+  codec->setMaxBitDepth(maxBitDepth);
+  ended = false;
+  return true;
+}
+
+bool AudioDecoderStream::retry(int& failures) {
+  // a frame failing before the end of the stream is skipped over by the container
+  if (container->isEnd() && ++failures > DECODER_MAX_TRAILING_FAILURES) {
+    ended = true;
+    return false;
+  }
+  return true;
+}
+
+void AudioDecoderStream::updateFormat() {
+  Format format = {codec->sampleRate, codec->channelCount, codec->bitDepth};
+  if (formatKnown && format == currentFormat)
+    return;
+  formatKnown = true;
+  currentFormat = format;
+  if (formatCallback)
+    formatCallback(currentFormat);
+}
@@ -1,21 +1,25 @@
 #include "BufferedStream.h"
 
-#include <stdlib.h>     // for free, malloc
-#include <algorithm>    // for min
+#include <stdlib.h>     // for free, malloc, abs
+#include <algorithm>    // for min, clamp
 #include <cstdint>      // for uint32_t
 #include <cstring>      // for memcpy
 #include <type_traits>  // for remove_extent_t
+#include <utility>      // for move
 
 BufferedStream::BufferedStream(const std::string& taskName, uint32_t bufferSize,
                                uint32_t readThreshold, uint32_t readSize,
                                uint32_t readyThreshold,
-                               uint32_t notReadyThreshold, bool waitForReady)
-    : bell::Task(taskName, 4096, 5, 0) {
+                               uint32_t notReadyThreshold, bool waitForReady,
+                               int taskPriority, int taskCore)
+    : bell::Task(taskName, 4096, taskPriority, taskCore) {
   this->bufferSize = bufferSize;
   this->readAt = bufferSize - readThreshold;
   this->readSize = readSize;
   this->readyThreshold = readyThreshold;
   this->notReadyThreshold = notReadyThreshold;
+  this->notReadyRatio =
+      readyThreshold ? (uint64_t)notReadyThreshold * 256 / readyThreshold : 0;
   this->waitForReady = waitForReady;
   this->buf = static_cast<uint8_t*>(malloc(bufferSize));
   this->bufEnd = buf + bufferSize;
@@ -42,15 +46,26 @@ void BufferedStream::reset() {
   this->readTotal = 0;
   this->bufferTotal = 0;
   this->readAvailable = 0;
+  this->bufStartOffset = 0;
+  this->readOffset = 0;
   this->terminate = false;
 }
 
+void BufferedStream::start() {
+  // mark as running before the task does, so that read() doesn't report EOF
+  this->running = true;
+  startTask();
+}
+
 bool BufferedStream::open(const std::shared_ptr<bell::ByteStream>& stream) {
   if (this->running)
     this->close();
   reset();
   this->source = stream;
-  startTask();
+  this->sourceSize = stream ? stream->size() : 0;
+  this->sourceEnded = false;
+  this->rangeReader = nullptr;
+  start();
   return source.get();
 }
 
@@ -60,8 +75,13 @@ bool BufferedStream::open(const StreamReader& newReader,
     this->close();
   reset();
   this->reader = newReader;
+  this->rangeReader = newReader;
+  this->sourceSize = 0;
+  this->sourceEnded = false;
   this->bufferTotal = initialOffset;
-  startTask();
+  this->bufStartOffset = initialOffset;
+  this->readOffset = initialOffset;
+  start();
   return source.get();
 }
 
@@ -74,15 +94,207 @@ bool BufferedStream::isNotReady() const {
 }
 
 size_t BufferedStream::skip(size_t len) {
+  if (rangeReader && len > readAvailable) {
+    return seek(readOffset + len) ? len : 0;
+  }
   return read(nullptr, len);
 }
 
 size_t BufferedStream::position() {
-  return readTotal;
+  return readOffset;
 }
 
 size_t BufferedStream::size() {
-  return source->size();
+  return sourceSize;
+}
+
+bool BufferedStream::seek(size_t offset) {
+  if (offset == readOffset)
+    return true;
+  if (sourceSize && offset > sourceSize)
+    return false;
+
+  if (offset > readOffset && offset - readOffset <= readAvailable) {
+    // target is already buffered, ahead of the read pointer
+    return read(nullptr, offset - readOffset) == offset - readOffset;
+  }
+
+  // reserve readSize bytes behind, as the task might be writing there right now
+  if (offset < readOffset && readOffset - offset <= retainedBehind(readSize)) {
+    // target was read before, but not overwritten yet
+    const std::lock_guard lock(readMutex);
+    uint32_t delta = readOffset - offset;
+    bufReadPtr -= delta;
+    if (bufReadPtr < buf)
+      bufReadPtr += bufferSize;
+    readAvailable += delta;
+    readOffset = offset;
+    return true;
+  }
+
+  if (!rangeReader)
+    return false;
+
+  // reopen the source at the target offset
+  StreamReader newReader = rangeReader;
+  this->close();  // waits for the reading task to finish
+  retainSegment();
+  reset();
+  size_t prefilled = prefillFromSegments(offset);
+  this->bufStartOffset = offset;
+  this->readOffset = offset;
+  this->bufferTotal = offset + prefilled;
+  this->sourceEnded = sourceSize && bufferTotal >= sourceSize;
+  this->rangeReader = newReader;
+  // don't request anything past the end, if it's all in the cache
+  if (!sourceSize || bufferTotal < sourceSize)
+    this->reader = newReader;
+  start();
+  if (isReady())
+    this->readySem.give();
+  return true;
+}
+
+void BufferedStream::setRetainedSegments(uint8_t count) {
+  maxRetainedSegments = count;
+  while (retainedSegments.size() > count) {
+    retainedSegments.pop_back();
+  }
+}
+
+void BufferedStream::setAdaptive(uint32_t minReadyThreshold,
+                                 uint32_t maxReadyThreshold) {
+  // never expect more than the buffer can hold, while the source is reading
+  this->maxReadyThreshold = std::min(maxReadyThreshold, bufferSize - readSize);
+  this->minReadyThreshold =
+      std::min(minReadyThreshold, this->maxReadyThreshold);
+  this->readyThreshold = this->minReadyThreshold;
+  this->notReadyThreshold =
+      ((uint64_t)this->minReadyThreshold * notReadyRatio) >> 8;
+  this->adaptive = true;
+  this->lastAdapt = Clock::now();
+  this->stableSince = lastAdapt;
+}
+
+void BufferedStream::trackSourceRead(uint32_t len, Clock::duration took) {
+  auto tookUs = static_cast<uint32_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(took).count());
+  if (tookUs == 0)
+    tookUs = 1;
+
+  // throughput over at least 100ms spent reading, as a single fast read
+  // (served from the socket buffer) says nothing about the source
+  sourceBytes += len;
+  sourceReadUs += tookUs;
+  if (sourceReadUs >= 100000) {
+    int64_t rate = std::min<uint64_t>(sourceBytes * 1000000 / sourceReadUs,
+                                      UINT32_MAX);
+    throughput = throughput + (rate - (int64_t)throughput) / 4;
+    sourceBytes = 0;
+    sourceReadUs = 0;
+  }
+
+  // exponential moving averages, RFC 3550-style for the jitter
+  int32_t deviation = (int32_t)tookUs - (int32_t)meanReadUs;
+  meanReadUs += deviation / 8;
+  jitterUs = jitterUs + (std::abs(deviation) - (int32_t)jitterUs) / 16;
+}
+
+void BufferedStream::adaptThresholds() {
+  auto now = Clock::now();
+  auto elapsedMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                       now - lastAdapt)
+                       .count();
+  if (elapsedMs < 100)
+    return;
+
+  // consumption rate, i.e. how fast the buffer drains while reading
+  uint32_t served = readTotal - lastReadTotal;
+  lastReadTotal = readTotal;
+  lastAdapt = now;
+  if (served) {
+    int64_t rate = std::min<uint64_t>((uint64_t)served * 1000 / elapsedMs,
+                                      UINT32_MAX);
+    consumeRate = consumeRate + (rate - (int64_t)consumeRate) / 4;
+  }
+
+  // each underrun doubles the stall coverage, 10s without any halves it back
+  if (underruns != adaptedUnderruns) {
+    adaptedUnderruns = underruns;
+    underrunBoost = std::min(underrunBoost + 1, (uint32_t)4);
+    stableSince = now;
+  } else if (underrunBoost && now - stableSince > std::chrono::seconds(10)) {
+    underrunBoost--;
+    stableSince = now;
+  }
+
+  // cover the typical source stall plus four times its jitter
+  uint64_t coverUs = ((uint64_t)meanReadUs + 4 * (uint64_t)jitterUs)
+                     << underrunBoost;
+  uint64_t target = consumeRate * coverUs / 1000000;
+  target = std::clamp(target, (uint64_t)minReadyThreshold,
+                      (uint64_t)maxReadyThreshold);
+
+  readyThreshold = target;
+  notReadyThreshold = (target * notReadyRatio) >> 8;
+}
+
+uint32_t BufferedStream::retainedBehind(uint32_t margin) {
+  uint32_t freeSpace = bufferSize - readAvailable;
+  if (freeSpace <= margin)
+    return 0;
+  return std::min(static_cast<size_t>(freeSpace - margin),
+                  readOffset - bufStartOffset);
+}
+
+void BufferedStream::retainSegment() {
+  if (!maxRetainedSegments)
+    return;
+  uint32_t behind = retainedBehind(0);
+  size_t length = behind + readAvailable;
+  if (!length)
+    return;
+  size_t start = readOffset - behind;
+
+  // drop segments fully covered by the new one
+  retainedSegments.remove_if([&](const Segment& segment) {
+    return segment.start >= start &&
+           segment.start + segment.data.size() <= start + length;
+  });
+
+  Segment segment;
+  if (retainedSegments.size() >= maxRetainedSegments) {
+    // evict the least recently used segment, reusing its memory
+    segment = std::move(retainedSegments.back());
+    retainedSegments.pop_back();
+  }
+  segment.start = start;
+  segment.data.resize(length);
+
+  uint8_t* from = bufReadPtr - behind;
+  if (from < buf)
+    from += bufferSize;
+  size_t firstChunk = std::min(length, static_cast<size_t>(bufEnd - from));
+  memcpy(segment.data.data(), from, firstChunk);
+  memcpy(segment.data.data() + firstChunk, buf, length - firstChunk);
+  retainedSegments.push_front(std::move(segment));
+}
+
+size_t BufferedStream::prefillFromSegments(size_t offset) {
+  for (auto it = retainedSegments.begin(); it != retainedSegments.end();
+       it++) {
+    if (offset < it->start || offset >= it->start + it->data.size())
+      continue;
+    // leave room for at least one read from the source
+    size_t len = std::min(it->start + it->data.size() - offset,
+                          static_cast<size_t>(bufferSize - readSize));
+    memcpy(buf, it->data.data() + (offset - it->start), len);
+    bufWritePtr = buf + len;
+    readAvailable = len;
+    retainedSegments.splice(retainedSegments.begin(), retainedSegments, it);
+    return len;
+  }
+  return 0;
 }
 
 uint32_t BufferedStream::lengthBetween(uint8_t* me, uint8_t* other) {
@@ -106,6 +318,14 @@ size_t BufferedStream::read(uint8_t* dst, size_t len) {
     reset();
     return 0;
   }
+  if (len > readAvailable) {
+    // count each transition into an empty buffer as a single underrun
+    if (!starved && !readAvailable && readTotal)
+      underruns++;
+    starved = !readAvailable;
+  } else {
+    starved = false;
+  }
   uint32_t read = 0;
   uint32_t toReadTotal =
       std::min(readAvailable.load(), static_cast<uint32_t>(len));
@@ -123,6 +343,7 @@ size_t BufferedStream::read(uint8_t* dst, size_t len) {
     toReadTotal -= toRead;
     read += toRead;
     readTotal += toRead;
+    readOffset += toRead;
   }
   this->readSem.give();
   return read;
@@ -134,6 +355,8 @@ void BufferedStream::runTask() {
   if (!source && reader) {
     // get the initial request on the task's thread
     source = reader(this->bufferTotal);
+    if (source)
+      sourceSize = source->size();
   }
   while (!terminate) {
     if (!source)
@@ -156,7 +379,12 @@ void BufferedStream::runTask() {
         len = 0;
         break;
       }
+      auto readStart = Clock::now();
       len = source->read(bufWritePtr, toRead);
+      if (adaptive && len) {
+        trackSourceRead(len, Clock::now() - readStart);
+        adaptThresholds();
+      }
       readAvailable += len;
       bufferTotal += len;
       bufWritePtr += len;
@@ -167,10 +395,15 @@ void BufferedStream::runTask() {
         readSize <
             bufferSize -
                 readAvailable);  // loop until there's no more free space in the buffer
-    if (!len && reader)
+    // reconnect on a dropped source, unless it has reached its known end
+    if (!len && reader && (!sourceSize || bufferTotal < sourceSize)) {
       source = reader(bufferTotal);
-    else if (!len)
+      if (source)
+        sourceSize = source->size();
+    } else if (!len) {
+      sourceEnded = sourceSize && bufferTotal >= sourceSize;
       terminate = true;
+    }
     // signal that buffer is ready for reading
     if (!wasReady && isReady()) {
       this->readySem.give();
@@ -53,6 +53,14 @@ size_t FileStream::size() {
   return size;
 }
 
+bool FileStream::seek(size_t offset) {
+  if (file == NULL) {
+    throw std::runtime_error("Stream is closed");
+  }
+
+  return fseek(file, offset, SEEK_SET) == 0;
+}
+
 void FileStream::close() {
   if (file != NULL) {
     fclose(file);
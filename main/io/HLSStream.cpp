@@ -0,0 +1,466 @@
+#include "HLSStream.h"
+
+#include <string.h>   // for memcpy, memcmp, strlen
+#include <algorithm>  // for min, max, sort
+#include <cctype>     // for isspace
+#include <cstdlib>    // for strtod, strtoull
+#include <sstream>    // for istringstream
+#include <utility>    // for move
+
+#include "BellLogger.h"  // for AbstractLogger, BELL_LOG
+#include "BellUtils.h"   // for BELL_SLEEP_MS
+#include "HTTPClient.h"  // for HTTPClient
+
+using namespace bell;
+
+// reload delay while the playlist doesn't change, in target durations
+#define HLS_UNCHANGED_RELOAD_DIVIDER 2
+#define HLS_DEFAULT_TARGET_DURATION_MS 10000
+#define HLS_ID3_HEADER_SIZE 10
+// before a retry, times the attempts made
+#define HLS_RETRY_DELAY_MS 250
+
+static std::string attribute(const std::string& line, const std::string& name) {
+  // NAME=value or NAME="value", in a comma separated list
+  size_t start = 0;
+  while ((start = line.find(name + "=", start)) != std::string::npos) {
+    if (start == 0 || line[start - 1] == ':' || line[start - 1] == ',')
+      break;
+    start += name.size();
+  }
+  if (start == std::string::npos)
+    return "";
+  start += name.size() + 1;
+  if (start < line.size() && line[start] == '"') {
+    size_t end = line.find('"', start + 1);
+    return line.substr(start + 1, end == std::string::npos
+                                      ? std::string::npos
+                                      : end - start - 1);
+  }
+  return line.substr(start, line.find(',', start) - start);
+}
+
+// value following tag at the start of line, nullptr if line is another tag
+static const char* tagValue(const std::string& line, const char* tag) {
+  size_t len = strlen(tag);
+  return line.compare(0, len, tag) == 0 ? line.c_str() + len : nullptr;
+}
+
+// size of the ID3 tag starting packed audio segments, 0 if there's none
+static size_t id3Size(const uint8_t* data, size_t len) {
+  if (len < HLS_ID3_HEADER_SIZE || memcmp(data, "ID3", 3) != 0)
+    return 0;
+  size_t size = ((data[6] & 0x7f) << 21) | ((data[7] & 0x7f) << 14) |
+                ((data[8] & 0x7f) << 7) | (data[9] & 0x7f);
+  size += HLS_ID3_HEADER_SIZE * ((data[5] & 0x10) ? 2 : 1);
+  return std::min(size, len);
+}
+
+HLSStream::Fetcher::Fetcher(HLSStream* owner, const Config& config)
+    : bell::Task(config.taskName, config.taskStackSize, config.taskPriority,
+                 config.taskCore),
+      owner(owner) {}
+
+void HLSStream::Fetcher::runTask() {
+  owner->fetchLoop();
+  finished.give();
+}
+
+HLSStream::HLSStream(const Config& config) : config(config) {
+  this->config.parallelFetches = std::max<uint32_t>(config.parallelFetches, 1);
+}
+
+HLSStream::~HLSStream() {
+  close();
+  // the tasks finish after their current download
+  for (auto& fetcher : fetchers) {
+    fetcher->finished.wait();
+  }
+}
+
+std::shared_ptr<HLSStream> HLSStream::open(const std::string& url,
+                                           const Config& config) {
+  auto stream = std::make_shared<HLSStream>(config);
+  if (!stream->start(url))
+    return nullptr;
+  return stream;
+}
+
+bool HLSStream::start(const std::string& url) {
+  playlistUrl = url;
+  std::vector<uint8_t> text;
+  Playlist playlist;
+  if (!download(playlistUrl, text) ||
+      !parsePlaylist(std::string(text.begin(), text.end()), playlistUrl,
+                     playlist)) {
+    BELL_LOG(error, "HLSStream", "Cannot load playlist %s", url.c_str());
+    return false;
+  }
+
+  if (!playlist.variants.empty()) {
+    // the highest bandwidth allowed, or the lowest one if none is
+    std::sort(playlist.variants.begin(), playlist.variants.end());
+    auto variant = playlist.variants.begin();
+    for (auto it = variant; it != playlist.variants.end(); ++it) {
+      if (!config.maxBandwidth || it->first <= config.maxBandwidth)
+        variant = it;
+    }
+    playlistUrl = variant->second;
+    BELL_LOG(info, "HLSStream", "Variant %s, %u bit/s", playlistUrl.c_str(),
+             variant->first);
+
+    text.clear();
+    playlist = Playlist();
+    if (!download(playlistUrl, text) ||
+        !parsePlaylist(std::string(text.begin(), text.end()), playlistUrl,
+                       playlist) ||
+        !playlist.variants.empty()) {
+      BELL_LOG(error, "HLSStream", "Cannot load playlist %s",
+               playlistUrl.c_str());
+      return false;
+    }
+  }
+
+  {
+    std::scoped_lock lock(dataMutex);
+    queueSegments(playlist, true);
+  }
+  for (uint32_t i = 0; i < config.parallelFetches; i++) {
+    fetchers.push_back(std::make_unique<Fetcher>(this, config));
+    if (!fetchers.back()->startTask()) {
+      fetchers.pop_back();
+      break;
+    }
+  }
+  if (fetchers.empty()) {
+    BELL_LOG(error, "HLSStream", "Cannot start the download tasks");
+    return false;
+  }
+  return true;
+}
+
+size_t HLSStream::read(uint8_t* buf, size_t nbytes) {
+  return take(buf, nbytes);
+}
+
+size_t HLSStream::skip(size_t nbytes) {
+  return take(nullptr, nbytes);
+}
+
+void HLSStream::close() {
+  std::scoped_lock lock(dataMutex);
+  closed = true;
+  changed.notify_all();
+}
+
+bool HLSStream::isLive() {
+  std::scoped_lock lock(dataMutex);
+  return !ended;
+}
+
+size_t HLSStream::take(uint8_t* dst, size_t nbytes) {
+  std::unique_lock lock(dataMutex);
+  while (!closed) {
+    if (segments.empty()) {
+      if (ended)
+        return 0;
+    } else if (segments.front().state == SegmentState::READY &&
+               readOffset < segments.front().data.size()) {
+      auto& data = segments.front().data;
+      size_t len = std::min(nbytes, data.size() - readOffset);
+      if (dst)
+        memcpy(dst, data.data() + readOffset, len);
+      readOffset += len;
+      bytesRead += len;
+      return len;
+    } else if (segments.front().state == SegmentState::READY ||
+               segments.front().state == SegmentState::FAILED) {
+      // read, or given up on; makes room for the next download
+      segments.pop_front();
+      readOffset = 0;
+      changed.notify_all();
+      continue;
+    }
+    changed.wait(lock);
+  }
+  return 0;
+}
+
+void HLSStream::fetchLoop() {
+  std::unique_lock lock(dataMutex);
+  while (!closed) {
+    // the first segment not downloaded yet, within the prefetch window
+    Segment* next = nullptr;
+    size_t window =
+        std::min<size_t>(segments.size(), config.prefetchSegments + 1);
+    for (size_t i = 0; i < window && !next; i++) {
+      if (segments[i].state == SegmentState::PENDING)
+        next = &segments[i];
+    }
+
+    if (next) {
+      // segments are only removed once read, and references survive appending
+      next->state = SegmentState::FETCHING;
+      Segment job = *next;
+      lock.unlock();
+      std::vector<uint8_t> data;
+      bool fetched = fetchSegment(job, data);
+      lock.lock();
+      if (!fetched)
+        BELL_LOG(error, "HLSStream", "Skipping segment %s", job.url.c_str());
+      next->data = std::move(data);
+      next->state = fetched ? SegmentState::READY : SegmentState::FAILED;
+      changed.notify_all();
+      continue;
+    }
+
+    if (!ended && !reloading && Clock::now() >= nextReload) {
+      reloading = true;
+      lock.unlock();
+      reload();
+      lock.lock();
+      reloading = false;
+      changed.notify_all();
+      continue;
+    }
+
+    if (ended) {
+      changed.wait(lock);
+    } else {
+      changed.wait_until(lock, nextReload);
+    }
+  }
+}
+
+bool HLSStream::fetchSegment(const Segment& segment,
+                             std::vector<uint8_t>& data) {
+  if (segment.sendInit) {
+    bool cached;
+    {
+      std::scoped_lock lock(dataMutex);
+      cached = initUrl == segment.initUrl;
+      if (cached)
+        data = initData;
+    }
+    if (!cached) {
+      if (!download(segment.initUrl, data))
+        return false;
+      std::scoped_lock lock(dataMutex);
+      initUrl = segment.initUrl;
+      initData = data;
+    }
+  }
+
+  size_t start = data.size();
+  if (!download(segment.url, data, segment.rangeStart, segment.rangeLength))
+    return false;
+  if (segment.initUrl.empty()) {
+    // packed audio, the timestamp tag would interrupt the stream
+    size_t tag = id3Size(data.data() + start, data.size() - start);
+    data.erase(data.begin() + start, data.begin() + start + tag);
+  }
+  return true;
+}
+
+bool HLSStream::reload() {
+  std::vector<uint8_t> text;
+  Playlist playlist;
+  bool loaded = download(playlistUrl, text) &&
+                parsePlaylist(std::string(text.begin(), text.end()),
+                              playlistUrl, playlist);
+
+  std::scoped_lock lock(dataMutex);
+  if (!loaded) {
+    BELL_LOG(error, "HLSStream", "Cannot reload playlist %s",
+             playlistUrl.c_str());
+    nextReload = Clock::now() + std::chrono::milliseconds(targetDurationMs);
+    return false;
+  }
+  queueSegments(playlist, false);
+  return true;
+}
+
+void HLSStream::queueSegments(Playlist& playlist, bool initial) {
+  if (playlist.targetDurationMs)
+    targetDurationMs = playlist.targetDurationMs;
+  if (!targetDurationMs)
+    targetDurationMs = HLS_DEFAULT_TARGET_DURATION_MS;
+  ended = playlist.ended;
+
+  size_t first = 0;
+  if (initial) {
+    // live playlists start near their end
+    if (!ended && playlist.segments.size() > config.liveStartSegments)
+      first = playlist.segments.size() - config.liveStartSegments;
+  } else {
+    while (first < playlist.segments.size() &&
+           playlist.segments[first].sequence <= lastSequence) {
+      first++;
+    }
+    if (first < playlist.segments.size() &&
+        playlist.segments[first].sequence > lastSequence + 1) {
+      BELL_LOG(error, "HLSStream", "Missed %llu segments",
+               (unsigned long long)(playlist.segments[first].sequence -
+                                    lastSequence - 1));
+    }
+  }
+
+  for (size_t i = first; i < playlist.segments.size(); i++) {
+    auto& segment = playlist.segments[i];
+    segment.sendInit =
+        !segment.initUrl.empty() && segment.initUrl != lastInitUrl;
+    lastInitUrl = segment.initUrl;
+    lastSequence = segment.sequence;
+    segments.push_back(std::move(segment));
+  }
+
+  // sooner while nothing changes, not to fall behind the live edge
+  uint32_t delayMs = targetDurationMs;
+  if (!initial && first == playlist.segments.size())
+    delayMs /= HLS_UNCHANGED_RELOAD_DIVIDER;
+  nextReload = Clock::now() + std::chrono::milliseconds(delayMs);
+  changed.notify_all();
+}
+
+bool HLSStream::download(const std::string& url, std::vector<uint8_t>& data,
+                         size_t rangeStart, size_t rangeLength) {
+  size_t start = data.size();
+  for (uint32_t attempt = 0; attempt <= config.retries && !closed; attempt++) {
+    if (attempt)
+      BELL_SLEEP_MS(HLS_RETRY_DELAY_MS * attempt);
+    HTTPClient::Headers headers;
+    if (rangeLength) {
+      headers.push_back(HTTPClient::RangeHeader::range(
+          rangeStart, rangeStart + rangeLength - 1));
+    }
+    auto response = std::make_unique<HTTPClient::Response>();
+    if (response->connect(url) != 0 || !response->get(url, headers))
+      continue;
+    if (response->statusCode() / 100 != 2) {
+      BELL_LOG(error, "HLSStream", "HTTP %d for %s", response->statusCode(),
+               url.c_str());
+      // client errors won't go away by retrying
+      if (response->statusCode() / 100 == 4)
+        break;
+      continue;
+    }
+
+    // the body ends with the connection without a Content-Length
+    data.resize(start);
+    auto& stream = response->stream();
+    size_t length = response->contentLength();
+    bool skipped = true;
+    if (rangeLength && response->statusCode() != 206) {
+      // the range was ignored and the whole resource sent, cut the range out
+      stream.ignore(rangeStart);
+      skipped = (size_t)stream.gcount() == rangeStart;
+      length = rangeLength;
+    }
+    if (skipped && length) {
+      data.resize(start + length);
+      stream.read((char*)data.data() + start, length);
+      if ((size_t)stream.gcount() == length)
+        return true;
+    } else if (skipped) {
+      char buffer[4096];
+      do {
+        stream.read(buffer, sizeof(buffer));
+        data.insert(data.end(), buffer, buffer + stream.gcount());
+      } while (stream.gcount() > 0);
+      if (data.size() > start)
+        return true;
+    }
+    BELL_LOG(error, "HLSStream", "Incomplete download of %s", url.c_str());
+  }
+  data.resize(start);
+  return false;
+}
+
+bool HLSStream::parsePlaylist(const std::string& text, const std::string& url,
+                              Playlist& playlist) {
+  std::istringstream lines(text);
+  std::string line;
+  if (!std::getline(lines, line) || !tagValue(line, "#EXTM3U"))
+    return false;
+
+  uint64_t sequence = 0;
+  uint32_t durationMs = 0;
+  uint32_t bandwidth = 0;
+  bool variant = false;
+  std::string initUrl;
+  size_t rangeStart = 0, rangeLength = 0;
+  // a byte range without an offset follows the previous one
+  size_t rangeEnd = 0;
+  while (std::getline(lines, line)) {
+    while (!line.empty() && isspace((unsigned char)line.back()))
+      line.pop_back();
+    if (line.empty())
+      continue;
+
+    const char* value;
+    if (line[0] != '#') {
+      std::string uri = resolveURL(url, line);
+      if (variant) {
+        playlist.variants.emplace_back(bandwidth, uri);
+        variant = false;
+        continue;
+      }
+      Segment segment;
+      segment.sequence = sequence++;
+      segment.url = uri;
+      segment.durationMs = durationMs;
+      segment.rangeStart = rangeStart;
+      segment.rangeLength = rangeLength;
+      segment.initUrl = initUrl;
+      playlist.segments.push_back(std::move(segment));
+      rangeLength = 0;
+    } else if (tagValue(line, "#EXT-X-STREAM-INF:")) {
+      variant = true;
+      bandwidth = std::strtoul(attribute(line, "BANDWIDTH").c_str(), nullptr,
+                               10);
+    } else if ((value = tagValue(line, "#EXTINF:"))) {
+      durationMs = std::strtod(value, nullptr) * 1000;
+    } else if ((value = tagValue(line, "#EXT-X-TARGETDURATION:"))) {
+      playlist.targetDurationMs = std::strtoul(value, nullptr, 10) * 1000;
+    } else if ((value = tagValue(line, "#EXT-X-MEDIA-SEQUENCE:"))) {
+      sequence = std::strtoull(value, nullptr, 10);
+    } else if ((value = tagValue(line, "#EXT-X-BYTERANGE:"))) {
+      char* end;
+      rangeLength = std::strtoull(value, &end, 10);
+      rangeStart = *end == '@' ? std::strtoull(end + 1, nullptr, 10) : rangeEnd;
+      rangeEnd = rangeStart + rangeLength;
+    } else if (tagValue(line, "#EXT-X-MAP:")) {
+      if (!attribute(line, "BYTERANGE").empty()) {
+        BELL_LOG(error, "HLSStream", "Unsupported initialization byte range");
+        return false;
+      }
+      initUrl = resolveURL(url, attribute(line, "URI"));
+    } else if (tagValue(line, "#EXT-X-KEY:")) {
+      if (attribute(line, "METHOD") != "NONE") {
+        BELL_LOG(error, "HLSStream", "Encrypted playlists aren't supported");
+        return false;
+      }
+    } else if (tagValue(line, "#EXT-X-ENDLIST")) {
+      playlist.ended = true;
+    }
+  }
+  return true;
+}
+
+std::string HLSStream::resolveURL(const std::string& base,
+                                  const std::string& reference) {
+  if (reference.find("://") != std::string::npos)
+    return reference;
+  size_t schemeEnd = base.find("://");
+  if (schemeEnd == std::string::npos)
+    return reference;
+  if (reference.compare(0, 2, "//") == 0)
+    return base.substr(0, schemeEnd + 1) + reference;
+  if (!reference.empty() && reference[0] == '/') {
+    size_t hostEnd = base.find('/', schemeEnd + 3);
+    return base.substr(0, hostEnd) + reference;
+  }
+  // relative to the playlist's directory, its query left out
+  std::string path = base.substr(0, base.find('?'));
+  return path.substr(0, path.rfind('/') + 1) + reference;
+}
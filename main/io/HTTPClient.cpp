@@ -1,6 +1,6 @@
 #include "HTTPClient.h"
 
-#include <string.h>   // for memcpy
+#include <string.h>   // for memcpy, memcmp, memmove
 #include <algorithm>  // for transform
 #include <algorithm>
 #include <cassert>    // for assert
@@ -138,10 +138,10 @@ bool HTTPClient::Response::readResponseHeaders() {
   size_t msgLen;
   int pret;
   int minorVersion;
-  int status;
   size_t prevbuflen = 0;
   size_t numHeaders = maxHeaders;
   this->httpBufferAvailable = 0;
+  this->status = 0;
   size_t retries = 0;
   bool foundHttpHeader = false;
 
@@ -155,6 +155,16 @@ bool HTTPClient::Response::readResponseHeaders() {
       prevbuflen = httpBufferAvailable;
       httpBufferAvailable += bytesRead;
 
+      // SHOUTcast v1 servers answer with "ICY 200 OK", parsed as HTTP/1.0
+      if (prevbuflen == 0 && httpBufferAvailable >= 4 &&
+          httpBufferAvailable + 5 <= httpBuffer.size() &&
+          memcmp(httpBuffer.data(), "ICY ", 4) == 0) {
+        memmove(httpBuffer.data() + 8, httpBuffer.data() + 3,
+                httpBufferAvailable - 3);
+        memcpy(httpBuffer.data(), "HTTP/1.0", 8);
+        httpBufferAvailable += 5;
+      }
+
       if (!foundHttpHeader) {
         const char* httpStart = strstr((const char*)httpBuffer.data(), "HTTP/");
         if (httpStart) {
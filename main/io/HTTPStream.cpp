@@ -0,0 +1,89 @@
+#include "HTTPStream.h"
+
+#include <utility>  // for move
+
+#include "BellLogger.h"  // for AbstractLogger, BELL_LOG
+
+using namespace bell;
+
+HTTPStream::HTTPStream(std::unique_ptr<HTTPClient::Response> response,
+                       uint32_t rangeStart)
+    : httpResponse(std::move(response)), currentPosition(rangeStart) {
+  bool hasRange = !httpResponse->header("content-range").empty();
+  if (rangeStart > 0 && !hasRange && httpResponse->statusCode() != 206) {
+    // range ignored, the body is the whole resource: skip up to rangeStart.
+    // position() falls short of rangeStart if the body is shorter
+    totalSize = httpResponse->contentLength();
+    currentPosition = 0;
+    while (currentPosition < rangeStart) {
+      if (skip(rangeStart - currentPosition) == 0)
+        break;
+    }
+    return;
+  }
+
+  // totalLength() falls back to Content-Length if there's no Content-Range
+  totalSize = httpResponse->totalLength();
+  if (!hasRange && totalSize > 0) {
+    totalSize += rangeStart;
+  }
+}
+
+HTTPStream::~HTTPStream() {
+  close();
+}
+
+std::shared_ptr<HTTPStream> HTTPStream::open(const std::string& url,
+                                             uint32_t rangeStart,
+                                             HTTPClient::Headers headers) {
+  if (rangeStart > 0) {
+    headers.push_back(HTTPClient::RangeHeader::from(rangeStart));
+  }
+
+  auto response = std::make_unique<HTTPClient::Response>();
+  if (response->connect(url) != 0 || !response->get(url, headers)) {
+    BELL_LOG(error, "HTTPStream", "Cannot open %s at %u", url.c_str(),
+             rangeStart);
+    return nullptr;
+  }
+
+  auto stream = std::make_shared<HTTPStream>(std::move(response), rangeStart);
+  if (stream->position() != rangeStart) {
+    BELL_LOG(error, "HTTPStream", "Cannot skip to %u of %s", rangeStart,
+             url.c_str());
+    return nullptr;
+  }
+  return stream;
+}
+
+size_t HTTPStream::read(uint8_t* buf, size_t nbytes) {
+  if (!httpResponse || !httpResponse->stream().isOpen())
+    return 0;
+  httpResponse->stream().read(reinterpret_cast<char*>(buf), nbytes);
+  size_t len = httpResponse->stream().gcount();
+  currentPosition += len;
+  return len;
+}
+
+size_t HTTPStream::skip(size_t nbytes) {
+  if (!httpResponse || !httpResponse->stream().isOpen())
+    return 0;
+  httpResponse->stream().ignore(nbytes);
+  size_t len = httpResponse->stream().gcount();
+  currentPosition += len;
+  return len;
+}
+
+size_t HTTPStream::position() {
+  return currentPosition;
+}
+
+size_t HTTPStream::size() {
+  return totalSize;
+}
+
+void HTTPStream::close() {
+  if (httpResponse && httpResponse->stream().isOpen()) {
+    httpResponse->stream().close();
+  }
+}
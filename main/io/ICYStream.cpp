@@ -0,0 +1,132 @@
+#include "ICYStream.h"
+
+#include <algorithm>  // for min
+#include <cstdlib>    // for strtoul
+#include <utility>    // for move
+
+#include "BellLogger.h"  // for AbstractLogger, BELL_LOG
+#include "HTTPStream.h"  // for HTTPStream
+
+using namespace bell;
+
+// metadata blocks are at most 255 * 16 bytes
+#define ICY_METADATA_UNIT 16
+#define ICY_MAX_METADATA_SIZE (255 * ICY_METADATA_UNIT)
+
+ICYStream::ICYStream(std::shared_ptr<ByteStream> source, size_t metaInterval,
+                     TitleCallback callback)
+    : source(std::move(source)),
+      metaInterval(metaInterval),
+      callback(std::move(callback)),
+      audioLeft(metaInterval) {
+  if (metaInterval)
+    metadata.resize(ICY_MAX_METADATA_SIZE);
+}
+
+ICYStream::~ICYStream() {
+  close();
+}
+
+std::shared_ptr<ICYStream> ICYStream::open(const std::string& url,
+                                           TitleCallback callback) {
+  auto stream = HTTPStream::open(url, 0, {{"Icy-MetaData", "1"}});
+  if (!stream)
+    return nullptr;
+
+  std::string interval(stream->response().header("icy-metaint"));
+  size_t metaInterval = std::strtoul(interval.c_str(), nullptr, 10);
+  if (!metaInterval)
+    BELL_LOG(info, "ICYStream", "No ICY metadata in %s", url.c_str());
+  return std::make_shared<ICYStream>(stream, metaInterval,
+                                     std::move(callback));
+}
+
+size_t ICYStream::read(uint8_t* buf, size_t nbytes) {
+  if (!metaInterval)
+    return source->read(buf, nbytes);
+  if (!audioLeft && !readMetadata())
+    return 0;
+
+  size_t len = source->read(buf, std::min(nbytes, audioLeft));
+  audioLeft -= len;
+  audioPosition += len;
+  return len;
+}
+
+size_t ICYStream::skip(size_t nbytes) {
+  if (!metaInterval)
+    return source->skip(nbytes);
+
+  size_t skipped = 0;
+  while (skipped < nbytes) {
+    if (!audioLeft && !readMetadata())
+      break;
+    size_t len = source->skip(std::min(nbytes - skipped, audioLeft));
+    if (!len)
+      break;
+    audioLeft -= len;
+    audioPosition += len;
+    skipped += len;
+  }
+  return skipped;
+}
+
+size_t ICYStream::position() {
+  return metaInterval ? audioPosition : source->position();
+}
+
+size_t ICYStream::size() {
+  // the metadata blocks are part of the source's size
+  return metaInterval ? 0 : source->size();
+}
+
+void ICYStream::close() {
+  if (source)
+    source->close();
+}
+
+bool ICYStream::readMetadata() {
+  uint8_t length;
+  if (source->read(&length, 1) != 1)
+    return false;
+
+  // the source may return it in parts
+  size_t len = length * ICY_METADATA_UNIT;
+  for (size_t read = 0; read < len;) {
+    size_t chunk = source->read(metadata.data() + read, len - read);
+    if (!chunk)
+      return false;
+    read += chunk;
+  }
+  audioLeft = metaInterval;
+  // an empty block means that nothing changed
+  if (len)
+    parseMetadata(len);
+  return true;
+}
+
+void ICYStream::parseMetadata(size_t len) {
+  // e.g. "StreamTitle='Artist - Title';StreamUrl='';", padded with zeros
+  std::string text((const char*)metadata.data(), len);
+  text.resize(text.find('\0') == std::string::npos ? len : text.find('\0'));
+
+  const std::string key = "StreamTitle='";
+  size_t start = text.find(key);
+  if (start == std::string::npos)
+    return;
+  start += key.size();
+  // titles may contain quotes, the value ends with "';"
+  size_t end = text.find("';", start);
+  if (end == std::string::npos)
+    end = text.rfind('\'');
+  if (end == std::string::npos || end < start)
+    end = text.size();
+
+  std::string title = text.substr(start, end - start);
+  if (title == currentTitle)
+    return;
+  currentTitle = title;
+  BELL_LOG(info, "ICYStream", "Now playing: %s", currentTitle.c_str());
+  if (callback)
+    callback(currentTitle);
+}
@@ -0,0 +1,339 @@
+#include "TimeShiftBuffer.h"
+
+#include <stdio.h>    // for fopen, fread, fwrite, fseek, remove, setvbuf
+#include <string.h>   // for memcpy, memmove
+#include <algorithm>  // for min, upper_bound
+#include <utility>    // for move
+
+#include "BellLogger.h"  // for AbstractLogger, BELL_LOG
+
+using namespace bell;
+
+TimeShiftBuffer::Reader::Reader(TimeShiftBuffer* owner, size_t offset)
+    : owner(owner), offset(offset) {}
+
+TimeShiftBuffer::Reader::~Reader() {
+  if (file)
+    fclose(file);
+}
+
+size_t TimeShiftBuffer::Reader::read(uint8_t* buf, size_t nbytes) {
+  std::unique_lock lock(owner->dataMutex);
+  // at the live edge, wait for the recording task
+  owner->dataAvailable.wait_for(
+      lock, std::chrono::milliseconds(owner->config.liveWaitMs), [this]() {
+        return closed || offset < owner->writtenOffset || !owner->recording;
+      });
+
+  size_t segmentSize = owner->config.segmentSize;
+  if (closed || offset < owner->firstSegment * segmentSize ||
+      offset >= owner->writtenOffset) {
+    return 0;
+  }
+
+  if (offset >= owner->flushedOffset) {
+    // not written out yet
+    size_t len = std::min(nbytes, owner->writtenOffset - offset);
+    memcpy(buf, owner->batch.data() + (offset - owner->flushedOffset), len);
+    offset += len;
+    return len;
+  }
+
+  size_t segment = offset / segmentSize;
+  size_t len = std::min({nbytes, owner->flushedOffset - offset,
+                         (segment + 1) * segmentSize - offset});
+  lock.unlock();
+
+  if (!file || fileSegment != segment) {
+    if (file)
+      fclose(file);
+    file = fopen(owner->segmentPath(segment).c_str(), "rb");
+    fileSegment = segment;
+    if (!file)
+      return 0;
+  }
+  // also drops stdio's read buffer, which may predate the last flush
+  if (fseek(file, offset - segment * segmentSize, SEEK_SET) != 0)
+    return 0;
+  size_t read = fread(buf, 1, len, file);
+  offset += read;
+  return read;
+}
+
+size_t TimeShiftBuffer::Reader::skip(size_t nbytes) {
+  std::scoped_lock lock(owner->dataMutex);
+  size_t len = std::min(nbytes, owner->writtenOffset - offset);
+  offset += len;
+  return len;
+}
+
+void TimeShiftBuffer::Reader::close() {
+  std::scoped_lock lock(owner->dataMutex);
+  closed = true;
+  owner->dataAvailable.notify_all();
+}
+
+TimeShiftBuffer::TimeShiftBuffer(const Config& config)
+    : bell::Task(config.taskName, config.taskStackSize, config.taskPriority,
+                 config.taskCore),
+      config(config) {
+  batch.reserve(config.writeBatchSize);
+}
+
+TimeShiftBuffer::~TimeShiftBuffer() {
+  stop();
+  reset();
+}
+
+bool TimeShiftBuffer::start(std::shared_ptr<ByteStream> source) {
+  stop();
+  if (!source)
+    return false;
+  reset();
+  this->source = std::move(source);
+  recording = true;
+  started = true;
+  lastFlush = Clock::now();
+  if (!startTask()) {
+    recording = false;
+    started = false;
+    return false;
+  }
+  return true;
+}
+
+void TimeShiftBuffer::stop() {
+  recording = false;
+  if (started) {
+    // the task finishes after the source's current read() returns
+    finished.wait();
+    started = false;
+  }
+}
+
+void TimeShiftBuffer::reset() {
+  std::scoped_lock lock(dataMutex);
+  if (segmentFile)
+    fclose(segmentFile);
+  segmentFile = nullptr;
+  if (flushedOffset > 0) {
+    size_t lastSegment = (flushedOffset - 1) / config.segmentSize;
+    for (size_t segment = firstSegment; segment <= lastSegment; segment++) {
+      remove(segmentPath(segment).c_str());
+    }
+  }
+  firstSegment = 0;
+  segmentIndex = 0;
+  flushedOffset = 0;
+  writtenOffset = 0;
+  batch.clear();
+  codec = AudioCodec::UNKNOWN;
+  headerLength = 0;
+  frameRemaining = 0;
+  hasPending = false;
+  recordedUs = 0;
+  index.clear();
+}
+
+std::string TimeShiftBuffer::segmentPath(size_t segment) const {
+  return config.directory + "/" + config.prefix + "_" +
+         std::to_string(segment) + ".seg";
+}
+
+void TimeShiftBuffer::runTask() {
+  std::vector<uint8_t> readBuffer(config.readSize);
+  while (recording) {
+    size_t len = source->read(readBuffer.data(), readBuffer.size());
+    if (!len || !append(readBuffer.data(), len))
+      break;
+  }
+
+  {
+    std::scoped_lock lock(dataMutex);
+    flushBatch();
+    if (segmentFile)
+      fclose(segmentFile);
+    segmentFile = nullptr;
+    recording = false;
+    dataAvailable.notify_all();
+  }
+  source->close();
+  source = nullptr;
+  finished.give();
+}
+
+bool TimeShiftBuffer::append(const uint8_t* data, size_t len) {
+  std::scoped_lock lock(dataMutex);
+  scanFrames(data, len);
+  batch.insert(batch.end(), data, data + len);
+  writtenOffset += len;
+
+  bool written = true;
+  if (batch.size() >= config.writeBatchSize ||
+      Clock::now() - lastFlush >=
+          std::chrono::milliseconds(config.flushIntervalMs)) {
+    written = flushBatch();
+  }
+  dataAvailable.notify_all();
+  return written;
+}
+
+bool TimeShiftBuffer::flushBatch() {
+  size_t written = 0;
+  bool complete = true;
+  while (written < batch.size()) {
+    size_t offset = flushedOffset + written;
+    size_t segment = offset / config.segmentSize;
+    if ((!segmentFile || segment != segmentIndex) && !openSegment(segment)) {
+      complete = false;
+      break;
+    }
+    size_t len = std::min(batch.size() - written,
+                          (segment + 1) * config.segmentSize - offset);
+    size_t done = fwrite(batch.data() + written, 1, len, segmentFile);
+    written += done;
+    if (done != len) {
+      BELL_LOG(error, "TimeShiftBuffer", "Cannot write segment %zu", segment);
+      complete = false;
+      break;
+    }
+  }
+  // readers find the bytes that reached the segment files there, and the rest
+  // in the batch; a later flush carries on from the first missing byte
+  flushedOffset += written;
+  batch.erase(batch.begin(), batch.begin() + written);
+  lastFlush = Clock::now();
+  return complete;
+}
+
+bool TimeShiftBuffer::openSegment(size_t segment) {
+  if (segmentFile)
+    fclose(segmentFile);
+  while (segment - firstSegment >= config.maxSegments) {
+    rotate();
+  }
+  segmentFile = fopen(segmentPath(segment).c_str(), "wb");
+  segmentIndex = segment;
+  if (!segmentFile) {
+    BELL_LOG(error, "TimeShiftBuffer", "Cannot create segment %s",
+             segmentPath(segment).c_str());
+    return false;
+  }
+  // writes are batched already; unbuffered, readers see the data right away
+  // (no fsync), and fwrite() counts the bytes that reached the file
+  setvbuf(segmentFile, nullptr, _IONBF, 0);
+  return true;
+}
+
+void TimeShiftBuffer::rotate() {
+  remove(segmentPath(firstSegment).c_str());
+  firstSegment++;
+  size_t start = firstSegment * config.segmentSize;
+  while (!index.empty() && index.front().offset < start) {
+    index.pop_front();
+  }
+}
+
+AudioCodec TimeShiftBuffer::parseHeader(FrameHeader::Info& info) {
+  if (codec != AudioCodec::UNKNOWN)
+    return FrameHeader::parse(codec, header, info) ? codec.load()
+                                                   : AudioCodec::UNKNOWN;
+  if (FrameHeader::parseADTS(header, info))
+    return AudioCodec::AAC;
+  if (FrameHeader::parseMP3(header, info))
+    return AudioCodec::MP3;
+  return AudioCodec::UNKNOWN;
+}
+
+void TimeShiftBuffer::scanFrames(const uint8_t* data, size_t len) {
+  size_t i = 0;
+  while (i < len) {
+    if (frameRemaining) {
+      size_t toSkip = std::min(frameRemaining, len - i);
+      i += toSkip;
+      frameRemaining -= toSkip;
+      continue;
+    }
+
+    header[headerLength++] = data[i++];
+    size_t needed = codec == AudioCodec::UNKNOWN
+                        ? FrameHeader::ADTS_HEADER_SIZE
+                        : FrameHeader::headerSize(codec);
+    if (headerLength < needed)
+      continue;
+
+    FrameHeader::Info info;
+    size_t frameOffset = writtenOffset + i - headerLength;
+    AudioCodec found = parseHeader(info);
+    if (found == AudioCodec::UNKNOWN || info.frameSize < headerLength) {
+      // lost sync, look for a header at the next byte
+      hasPending = false;
+      memmove(header, header + 1, --headerLength);
+      continue;
+    }
+
+    // two chained frames confirm the sync
+    if (hasPending && pendingOffset + pendingInfo.frameSize == frameOffset) {
+      codec = found;
+      indexFrame(pendingOffset, pendingInfo);
+    }
+    hasPending = true;
+    pendingOffset = frameOffset;
+    pendingInfo = info;
+    frameRemaining = info.frameSize - headerLength;
+    headerLength = 0;
+  }
+}
+
+void TimeShiftBuffer::indexFrame(size_t offset,
+                                 const FrameHeader::Info& info) {
+  uint64_t timeMs = recordedUs / 1000;
+  if (index.empty() || timeMs >= index.back().timeMs + config.indexIntervalMs)
+    index.push_back({timeMs, offset});
+  recordedUs += (uint64_t)info.samples * 1000000 / info.sampleRate;
+}
+
+std::shared_ptr<ByteStream> TimeShiftBuffer::open(size_t offset) {
+  std::scoped_lock lock(dataMutex);
+  if (offset < firstSegment * config.segmentSize || offset > writtenOffset ||
+      (!recording && offset == writtenOffset)) {
+    return nullptr;
+  }
+  return std::make_shared<Reader>(this, offset);
+}
+
+BufferedStream::StreamReader TimeShiftBuffer::reader() {
+  return [this](uint32_t rangeStart) { return open(rangeStart); };
+}
+
+size_t TimeShiftBuffer::offsetBehindLive(uint32_t ms) {
+  std::scoped_lock lock(dataMutex);
+  if (index.empty())
+    return firstSegment * config.segmentSize;
+  uint64_t newestMs = index.back().timeMs;
+  uint64_t targetMs = newestMs > ms ? newestMs - ms : 0;
+  auto it = std::upper_bound(index.begin(), index.end(), targetMs,
+                             [](uint64_t time, const IndexEntry& entry) {
+                               return time < entry.timeMs;
+                             });
+  if (it != index.begin())
+    it--;
+  return it->offset;
+}
+
+uint32_t TimeShiftBuffer::availableMs() {
+  std::scoped_lock lock(dataMutex);
+  if (index.empty())
+    return 0;
+  return index.back().timeMs - index.front().timeMs;
+}
+
+size_t TimeShiftBuffer::startOffset() {
+  std::scoped_lock lock(dataMutex);
+  return firstSegment * config.segmentSize;
+}
+
+size_t TimeShiftBuffer::endOffset() {
+  std::scoped_lock lock(dataMutex);
+  return writtenOffset;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <stddef.h>    // for size_t
+#include <stdint.h>    // for uint32_t, uint8_t, uint64_t
+#include <functional>  // for function
+#include <memory>      // for shared_ptr, unique_ptr
+#include <utility>     // for move
+
+#include "PCMContainer.h"  // for PCMContainer
+#include "StreamInfo.h"    // for PCMFormat, PlanarBuffer
+
+namespace bell {
+class AudioContainer;
+class BaseCodec;
+class ByteStream;
+struct IByteStream;
+
+/**
+ * Pull-based decoder over any ByteStream. open() sniffs the format, creates the matching
+ * AudioContainer, and takes a decoder of its own from the AudioCodecs pool; every call
+ * to decode() then returns the next block of PCM.
+ *
+ * Input is read through a buffer of fixed size, and frames are parsed in place by the
+ * container; the PCM is returned in the decoder's own buffer. Once the first frames
+ * were decoded, nothing is allocated per frame.
+ *
+ * Decoders may change the sample rate or channel count mid-stream (e.g. HE-AAC
+ * signalling SBR, chained Ogg streams). The format callback is called before the first
+ * block of every new format.
+ */
+class AudioDecoderStream {
+ public:
+  typedef PCMFormat Format;
+  typedef std::function<void(const Format&)> FormatCallback;
+
+  /**
+	 * @param inputBufferSize size of the reads from the source stream
+	 */
+  AudioDecoderStream(size_t inputBufferSize = 4096);
+  ~AudioDecoderStream();
+
+  /**
+	 * Start decoding the given stream, closing the current one.
+	 *
+	 * @param waitForData called when the stream returns no data; returning true retries the read, false (or none given) ends the stream. See ByteStreamBuffer.
+	 * @returns false if the format isn't recognized, or no decoder is available for it
+	 */
+  bool open(std::shared_ptr<ByteStream> stream,
+            std::function<bool()> waitForData = nullptr);
+  /**
+	 * Start decoding a stream of raw PCM in the given format, which can't be sniffed.
+	 *
+	 * @returns false if the format is unsupported
+	 */
+  bool open(std::shared_ptr<ByteStream> stream,
+            const PCMContainer::Format& format,
+            std::function<bool()> waitForData = nullptr);
+  /**
+	 * Release the decoder, and close the stream.
+	 */
+  void close();
+  bool isOpen() const { return codec != nullptr; }
+
+  /**
+	 * Decode the next block, skipping over frames that fail to decode.
+	 *
+	 * @param [out] len size of the returned PCM, in bytes
+	 * @returns interleaved PCM at format(), owned by the decoder and valid until the next call; nullptr at the end of the stream
+	 */
+  uint8_t* decode(uint32_t& len);
+  /**
+	 * Decode into the caller's planar float buffer, see BaseCodec::decodeInto().
+	 *
+	 * @returns samples per channel written; 0 at the end of the stream
+	 */
+  size_t decodeInto(PlanarBuffer& buffer, size_t maxSamples);
+  /**
+	 * Move to the given sample (per channel), see AudioContainer::seekToSample().
+	 *
+	 * @returns false if the stream is not seekable
+	 */
+  bool seekToSample(uint64_t sample);
+
+  /**
+	 * Let decoders of high-resolution sources (FLAC, ALAC) output up to the given bits per
+	 * sample, see BaseCodec::setMaxBitDepth(). Applies from the next open(); 16 by default.
+	 */
+  void setMaxBitDepth(uint8_t bitDepth) { maxBitDepth = bitDepth; }
+
+  /**
+	 * Format of the last decoded block; the one the decoder was set up with until the first.
+	 */
+  const Format& format() const { return currentFormat; }
+  void setFormatCallback(FormatCallback callback) {
+    formatCallback = std::move(callback);
+  }
+  // true once the source stream ended, and no more blocks can be decoded
+  bool eof() const { return ended; }
+
+  AudioContainer* getContainer() { return container.get(); }
+  BaseCodec* getCodec() { return codec.get(); }
+
+ private:
+  size_t inputBufferSize;
+  uint8_t maxBitDepth = 16;
+  // the container reads from istr, and the codec from the container
+  std::unique_ptr<IByteStream> istr;
+  std::unique_ptr<AudioContainer> container;
+  std::shared_ptr<BaseCodec> codec;
+
+  Format currentFormat;
+  // whether the callback was called for currentFormat
+  bool formatKnown = false;
+  FormatCallback formatCallback;
+  bool ended = true;
+
+  // takes a decoder for the container, once created
+  bool openCodec();
+  // whether decoding can go on after the last failure
+  bool retry(int& failures);
+  void updateFormat();
+};
+}  // namespace bell
@@ -3,10 +3,13 @@
 #include <stddef.h>    // for size_t
 #include <stdint.h>    // for uint32_t, uint8_t
 #include <atomic>      // for atomic
+#include <chrono>      // for steady_clock
 #include <functional>  // for function
+#include <list>        // for list
 #include <memory>      // for shared_ptr
 #include <mutex>       // for mutex
 #include <string>      // for string
+#include <vector>      // for vector
 
 #include "BellTask.h"          // for Task
 #include "ByteStream.h"        // for ByteStream
@@ -28,6 +31,16 @@
  *
  * The source stream (passed to open() or returned by the reader) should implement the read()
  * method correctly, such as that 0 is returned if, and only if the stream ends.
+ *
+ * When opened with a StreamReader, the stream is seekable. Seeking within the buffered
+ * data (including already read bytes, which are not yet overwritten) does not touch the
+ * source. Otherwise, the source is reopened at the target offset using the reader.
+ * Previously downloaded buffer contents can be retained in a small LRU cache of segments
+ * (see setRetainedSegments()), so that scrubbing back to them doesn't hit the network.
+ *
+ * In adaptive mode (see setAdaptive()), the ready thresholds follow the observed network
+ * jitter, consumption rate and underruns, instead of being fixed. The buffer size is never
+ * changed, so the memory used stays the same.
  */
 class BufferedStream : public bell::ByteStream, bell::Task {
  public:
@@ -44,11 +57,14 @@ class BufferedStream : public bell::ByteStream, bell::Task {
 	 * @param notReadyThreshold maximum amount of available bytes to report isNotReady()
 	 * @param waitForReady whether to wait for the buffer to be ready during reading
 	 * @param endWithSource whether to end the streaming as soon as source returns 0 from read()
+	 * @param taskPriority priority of the reading task
+	 * @param taskCore core to run the reading task on
 	 */
   BufferedStream(const std::string& taskName, uint32_t bufferSize,
                  uint32_t readThreshold, uint32_t readSize,
                  uint32_t readyThreshold, uint32_t notReadyThreshold,
-                 bool waitForReady = false);
+                 bool waitForReady = false, int taskPriority = 5,
+                 int taskCore = 0);
   ~BufferedStream() override;
   bool open(const StreamPtr& stream);
   bool open(const StreamReader& newReader, uint32_t initialOffset = 0);
@@ -66,10 +82,60 @@ class BufferedStream : public bell::ByteStream, bell::Task {
 	 * stream is already closed and there is no reader attached.
 	 */
   size_t read(uint8_t* dst, size_t len) override;
+  /**
+	 * Skip len bytes. If len exceeds the amount of buffered data and the stream
+	 * was opened with a reader, this seeks instead of downloading the skipped data.
+	 */
   size_t skip(size_t len) override;
+  /**
+	 * Absolute offset of the next byte returned by read().
+	 */
   size_t position() override;
+  /**
+	 * Total size of the source, as reported by the source stream when it was opened
+	 * (Content-Range for HTTP range requests). 0 if unknown.
+	 */
   size_t size() override;
 
+  /**
+	 * Move the read position to the given absolute offset.
+	 *
+	 * The request is served from the buffer, if the target is still there. Otherwise,
+	 * the source is reopened at offset using the reader, with buffered data possibly
+	 * prefilled from the retained segments cache.
+	 *
+	 * @returns false if the target can't be reached (no reader attached and offset
+	 * lies outside of the buffer, or offset is past the end of the source)
+	 */
+  bool seek(size_t offset) override;
+  /**
+	 * Set how many previously downloaded buffer segments are retained for seeking.
+	 * Each segment takes at most bufferSize bytes. 0 (the default) disables the cache.
+	 */
+  void setRetainedSegments(uint8_t count);
+
+  /**
+	 * Enable adaptive readiness. The effective ready threshold starts at minReadyThreshold,
+	 * so that streams on good links start quickly, and then grows with source jitter and
+	 * underruns, up to maxReadyThreshold (capped to what fits in the buffer). It shrinks
+	 * back after a period of stable reading. notReadyThreshold keeps its configured ratio
+	 * to readyThreshold.
+	 */
+  void setAdaptive(uint32_t minReadyThreshold, uint32_t maxReadyThreshold);
+  /**
+	 * Current effective ready threshold, in bytes.
+	 */
+  uint32_t getReadyThreshold() const { return readyThreshold; }
+  /**
+	 * Observed source throughput, in bytes per second, measured over at least 100ms
+	 * spent reading from the source. 0 until then.
+	 */
+  uint32_t getThroughput() const { return throughput; }
+  /**
+	 * Observed jitter of source read durations, in milliseconds.
+	 */
+  uint32_t getJitterMs() const { return jitterUs / 1000; }
+
   // stream status
  public:
   /**
@@ -84,6 +150,10 @@ class BufferedStream : public bell::ByteStream, bell::Task {
 	 * Amount of bytes available to read from the buffer.
 	 */
   std::atomic<uint32_t> readAvailable;
+  /**
+	 * Number of times read() found the buffer empty while the source was still open.
+	 */
+  std::atomic<uint32_t> underruns = 0;
   /**
 	 * Whether the caller should start reading the data. This indicates that a safe
 	 * amount (determined by readyThreshold) of data is available in the buffer.
@@ -95,6 +165,16 @@ class BufferedStream : public bell::ByteStream, bell::Task {
 	 * faster than it can be buffered.
 	 */
   bool isNotReady() const;
+  /**
+	 * Whether more data can be read, i.e. there's some data left in the buffer, or the
+	 * source is still being read. If false, read() returning 0 means end of stream.
+	 */
+  bool isStreaming() const { return running || readAvailable; }
+  /**
+	 * Whether the source was read up to its known size(), rather than closed or dropped
+	 * before it. Stays set once all the data was read.
+	 */
+  bool reachedEnd() const { return sourceEnded; }
   /**
 	 * Semaphore that is given when the buffer becomes ready (isReady() == true). Caller can
 	 * wait for the semaphore instead of continuously querying isReady().
@@ -102,6 +182,11 @@ class BufferedStream : public bell::ByteStream, bell::Task {
   bell::WrappedSemaphore readySem;
 
  private:
+  struct Segment {
+    size_t start;
+    std::vector<uint8_t> data;
+  };
+
   std::mutex runningMutex;
   bool running = false;
   bool terminate = false;
@@ -112,16 +197,51 @@ class BufferedStream : public bell::ByteStream, bell::Task {
   uint32_t bufferSize;
   uint32_t readAt;
   uint32_t readSize;
-  uint32_t readyThreshold;
-  uint32_t notReadyThreshold;
+  std::atomic<uint32_t> readyThreshold;
+  std::atomic<uint32_t> notReadyThreshold;
   bool waitForReady;
   uint8_t* buf;
   uint8_t* bufEnd;
   uint8_t* bufReadPtr;
   uint8_t* bufWritePtr;
+  size_t bufStartOffset;  // absolute offset of the first byte written to buf
+  size_t readOffset;      // absolute offset of bufReadPtr
+  // set by the reading task, read by callers
+  std::atomic<size_t> sourceSize = 0;
+  std::atomic<bool> sourceEnded = false;
   StreamPtr source;
   StreamReader reader;
+  StreamReader rangeReader;  // kept after the reading task ends, for seeking
+  std::list<Segment> retainedSegments;  // most recently used first
+  uint8_t maxRetainedSegments = 0;
+
+  // adaptive mode state, updated by the reading task
+  typedef std::chrono::steady_clock Clock;
+  bool adaptive = false;
+  bool starved = false;
+  uint32_t minReadyThreshold;
+  uint32_t maxReadyThreshold;
+  uint32_t notReadyRatio;  // notReadyThreshold / readyThreshold, in 1/256
+  std::atomic<uint32_t> throughput = 0;
+  std::atomic<uint32_t> jitterUs = 0;
+  uint32_t meanReadUs = 0;
+  // source reads since throughput was last updated
+  uint64_t sourceBytes = 0;
+  uint64_t sourceReadUs = 0;
+  uint32_t consumeRate = 0;  // bytes served per second
+  uint32_t adaptedUnderruns = 0;
+  uint32_t underrunBoost = 0;
+  uint32_t lastReadTotal = 0;
+  Clock::time_point lastAdapt;
+  Clock::time_point stableSince;
+
   void runTask() override;
   void reset();
+  void trackSourceRead(uint32_t len, Clock::duration took);
+  void adaptThresholds();
+  void start();
   uint32_t lengthBetween(uint8_t* me, uint8_t* other);
+  uint32_t retainedBehind(uint32_t margin);
+  void retainSegment();
+  size_t prefillFromSegments(size_t offset);
 };
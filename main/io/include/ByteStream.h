@@ -19,6 +19,12 @@ class ByteStream {
   virtual size_t position() = 0;
   virtual size_t size() = 0;
   virtual void close() = 0;
+
+  /**
+	 * Move to the given absolute offset.
+	 * @returns false if the stream is not seekable, or the offset can't be reached
+	 */
+  virtual bool seek(size_t offset) { return false; }
 };
 }  // namespace bell
 
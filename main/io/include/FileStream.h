@@ -38,6 +38,8 @@ class FileStream : public ByteStream {
 
   size_t size();
 
+  bool seek(size_t offset) override;
+
   // Closes the connection
   void close();
 };
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <stddef.h>            // for size_t
+#include <stdint.h>            // for uint32_t, uint8_t, uint64_t
+#include <atomic>              // for atomic
+#include <chrono>              // for steady_clock
+#include <condition_variable>  // for condition_variable
+#include <deque>               // for deque
+#include <memory>              // for shared_ptr, unique_ptr
+#include <mutex>               // for mutex
+#include <string>              // for string
+#include <vector>              // for vector
+
+#include "BellTask.h"          // for Task
+#include "ByteStream.h"        // for ByteStream
+#include "WrappedSemaphore.h"  // for WrappedSemaphore
+
+namespace bell {
+/**
+ * bell::ByteStream over a HLS (HTTP Live Streaming) media playlist of packed audio
+ * (AAC in ADTS, MP3) or fMP4 segments, for the container layer to read as one continuous
+ * stream. MPEG-TS segments and encrypted playlists aren't supported.
+ *
+ * A master playlist is resolved to one of its variants first. Segments are downloaded
+ * whole by parallelFetches tasks, at most prefetchSegments ahead of the one being read,
+ * which bounds memory to about prefetchSegments + 1 segments; a segment is released as
+ * soon as it was read. Segments are joined as follows:
+ *  - packed audio: the ID3 tag (carrying a timestamp) starting every segment is dropped,
+ *  - fMP4: the initialization segment (EXT-X-MAP) is sent before the first segment, and
+ *    again whenever it changes.
+ * Segments failing to download after all retries are skipped.
+ *
+ * Live playlists (without EXT-X-ENDLIST) start liveStartSegments from their end, and are
+ * reloaded every target duration (half of it after a reload without new segments), until
+ * they end. At the live edge, read() waits for the next segment.
+ *
+ * position() counts the bytes read. The stream can't seek, nor report its size.
+ */
+class HLSStream : public ByteStream {
+ public:
+  struct Config {
+    // segments downloaded ahead of the one being read
+    uint32_t prefetchSegments = 3;
+    // downloads running at once, each on its own task
+    uint32_t parallelFetches = 2;
+    // of a master playlist, the variant with the highest bandwidth up to this
+    // is picked; 0 picks the highest
+    uint32_t maxBandwidth = 0;
+    uint32_t liveStartSegments = 3;
+    // per download, playlist reloads included
+    uint32_t retries = 2;
+
+    std::string taskName = "bell_hls";
+    int taskStackSize = 8192;
+    int taskPriority = 5;
+    int taskCore = 0;
+  };
+
+  HLSStream(const Config& config);
+  ~HLSStream() override;
+
+  /**
+	 * Load the playlist at url, and start downloading its segments.
+	 *
+	 * @returns the opened stream, or nullptr if the playlist can't be loaded
+	 */
+  static std::shared_ptr<HLSStream> open(const std::string& url,
+                                         const Config& config);
+
+  size_t read(uint8_t* buf, size_t nbytes) override;
+  size_t skip(size_t nbytes) override;
+  size_t position() override { return bytesRead; }
+  size_t size() override { return 0; }
+  /**
+	 * Stop downloading and wake up readers. Downloads in progress finish in the
+	 * background, the destructor waits for them.
+	 */
+  void close() override;
+
+  bool isLive();
+
+ private:
+  enum class SegmentState { PENDING, FETCHING, READY, FAILED };
+
+  struct Segment {
+    uint64_t sequence = 0;
+    std::string url;
+    uint32_t durationMs = 0;
+    // EXT-X-BYTERANGE, the whole resource if rangeLength is 0
+    size_t rangeStart = 0;
+    size_t rangeLength = 0;
+    // EXT-X-MAP in effect, and whether it's sent before this segment
+    std::string initUrl;
+    bool sendInit = false;
+
+    SegmentState state = SegmentState::PENDING;
+    std::vector<uint8_t> data;
+  };
+
+  struct Playlist {
+    // master playlist: variant URLs and their bandwidth
+    std::vector<std::pair<uint32_t, std::string>> variants;
+    uint32_t targetDurationMs = 0;
+    bool ended = false;
+    std::vector<Segment> segments;
+  };
+
+  class Fetcher : public bell::Task {
+   public:
+    Fetcher(HLSStream* owner, const Config& config);
+    bell::WrappedSemaphore finished;
+
+   protected:
+    void runTask() override;
+
+   private:
+    HLSStream* owner;
+  };
+
+  typedef std::chrono::steady_clock Clock;
+
+  Config config;
+  std::string playlistUrl;
+  std::vector<std::unique_ptr<Fetcher>> fetchers;
+
+  // guards everything below, notifies readers and fetchers of changes
+  std::mutex dataMutex;
+  std::condition_variable changed;
+  std::atomic<bool> closed = false;
+  // from the one being read on
+  std::deque<Segment> segments;
+  size_t readOffset = 0;
+  size_t bytesRead = 0;
+  // of the last segment queued
+  uint64_t lastSequence = 0;
+  std::string lastInitUrl;
+  bool ended = false;
+  uint32_t targetDurationMs = 0;
+  Clock::time_point nextReload;
+  bool reloading = false;
+  // initialization segment, kept to be sent again after a change back
+  std::string initUrl;
+  std::vector<uint8_t> initData;
+
+  bool start(const std::string& url);
+  size_t take(uint8_t* dst, size_t nbytes);
+  void fetchLoop();
+  void queueSegments(Playlist& playlist, bool initial);
+  bool fetchSegment(const Segment& segment, std::vector<uint8_t>& data);
+  bool reload();
+  // appends the body to data
+  bool download(const std::string& url, std::vector<uint8_t>& data,
+                size_t rangeStart = 0, size_t rangeLength = 0);
+
+  static bool parsePlaylist(const std::string& text, const std::string& url,
+                            Playlist& playlist);
+  static std::string resolveURL(const std::string& base,
+                                const std::string& reference);
+};
+}  // namespace bell
@@ -35,6 +35,14 @@ class HTTPClient {
 #endif
     }
 
+    static ValueHeader from(int32_t from) {
+#ifndef BELL_DISABLE_FMT
+      return ValueHeader{"Range", fmt::format("bytes={}-", from)};
+#else
+      return ValueHeader{"Range", "bytes=" + std::to_string(from) + "-"};
+#endif
+    }
+
     static ValueHeader last(int32_t nbytes) {
 #ifndef BELL_DISABLE_FMT
       return ValueHeader{"Range", fmt::format("bytes=-{}", nbytes)};
@@ -71,6 +79,8 @@ class HTTPClient {
 
     size_t contentLength();
     size_t totalLength();
+    // of the last response, 0 before one was received
+    int statusCode() { return status; }
 
    private:
     bell::URLParser urlParser;
@@ -85,6 +95,7 @@ class HTTPClient {
     size_t httpBufferAvailable;
 
     size_t contentSize = 0;
+    int status = 0;
     uint8_t retries__ = 5;
     bool hasContentSize = false;
 
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stddef.h>  // for size_t
+#include <stdint.h>  // for uint8_t, uint32_t
+#include <memory>    // for shared_ptr, unique_ptr
+#include <string>    // for string
+
+#include "ByteStream.h"  // for ByteStream
+#include "HTTPClient.h"  // for HTTPClient
+
+namespace bell {
+/**
+ * bell::ByteStream over the body of a HTTPClient::Response.
+ *
+ * The stream optionally starts at a given byte offset, using a HTTP range request.
+ * If the server ignores the range and sends the whole resource, the bytes before the
+ * offset are skipped. size() reports the total length of the remote resource (taken
+ * from Content-Range, if present), or 0 if unknown, and position() is absolute within
+ * that resource, so the stream can be used directly as a BufferedStream::StreamReader
+ * result.
+ */
+class HTTPStream : public ByteStream {
+ public:
+  HTTPStream(std::unique_ptr<HTTPClient::Response> response,
+             uint32_t rangeStart = 0);
+  ~HTTPStream() override;
+
+  /**
+	 * Issue a GET request for url, starting at rangeStart.
+	 *
+	 * @returns the opened stream, or nullptr if the request has failed
+	 */
+  static std::shared_ptr<HTTPStream> open(const std::string& url,
+                                          uint32_t rangeStart = 0,
+                                          HTTPClient::Headers headers = {});
+
+  size_t read(uint8_t* buf, size_t nbytes) override;
+  size_t skip(size_t nbytes) override;
+  size_t position() override;
+  size_t size() override;
+  void close() override;
+
+  HTTPClient::Response& response() { return *httpResponse; }
+
+ private:
+  std::unique_ptr<HTTPClient::Response> httpResponse;
+  size_t currentPosition;
+  size_t totalSize;
+};
+}  // namespace bell
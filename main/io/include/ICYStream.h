@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stddef.h>    // for size_t
+#include <stdint.h>    // for uint8_t
+#include <functional>  // for function
+#include <memory>      // for shared_ptr
+#include <string>      // for string
+#include <vector>      // for vector
+
+#include "ByteStream.h"  // for ByteStream
+
+namespace bell {
+/**
+ * bell::ByteStream stripping the ICY (SHOUTcast/Icecast) metadata blocks interleaved with
+ * the audio of internet radio streams.
+ *
+ * When requested with "Icy-MetaData: 1", servers send a metadata block after every
+ * icy-metaint bytes of audio: a length byte (in 16 byte units), followed by text like
+ * "StreamTitle='Artist - Title';". Audio is read straight into the caller's buffer, never
+ * past the next block, so that only the blocks themselves are copied. New titles are
+ * passed to the callback, on the thread reading the stream.
+ *
+ * position() counts audio bytes only. The stream can't seek, nor report its size.
+ */
+class ICYStream : public ByteStream {
+ public:
+  typedef std::function<void(const std::string& title)> TitleCallback;
+
+  /**
+	 * @param source HTTP response body, starting with audio
+	 * @param metaInterval audio bytes between metadata blocks, from the icy-metaint header; 0 passes the source through
+	 */
+  ICYStream(std::shared_ptr<ByteStream> source, size_t metaInterval,
+            TitleCallback callback = nullptr);
+  ~ICYStream() override;
+
+  /**
+	 * Issue a GET request for url asking for metadata, and wrap its response.
+	 *
+	 * @returns the opened stream, or nullptr if the request has failed
+	 */
+  static std::shared_ptr<ICYStream> open(const std::string& url,
+                                         TitleCallback callback = nullptr);
+
+  size_t read(uint8_t* buf, size_t nbytes) override;
+  size_t skip(size_t nbytes) override;
+  size_t position() override;
+  size_t size() override;
+  void close() override;
+
+  // last title received, empty until the first one
+  const std::string& title() const { return currentTitle; }
+
+ private:
+  std::shared_ptr<ByteStream> source;
+  size_t metaInterval;
+  TitleCallback callback;
+
+  // audio bytes left before the next metadata block
+  size_t audioLeft;
+  size_t audioPosition = 0;
+  std::vector<uint8_t> metadata;
+  std::string currentTitle;
+
+  bool readMetadata();
+  void parseMetadata(size_t len);
+};
+}  // namespace bell
@@ -1,8 +1,13 @@
 #pragma once
 
 #include <cstddef>
+#include <functional>
 #include <istream>
+#include <memory>
 #include <streambuf>
+#include <vector>
+
+#include "ByteStream.h"
 
 namespace bell {
 struct MemoryBuffer : std::streambuf {
@@ -16,4 +21,88 @@ struct IMemoryStream : virtual MemoryBuffer, std::istream {
       : MemoryBuffer(base, size),
         std::istream(static_cast<std::streambuf*>(this)) {}
 };
+
+/**
+ * std::streambuf reading from a bell::ByteStream.
+ *
+ * When the stream's read() returns 0, waitForData is called (if set); returning true
+ * retries the read, while returning false (or no waitForData) means end of stream.
+ * This allows using sources like BufferedStream, which may be temporarily empty.
+ *
+ * Seeking (seekg(), tellg()) goes through ByteStream::seek() and position(), so that
+ * containers can seek in files and range-capable HTTP sources.
+ */
+struct ByteStreamBuffer : std::streambuf {
+  ByteStreamBuffer(std::shared_ptr<ByteStream> stream,
+                   std::function<bool()> waitForData = nullptr,
+                   size_t bufferSize = 1024)
+      : stream(std::move(stream)),
+        waitForData(std::move(waitForData)),
+        buffer(bufferSize) {}
+
+ protected:
+  int_type underflow() override {
+    if (gptr() < egptr())
+      return traits_type::to_int_type(*gptr());
+    while (stream) {
+      size_t len = stream->read((uint8_t*)buffer.data(), buffer.size());
+      if (len > 0) {
+        setg(buffer.data(), buffer.data(), buffer.data() + len);
+        return traits_type::to_int_type(*gptr());
+      }
+      if (!waitForData || !waitForData())
+        break;
+    }
+    return traits_type::eof();
+  }
+
+  pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                   std::ios_base::openmode which) override {
+    if (!stream)
+      return pos_type(off_type(-1));
+    // position() is past the bytes still in the get area
+    off_type current = stream->position() - (egptr() - gptr());
+    if (dir == std::ios_base::cur && off == 0)
+      return pos_type(current);
+
+    off_type target = off;
+    if (dir == std::ios_base::cur) {
+      target += current;
+    } else if (dir == std::ios_base::end) {
+      if (!stream->size())
+        return pos_type(off_type(-1));
+      target += stream->size();
+    }
+    return seekpos(pos_type(target), which);
+  }
+
+  pos_type seekpos(pos_type pos, std::ios_base::openmode which) override {
+    if (!stream || pos < 0)
+      return pos_type(off_type(-1));
+    off_type buffered = off_type(pos) - (off_type(stream->position()) -
+                                         (egptr() - eback()));
+    if (buffered >= 0 && buffered <= egptr() - eback()) {
+      // still in the get area
+      setg(eback(), eback() + buffered, egptr());
+      return pos;
+    }
+    if (!stream->seek(pos))
+      return pos_type(off_type(-1));
+    setg(buffer.data(), buffer.data(), buffer.data());
+    return pos;
+  }
+
+ private:
+  std::shared_ptr<ByteStream> stream;
+  std::function<bool()> waitForData;
+  std::vector<char> buffer;
+};
+struct IByteStream : virtual ByteStreamBuffer, std::istream {
+  IByteStream(std::shared_ptr<ByteStream> stream,
+              std::function<bool()> waitForData = nullptr,
+              size_t bufferSize = 1024)
+      : ByteStreamBuffer(std::move(stream), std::move(waitForData),
+                         bufferSize),
+        std::istream(static_cast<std::streambuf*>(this)) {}
+};
 }  // namespace bell
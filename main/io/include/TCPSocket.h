@@ -79,6 +79,7 @@ class TCPSocket : public bell::Socket {
                errno);
       throw std::runtime_error("Resolve failed");
     }
+#endif
     err = connect(sockFd, addr->ai_addr, addr->ai_addrlen);
     if (err < 0) {
       close();
@@ -86,7 +87,6 @@ class TCPSocket : public bell::Socket {
                errno);
       throw std::runtime_error("Resolve failed");
     }
-#endif
 
     int flag = 1;
     setsockopt(sockFd,       /* socket affected */
@@ -0,0 +1,173 @@
+#pragma once
+
+#include <stddef.h>            // for size_t
+#include <stdint.h>            // for uint32_t, uint8_t, uint64_t
+#include <stdio.h>             // for FILE
+#include <atomic>              // for atomic
+#include <chrono>              // for steady_clock
+#include <condition_variable>  // for condition_variable
+#include <deque>               // for deque
+#include <memory>              // for shared_ptr
+#include <mutex>               // for mutex
+#include <string>              // for string
+#include <vector>              // for vector
+
+#include "BellTask.h"          // for Task
+#include "BufferedStream.h"    // for BufferedStream
+#include "ByteStream.h"        // for ByteStream
+#include "CodecType.h"         // for AudioCodec
+#include "FrameHeader.h"       // for Info
+#include "WrappedSemaphore.h"  // for WrappedSemaphore
+
+namespace bell {
+/**
+ * Disk-backed time-shift buffer for live streams.
+ *
+ * While recording, a task reads the encoded source (e.g. an HTTPStream) and appends it to
+ * a set of fixed-size segment files in a directory. Once maxSegments segments exist, the
+ * oldest one is deleted, so disk usage is bounded by segmentSize * maxSegments. Writes are
+ * batched in memory and only flushed (never fsync'ed), and readers are served from the
+ * batch until it's written out. A failed write stops the recording, keeping what was
+ * recorded available.
+ *
+ * Offsets are absolute from the start of the recording, and stay valid across rotation.
+ * MP3 and ADTS AAC frame headers are followed as data is written, building an index of
+ * frame-aligned offsets at indexIntervalMs steps, so playback can be started a given
+ * time behind live. Other formats are still recorded, without time lookups.
+ *
+ * Recording continues independently of playback, which reads the segments through
+ * streams from reader() - usually passed to a BufferedStream or PlaybackEngine. At the
+ * live edge, reads wait for new data for up to liveWaitMs, and then return 0, so that
+ * BufferedStream reopens the stream at the same offset. The buffer must outlive its
+ * readers.
+ */
+class TimeShiftBuffer : public bell::Task {
+ public:
+  struct Config {
+    // directory for the segment files, which must exist
+    std::string directory;
+    std::string prefix = "timeshift";
+    size_t segmentSize = 4 * 1024 * 1024;
+    uint32_t maxSegments = 16;
+    // in-memory batch, flushed when full, or after flushIntervalMs
+    size_t writeBatchSize = 16 * 1024;
+    uint32_t flushIntervalMs = 1000;
+    uint32_t indexIntervalMs = 1000;
+    uint32_t liveWaitMs = 500;
+    uint32_t readSize = 4096;
+
+    std::string taskName = "bell_timeshift";
+    int taskStackSize = 4096;
+    int taskPriority = 5;
+    int taskCore = 0;
+  };
+
+  TimeShiftBuffer(const Config& config);
+  ~TimeShiftBuffer();
+
+  /**
+	 * Drop any previous recording, and start recording the source.
+	 */
+  bool start(std::shared_ptr<ByteStream> source);
+  /**
+	 * Stop recording. The recorded data stays available to readers.
+	 */
+  void stop();
+  bool isRecording() const { return recording; }
+
+  /**
+	 * Open a stream of the recorded data at the given absolute offset.
+	 * @returns nullptr if offset was already rotated out, or is at the end of a
+	 * stopped recording
+	 */
+  std::shared_ptr<ByteStream> open(size_t offset);
+  /**
+	 * Stream factory for BufferedStream::open() and PlaybackEngine::play().
+	 */
+  BufferedStream::StreamReader reader();
+
+  /**
+	 * Offset of the frame closest to, and not later than ms milliseconds behind the
+	 * newest indexed frame. The oldest indexed frame is used, if ms exceeds the
+	 * recorded duration.
+	 */
+  size_t offsetBehindLive(uint32_t ms);
+  /**
+	 * Duration of the indexed recording, in milliseconds.
+	 */
+  uint32_t availableMs();
+
+  // range of recorded data available for reading
+  size_t startOffset();
+  size_t endOffset();
+
+  bell::AudioCodec getCodec() const { return codec; }
+
+ private:
+  class Reader : public ByteStream {
+   public:
+    Reader(TimeShiftBuffer* owner, size_t offset);
+    ~Reader() override;
+
+    size_t read(uint8_t* buf, size_t nbytes) override;
+    size_t skip(size_t nbytes) override;
+    size_t position() override { return offset; }
+    size_t size() override { return 0; }
+    void close() override;
+
+   private:
+    TimeShiftBuffer* owner;
+    size_t offset;
+    FILE* file = nullptr;
+    size_t fileSegment = 0;
+    std::atomic<bool> closed = false;
+  };
+
+  struct IndexEntry {
+    uint64_t timeMs;
+    size_t offset;
+  };
+
+  typedef std::chrono::steady_clock Clock;
+
+  Config config;
+  std::shared_ptr<ByteStream> source;
+  std::atomic<bool> recording = false;
+  bool started = false;
+  bell::WrappedSemaphore finished;
+
+  // guards everything below, notifies readers of new data
+  std::mutex dataMutex;
+  std::condition_variable dataAvailable;
+  size_t firstSegment = 0;
+  size_t flushedOffset = 0;
+  size_t writtenOffset = 0;
+  std::vector<uint8_t> batch;  // data between flushedOffset and writtenOffset
+  FILE* segmentFile = nullptr;
+  size_t segmentIndex = 0;
+  Clock::time_point lastFlush;
+
+  // frame scanning, done on written data
+  std::atomic<bell::AudioCodec> codec = bell::AudioCodec::UNKNOWN;
+  uint8_t header[FrameHeader::ADTS_HEADER_SIZE];
+  size_t headerLength = 0;
+  size_t frameRemaining = 0;
+  // last parsed frame, indexed once the next one confirms the sync
+  bool hasPending = false;
+  size_t pendingOffset = 0;
+  FrameHeader::Info pendingInfo;
+  uint64_t recordedUs = 0;
+  std::deque<IndexEntry> index;
+
+  void runTask() override;
+  bool append(const uint8_t* data, size_t len);
+  void scanFrames(const uint8_t* data, size_t len);
+  bell::AudioCodec parseHeader(FrameHeader::Info& info);
+  void indexFrame(size_t offset, const FrameHeader::Info& info);
+  bool flushBatch();
+  bool openSegment(size_t segment);
+  void rotate();
+  std::string segmentPath(size_t segment) const;
+  void reset();
+};
+}  // namespace bell
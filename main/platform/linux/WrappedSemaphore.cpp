@@ -25,6 +25,11 @@ int WrappedSemaphore::twait(long milliseconds) {
 
   ts.tv_sec = tv.tv_sec + milliseconds / 1000;
   ts.tv_nsec = tv.tv_usec * 1000 + (milliseconds % 1000) * 1000000;
+  // tv_nsec must stay below one second, or sem_timedwait fails with EINVAL
+  if (ts.tv_nsec >= 1000000000) {
+    ts.tv_sec += 1;
+    ts.tv_nsec -= 1000000000;
+  }
   return sem_timedwait(&this->semaphoreHandle, &ts);
 }
 
@@ -0,0 +1,1248 @@
+#include <stdint.h>            // for int32_t, uint8_t, uint32_t, uint64_t
+#include <stdio.h>             // for printf
+#include <stdlib.h>            // for abs, llabs
+#include <string.h>            // for memcmp, memcpy
+#include <algorithm>           // for min
+#include <atomic>              // for atomic
+#include <chrono>              // for steady_clock, milliseconds
+#include <condition_variable>  // for condition_variable
+#include <functional>          // for function
+#include <memory>              // for make_shared, make_unique, shared_ptr
+#include <mutex>               // for mutex, scoped_lock, unique_lock
+#include <sstream>             // for istringstream
+#include <string>              // for string, to_string
+#include <thread>              // for thread
+#include <utility>             // for move, pair
+#include <vector>              // for vector
+
+#ifndef _WIN32
+#include <arpa/inet.h>   // for htonl, ntohs
+#include <netinet/in.h>  // for sockaddr_in, INADDR_LOOPBACK
+#include <poll.h>        // for poll, pollfd, POLLIN
+#include <signal.h>      // for signal, SIGPIPE, SIG_IGN
+#include <sys/socket.h>  // for socket, bind, listen, accept, recv, send
+#include <unistd.h>      // for close
+#endif
+
+#include "AudioContainer.h"      // for AudioContainer
+#include "AudioContainers.h"     // for guessAudioContainer
+#include "AudioDecoderStream.h"  // for AudioDecoderStream
+#include "AudioPipeline.h"       // for AudioPipeline
+#include "AudioSink.h"           // for AudioSink
+#include "AudioTransform.h"      // for AudioTransform
+#include "BellDSP.h"             // for BellDSP
+#include "BellLogger.h"          // for AbstractLogger, bellGlobalLogger
+#include "BellUtils.h"           // for BELL_SLEEP_MS
+#include "BufferedStream.h"      // for BufferedStream
+#include "ByteStream.h"          // for ByteStream
+#include "CentralAudioBuffer.h"  // for CentralAudioBuffer
+#include "FileStream.h"          // for FileStream
+#include "HLSStream.h"           // for HLSStream
+#include "HTTPClient.h"          // for HTTPClient
+#include "ICYStream.h"           // for ICYStream
+#include "ID3Tag.h"              // for ID3Tag
+#include "PCMCache.h"            // for PCMCache
+#include "PCMContainer.h"        // for PCMContainer
+#include "PCMConverter.h"        // for convert, fromFloat, toFloat
+#include "PlaybackEngine.h"      // for PlaybackEngine
+#include "StreamInfo.h"          // for BitWidth, PCMFormat, StreamInfo
+
+/**
+ * Checks of the audio path, from the sources to the sink:
+ *  - PCM formats above 16 bits: PCMConverter round trips at every bit depth, BellDSP and
+ *    CentralAudioBuffer on 24- and 32-bit PCM, and FLAC and ALAC decoding at 96 kHz/24
+ *    bits and 192 kHz/32 bits over the fixtures in test/fixtures (or the directory given
+ *    as the first argument),
+ *  - PCMCache, directly and through PlaybackEngine,
+ *  - gapless playback of queued tracks,
+ *  - ID3v2 tags: skipping them to guess the container, and reading them on demand,
+ *  - ICY metadata stripping, in memory and from a server on the loopback interface,
+ *  - HLS playlists and segments, from a server on the loopback interface,
+ *  - WAV and AIFF headers, and seeking within their sound data.
+ *
+ * The fixtures, and the WAV files built in memory, are stereo frames of a sawtooth
+ * covering the full range of their bit depth, see sawtooth(), so the decoded PCM is
+ * compared bit for bit.
+ */
+
+using namespace bell;
+
+namespace {
+int failures = 0;
+
+#define CHECK(condition)                                              \
+  do {                                                                \
+    if (!(condition)) {                                               \
+      printf("%s:%d: check failed: %s\n", __FILE__, __LINE__,         \
+             #condition);                                             \
+      failures++;                                                     \
+    }                                                                 \
+  } while (0)
+
+// drops the log lines of the decoders
+class SilentLogger : public AbstractLogger {
+ public:
+  void debug(std::string filename, int line, std::string submodule,
+             const char* format, ...) override {}
+  void error(std::string filename, int line, std::string submodule,
+             const char* format, ...) override {}
+  void info(std::string filename, int line, std::string submodule,
+            const char* format, ...) override {}
+};
+
+// signal of the fixtures, at the top bits of a 32-bit sample
+int32_t sawtooth(uint64_t frame, int channel, uint8_t bitDepth) {
+  uint32_t value = (uint32_t)frame * 8947849u + channel * 0x40000000u;
+  return (int32_t)value >> (32 - bitDepth);
+}
+
+int32_t readSample(const uint8_t* in, uint8_t bitDepth) {
+  int32_t value = 0;
+  memcpy(&value, in, bitDepth / 8);
+  // sign extension of the packed sample
+  return (int32_t)((uint32_t)value << (32 - bitDepth)) >> (32 - bitDepth);
+}
+
+void writeSample(uint8_t* out, int32_t value, uint8_t bitDepth) {
+  memcpy(out, &value, bitDepth / 8);
+}
+
+void testConverter(uint8_t bitDepth) {
+  size_t sampleSize = bitDepth / 8;
+  // the extremes, zero, and the sawtooth in between
+  std::vector<int32_t> samples = {sawtooth(0, 2, bitDepth), -1, 0, 1,
+                                  ~sawtooth(0, 2, bitDepth)};
+  for (uint64_t frame = 0; frame < 1000; frame++) {
+    samples.push_back(sawtooth(frame * 4801, 0, bitDepth));
+  }
+  std::vector<uint8_t> pcm(samples.size() * sampleSize);
+  for (size_t i = 0; i < samples.size(); i++) {
+    writeSample(&pcm[i * sampleSize], samples[i], bitDepth);
+  }
+
+  // floats hold 24 bits exactly; 32-bit samples are rounded to them
+  int32_t tolerance = bitDepth > 24 ? 1 << (bitDepth - 25) : 0;
+  std::vector<float> floats(samples.size());
+  std::vector<uint8_t> back(pcm.size());
+  PCMConverter::toFloat(pcm.data(), bitDepth, sampleSize, floats.data(),
+                        samples.size());
+  PCMConverter::fromFloat(floats.data(), back.data(), bitDepth, sampleSize,
+                          samples.size());
+  for (size_t i = 0; i < samples.size(); i++) {
+    CHECK(floats[i] >= -1.0f && floats[i] <= 1.0f);
+    int32_t value = readSample(&back[i * sampleSize], bitDepth);
+    CHECK(llabs((int64_t)value - samples[i]) <= tolerance);
+  }
+
+  // to every other depth and back: widening is exact, narrowing keeps the top
+  // bits
+  for (uint8_t otherDepth : {16, 24, 32}) {
+    size_t otherSize = otherDepth / 8;
+    std::vector<uint8_t> other(samples.size() * otherSize);
+    CHECK(PCMConverter::convert(pcm.data(), bitDepth, other.data(), otherDepth,
+                                samples.size()) == other.size());
+    CHECK(PCMConverter::convert(other.data(), otherDepth, back.data(),
+                                bitDepth, samples.size()) == pcm.size());
+    int shift = abs(otherDepth - bitDepth);
+    for (size_t i = 0; i < samples.size(); i++) {
+      int32_t converted = otherDepth < bitDepth ? samples[i] >> shift
+                                                : samples[i] * (1 << shift);
+      int32_t restored =
+          otherDepth < bitDepth ? converted * (1 << shift) : samples[i];
+      CHECK(readSample(&other[i * otherSize], otherDepth) == converted);
+      CHECK(readSample(&back[i * sampleSize], bitDepth) == restored);
+    }
+  }
+}
+
+// claims more channels than it was given, without touching the data
+class UpmixTransform : public AudioTransform {
+ public:
+  std::unique_ptr<StreamInfo> process(
+      std::unique_ptr<StreamInfo> data) override {
+    data->numChannels = 3;
+    return data;
+  }
+};
+
+void testDSP(BitWidth bitWidth) {
+  auto bits = static_cast<uint8_t>(bitWidth);
+  size_t sampleSize = bits / 8;
+  const size_t frames = 3000;
+  std::vector<uint8_t> pcm(frames * 2 * sampleSize);
+  for (size_t frame = 0; frame < frames; frame++) {
+    for (int channel = 0; channel < 2; channel++) {
+      writeSample(&pcm[(frame * 2 + channel) * sampleSize],
+                  sawtooth(frame, channel, bits), bits);
+    }
+  }
+  std::vector<uint8_t> original = pcm;
+
+  // without a pipeline, the PCM is converted to floats and back unchanged
+  BellDSP dsp(nullptr);
+  CHECK(dsp.process(pcm.data(), pcm.size(), 2, 96000, bitWidth) == pcm.size());
+  int32_t tolerance = bits > 24 ? 1 << (bits - 25) : 0;
+  for (size_t i = 0; i < frames * 2; i++) {
+    int32_t value = readSample(&pcm[i * sampleSize], bits);
+    int32_t expected = readSample(&original[i * sampleSize], bits);
+    CHECK(llabs((int64_t)value - expected) <= tolerance);
+  }
+
+  // a pipeline adding channels can't grow the PCM written in place
+  auto pipeline = std::make_shared<AudioPipeline>();
+  pipeline->addTransform(std::make_shared<UpmixTransform>());
+  dsp.applyPipeline(pipeline);
+  CHECK(dsp.process(pcm.data(), pcm.size(), 2, 96000, bitWidth) <= pcm.size());
+}
+
+void testCentralBuffer(BitWidth bitWidth) {
+  auto bits = static_cast<uint8_t>(bitWidth);
+  size_t frameSize = 2 * bits / 8;
+  CentralAudioBuffer buffer(16);
+  std::vector<uint8_t> pcm(10 * CentralAudioBuffer::PCM_CHUNK_SIZE);
+  for (size_t i = 0; i < pcm.size(); i++) {
+    pcm[i] = i * 7;
+  }
+
+  // whole frames only, even when the input isn't
+  size_t written = 0;
+  while (written < pcm.size() - frameSize) {
+    size_t size = buffer.writePCM(&pcm[written], pcm.size() - written - 1, 1,
+                                  96000, 2, bitWidth);
+    CHECK(size % frameSize == 0);
+    if (size == 0) {
+      break;
+    }
+    written += size;
+  }
+  // a new chunk for a new format
+  uint8_t frame[8] = {};
+  CHECK(buffer.writePCM(frame, frameSize, 1, 192000, 2, bitWidth) ==
+        frameSize);
+  CHECK(buffer.flush());
+
+  size_t read = 0;
+  size_t fullChunk = CentralAudioBuffer::PCM_CHUNK_SIZE -
+                     CentralAudioBuffer::PCM_CHUNK_SIZE % frameSize;
+  while (auto* chunk = buffer.readChunk()) {
+    CHECK(chunk->bitWidth == bits);
+    CHECK(chunk->channels == 2);
+    CHECK(chunk->pcmSize % frameSize == 0);
+    if (chunk->sampleRate == 192000) {
+      CHECK(read == written);
+      CHECK(chunk->pcmSize == frameSize);
+      continue;
+    }
+    CHECK(chunk->sampleRate == 96000);
+    CHECK(chunk->pcmSize == fullChunk || read + chunk->pcmSize == written);
+    CHECK(memcmp(chunk->pcmData, &pcm[read], chunk->pcmSize) == 0);
+    read += chunk->pcmSize;
+  }
+  CHECK(read == written);
+}
+
+void testDecoder(const std::string& path, uint32_t sampleRate,
+                 uint8_t sourceDepth, uint8_t maxBitDepth) {
+  AudioDecoderStream decoder;
+  decoder.setMaxBitDepth(maxBitDepth);
+  if (!decoder.open(std::make_shared<FileStream>(path, "rb"))) {
+    printf("%s: can't be opened\n", path.c_str());
+    failures++;
+    return;
+  }
+
+  uint8_t expectedDepth = std::min(sourceDepth, maxBitDepth);
+  uint64_t frames = 0;
+  uint64_t mismatches = 0;
+  uint32_t len;
+  while (uint8_t* pcm = decoder.decode(len)) {
+    const auto& format = decoder.format();
+    CHECK(format.sampleRate == sampleRate);
+    CHECK(format.channels == 2);
+    CHECK(format.bitDepth == expectedDepth);
+    size_t sampleSize = format.bitDepth / 8;
+    for (size_t i = 0; i < len / format.frameSize(); i++, frames++) {
+      for (int channel = 0; channel < 2; channel++) {
+        int32_t value = readSample(
+            pcm + i * format.frameSize() + channel * sampleSize,
+            format.bitDepth);
+        mismatches += value != sawtooth(frames, channel, format.bitDepth);
+      }
+    }
+  }
+  CHECK(frames == 9600);
+  if (mismatches > 0) {
+    printf("%s at %d bits: %llu samples differ\n", path.c_str(), maxBitDepth,
+           (unsigned long long)mismatches);
+    failures++;
+  }
+}
+
+// serves a buffer; reports its whole size, but ends after `available` bytes,
+// or when `blocking`, waits there for setAvailable() like a stalled connection
+class MemoryStream : public ByteStream {
+ public:
+  MemoryStream(std::shared_ptr<const std::vector<uint8_t>> data,
+               size_t available = SIZE_MAX, bool blocking = false)
+      : data(data),
+        available(std::min(available, data->size())),
+        blocking(blocking) {}
+
+  size_t read(uint8_t* buf, size_t nbytes) override {
+    std::unique_lock lock(dataMutex);
+    if (blocking) {
+      changed.wait(lock, [this]() {
+        return closed || offset < available || available == data->size();
+      });
+    }
+    nbytes = std::min(nbytes, available - std::min(offset, available));
+    if (nbytes)
+      memcpy(buf, data->data() + offset, nbytes);
+    offset += nbytes;
+    bytesRead += nbytes;
+    return nbytes;
+  }
+  size_t skip(size_t nbytes) override {
+    std::scoped_lock lock(dataMutex);
+    nbytes = std::min(nbytes, data->size() - std::min(offset, data->size()));
+    offset += nbytes;
+    return nbytes;
+  }
+  size_t position() override {
+    std::scoped_lock lock(dataMutex);
+    return offset;
+  }
+  size_t size() override { return data->size(); }
+  void close() override {
+    std::scoped_lock lock(dataMutex);
+    closed = true;
+    changed.notify_all();
+  }
+  bool seek(size_t position) override {
+    std::scoped_lock lock(dataMutex);
+    if (position > data->size())
+      return false;
+    offset = position;
+    return true;
+  }
+
+  void setAvailable(size_t available) {
+    std::scoped_lock lock(dataMutex);
+    this->available = std::min(available, data->size());
+    changed.notify_all();
+  }
+  // bytes returned by read(), in total
+  size_t totalRead() {
+    std::scoped_lock lock(dataMutex);
+    return bytesRead;
+  }
+
+ private:
+  std::shared_ptr<const std::vector<uint8_t>> data;
+  std::mutex dataMutex;
+  std::condition_variable changed;
+  size_t available;
+  bool blocking;
+  bool closed = false;
+  size_t offset = 0;
+  size_t bytesRead = 0;
+};
+
+// 16-bit stereo PCM of the sawtooth, from the given frame on
+std::vector<uint8_t> sawtoothPCM(uint64_t firstFrame, size_t frames) {
+  std::vector<uint8_t> pcm(frames * 4);
+  for (size_t frame = 0; frame < frames; frame++) {
+    for (int channel = 0; channel < 2; channel++) {
+      writeSample(&pcm[(frame * 2 + channel) * 2],
+                  sawtooth(firstFrame + frame, channel, 16), 16);
+    }
+  }
+  return pcm;
+}
+
+void writeLE(std::vector<uint8_t>& out, uint32_t value, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    out.push_back(value >> (8 * i));
+  }
+}
+
+// 44.1 kHz, 16-bit stereo WAV file of the given PCM
+std::shared_ptr<const std::vector<uint8_t>> makeWAV(
+    const std::vector<uint8_t>& pcm) {
+  auto wav = std::make_shared<std::vector<uint8_t>>();
+  const char* riff = "RIFF";
+  wav->insert(wav->end(), riff, riff + 4);
+  writeLE(*wav, 36 + pcm.size(), 4);
+  const char* fmt = "WAVEfmt ";
+  wav->insert(wav->end(), fmt, fmt + 8);
+  writeLE(*wav, 16, 4);
+  writeLE(*wav, 1, 2);  // WAVE_FORMAT_PCM
+  writeLE(*wav, 2, 2);
+  writeLE(*wav, 44100, 4);
+  writeLE(*wav, 44100 * 4, 4);
+  writeLE(*wav, 4, 2);
+  writeLE(*wav, 16, 2);
+  const char* data = "data";
+  wav->insert(wav->end(), data, data + 4);
+  writeLE(*wav, pcm.size(), 4);
+  wav->insert(wav->end(), pcm.begin(), pcm.end());
+  return wav;
+}
+
+// keeps what it's fed, accepting any format; optionally at a pace, or holding
+// the player while paused
+class CaptureSink : public AudioSink {
+ public:
+  CaptureSink(uint32_t delayMs = 0) : delayMs(delayMs) {}
+
+  void feedPCMFrames(const uint8_t* buffer, size_t bytes) override {
+    {
+      std::unique_lock lock(dataMutex);
+      resumed.wait(lock, [this]() { return !paused; });
+      data.insert(data.end(), buffer, buffer + bytes);
+    }
+    if (delayMs)
+      BELL_SLEEP_MS(delayMs);
+  }
+  bool setParams(uint32_t sampleRate, uint8_t channelCount,
+                 uint8_t bitDepth) override {
+    return true;
+  }
+
+  void pause(bool paused) {
+    std::scoped_lock lock(dataMutex);
+    this->paused = paused;
+    resumed.notify_all();
+  }
+  size_t received() {
+    std::scoped_lock lock(dataMutex);
+    return data.size();
+  }
+  std::vector<uint8_t> take() {
+    std::scoped_lock lock(dataMutex);
+    return std::move(data);
+  }
+
+ private:
+  uint32_t delayMs;
+  std::mutex dataMutex;
+  std::condition_variable resumed;
+  bool paused = false;
+  std::vector<uint8_t> data;
+};
+
+// until the engine decoded and played everything
+void waitPlayed(PlaybackEngine& engine) {
+  BELL_SLEEP_MS(50);
+  while (engine.isDecoding() ||
+         engine.getAudioBuffer()->audioBuffer->size() > 0) {
+    BELL_SLEEP_MS(5);
+  }
+  // the last chunk is being fed to the sink
+  BELL_SLEEP_MS(100);
+}
+
+// source of a track that must come from the cache
+BufferedStream::StreamPtr noSource(uint32_t offset) {
+  failures++;
+  printf("a cached track was read from its source\n");
+  return nullptr;
+}
+
+std::vector<uint8_t> readCached(PCMCache& cache, size_t trackHash) {
+  std::vector<uint8_t> pcm;
+  auto reader = cache.open(trackHash);
+  if (!reader)
+    return pcm;
+  uint32_t len;
+  while (const uint8_t* data = reader->read(len)) {
+    pcm.insert(pcm.end(), data, data + len);
+  }
+  return pcm;
+}
+
+void testPCMCache() {
+  PCMFormat format;
+  format.sampleRate = 44100;
+  format.channels = 2;
+  format.bitDepth = 16;
+  std::vector<uint8_t> pcm = sawtoothPCM(0, 10000);
+
+  // a hit returns the recorded PCM as it was, whatever the blocks it came in
+  PCMCache::Config config;
+  config.maxBytes = pcm.size() * 5 / 2;
+  PCMCache cache(config);
+  for (size_t trackHash : {1, 2, 3}) {
+    cache.beginRecording(trackHash);
+    for (size_t offset = 0; offset < pcm.size(); offset += 4000) {
+      cache.record(&pcm[offset], std::min<size_t>(4000, pcm.size() - offset),
+                   format);
+    }
+    cache.endRecording(true);
+    CHECK(readCached(cache, trackHash) == pcm);
+  }
+
+  // past maxBytes, the least recently used track is evicted
+  CHECK(!cache.contains(1));
+  CHECK(cache.contains(2) && cache.contains(3));
+  CHECK(cache.trackCount() == 2);
+  CHECK(cache.memoryUsed() <= config.maxBytes);
+  CHECK(cache.open(2) != nullptr);
+  cache.beginRecording(4);
+  cache.record(pcm.data(), pcm.size(), format);
+  cache.endRecording(true);
+  CHECK(cache.contains(2) && !cache.contains(3) && cache.contains(4));
+
+  // incomplete recordings aren't kept
+  cache.beginRecording(5);
+  cache.record(pcm.data(), pcm.size(), format);
+  cache.endRecording(false);
+  CHECK(!cache.contains(5));
+
+#ifdef BELL_CODEC_PCM
+  // through the engine: a source ending before its size isn't cached, even
+  // though its decoding ended normally
+  auto sink = std::make_shared<CaptureSink>();
+  PlaybackEngine engine(sink);
+  auto engineCache = std::make_shared<PCMCache>();
+  engine.setCache(engineCache);
+  auto wav = makeWAV(pcm);
+  engine.play(
+      [wav](uint32_t offset) -> BufferedStream::StreamPtr {
+        // the stream can't be reopened past where it stopped
+        if (offset > 0)
+          return nullptr;
+        return std::make_shared<MemoryStream>(wav, wav->size() / 2);
+      },
+      1);
+  waitPlayed(engine);
+  std::vector<uint8_t> played = sink->take();
+  CHECK(!played.empty() && played.size() < pcm.size());
+  CHECK(!engineCache->contains(1));
+
+  engine.play(std::make_shared<MemoryStream>(wav), 2);
+  waitPlayed(engine);
+  CHECK(sink->take() == pcm);
+  CHECK(engineCache->contains(2));
+  engine.play(noSource, 2);
+  waitPlayed(engine);
+  CHECK(sink->take() == pcm);
+#endif
+}
+
+// until done() holds, for up to the given time
+template <typename Condition>
+bool waitFor(Condition done, uint32_t timeoutMs) {
+  auto deadline = std::chrono::steady_clock::now() +
+                  std::chrono::milliseconds(timeoutMs);
+  while (!done()) {
+    if (std::chrono::steady_clock::now() > deadline)
+      return false;
+    BELL_SLEEP_MS(5);
+  }
+  return true;
+}
+
+void testGapless() {
+  // one continuous sawtooth, cut in two tracks
+  std::vector<uint8_t> first = sawtoothPCM(0, 20000);
+  std::vector<uint8_t> second = sawtoothPCM(20000, 20000);
+  std::vector<uint8_t> both = first;
+  both.insert(both.end(), second.begin(), second.end());
+  auto firstWAV = makeWAV(first);
+  auto secondWAV = makeWAV(second);
+
+  // buffers much smaller than the tracks, so that the decoder stalls on the
+  // player during the first one
+  PlaybackEngine::Config config;
+  config.streamBufferSize = 8 * 1024;
+  config.streamReadyThreshold = 1024;
+  config.streamNotReadyThreshold = 512;
+  config.audioBufferChunks = 4;
+  config.playbackStartChunks = 2;
+  config.prefetchChunks = 8;
+
+  {
+    // with the player held, the queued track can only be read past its stream
+    // buffer by being decoded into the staging buffer
+    auto sink = std::make_shared<CaptureSink>();
+    PlaybackEngine engine(sink, config);
+    auto source = std::make_shared<MemoryStream>(secondWAV);
+    sink->pause(true);
+    engine.play(std::make_shared<MemoryStream>(firstWAV), 1);
+    engine.queue(source, 2);
+    size_t staged = config.prefetchChunks * CentralAudioBuffer::PCM_CHUNK_SIZE;
+    CHECK(waitFor([&]() { return source->totalRead() >= staged; }, 2000));
+    CHECK(sink->received() < first.size());
+    sink->pause(false);
+    waitPlayed(engine);
+    CHECK(sink->take() == both);
+  }
+
+  {
+    // a stalled queued source doesn't hold up the current track, which plays
+    // up to its last chunk, left to be completed by the queued track's start
+    auto sink = std::make_shared<CaptureSink>(2);
+    PlaybackEngine engine(sink, config);
+    auto source = std::make_shared<MemoryStream>(secondWAV, 2048, true);
+    engine.play(std::make_shared<MemoryStream>(firstWAV), 1);
+    engine.queue(source, 2);
+    size_t played =
+        first.size() - first.size() % CentralAudioBuffer::PCM_CHUNK_SIZE;
+    CHECK(waitFor([&]() { return sink->received() >= played; }, 5000));
+    source->setAvailable(SIZE_MAX);
+    waitPlayed(engine);
+    CHECK(sink->take() == both);
+  }
+}
+
+// every byte's high bit left clear
+void writeSyncsafe(std::vector<uint8_t>& out, uint32_t value) {
+  for (int shift = 21; shift >= 0; shift -= 7) {
+    out.push_back((value >> shift) & 0x7f);
+  }
+}
+
+// ID3v2.4 tag of the given frames, IDs and contents, followed by padding
+std::string makeID3(
+    const std::vector<std::pair<std::string, std::string>>& frames,
+    size_t padding, bool footer) {
+  std::vector<uint8_t> body;
+  for (const auto& [id, content] : frames) {
+    body.insert(body.end(), id.begin(), id.end());
+    writeSyncsafe(body, content.size());
+    body.push_back(0);
+    body.push_back(0);
+    body.insert(body.end(), content.begin(), content.end());
+  }
+  body.resize(body.size() + padding);
+
+  std::vector<uint8_t> tag = {'I', 'D', '3', 4, 0, uint8_t(footer ? 0x10 : 0)};
+  writeSyncsafe(tag, body.size());
+  tag.insert(tag.end(), body.begin(), body.end());
+  if (footer) {
+    tag.insert(tag.end(), {'3', 'D', 'I', 4, 0, 0x10});
+    writeSyncsafe(tag, body.size());
+  }
+  return std::string(tag.begin(), tag.end());
+}
+
+// samples of a PCM container, as they're stored
+std::vector<uint8_t> readContainer(AudioContainer& container) {
+  std::vector<uint8_t> data;
+  uint32_t len;
+  while (std::byte* sample = container.readSample(len)) {
+    data.insert(data.end(), (uint8_t*)sample, (uint8_t*)sample + len);
+    container.consumeBytes(len);
+  }
+  return data;
+}
+
+void testID3() {
+  // the size is syncsafe, 7 bits per byte, and excludes the header and footer
+  uint8_t header[ID3Tag::HEADER_SIZE] = {'I', 'D', '3', 4, 0, 0, 1, 2, 3, 4};
+  uint32_t size = (1 << 21) | (2 << 14) | (3 << 7) | 4;
+  CHECK(ID3Tag::tagSize(header) == size + ID3Tag::HEADER_SIZE);
+  header[5] = 0x10;
+  CHECK(ID3Tag::tagSize(header) == size + 2 * ID3Tag::HEADER_SIZE);
+  header[8] = 0x83;
+  CHECK(ID3Tag::tagSize(header) == 0);
+
+  std::vector<uint8_t> pcm = sawtoothPCM(0, 5000);
+  auto wav = makeWAV(pcm);
+  std::string wavData(wav->begin(), wav->end());
+  // UTF-8, then Latin-1 text
+  std::vector<std::pair<std::string, std::string>> frames = {
+      {"TIT2", std::string("\x03Title \xc3\xa9", 10)},
+      {"TPE1", std::string("\x00" "Artist \xe9", 9)}};
+
+  for (bool footer : {false, true}) {
+    // sizes up to the third syncsafe byte
+    for (size_t padding : {0, 300, 20000}) {
+      std::istringstream istr(makeID3(frames, padding, footer) + wavData);
+      auto container = AudioContainers::guessAudioContainer(istr);
+      CHECK(container && container->getCodec() == AudioCodec::PCM);
+      if (!container)
+        continue;
+
+      // read once samples were, seeking back to the tag and then to them
+      container->parseSetupData();
+      uint32_t len;
+      std::byte* sample = container->readSample(len);
+      CHECK(sample && len > 0 && memcmp(sample, pcm.data(), len) == 0);
+      const ID3Tag::Fields* tags = container->getTags();
+      CHECK(tags && tags->title == "Title \xc3\xa9");
+      CHECK(tags && tags->artist == "Artist \xc3\xa9");
+      CHECK(readContainer(*container) == pcm);
+    }
+  }
+
+  // a frame running past the end of the tag ends it, keeping the frames before
+  std::string tag = makeID3(frames, 0, false);
+  // the last byte of TPE1's size, after the tag header and the TIT2 frame
+  size_t sizeByte = ID3Tag::HEADER_SIZE + 10 + frames[0].second.size() + 7;
+  tag[sizeByte] += 8;
+  std::istringstream truncatedFrame(tag + wavData);
+  auto container = AudioContainers::guessAudioContainer(truncatedFrame);
+  CHECK(container && container->getCodec() == AudioCodec::PCM);
+  if (container) {
+    const ID3Tag::Fields* tags = container->getTags();
+    CHECK(tags && tags->title == "Title \xc3\xa9" && tags->artist.empty());
+    CHECK(readContainer(*container) == pcm);
+  }
+
+  // a stream ending within the tag has no container
+  tag = makeID3(frames, 20000, false);
+  std::istringstream truncatedTag(tag.substr(0, tag.size() / 2));
+  CHECK(AudioContainers::guessAudioContainer(truncatedTag) == nullptr);
+}
+
+// returns at most maxRead bytes per read, splitting what follows
+class ChoppyStream : public MemoryStream {
+ public:
+  ChoppyStream(std::shared_ptr<const std::vector<uint8_t>> data,
+               size_t maxRead)
+      : MemoryStream(data), maxRead(maxRead) {}
+
+  size_t read(uint8_t* buf, size_t nbytes) override {
+    return MemoryStream::read(buf, std::min(nbytes, maxRead));
+  }
+
+ private:
+  size_t maxRead;
+};
+
+#ifndef _WIN32
+// HTTP server on 127.0.0.1, answering every request with what the handler
+// returns for it, and closing the connection
+class LoopbackServer {
+ public:
+  typedef std::function<std::string(const std::string& request)> Handler;
+
+  LoopbackServer(Handler handler) : handler(std::move(handler)) {
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t length = sizeof(address);
+    if (bind(listener, (sockaddr*)&address, length) != 0 ||
+        listen(listener, 16) != 0 ||
+        getsockname(listener, (sockaddr*)&address, &length) != 0) {
+      printf("can't listen on the loopback interface\n");
+      failures++;
+    }
+    port = ntohs(address.sin_port);
+    thread = std::thread([this]() { serve(); });
+  }
+  ~LoopbackServer() {
+    stopped = true;
+    thread.join();
+    ::close(listener);
+  }
+
+  std::string url(const std::string& path) {
+    return "http://127.0.0.1:" + std::to_string(port) + path;
+  }
+  // request headers received so far
+  std::vector<std::string> requests() {
+    std::scoped_lock lock(requestsMutex);
+    return received;
+  }
+
+ private:
+  Handler handler;
+  int listener;
+  uint16_t port = 0;
+  std::thread thread;
+  std::atomic<bool> stopped = false;
+  std::mutex requestsMutex;
+  std::vector<std::string> received;
+
+  void serve() {
+    while (!stopped) {
+      pollfd listening = {listener, POLLIN, 0};
+      if (poll(&listening, 1, 20) <= 0)
+        continue;
+      int client = accept(listener, nullptr, nullptr);
+      if (client < 0)
+        continue;
+
+      std::string request;
+      char buffer[1024];
+      while (request.find("\r\n\r\n") == std::string::npos) {
+        ssize_t len = recv(client, buffer, sizeof(buffer), 0);
+        if (len <= 0)
+          break;
+        request.append(buffer, len);
+      }
+      {
+        std::scoped_lock lock(requestsMutex);
+        received.push_back(request);
+      }
+      std::string response = handler(request);
+      for (size_t sent = 0; sent < response.size();) {
+        ssize_t len = send(client, response.data() + sent,
+                           response.size() - sent, MSG_NOSIGNAL);
+        if (len <= 0)
+          break;
+        sent += len;
+      }
+      ::close(client);
+    }
+  }
+};
+#endif
+
+// ICY stream of the given audio, with the given metadata blocks after each
+// interval of it in turn, then empty ones
+std::vector<uint8_t> makeICY(const std::vector<uint8_t>& audio,
+                             size_t interval,
+                             const std::vector<std::string>& blocks) {
+  std::vector<uint8_t> stream;
+  for (size_t offset = 0, block = 0; offset < audio.size();
+       offset += interval, block++) {
+    size_t len = std::min(interval, audio.size() - offset);
+    stream.insert(stream.end(), audio.begin() + offset,
+                  audio.begin() + offset + len);
+    if (len < interval)
+      break;
+    std::string text = block < blocks.size() ? blocks[block] : "";
+    // in 16 byte units, padded with zeros
+    stream.push_back((text.size() + 15) / 16);
+    text.resize((text.size() + 15) / 16 * 16);
+    stream.insert(stream.end(), text.begin(), text.end());
+  }
+  return stream;
+}
+
+// reads a stream to its end; with skipLen set, reads and skips alternately,
+// marking skipped bytes in `skipped`
+std::vector<uint8_t> readAll(ByteStream& stream, size_t skipLen = 0,
+                             std::vector<bool>* skipped = nullptr) {
+  std::vector<uint8_t> data;
+  uint8_t buffer[1000];
+  while (true) {
+    size_t len = stream.read(buffer, skipLen ? skipLen : sizeof(buffer));
+    if (!len)
+      break;
+    data.insert(data.end(), buffer, buffer + len);
+    if (skipped) {
+      skipped->resize(data.size(), false);
+      data.resize(data.size() + stream.skip(skipLen));
+      skipped->resize(data.size(), true);
+    }
+  }
+  return data;
+}
+
+void testICY() {
+  std::vector<uint8_t> audio(4000);
+  for (size_t i = 0; i < audio.size(); i++) {
+    audio[i] = i * 7 + i / 256;
+  }
+  // empty blocks and repeated titles don't change the title, which may
+  // contain quotes
+  std::vector<std::string> blocks = {
+      "StreamTitle='First';StreamUrl='';",
+      "",
+      "StreamTitle='First';",
+      "StreamTitle='Rock 'n' Roll';StreamUrl='http://example.com/';",
+      "",
+      "StreamTitle='Ends with a quote'';"};
+  std::vector<std::string> titles = {"First", "Rock 'n' Roll",
+                                     "Ends with a quote'"};
+  const size_t interval = 256;
+  auto stream = std::make_shared<const std::vector<uint8_t>>(
+      makeICY(audio, interval, blocks));
+
+  // whole reads, reads cutting the blocks, and skips over them
+  for (size_t maxRead : {SIZE_MAX, size_t(1), size_t(7)}) {
+    for (size_t skipLen : {0, 100}) {
+      std::vector<std::string> received;
+      ICYStream icy(std::make_shared<ChoppyStream>(stream, maxRead), interval,
+                    [&](const std::string& title) {
+                      received.push_back(title);
+                    });
+      std::vector<bool> skipped;
+      std::vector<uint8_t> data =
+          readAll(icy, skipLen, skipLen ? &skipped : nullptr);
+      CHECK(data.size() == audio.size());
+      bool same = data.size() == audio.size();
+      for (size_t i = 0; same && i < data.size(); i++) {
+        same = data[i] == audio[i] || (skipLen && skipped[i]);
+      }
+      CHECK(same);
+      CHECK(received == titles);
+      CHECK(icy.title() == titles.back());
+      CHECK(icy.position() == audio.size());
+    }
+  }
+
+#ifndef _WIN32
+  // SHOUTcast v1 answers with "ICY 200 OK", which the HTTP client takes for
+  // HTTP/1.0
+  LoopbackServer server([&](const std::string& request) {
+    return "ICY 200 OK\r\nicy-metaint: " + std::to_string(interval) +
+           "\r\nContent-Type: audio/mpeg\r\n\r\n" +
+           std::string(stream->begin(), stream->end());
+  });
+  std::vector<std::string> received;
+  auto icy = ICYStream::open(server.url("/radio"),
+                             [&](const std::string& title) {
+                               received.push_back(title);
+                             });
+  CHECK(icy != nullptr);
+  if (icy) {
+    CHECK(readAll(*icy) == audio);
+    CHECK(received == titles);
+  }
+  auto requests = server.requests();
+  CHECK(requests.size() == 1 &&
+        requests[0].find("Icy-MetaData: 1\r\n") != std::string::npos);
+#endif
+}
+
+#ifndef _WIN32
+std::string httpResponse(const std::string& status, const std::string& body,
+                         const std::string& headers = "") {
+  return "HTTP/1.1 " + status +
+         "\r\nContent-Length: " + std::to_string(body.size()) + "\r\n" +
+         headers + "Connection: close\r\n\r\n" + body;
+}
+
+void testHLS() {
+  // packed audio segments, starting with a timestamp tag
+  auto payload = [](uint64_t sequence) {
+    std::string data(1000 + sequence * 10, 0);
+    for (size_t i = 0; i < data.size(); i++) {
+      data[i] = i * 13 + sequence;
+    }
+    return data;
+  };
+  auto segment = [&](uint64_t sequence) {
+    std::string timestamp("com.apple.streaming.transportStreamTimestamp", 45);
+    return makeID3({{"PRIV", timestamp + std::string(8, 1)}}, 0, false) +
+           payload(sequence);
+  };
+  // segments 14 and 16 are byte ranges of a larger resource
+  std::string bundle = std::string(100, 'x') + segment(14) +
+                       std::string(50, 'y') + segment(16) +
+                       std::string(20, 'z');
+  size_t range14 = 100, range16 = 150 + segment(14).size();
+
+  // the live window moves by a segment on every reload, until it ends
+  std::atomic<int> reloads = 0;
+  auto playlist = [&]() {
+    int reload = reloads++;
+    std::string text =
+        "#EXTM3U\n#EXT-X-TARGETDURATION:1\n#EXT-X-MEDIA-SEQUENCE:" +
+        std::to_string(10 + reload) + "\n";
+    for (int sequence = 10 + reload; sequence <= 13 + reload; sequence++) {
+      text += "#EXTINF:1.0,\n";
+      if (sequence == 14) {
+        text += "#EXT-X-BYTERANGE:" + std::to_string(segment(14).size()) +
+                "@" + std::to_string(range14) + "\nranges.aac\n";
+      } else if (sequence == 16) {
+        text += "#EXT-X-BYTERANGE:" + std::to_string(segment(16).size()) +
+                "@" + std::to_string(range16) + "\nwhole.aac\n";
+      } else {
+        text += std::to_string(sequence) + ".aac\n";
+      }
+    }
+    return text + (reload == 3 ? "#EXT-X-ENDLIST\n" : "");
+  };
+
+  LoopbackServer server([&](const std::string& request) {
+    std::string path = request.substr(4, request.find(' ', 4) - 4);
+    if (path == "/master.m3u8") {
+      return httpResponse(
+          "200 OK",
+          "#EXTM3U\n"
+          "#EXT-X-STREAM-INF:BANDWIDTH=64000\nlow/live.m3u8\n"
+          "#EXT-X-STREAM-INF:BANDWIDTH=128000\nmid/live.m3u8\n"
+          "#EXT-X-STREAM-INF:BANDWIDTH=256000\nhigh/live.m3u8\n");
+    }
+    if (path == "/mid/live.m3u8")
+      return httpResponse("200 OK", playlist());
+    if (path == "/mid/ranges.aac") {
+      size_t range = request.find("Range: bytes=");
+      if (range == std::string::npos)
+        return httpResponse("200 OK", bundle);
+      size_t first = std::strtoul(request.c_str() + range + 13, nullptr, 10);
+      size_t last = std::strtoul(
+          request.c_str() + request.find('-', range) + 1, nullptr, 10);
+      return httpResponse(
+          "206 Partial Content", bundle.substr(first, last - first + 1),
+          "Content-Range: bytes " + std::to_string(first) + "-" +
+              std::to_string(last) + "/" + std::to_string(bundle.size()) +
+              "\r\n");
+    }
+    // a server ignoring ranges
+    if (path == "/mid/whole.aac")
+      return httpResponse("200 OK", bundle);
+    // gone, which retrying won't change
+    if (path == "/mid/15.aac")
+      return httpResponse("404 Not Found", "");
+    unsigned sequence;
+    if (sscanf(path.c_str(), "/mid/%u.aac", &sequence) == 1)
+      return httpResponse("200 OK", segment(sequence));
+    return httpResponse("404 Not Found", "");
+  });
+
+  HLSStream::Config config;
+  config.maxBandwidth = 150000;
+  config.liveStartSegments = 2;
+  auto hls = HLSStream::open(server.url("/master.m3u8"), config);
+  CHECK(hls != nullptr);
+  if (!hls)
+    return;
+  CHECK(hls->isLive());
+
+  // closes the stream if it hangs
+  std::atomic<bool> done = false;
+  std::thread watchdog([&]() {
+    if (!waitFor([&]() { return done.load(); }, 15000))
+      hls->close();
+  });
+  std::vector<uint8_t> data = readAll(*hls);
+  done = true;
+  watchdog.join();
+
+  // from the live start on, each segment once, without its tag; the missing
+  // one is skipped
+  std::string expected = payload(12) + payload(13) + payload(14) + payload(16);
+  CHECK(std::string(data.begin(), data.end()) == expected);
+  CHECK(hls->position() == expected.size());
+  CHECK(!hls->isLive());
+
+  int variantRequests = 0, missingRequests = 0, rangeRequests = 0;
+  for (const auto& request : server.requests()) {
+    variantRequests += request.find(" /low/") != std::string::npos ||
+                       request.find(" /high/") != std::string::npos;
+    missingRequests += request.find(" /mid/15.aac ") != std::string::npos;
+    rangeRequests += request.find("Range: bytes=" + std::to_string(range14) +
+                                  "-") != std::string::npos;
+  }
+  CHECK(variantRequests == 0);
+  CHECK(missingRequests == 1);
+  CHECK(rangeRequests == 1);
+}
+#endif
+
+#ifdef BELL_CODEC_PCM
+enum class PCMFile { WAV_EXTENSIBLE, AIFF, AIFC };
+
+void writeBE(std::vector<uint8_t>& out, uint64_t value, size_t size) {
+  for (size_t i = size; i > 0; i--) {
+    out.push_back(value >> (8 * (i - 1)));
+  }
+}
+
+void writeTag(std::vector<uint8_t>& out, const char* tag) {
+  out.insert(out.end(), tag, tag + 4);
+}
+
+// 44.1 kHz stereo file of the sawtooth. Its sound data ends with a partial
+// frame, and is followed by another chunk
+std::shared_ptr<const std::vector<uint8_t>> makePCMFile(PCMFile type,
+                                                        uint8_t bitDepth,
+                                                        size_t frames) {
+  bool bigEndian = type != PCMFile::WAV_EXTENSIBLE;
+  size_t sampleSize = bitDepth / 8;
+  std::vector<uint8_t> sound;
+  for (size_t frame = 0; frame < frames; frame++) {
+    for (int channel = 0; channel < 2; channel++) {
+      uint32_t sample = sawtooth(frame, channel, bitDepth);
+      if (bigEndian) {
+        writeBE(sound, sample, sampleSize);
+      } else {
+        writeLE(sound, sample, sampleSize);
+      }
+    }
+  }
+  sound.push_back(0x55);
+
+  auto file = std::make_shared<std::vector<uint8_t>>();
+  std::vector<uint8_t> body;
+  if (type == PCMFile::WAV_EXTENSIBLE) {
+    writeTag(body, "WAVE");
+    writeTag(body, "fmt ");
+    writeLE(body, 40, 4);
+    writeLE(body, 0xFFFE, 2);  // WAVE_FORMAT_EXTENSIBLE
+    writeLE(body, 2, 2);
+    writeLE(body, 44100, 4);
+    writeLE(body, 44100 * 2 * sampleSize, 4);
+    writeLE(body, 2 * sampleSize, 2);
+    writeLE(body, bitDepth, 2);
+    writeLE(body, 22, 2);
+    writeLE(body, bitDepth, 2);
+    writeLE(body, 3, 4);  // SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT
+    // KSDATAFORMAT_SUBTYPE_PCM
+    const uint8_t subformat[16] = {1, 0, 0, 0, 0,    0,    0x10, 0,
+                                   0x80, 0, 0, 0xAA, 0, 0x38, 0x9B, 0x71};
+    body.insert(body.end(), subformat, subformat + 16);
+    writeTag(body, "data");
+    writeLE(body, sound.size(), 4);
+    body.insert(body.end(), sound.begin(), sound.end());
+    body.push_back(0);  // padding of the odd size
+    writeTag(body, "LIST");
+    writeLE(body, 4, 4);
+    writeTag(body, "INFO");
+    writeTag(*file, "RIFF");
+    writeLE(*file, body.size(), 4);
+  } else {
+    bool aifc = type == PCMFile::AIFC;
+    writeTag(body, aifc ? "AIFC" : "AIFF");
+    writeTag(body, "COMM");
+    // the compression type is followed by an empty name, padded to even
+    writeBE(body, aifc ? 24 : 18, 4);
+    writeBE(body, 2, 2);
+    writeBE(body, frames, 4);
+    writeBE(body, bitDepth, 2);
+    // 44100 as an 80-bit extended float
+    writeBE(body, 16383 + 15, 2);
+    writeBE(body, 44100ull << 48, 8);
+    if (aifc) {
+      writeTag(body, "NONE");
+      writeBE(body, 0, 2);
+    }
+    writeTag(body, "SSND");
+    writeBE(body, 8 + sound.size(), 4);
+    writeBE(body, 0, 8);  // offset and block size
+    body.insert(body.end(), sound.begin(), sound.end());
+    body.push_back(0);
+    writeTag(body, "ANNO");
+    writeBE(body, 4, 4);
+    writeTag(body, "note");
+    writeTag(*file, "FORM");
+    writeBE(*file, body.size(), 4);
+  }
+  file->insert(file->end(), body.begin(), body.end());
+  return file;
+}
+
+// frames decoded until the end, -1 from the first one off the sawtooth
+int64_t decodeSawtooth(AudioDecoderStream& decoder, uint64_t firstFrame,
+                       uint8_t bitDepth) {
+  uint64_t frame = firstFrame;
+  uint32_t len;
+  bool matches = true;
+  while (uint8_t* pcm = decoder.decode(len)) {
+    const auto& format = decoder.format();
+    CHECK(format.sampleRate == 44100);
+    CHECK(format.channels == 2);
+    CHECK(format.bitDepth == bitDepth);
+    size_t sampleSize = bitDepth / 8;
+    for (size_t i = 0; i < len / format.frameSize(); i++, frame++) {
+      for (int channel = 0; channel < 2; channel++) {
+        int32_t value = readSample(
+            pcm + i * format.frameSize() + channel * sampleSize, bitDepth);
+        matches = matches && value == sawtooth(frame, channel, bitDepth);
+      }
+    }
+  }
+  return matches ? (int64_t)(frame - firstFrame) : -1;
+}
+
+void testPCMContainers() {
+  const size_t frames = 5000;
+  for (auto [type, sourceDepth] :
+       std::vector<std::pair<PCMFile, uint8_t>>{{PCMFile::WAV_EXTENSIBLE, 24},
+                                                {PCMFile::WAV_EXTENSIBLE, 32},
+                                                {PCMFile::AIFF, 16},
+                                                {PCMFile::AIFF, 24},
+                                                {PCMFile::AIFC, 24}}) {
+    auto file = makePCMFile(type, sourceDepth, frames);
+
+    // whole frames of the sound data, then the end, rather than waiting for the
+    // rest of the partial frame
+    std::istringstream istr(std::string(file->begin(), file->end()));
+    auto container = AudioContainers::guessAudioContainer(istr);
+    CHECK(container != nullptr);
+    if (!container)
+      continue;
+    CHECK(readContainer(*container).size() == frames * 2 * sourceDepth / 8);
+    CHECK(container->isEnd());
+    if (!container->isEnd())
+      continue;
+
+    for (uint8_t maxBitDepth : {16, 24, 32}) {
+      AudioDecoderStream decoder;
+      decoder.setMaxBitDepth(maxBitDepth);
+      CHECK(decoder.open(std::make_shared<MemoryStream>(file)));
+      if (!decoder.isOpen())
+        continue;
+      auto* pcm = static_cast<PCMContainer*>(decoder.getContainer());
+      CHECK(pcm->getFormat().bigEndian == (type != PCMFile::WAV_EXTENSIBLE));
+      CHECK(pcm->getFormat().validBits == sourceDepth);
+      CHECK(pcm->getFormat().channelMask ==
+            (type == PCMFile::WAV_EXTENSIBLE ? 3 : 0));
+      CHECK(pcm->duration() == frames);
+
+      // byte-swapped and narrowed; neither the partial frame nor the next
+      // chunk are played
+      uint8_t bitDepth = std::min(sourceDepth, maxBitDepth);
+      CHECK(decodeSawtooth(decoder, 0, bitDepth) == frames);
+
+      CHECK(decoder.seekToSample(frames / 3));
+      CHECK(pcm->currentSample() == frames / 3);
+      CHECK(decodeSawtooth(decoder, frames / 3, bitDepth) ==
+            frames - frames / 3);
+
+      // past the end, to the end of the sound data
+      CHECK(decoder.seekToSample(frames * 2));
+      CHECK(pcm->currentSample() == frames);
+      CHECK(decodeSawtooth(decoder, frames, bitDepth) == 0);
+      CHECK(decoder.eof());
+    }
+  }
+}
+#endif
+}  // namespace
+
+int main(int argc, char** argv) {
+  bell::bellGlobalLogger = new SilentLogger();
+#ifndef _WIN32
+  // writes to connections the other side closed fail instead
+  signal(SIGPIPE, SIG_IGN);
+#endif
+  std::string directory = argc > 1 ? argv[1] : BELL_TEST_FIXTURES;
+
+  for (uint8_t bitDepth : {16, 24, 32}) {
+    testConverter(bitDepth);
+  }
+  for (auto bitWidth : {BitWidth::BW_16, BitWidth::BW_24, BitWidth::BW_32}) {
+    testDSP(bitWidth);
+    testCentralBuffer(bitWidth);
+  }
+  testPCMCache();
+#ifdef BELL_CODEC_PCM
+  testGapless();
+#endif
+  testID3();
+  testICY();
+#ifndef _WIN32
+  testHLS();
+#endif
+#ifdef BELL_CODEC_PCM
+  testPCMContainers();
+#endif
+#ifdef BELL_CODEC_FLAC
+  for (uint8_t maxBitDepth : {16, 24, 32}) {
+    testDecoder(directory + "/flac_96k_24.flac", 96000, 24, maxBitDepth);
+  }
+#endif
+#ifdef BELL_CODEC_ALAC
+  for (uint8_t maxBitDepth : {16, 24, 32}) {
+    testDecoder(directory + "/alac_96k_24.m4a", 96000, 24, maxBitDepth);
+    testDecoder(directory + "/alac_192k_32.m4a", 192000, 32, maxBitDepth);
+  }
+#endif
+
+  if (failures > 0) {
+    printf("%d checks failed\n", failures);
+    return 1;
+  }
+  printf("all checks passed\n");
+  return 0;
+}